@@ -148,6 +148,15 @@ BTKAPI auto SetUIContext(UIContext *context)  -> void;
 BTKAPI auto GetDispatcher()                   -> EventDispatcher *;
 BTKAPI auto SetDispatcher(EventDispatcher *)  -> void;
 
+/**
+ * @brief Send a call event to the dispatcher from any thread
+ * 
+ * @param dispatcher The dispatcher, it may be already destroyed
+ * @param event The event
+ * @return true on sent, false on the dispatcher is no longer installed or the queue is full
+ */
+BTKAPI auto PostCall(EventDispatcher *dispatcher, const CallEvent &event) -> bool;
+
 inline auto GetUIDisplatcher()                -> EventDispatcher * {
     return GetUIContext()->dispatcher();
 }
@@ -186,6 +186,7 @@ class EventDispatcher;
 class EventQueue;
 class EventLoop;
 class UIContext;
+class CallEvent;
 class Event;
 
 class Trackable;
@@ -27,6 +27,7 @@ BTK_NS_BEGIN
 
 class PaintDevice;
 class PaintContext;
+class PaintStats;
 class AbstractTexture;
 
 enum class PaintContextFeature : uint8_t {
@@ -54,6 +55,7 @@ enum class PaintDeviceValue   : uint8_t {
     PixelSize,   //< Pixel size of the drawable         (Size)
     Dpi,         //< Dpi of the drawable                (FPoint)
     PixelFormat, //< Pixel format of the drawable       (PixFormat)
+    ContentPreserved, //< Does the drawable keep the content of the last frame (bool)
 };
 enum class TextureSource      : uint8_t;
 
@@ -149,6 +151,12 @@ class WindowDevice : public PaintDevice {
  */
 class PaintContext : public PaintResource, public GraphicsContext {
     public:
+        /**
+         * @brief Counters of the current frame, set by the Painter in begin() (could be nullptr)
+         * 
+         */
+        PaintStats *stats = nullptr;
+
         // Clear
         virtual void clear(Brush &) = 0;
 
@@ -171,6 +179,22 @@ class PaintContext : public PaintResource, public GraphicsContext {
         virtual bool fill_ellipse(float x, float y, float xr, float yr) = 0;
         virtual bool fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) = 0;
 
+        /**
+         * @brief Fill a batch of rectangles with the current brush
+         * @note The rectangles never overlap, so the backend could submit them in one draw call
+         * 
+         * @param rects The pointer of rectangles
+         * @param n The number of rectangles
+         * @return true 
+         * @return false 
+         */
+        virtual bool fill_rects(const FRect *rects, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                fill_rect(rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+            }
+            return true;
+        }
+
         // Texture
         /**
          * @brief Create a texture object
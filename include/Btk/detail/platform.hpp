@@ -109,6 +109,7 @@ class AbstractWindow : public Any {
             MinimumSize, //< args (*Size)
             Opacity,     //< args (*float)
             Parent,      //< args (*AbstractWindow*)
+            RefreshRate, //< Refresh rate of the display (*float)
         };
 
         /**
@@ -314,6 +314,34 @@ class MotionEvent : public WidgetEvent {
             _x = p.x;
             _y = p.y;
         }
+
+        /**
+         * @brief Get the number of the earlier positions coalesced into this event
+         * 
+         * @return size_t (0 on not coalesced)
+         */
+        size_t history_size() const {
+            return _nhistory;
+        }
+        /**
+         * @brief Get the earlier position (oldest first), in the same coord as position()
+         * 
+         * @param idx The index in [0, history_size())
+         * @return Point 
+         */
+        Point  history(size_t idx) const {
+            return Point(_x + _history[idx].x, _y + _history[idx].y);
+        }
+        /**
+         * @brief Set the earlier positions, as offsets from position() (it is not copied)
+         * 
+         * @param offsets The offsets array
+         * @param n The number of offsets
+         */
+        void   set_history(const Point *offsets, size_t n) {
+            _history  = offsets;
+            _nhistory = n;
+        }
     private:
         int _x = -1;
         int _y = -1;
@@ -321,6 +349,10 @@ class MotionEvent : public WidgetEvent {
         // Which value shouble be used for invalid rel values
         int _xrel = 0;
         int _yrel = 0;
+
+        // Coalesced positions, offsets from (_x, _y) so it keeps valid after set_position()
+        const Point *_history  = nullptr;
+        size_t       _nhistory = 0;
 };
 /**
  * @brief Mouse Button Press or Release
@@ -392,6 +424,35 @@ class WheelEvent : public WidgetEvent {
 class PaintEvent : public WidgetEvent {
     public:
         PaintEvent() : WidgetEvent(Paint) { }
+
+        /**
+         * @brief Check only a part of the widget need to be painted
+         * 
+         * @return true The damage() rectangle is valid
+         * @return false The whole widget should be painted
+         */
+        bool has_damage() const {
+            return _has_damage;
+        }
+        /**
+         * @brief Get the area need to be painted (damaged and visible), in the coordinate of the receiver
+         * 
+         * @return Rect 
+         */
+        Rect damage() const {
+            return _damage;
+        }
+
+        void set_damage(const Rect &r) {
+            _damage = r;
+            _has_damage = true;
+        }
+        void reset_damage() {
+            _has_damage = false;
+        }
+    private:
+        Rect _damage = {0, 0, 0, 0}; //< Damaged area
+        bool _has_damage = false;
 };
 /**
  * @brief Close Event
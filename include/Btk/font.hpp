@@ -233,6 +233,26 @@ class BTKAPI Font {
          * @return float 
          */
         float size() const;
+        /**
+         * @brief Get the family of the font
+         * 
+         * @return u8string 
+         */
+        u8string family() const;
+        /**
+         * @brief Check the font is bold
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool  bold() const;
+        /**
+         * @brief Check the font is italic
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool  italic() const;
         /**
          * @brief Check the font is empty or not
          * 
@@ -279,6 +299,22 @@ class BTKAPI Font {
          * @return false 
          */
         bool  native_handle(FontHandle what, void *out) const;
+        /**
+         * @brief Get the hash of the font description
+         * 
+         * @return size_t 
+         */
+        size_t hash() const;
+
+        /**
+         * @brief Check if the font description is equal to another font
+         * 
+         * @param font 
+         * @return true 
+         * @return false 
+         */
+        bool operator ==(const Font &font) const;
+        bool operator !=(const Font &font) const;
 
         static auto FromFile(u8string_view fname, float size) -> Font;
         static auto ListFamily()                              -> StringList;
@@ -130,6 +130,9 @@ inline FileStream::~FileStream() {
 }
 inline bool FileStream::close() {
     FILE *fp = detach();
+    if (fp == nullptr) {
+        return false;
+    }
     if (::fclose(fp) != 0) {
         errcode = errno;
         return false;
@@ -9,6 +9,7 @@
 
 BTK_NS_BEGIN
 
+class PainterRecorderImpl ;
 class PainterEffectImpl ;
 class PainterPathImpl ;
 class PainterImpl    ;
@@ -72,6 +73,23 @@ enum class LineCap : uint8_t {
     Round,
     Square,
 };
+enum class PaintPrimitive : uint8_t {
+    Clear,
+    DrawPath,
+    DrawLine,
+    DrawRect,
+    DrawRoundedRect,
+    DrawEllipse,
+    DrawImage,
+    DrawText,
+    DrawTextLayout,
+    FillPath,
+    FillRect,
+    FillRoundedRect,
+    FillEllipse,
+    FillMask,
+    Max, //< Number of primitives
+};
 
 /**
  * @brief Color stop structore
@@ -757,13 +775,167 @@ class BTKAPI Pen {
     friend class Painter;
 };
 
+/**
+ * @brief Result of comparing two recordings
+ * 
+ */
+class PainterRecorderDiff {
+    public:
+        size_t prefix  = 0; //< Number of same commands at the begin
+        size_t suffix  = 0; //< Number of same commands at the end
+        size_t removed = 0; //< Number of commands only in the old recording
+        size_t added   = 0; //< Number of commands only in the new recording
+
+        bool   same() const noexcept {
+            return removed == 0 && added == 0;
+        }
+};
+
 /**
  * @brief Record the painter command 
  * 
+ * @code {.cpp}
+ * PainterRecorder recorder;
+ * Painter painter(recorder);
+ * painter.begin(); // Previous commands are dropped here
+ * painter.fill_rect(0, 0, 100, 100);
+ * painter.end();
+ * 
+ * recorder.play(window_painter);
+ * @endcode
  */
 class BTKAPI PainterRecorder {
     public:
-        void play(Painter &) const;
+        PainterRecorder();
+        PainterRecorder(PainterRecorder &&);
+        PainterRecorder(const PainterRecorder &) = delete;
+        ~PainterRecorder();
+
+        /**
+         * @brief Set the logical size and dpi reported to the recording painter
+         * 
+         * @param w The width
+         * @param h The height
+         * @param xdpi The x dpi (default 96)
+         * @param ydpi The y dpi (default 96)
+         */
+        void   set_size(float w, float h, float xdpi = 96.0f, float ydpi = 96.0f);
+        /**
+         * @brief Drop all commands
+         * 
+         */
+        void   clear();
+        /**
+         * @brief Check the recording has no commands
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool   empty() const;
+        /**
+         * @brief Get the number of commands
+         * 
+         * @return size_t 
+         */
+        size_t count() const;
+        /**
+         * @brief Get the size of the command buffer (in bytes)
+         * 
+         * @return size_t 
+         */
+        size_t memory_usage() const;
+        /**
+         * @brief Replay all commands on the painter
+         * 
+         * @note The commands are relative to the current transform and alpha of the painter, the scissor is replaced
+         * 
+         * @param painter The painter (between begin() and end())
+         */
+        void   play(Painter &painter) const;
+        /**
+         * @brief Compare with the other recording
+         * 
+         * @param other The new recording
+         * @return PainterRecorderDiff 
+         */
+        auto   diff(const PainterRecorder &other) const -> PainterRecorderDiff;
+        /**
+         * @brief Serialize the recording into stream (native byte order)
+         * 
+         * @param stream The pointer of IOStream
+         * @return true 
+         * @return false 
+         */
+        bool   write_to(IOStream *stream) const;
+
+        PainterRecorder &operator =(PainterRecorder &&);
+
+        /**
+         * @brief Load the recording from stream
+         * 
+         * @param stream The pointer of IOStream
+         * @return PainterRecorder (empty on failure)
+         */
+        static PainterRecorder FromStream(IOStream *stream);
+    private:
+        PainterRecorderImpl *priv;
+    friend class Painter;
+};
+
+/**
+ * @brief Counters of a painter frame, reset in Painter::begin()
+ * 
+ */
+class BTKAPI PaintStats {
+    public:
+        static constexpr size_t NumPrimitives = size_t(PaintPrimitive::Max);
+        static constexpr size_t NumStates     = 7; //< Number of PaintContextState
+
+        uint64_t frame = 0; //< Number of frames begun on the painter
+
+        uint32_t draw_calls[NumPrimitives] = {}; //< Draw calls, indexed by PaintPrimitive
+        uint32_t state_changes[NumStates]  = {}; //< State sent to the context, indexed by PaintContextState
+        uint32_t state_skipped = 0; //< Redundant state changes dropped before reaching the context
+        uint32_t batches       = 0; //< Batched submissions of fill_rect
+        uint32_t batched_rects = 0; //< Rectangles submitted in batches
+
+        uint32_t textures_created      = 0; //< Number of textures created
+        uint64_t texture_created_bytes = 0; //< Bytes of textures created
+        uint32_t texture_uploads       = 0; //< Number of pixel uploads to textures
+        uint64_t texture_upload_bytes  = 0; //< Bytes uploaded to textures
+
+        uint32_t text_cache_hits    = 0; //< Text reused from the backend cache
+        uint32_t text_cache_misses  = 0; //< Text rasterized again
+        uint32_t path_tessellations = 0; //< Paths tessellated / rasterized by the backend
+
+        double   begin_time = 0.0; //< Time of begin() (in ms)
+        double   end_time   = 0.0; //< Time of end()   (in ms)
+        double   swap_time  = 0.0; //< Time of swap_buffers() (in ms)
+        double   frame_time = 0.0; //< Time from begin() to the end of swap_buffers() (in ms)
+
+        /**
+         * @brief Reset all counters of the frame (the frame index is kept)
+         * 
+         */
+        void     reset();
+        /**
+         * @brief Get the number of draw calls in all primitives
+         * 
+         * @return uint32_t 
+         */
+        uint32_t total_draw_calls() const;
+        /**
+         * @brief Get the number of state changes in all states
+         * 
+         * @return uint32_t 
+         */
+        uint32_t total_state_changes() const;
+        /**
+         * @brief Export the counters as a JSON object
+         * 
+         * @return u8string 
+         */
+        u8string to_json() const;
 };
 
 /**
@@ -792,6 +964,12 @@ class BTKAPI Painter {
          * @param buffer 
          */
         Painter(PixBuffer &buffer);
+        /**
+         * @brief Construct a new Painter object, record all commands into recorder
+         * 
+         * @param recorder The recorder
+         */
+        Painter(PainterRecorder &recorder);
 
         Painter(const Painter&) = delete;
         Painter(Painter &&);
@@ -873,13 +1051,17 @@ class BTKAPI Painter {
         // Get
         auto alpha() const -> float;
         auto context() const -> PaintContext *;
+        auto stats() const -> const PaintStats &;
+        bool empty() const;
 
         // Interface for painter on window
         void notify_dpi_changed(float xdpi, float ydpi);
         void notify_resize(int w, int h);
+        bool content_preserved() const;
 
         // Assign
         void operator =(Painter &&);
+        void swap(Painter &);
 
         // Construct painter from
         static Painter FromWindow(AbstractWindow *);
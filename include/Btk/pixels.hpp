@@ -2,12 +2,16 @@
 
 #include <Btk/rect.hpp>
 #include <Btk/defs.hpp>
+#include <functional>
+#include <memory>
+#include <atomic>
 
 BTK_NS_BEGIN
 
 class Color;
 class GLColor;
 class ImageImpl;
+class ImageCacheImpl;
 
 class Color {
     public:
@@ -91,6 +95,12 @@ enum class InterpolationMode : uint32_t {
     Nearest = 0,
     Linear  = 1,
 };
+enum class ResizeFilter      : uint32_t {
+    Box      = 0, //< Average of covered pixels
+    Bilinear = 1,
+    Bicubic  = 2,
+    Lanczos3 = 3,
+};
 enum class PixFormat         : uint32_t {
     RGBA32 = 0, //< ABGR in little ed
     RGB24  = 1,
@@ -100,8 +110,18 @@ enum class PixFormat         : uint32_t {
     
 
     // < YUV 
-    NV12   = 1001,
-    NV21   = 1002,
+    NV12   = 1001, //< Y plane, then interleaved UV plane in half size
+    NV21   = 1002, //< Y plane, then interleaved VU plane in half size
+    I420   = 1003, //< Y plane, then U and V planes in half size
+};
+// YUV matrix / range of the YUV formats
+enum class YuvColorSpace     : uint32_t {
+    BT601 = 0, //< SD video, jpeg
+    BT709 = 1, //< HD video
+};
+enum class YuvRange          : uint32_t {
+    Limited = 0, //< Y in [16, 235], UV in [16, 240]
+    Full    = 1, //< Y and UV in [0, 255]
 };
 // Blend mode / Bend Factor
 enum class BlendMode         : uint32_t {
@@ -125,6 +145,42 @@ class BTKAPI PixPalette {
     private:
         // std::vector<Color> maps;
 };
+/**
+ * @brief Token of a async loading, cancel it when the result is no longer needed
+ * 
+ */
+class BTKAPI LoadToken {
+    public:
+        LoadToken() = default;
+
+        /**
+         * @brief Cancel the loading, the callback will not be called
+         * 
+         */
+        void cancel() const {
+            if (_canceled) {
+                *_canceled = true;
+            }
+        }
+        /**
+         * @brief Is the loading canceled?
+         * 
+         * @return true 
+         * @return false 
+         */
+        bool canceled() const {
+            return _canceled && *_canceled;
+        }
+        bool empty() const {
+            return _canceled == nullptr;
+        }
+    private:
+        LoadToken(const std::shared_ptr<std::atomic_bool> &c) : _canceled(c) {}
+
+        std::shared_ptr<std::atomic_bool> _canceled;
+    friend class PixBuffer;
+    friend class Image;
+};
 /**
  * @brief RGBA Pixel Buffer
  * 
@@ -282,6 +338,21 @@ class BTKAPI PixBuffer {
         PixFormat format() const noexcept {
             return _format;
         }
+        /**
+         * @brief Get the plane of the YUV formats (0 on Y, 1 on UV / U, 2 on V), plane 0 on others
+         * 
+         * @param idx The plane index
+         * @return pointer_t (nullptr on no such plane)
+         */
+        pointer_t  plane(int idx) noexcept;
+        cpointer_t plane(int idx) const noexcept;
+        /**
+         * @brief Get the pitch of the plane
+         * 
+         * @param idx The plane index
+         * @return int (0 on no such plane)
+         */
+        int        plane_pitch(int idx) const noexcept;
 
         /**
          * @brief Tell the pixbuffer should he free the pixel data
@@ -330,7 +401,25 @@ class BTKAPI PixBuffer {
         PixBuffer filter2d(const double (&kerel)[W][H], uint8_t ft_alpha = 0) const;
         PixBuffer filter2d(const double  *kernel, int w, int h, uint8_t ft_alpha = 0) const;
         PixBuffer convert(PixFormat f) const;
-        PixBuffer resize(int w, int h) const;
+        /**
+         * @brief Convert the YUV pixbuffer to RGBA32 / BGRA32, resampled in the same pass
+         * 
+         * @param f The destination format (RGBA32 or BGRA32)
+         * @param space The YUV matrix
+         * @param range The YUV range
+         * @param size The destination size (empty for keep the original size)
+         * @return PixBuffer (empty on unsupported formats)
+         */
+        PixBuffer convert(PixFormat f, YuvColorSpace space, YuvRange range, Size size = {0, 0}) const;
+        /**
+         * @brief Resample the pixbuffer into a new size
+         * 
+         * @param w The new width
+         * @param h The new height
+         * @param filter The resampling filter
+         * @return PixBuffer (4 bytes formats are kept, others are converted to RGBA32)
+         */
+        PixBuffer resize(int w, int h, ResizeFilter filter = ResizeFilter::Bicubic) const;
         PixBuffer blur(float r) const;
         PixBuffer clone() const;
         PixBuffer ref()   const;
@@ -338,10 +427,38 @@ class BTKAPI PixBuffer {
         // Draw / Fill / Bilt
         void      bilt(const PixBuffer &buf, const Rect *dst, const Rect *src, const FMatrix &trans);
         void      bilt(const PixBuffer &buf, const Rect *dst, const Rect *src);
+        /**
+         * @brief Bilt the pixbuffer with blending (scaled in nearest, rectangles are clipped)
+         * 
+         * @param buf The source pixbuffer (should not be this)
+         * @param dst The destination rectangle (nullptr on whole)
+         * @param src The source rectangle (nullptr on whole)
+         * @param mode The blend mode (None on copy)
+         * @param premultiplied Is the source in premultiplied alpha
+         */
+        void      bilt(const PixBuffer &buf, const Rect *dst, const Rect *src, BlendMode mode, bool premultiplied = false);
         void      fill(const Rect *dst, uint32_t pixel);
 
         // Write to file / memory / iostream
-        bool      write_to(u8string_view path) const;
+        /**
+         * @brief Encode and write to the file, the type comes from the extension
+         * 
+         * @param path The utf8 encoded filesystem path
+         * @param level The png compression level, 0 (fastest) to 9 (smallest), -1 for default
+         * @return true 
+         * @return false 
+         */
+        bool      write_to(u8string_view path, int level = -1) const;
+        /**
+         * @brief Encode and write to the stream, it only reads the buffer so it could run on a worker thread
+         * 
+         * @param stream The output stream
+         * @param type The image type, "png" or "qoi"
+         * @param level The png compression level, 0 (fastest) to 9 (smallest), -1 for default
+         * @return true 
+         * @return false 
+         */
+        bool      write_to(IOStream   *stream, u8string_view type, int level = -1) const;
         bool      write_to(IOStream   *stream) const;
 
         // Assignment
@@ -363,6 +480,13 @@ class BTKAPI PixBuffer {
          * @return PixBuffer (failed on empty pixel buffer)
          */
         static PixBuffer FromMem(cpointer_t data, size_t size);
+        /**
+         * @brief Load pixbuffer from a memory mapped file, without reading it into a heap copy
+         * 
+         * @param path The utf8 encoded filesystem path
+         * @return PixBuffer (failed on empty pixel buffer)
+         */
+        static PixBuffer FromFileMapped(u8string_view path);
         /**
          * @brief Load pixbuffer from IOStream
          * 
@@ -370,6 +494,17 @@ class BTKAPI PixBuffer {
          * @return PixBuffer (failed on empty pixel buffer) 
          */
         static PixBuffer FromStream(IOStream *stream);
+        /**
+         * @brief Load pixbuffer from file in the background
+         * 
+         * @note It is decoded through ImageCache::GetInstance(), the buffer is shared with the cache, clone it before modifying
+         * 
+         * @param path The utf8 encoded filesystem path
+         * @param done The callback, called on the caller's dispatcher (empty pixel buffer on failure)
+         * @param size The size to resize to after decoding (empty for keep the original size)
+         * @return LoadToken for canceling
+         */
+        static LoadToken LoadAsync(u8string_view path, std::function<void(PixBuffer &)> done, Size size = {0, 0});
     private:
         // Format initalization
         void _init_format(PixFormat fmt);
@@ -395,8 +530,8 @@ class BTKAPI PixBuffer {
         uint32_t _bshift = 0;
         uint32_t _ashift = 0;
 
-        // Refcounting for COW
-        int      *_refcount = nullptr;
+        // Refcounting for COW, atomic because buffers are shared with the loader threads and the cache
+        std::atomic_int *_refcount = nullptr;
 };
 
 /**
@@ -418,7 +553,7 @@ class BTKAPI Image {
          */
         size_t count_frame() const;
         /**
-         * @brief Read frame at idx
+         * @brief Read frame at idx, it advances the decoder
          * 
          * @param idx The frame index
          * @param buf The output frame buffer
@@ -426,7 +561,7 @@ class BTKAPI Image {
          * @return true 
          * @return false 
          */
-        bool   read_frame(size_t idx, PixBuffer &buf, int *delay = nullptr) const;
+        bool   read_frame(size_t idx, PixBuffer &buf, int *delay = nullptr);
         /**
          * @brief Is the Image empty?
          * 
@@ -446,10 +581,109 @@ class BTKAPI Image {
         static Image FromFile(u8string_view path);
         static Image FromMem(cpointer_t data, size_t size);
         static Image FromStream(IOStream *stream);
+        /**
+         * @brief Load image from file in the background
+         * 
+         * @param path The utf8 encoded filesystem path
+         * @param done The callback, called on the caller's dispatcher (empty image on failure)
+         * @return LoadToken for canceling
+         */
+        static LoadToken LoadAsync(u8string_view path, std::function<void(Image &)> done);
     private:
         ImageImpl *priv;
 };
 
+/**
+ * @brief Statistics of the ImageCache
+ * 
+ */
+struct ImageCacheStats {
+    size_t hits      = 0; //< Lookups found in the cache
+    size_t misses    = 0; //< Lookups not found in the cache
+    size_t evictions = 0; //< Entries dropped by the budget
+    size_t entries   = 0; //< Entries in the cache
+    size_t bytes     = 0; //< Bytes of pixels in the cache
+    size_t budget    = 0; //< Max bytes of pixels
+};
+
+/**
+ * @brief Cache of decoded images keyed by source and size, least recently used ones are evicted by the budget
+ * 
+ * @note The cached buffers are shared, clone it before modifying. It is safe to use from multiple threads
+ */
+class BTKAPI ImageCache {
+    public:
+        ImageCache(size_t budget = 64 * 1024 * 1024);
+        ImageCache(const ImageCache &) = delete;
+        ~ImageCache();
+
+        /**
+         * @brief Get the image from the cache, or decode the file and cache it
+         * 
+         * @param path The utf8 encoded filesystem path
+         * @param size The size to resize to (empty for the original size)
+         * @return PixBuffer (empty on failure)
+         */
+        PixBuffer load(u8string_view path, Size size = {0, 0});
+        /**
+         * @brief Find the image in the cache
+         * 
+         * @param key The path or resource id
+         * @param size The requested size
+         * @return PixBuffer (empty on not found)
+         */
+        PixBuffer find(u8string_view key, Size size = {0, 0});
+        /**
+         * @brief Put an image decoded by yourself in the cache
+         * 
+         * @param key The path or resource id
+         * @param buf The image
+         * @param size The requested size (empty for the original size)
+         */
+        void      insert(u8string_view key, const PixBuffer &buf, Size size = {0, 0});
+        /**
+         * @brief Set the max bytes of pixels, evict immediately if it is over the budget
+         * 
+         * @param bytes 
+         */
+        void      set_budget(size_t bytes);
+        void      clear();
+
+        ImageCacheStats stats() const;
+
+        /**
+         * @brief Get the process wide cache
+         * 
+         * @return ImageCache& 
+         */
+        static ImageCache &GetInstance();
+    private:
+        ImageCacheImpl *priv;
+};
+
+/**
+ * @brief Convert strided YUV planes to RGBA32 / BGRA32 pixels, the planes are resampled (bilinear) if the size differs
+ * 
+ * @param src_fmt The source format (NV12, NV21 or I420)
+ * @param planes The source planes (Y, UV / Y, U, V)
+ * @param pitches The source pitches of the planes
+ * @param src_w The source width
+ * @param src_h The source height
+ * @param dst_fmt The destination format (RGBA32 or BGRA32)
+ * @param dst The destination pixels
+ * @param dst_pitch The destination pitch
+ * @param dst_w The destination width
+ * @param dst_h The destination height
+ * @param space The YUV matrix
+ * @param range The YUV range
+ * @return true 
+ * @return false on unsupported formats or empty sizes
+ */
+BTKAPI bool PixConvertYuv(
+    PixFormat src_fmt, const uint8_t *const planes[], const int pitches[], int src_w, int src_h, 
+    PixFormat dst_fmt, void *dst, int dst_pitch, int dst_w, int dst_h, 
+    YuvColorSpace space = YuvColorSpace::BT601, YuvRange range = YuvRange::Limited
+);
 
 // Helpful color functions
 
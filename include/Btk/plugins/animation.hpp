@@ -3,6 +3,7 @@
 #pragma once
 
 #include <Btk/object.hpp>
+#include <Btk/widget.hpp>
 #include <Btk/event.hpp>
 #include <Btk/defs.hpp>
 #include <Btk/rect.hpp>
@@ -108,6 +109,25 @@ class LerpAnimation     : public AbstractAnimation {
             if (_timerid != 0) {
                 del_timer(_timerid);
             }
+            if (_tickid != 0) {
+                _clock->remove_tick_callback(_tickid);
+            }
+        }
+
+        /**
+         * @brief Drive the animation by the frame clock, it falls back to the timer when the clock is destroyed
+         * 
+         * @param clock The frame clock (nullptr for the clock of the bound widget's window, or the timer if there is none)
+         */
+        void set_frame_clock(FrameClock *clock) {
+            bool playing = (_state == Playing);
+            if (playing) {
+                drive_stop();
+            }
+            watch_clock(clock);
+            if (playing) {
+                drive_start();
+            }
         }
 
         void set_duration(uint32_t dur) {
@@ -152,17 +172,15 @@ class LerpAnimation     : public AbstractAnimation {
             ts_end = ts_start + _duration;
             ts_cur = ts_start;
 
-            _timerid = add_timer(PerFrame);
+            drive_start();
             _state = Playing;
         }
         void pause() {
-            del_timer(_timerid);
-            _timerid = 0;
+            drive_stop();
             _state = Paused;
         }
         void stop() {
-            del_timer(_timerid);
-            _timerid = 0;
+            drive_stop();
             _state = Stopped;
         }
         void resume() {
@@ -175,32 +193,14 @@ class LerpAnimation     : public AbstractAnimation {
                 ts_start = ts_cur - (_duration - peri);
                 ts_end   = ts_cur + peri;
 
-                _timerid = add_timer(PerFrame);
+                drive_start();
                 _state   = Playing;
             }
         }
 
         bool timer_event(TimerEvent &event) override {
             if (event.timerid() == _timerid) {
-                ts_cur = event.timestamp();
-                if (ts_cur >= ts_end) {
-                    stop();
-                    return true;
-                }
-                auto rgn = float(ts_cur - ts_start) / float(_duration);
-                // T v = lerp(_start_value, _end_value, rgn);
-                auto [beg, end] = match_pair(rgn);
-                auto perc = (rgn - beg.step) / (end.step - beg.step);
-
-
-                BTK_ASSERT(!std::isnan(perc));
-                BTK_ASSERT(!std::isinf(perc));
-
-                T v = lerp(beg.v, end.v, perc);
-
-                // printf("%f / %f = %f\n", rgn - beg.step, end.step - beg.step, perc);
-
-                run(v);
+                step(event.timestamp());
             }
             return true;
         }
@@ -215,12 +215,14 @@ class LerpAnimation     : public AbstractAnimation {
             run = [self, fn](const T &v) {
                 (self->*fn)(v);
             };
+            bind_target(self);
         }
         template <typename Class, typename Ret, class Prov>
         void bind(Ret (Class::*fn)(T value), Prov *self) {
             run = [self, fn](const T &v) -> void {
                 (self->*fn)(v);
             };
+            bind_target(self);
         }
         // Member variable 
         template <typename Class, typename Var, class Prov>
@@ -228,6 +230,7 @@ class LerpAnimation     : public AbstractAnimation {
             run = [var, self](const T &value) {
                 (self->*var) = value;
             };
+            bind_target(self);
         }
         // Variable
         template <typename Var>
@@ -261,15 +264,102 @@ class LerpAnimation     : public AbstractAnimation {
         uint32_t _duration = 0;
         State    _state = Stopped;
         timerid_t _timerid = 0;
+        Widget     *_target = nullptr; //< Widget of the bound member, its window's clock is used by default
+        FrameClock *_clock  = nullptr;
+        Connection  _clock_con; //< Connected to _clock's destroyed signal
+        int      _tickid = 0;
         bool     values_changed = false;
 
         Signal<void()> _finished;
 
+        template <typename Prov>
+        void bind_target(Prov *self) {
+            if constexpr (std::is_base_of_v<Widget, Prov>) {
+                _target = self;
+            }
+        }
         // Private method
+        auto step(timestamp_t ts)         -> bool;
+        auto drive_start()                -> void;
+        auto drive_stop()                 -> void;
+        auto watch_clock(FrameClock *c)   -> void;
+        auto on_clock_destroyed()         -> void;
         auto match_pair(float perc) const -> std::pair<Value, Value>;
         auto sort_array()                 -> void;
 };
 
+template <typename T>
+inline auto LerpAnimation<T>::step(timestamp_t ts) -> bool {
+    ts_cur = ts;
+    if (ts_cur >= ts_end) {
+        // Returning false removes the tick callback, do not remove it while the clock is ticking
+        _tickid = 0;
+        stop();
+        return false;
+    }
+    auto rgn = float(ts_cur - ts_start) / float(_duration);
+    // T v = lerp(_start_value, _end_value, rgn);
+    auto [beg, end] = match_pair(rgn);
+    auto perc = (rgn - beg.step) / (end.step - beg.step);
+
+
+    BTK_ASSERT(!std::isnan(perc));
+    BTK_ASSERT(!std::isinf(perc));
+
+    T v = lerp(beg.v, end.v, perc);
+
+    // printf("%f / %f = %f\n", rgn - beg.step, end.step - beg.step, perc);
+
+    run(v);
+    return true;
+}
+template <typename T>
+inline auto LerpAnimation<T>::drive_start() -> void {
+    if (!_clock && _target) {
+        watch_clock(_target->frame_clock());
+    }
+    if (_clock) {
+        _tickid = _clock->add_tick_callback([this](timestamp_t ts) {
+            return step(ts);
+        });
+    }
+    else {
+        _timerid = add_timer(PerFrame);
+    }
+}
+template <typename T>
+inline auto LerpAnimation<T>::drive_stop() -> void {
+    if (_tickid != 0) {
+        _clock->remove_tick_callback(_tickid);
+        _tickid = 0;
+    }
+    if (_timerid != 0) {
+        del_timer(_timerid);
+        _timerid = 0;
+    }
+}
+template <typename T>
+inline auto LerpAnimation<T>::watch_clock(FrameClock *c) -> void {
+    if (c == _clock) {
+        return;
+    }
+    if (_clock) {
+        _clock_con.disconnect();
+    }
+    _clock = c;
+    if (_clock) {
+        _clock_con = _clock->signal_destoryed().connect(&LerpAnimation::on_clock_destroyed, this);
+    }
+}
+template <typename T>
+inline auto LerpAnimation<T>::on_clock_destroyed() -> void {
+    // The window is gone, the callbacks went with the clock, keep playing on the timer
+    _clock  = nullptr;
+    _tickid = 0;
+    if (_state == Playing) {
+        _timerid = add_timer(PerFrame);
+    }
+}
 template <typename T>
 inline auto LerpAnimation<T>::match_pair(float perc) const -> std::pair<Value, Value> {
     std::pair<Value, Value> result;
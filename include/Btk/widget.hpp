@@ -7,9 +7,11 @@
 #include <Btk/defs.hpp>
 #include <Btk/rect.hpp>
 
+#include <functional>
 #include <climits>
+#include <cstdint>
 #include <bitset>
-#include <list>
+#include <vector>
 
 
 BTK_NS_BEGIN
@@ -27,6 +29,7 @@ class ResizeEvent;
 class MotionEvent;
 class TextEditEvent;
 class TextInputEvent;
+class WidgetIndex;
 
 // SDL Capicity SystemCursor enums
 enum class SystemCursor : uint32_t {
@@ -66,7 +69,7 @@ enum class FocusPolicy : uint8_t {
     None  = 0,       //< Widget does not accept focus.
     Mouse = 1 << 0, //< Widget accepts focus by mouse click.
 };
-enum class WidgetAttrs : uint8_t {
+enum class WidgetAttrs : uint16_t {
     None          = 0, //< No attributes
     Debug         = 1 << 0, //< Show debug info
     DeleteOnClose = 1 << 1, //< Widget Delete after closed
@@ -74,7 +77,10 @@ enum class WidgetAttrs : uint8_t {
     BackgroundTransparent = 1 << 3, //< Make background transparent
     PaintBackground = 1 << 4, //< Force widget paint it's background even is not on the top
     PaintChildren   = 1 << 5, //< Paint children widget (default on)
+    Opaque          = 1 << 6, //< Widget fills all of its area with opaque content, siblings under it will not be painted
     MouseTransparent = 1 << 7, //< Mouse event will through it
+    CacheLayer       = 1 << 8, //< Paint widget and its children into a texture, reuse it until repaint() called on them
+    ChildIndex       = 1 << 9, //< Index children in a spatial grid, for fast child_at() with a lot of children
 };
 enum class SizeHint    : uint8_t {
     Perfered = 0,
@@ -134,7 +140,7 @@ class SizePolicy {
 BTK_FLAGS_OPERATOR(SizePolicy::Policy, uint8_t);
 BTK_FLAGS_OPERATOR(WindowFlags, uint32_t);
 BTK_FLAGS_OPERATOR(FocusPolicy, uint8_t);
-BTK_FLAGS_OPERATOR(WidgetAttrs, uint8_t);
+BTK_FLAGS_OPERATOR(WidgetAttrs, uint16_t);
 
 /**
  * @brief Mouse cursor interface
@@ -156,6 +162,97 @@ class BTKAPI Cursor {
         Ref<AbstractCursor> cursor;
 };
 
+/**
+ * @brief Timing stats of a frame
+ * 
+ */
+class FrameStats {
+    public:
+        uint64_t    frame      = 0;   //< Index of the frame
+        timestamp_t time       = 0;   //< Time of the tick
+        uint32_t    interval   = 0;   //< Time since the previous frame (ms)
+        uint32_t    skipped    = 0;   //< Refresh periods passed without a frame before it
+        uint32_t    requests   = 0;   //< Number of request_frame() merged into it
+        double      tick_time  = 0.0; //< Time spent on the tick callbacks (ms)
+        double      paint_time = 0.0; //< Time spent on layout and paint (ms)
+};
+
+/**
+ * @brief Per window clock, merge repaint requests and animation ticks into one tick per refresh period
+ * 
+ */
+class BTKAPI FrameClock : public Object {
+    public:
+        using TickCallback = std::function<bool(timestamp_t time)>; //< Return false to remove it
+
+        FrameClock(Widget *window);
+        ~FrameClock();
+
+        /**
+         * @brief Request a frame, the window will be painted on the next tick
+         * 
+         */
+        void              request_frame();
+        /**
+         * @brief Add a callback called on every tick before painting, frames are requested until it is removed
+         * 
+         * @param cb The callback
+         * @return int The id of the callback
+         */
+        int               add_tick_callback(TickCallback cb);
+        /**
+         * @brief Remove the tick callback
+         * 
+         * @param id The id returned by add_tick_callback()
+         */
+        void              remove_tick_callback(int id);
+        /**
+         * @brief Override the refresh rate
+         * 
+         * @param hz The refresh rate (0 for query it from the window)
+         */
+        void              set_refresh_rate(float hz);
+        /**
+         * @brief Get the refresh rate of the clock
+         * 
+         * @return float 
+         */
+        float             refresh_rate() const;
+        /**
+         * @brief Get the stats of the last frame
+         * 
+         * @return const FrameStats& 
+         */
+        const FrameStats &stats() const {
+            return _stats;
+        }
+
+        bool timer_event(TimerEvent &) override;
+
+        BTK_EXPOSE_SIGNAL(_frame_done);
+    private:
+        void schedule(); //< Arm the timer for the next refresh period
+        void tick(timestamp_t now);
+
+        struct Callback {
+            int          id;
+            TickCallback fn;
+        };
+
+        Widget               *_window    = nullptr;
+        std::vector<Callback> _callbacks;
+        int                   _next_id   = 0;
+        timerid_t             _timerid   = 0;
+        float                 _hz        = 0.0f; //< Overrided refresh rate
+        double                _deadline  = 0.0;  //< Time of the next tick
+        timestamp_t           _last_tick = 0;
+        uint32_t              _requests  = 0;
+        bool                  _ticking   = false;
+        FrameStats            _stats;
+
+        Signal<void()>        _frame_done;
+};
+
 /**
  * @brief Widget base class
  * 
@@ -213,11 +310,29 @@ class BTKAPI Widget : public Object {
          * 
          */
         void repaint();
+        /**
+         * @brief Send a paint event into queue, only the area need to be repainted
+         * 
+         * @param rect The damaged area (in widget coordinate)
+         */
+        void repaint(const Rect &rect);
         /**
          * @brief Force repaint right now
          * 
          */
         void repaint_now();
+        /**
+         * @brief Paint the window into the painter instead of its surface (offscreen rendering)
+         * 
+         * @param painter The painter (not begun), the pending damage is consumed like a normal frame
+         */
+        void render(Painter &painter);
+        /**
+         * @brief Get the frame clock of the window, repaint() requests a frame on it
+         * 
+         * @return FrameClock* (nullptr if the window is not created yet)
+         */
+        FrameClock *frame_clock() const;
         /**
          * @brief Try let the widget has the focus
          * 
@@ -725,6 +840,9 @@ class BTKAPI Widget : public Object {
         void window_destroy(); //< Destroy window if created.
         void rectangle_update(); //< rectangle is updated.
         void debug_draw(); //< Draw the debug info
+        bool paint_layer(PaintEvent &); //< Paint self by the cached layer, false on unsupported
+        const std::vector<Widget *> &zorder_children() const; //< Children from top to bottom
+        void child_detach(Widget *w); //< Remove child without notify
 
         UIContext  *_context    = nullptr; //< Pointer to UIContext
         Widget     *_parent     = nullptr; //< Parent widget
@@ -735,8 +853,14 @@ class BTKAPI Widget : public Object {
         FocusPolicy _focus      = FocusPolicy::Mouse; //< Focus policy
         SizePolicy  _size       = SizePolicy::Expanding; //< Size policy
         Palette     _palette    = {}; //< Palette of widget     
-        std::list<Widget *>           _children; //< Child widgets
-        std::list<Widget *>::iterator _in_child_iter = {}; //< Child iterator
+        std::vector<Widget *>         _children; //< Child widgets, removal swaps the last one in, so indexes may change (stacking order is _zorder)
+        mutable std::vector<Widget *> _zchildren; //< Child widgets from top to bottom (cache of _children)
+        mutable bool                  _zchildren_dirty = false; //< Need sort the cache again ?
+        size_t                        _child_index = SIZE_MAX; //< Index in parent's children
+        int64_t                       _zorder = 0; //< Stacking order in parent, bigger is upper
+        int64_t                       _zorder_top = 0; //< Max stacking order of children
+        int64_t                       _zorder_bottom = 0; //< Min stacking order of children
+        WidgetIndex                  *_index = nullptr; //< Spatial index of children (ChildIndex only)
 
         Size        _maximum_size = {INT_MAX, INT_MAX}; //< Maximum size
         Size        _minimum_size = {0, 0}; //< Minimum size
@@ -748,6 +872,11 @@ class BTKAPI Widget : public Object {
         window_t    _win     = {}; //< Window handle
         Painter     _painter = {}; //< Painter
         uint8_t     _painter_inited  = false; //< Is painter inited ?
+        Rect        _damage  = {0, 0, 0, 0}; //< Damaged area collected by repaint(rect) (window only)
+        bool        _damage_full = false; //< Need repaint the whole window ?
+        FrameClock *_clock   = nullptr; //< Frame clock (window only)
+        Texture     _layer   = {}; //< Cached content of self and children (CacheLayer only)
+        bool        _layer_dirty = true; //< Is the cached layer out of date ?
 
         u8string    _name    = {}; //< Widget name
 
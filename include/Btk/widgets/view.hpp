@@ -34,6 +34,13 @@ class BTKAPI ImageView : public Widget {
         void set_image(const PixBuffer &img);
         void set_image(const Image     &img);
         void set_keep_aspect_ratio(bool keep);
+        /**
+         * @brief Load the image in the background, the placeholder is shown until it is done
+         * 
+         * @param path The utf8 encoded filesystem path
+         */
+        void load_image(u8string_view path);
+        void set_placeholder(const PixBuffer &img);
 
         bool paint_event(PaintEvent &event) override;
         bool timer_event(TimerEvent &event) override;
@@ -43,6 +50,8 @@ class BTKAPI ImageView : public Widget {
         Texture  texture;
         PixBuffer pixbuf;
         Image     image;
+        PixBuffer placeholder;
+        LoadToken loading; //< Pending async loading
 
         timerid_t timer = 0; //< Timer for refresh
         int       frame = 0; //< Current frame
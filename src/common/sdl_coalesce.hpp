@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Btk/defs.hpp>
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <vector>
+
+BTK_NS_BEGIN
+
+// Range of the positions a coalesced motion passed through, in the history
+struct SDLMotionRange {
+    size_t begin = 0;
+    size_t size  = 0;
+};
+
+/**
+ * @brief Coalesce a batch drained from the SDL queue in place
+ *
+ * The consecutive motion of the same window / mouse / buttons is merged into the latest one,
+ * the older resize events of a window are dropped (RESIZED and SIZE_CHANGED are the same here)
+ *
+ * @param events The events in the queue order
+ * @param ranges The history range of each event left in events
+ * @param history The positions before the latest one of the merged motion, oldest first
+ */
+inline void SDLCoalesceEvents(std::vector<SDL_Event> &events, std::vector<SDLMotionRange> &ranges, std::vector<SDL_Point> &history) {
+    auto is_resize = [](const SDL_Event &e) {
+        return e.type == SDL_WINDOWEVENT &&
+               (e.window.event == SDL_WINDOWEVENT_RESIZED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED);
+    };
+
+    // From the newest, the older resize events of a window are out of date
+    std::vector<Uint32> resized;
+    for (size_t i = events.size(); i-- > 0; ) {
+        auto &e = events[i];
+        if (!is_resize(e)) {
+            continue;
+        }
+        if (std::find(resized.begin(), resized.end(), e.window.windowID) != resized.end()) {
+            e.type = SDL_FIRSTEVENT; //< Dropped
+        }
+        else {
+            resized.push_back(e.window.windowID);
+        }
+    }
+
+    // Merge the consecutive motion, keep the latest position
+    ranges.assign(events.size(), SDLMotionRange());
+    size_t out = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        auto &e = events[i];
+        if (e.type == SDL_FIRSTEVENT) {
+            continue;
+        }
+        if (e.type == SDL_MOUSEMOTION && out > 0 && events[out - 1].type == SDL_MOUSEMOTION) {
+            auto &range = ranges[out - 1];
+            auto &pm    = events[out - 1].motion;
+            auto &m     = e.motion;
+            if (pm.windowID == m.windowID && pm.which == m.which && pm.state == m.state) {
+                if (range.size == 0) {
+                    range.begin = history.size();
+                }
+                history.push_back({pm.x, pm.y});
+                range.size += 1;
+
+                pm.x          = m.x;
+                pm.y          = m.y;
+                pm.xrel      += m.xrel;
+                pm.yrel      += m.yrel;
+                pm.timestamp  = m.timestamp;
+                continue;
+            }
+        }
+        events[out++] = e;
+    }
+    events.resize(out);
+    ranges.resize(out);
+}
+
+BTK_NS_END
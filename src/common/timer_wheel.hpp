@@ -0,0 +1,267 @@
+#pragma once
+
+#include <Btk/defs.hpp>
+#include <unordered_map>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+BTK_NS_BEGIN
+
+// Hierarchical timer wheel, 4 levels of 64 slots in 1 ms ticks, owned and serviced by the dispatcher
+// Level n holds the timers expiring in [64^n, 64^(n+1)) ms, a slot is cascaded down when the level below wraps
+class TimerWheel {
+    public:
+        static constexpr int      LevelBits = 6;
+        static constexpr int      Levels    = 4;
+        static constexpr uint64_t Slots     = uint64_t(1) << LevelBits;
+        static constexpr uint64_t SlotMask  = Slots - 1;
+        static constexpr uint64_t MaxRange  = uint64_t(1) << (LevelBits * Levels); //< About 4.6 hours, longer ones are cascaded again
+
+        TimerWheel(uint64_t now = 0) : _current(now) { }
+        TimerWheel(const TimerWheel &) = delete;
+
+        /**
+         * @brief Add a periodic timer
+         *
+         * @param object The object to receive the timer event
+         * @param now Current ticks (ms)
+         * @param interval The interval (ms)
+         * @param slack How late it could be fired (ms), the deadline is aligned so timers near each others expire in the same tick
+         * @return timerid_t The id of the timer (never 0 and never reused)
+         */
+        timerid_t add(Object *object, uint64_t now, uint32_t interval, uint32_t slack = 0) {
+            if (_timers.empty()) {
+                reset(now);
+            }
+            timerid_t id = ++_next_id;
+
+            Timer t;
+            t.object   = object;
+            t.interval = max<uint32_t>(interval, 1);
+            t.grain    = 1;
+            while (t.grain <= slack / 2) {
+                t.grain *= 2;
+            }
+            t.nominal  = now + t.interval;
+
+            schedule(id, _timers[id] = t);
+            return id;
+        }
+        /**
+         * @brief Remove the timer, the slot entries are dropped lazily
+         *
+         * @param id The id of the timer
+         * @return true on the timer exists
+         */
+        bool      del(timerid_t id) {
+            return _timers.erase(id) != 0;
+        }
+        size_t    size() const {
+            return _timers.size();
+        }
+        /**
+         * @brief Get the time until the nearest deadline
+         *
+         * @param now Current ticks (ms)
+         * @return int64_t The timeout in ms, 0 on timers are due, -1 on no timers
+         */
+        int64_t   next_timeout(uint64_t now) {
+            if (_timers.empty()) {
+                return -1;
+            }
+            uint64_t nearest = UINT64_MAX;
+            for (int level = 0; level < Levels; level++) {
+                int      shift = LevelBits * level;
+                // The current slot of upper levels was cascaded (unless it is pending on the boundary), the entries in it are for the next round
+                bool     done  = level && (_current & ((uint64_t(1) << shift) - 1)) != 0;
+                uint64_t start = ((_current >> shift) + (done ? 1 : 0)) & SlotMask;
+                for (uint64_t i = 0; i < Slots && _masks[level]; i++) {
+                    uint64_t idx = (start + i) & SlotMask;
+                    if ((_masks[level] & (uint64_t(1) << idx)) == 0) {
+                        continue;
+                    }
+                    if (purge(level, idx, &nearest)) {
+                        break;
+                    }
+                }
+            }
+            if (nearest == UINT64_MAX) {
+                return -1;
+            }
+            return nearest <= now ? 0 : int64_t(nearest - now);
+        }
+        /**
+         * @brief Fire the timers expired at now, periodic ones are rearmed before calling
+         *
+         * @param now Current ticks (ms)
+         * @param cb The callback (Object *object, timerid_t id), it could add / del timers or enter a nested loop
+         * @return size_t The number of the fired timers
+         */
+        template <typename Callable>
+        size_t    expire(uint64_t now, Callable &&cb) {
+            std::vector<Entry> due;
+            size_t n = 0;
+            while (_current <= now) {
+                if (idle()) {
+                    _current = now + 1;
+                    break;
+                }
+                uint64_t idx = _current & SlotMask;
+                if (idx == 0) {
+                    cascade(1);
+                }
+                uint64_t bits = _masks[0] >> idx;
+                if (bits == 0) {
+                    // Nothing until the level 0 wraps
+                    uint64_t next = (_current | SlotMask) + 1;
+                    if (next > now) {
+                        _current = now + 1;
+                        break;
+                    }
+                    _current = next;
+                    continue;
+                }
+                uint64_t tick = _current + ctz(bits);
+                if (tick > now) {
+                    _current = now + 1;
+                    break;
+                }
+                uint64_t slot = tick & SlotMask;
+                due.clear();
+                due.swap(_slots[0][slot]);
+                _masks[0] &= ~(uint64_t(1) << slot);
+                _current   = tick + 1;
+
+                for (auto &e : due) {
+                    auto iter = _timers.find(e.id);
+                    if (iter == _timers.end() || iter->second.deadline != e.deadline) {
+                        continue;
+                    }
+                    auto &t      = iter->second;
+                    auto  object = t.object;
+                    // Drop the missed periods instead of firing them in a burst
+                    t.nominal += t.interval;
+                    if (t.nominal <= now) {
+                        t.nominal = now + t.interval;
+                    }
+                    schedule(e.id, t);
+
+                    cb(object, e.id);
+                    n += 1;
+                }
+            }
+            return n;
+        }
+    private:
+        struct Timer {
+            Object  *object   = nullptr;
+            uint64_t nominal  = 0; //< Deadline without the slack
+            uint64_t deadline = 0; //< Nominal aligned up to grain
+            uint32_t interval = 0;
+            uint32_t grain    = 1;
+        };
+        struct Entry {
+            timerid_t id;
+            uint64_t  deadline;
+        };
+
+        static int ctz(uint64_t bits) {
+#if defined(_MSC_VER)
+            unsigned long idx;
+            _BitScanForward64(&idx, bits);
+            return int(idx);
+#else
+            return __builtin_ctzll(bits);
+#endif
+        }
+
+        void schedule(timerid_t id, Timer &t) {
+            t.deadline = (t.nominal + t.grain - 1) & ~uint64_t(t.grain - 1);
+            link({id, t.deadline});
+        }
+        void link(const Entry &e) {
+            uint64_t when  = max(e.deadline, _current);
+            uint64_t delta = when - _current;
+            if (delta >= MaxRange) {
+                when  = _current + MaxRange - 1;
+                delta = MaxRange - 1;
+            }
+            int level = 0;
+            while (level < Levels - 1 && delta >= (uint64_t(1) << (LevelBits * (level + 1)))) {
+                level += 1;
+            }
+            uint64_t idx = (when >> (LevelBits * level)) & SlotMask;
+            _slots[level][idx].push_back(e);
+            _masks[level] |= uint64_t(1) << idx;
+        }
+        void cascade(int level) {
+            uint64_t idx = (_current >> (LevelBits * level)) & SlotMask;
+            if (idx == 0 && level + 1 < Levels) {
+                cascade(level + 1);
+            }
+            if ((_masks[level] & (uint64_t(1) << idx)) == 0) {
+                return;
+            }
+            std::vector<Entry> entries;
+            entries.swap(_slots[level][idx]);
+            _masks[level] &= ~(uint64_t(1) << idx);
+            for (auto &e : entries) {
+                if (valid(e)) {
+                    link(e);
+                }
+            }
+        }
+        // Drop the stale entries of the slot, return true if any left and update nearest
+        bool purge(int level, uint64_t idx, uint64_t *nearest) {
+            auto &slot = _slots[level][idx];
+            size_t out = 0;
+            for (size_t i = 0; i < slot.size(); i++) {
+                if (!valid(slot[i])) {
+                    continue;
+                }
+                *nearest = min(*nearest, slot[i].deadline);
+                slot[out++] = slot[i];
+            }
+            slot.resize(out);
+            if (out == 0) {
+                _masks[level] &= ~(uint64_t(1) << idx);
+            }
+            return out != 0;
+        }
+        bool idle() const {
+            for (int level = 0; level < Levels; level++) {
+                if (_masks[level]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        bool valid(const Entry &e) const {
+            auto iter = _timers.find(e.id);
+            return iter != _timers.end() && iter->second.deadline == e.deadline;
+        }
+        // No timers left, drop the stale entries and catch up
+        void reset(uint64_t now) {
+            for (int level = 0; level < Levels; level++) {
+                for (uint64_t idx = 0; idx < Slots; idx++) {
+                    if (_masks[level] & (uint64_t(1) << idx)) {
+                        _slots[level][idx].clear();
+                    }
+                }
+                _masks[level] = 0;
+            }
+            _current = max(_current, now);
+        }
+
+        std::vector<Entry>                   _slots[Levels][Slots];
+        uint64_t                             _masks[Levels] = {}; //< Bit set on the slot is not empty
+        std::unordered_map<timerid_t, Timer> _timers;
+        uint64_t                             _current = 0; //< Next tick to process
+        timerid_t                            _next_id = 0;
+};
+
+BTK_NS_END
@@ -5,8 +5,11 @@
 #include <Btk/painter.hpp>
 #include <Btk/event.hpp>
 #include <Btk/style.hpp>
+#include <algorithm>
 #include <thread> //< For std::this_thread::yield()
 #include <chrono>
+#include <vector>
+#include <mutex>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -25,6 +28,9 @@ static GraphicsDriverInfo *ui_driver = nullptr; //< Default graphics driver crea
 static UIContext  *ui_context = nullptr; //< Global UI context
 static EventType   ui_event   = EventType::User; //< Current Registered event
 
+static std::mutex                     live_mutex; //< Guard of live_dispatchers, taken by other threads posting events
+static std::vector<EventDispatcher *> live_dispatchers; //< Dispatchers installed by SetDispatcher and not removed yet
+
 auto SetUIContext(UIContext *context) -> void {
     ui_context = context;
 }
@@ -35,8 +41,26 @@ auto GetDispatcher() -> EventDispatcher * {
     return th_dispatcher;
 }
 auto SetDispatcher(EventDispatcher *d) -> void {
+    std::lock_guard<std::mutex> locker(live_mutex);
+    if (th_dispatcher) {
+        auto iter = std::find(live_dispatchers.begin(), live_dispatchers.end(), th_dispatcher);
+        if (iter != live_dispatchers.end()) {
+            live_dispatchers.erase(iter);
+        }
+    }
+    if (d) {
+        live_dispatchers.push_back(d);
+    }
     th_dispatcher = d;
 }
+auto PostCall(EventDispatcher *d, const CallEvent &event) -> bool {
+    // Hold the lock while sending, the owner thread could not remove it in the middle
+    std::lock_guard<std::mutex> locker(live_mutex);
+    if (std::find(live_dispatchers.begin(), live_dispatchers.end(), d) == live_dispatchers.end()) {
+        return false;
+    }
+    return d->send(CallEvent(event));
+}
 
 UIContext::UIContext(GraphicsDriver *driv) {
     initialize(driv);
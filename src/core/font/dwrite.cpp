@@ -170,6 +170,24 @@ void  Font::begin_mut() {
 bool  Font::empty() const {
     return priv == nullptr;
 }
+u8string Font::family() const {
+    if (priv) {
+        return priv->name;
+    }
+    return u8string();
+}
+bool  Font::bold() const {
+    if (priv) {
+        return priv->weight >= DWRITE_FONT_WEIGHT_BOLD;
+    }
+    return false;
+}
+bool  Font::italic() const {
+    if (priv) {
+        return priv->style != DWRITE_FONT_STYLE_NORMAL;
+    }
+    return false;
+}
 auto  Font::ListFamily() -> StringList {
     wchar_t locale_name[LOCALE_NAME_MAX_LENGTH];
     std::wstring tmp;
@@ -247,6 +265,31 @@ bool Font::native_handle(FontHandle what, void *out) const {
     *static_cast<IDWriteTextFormat **>(out) = ft;
     return true;
 }
+size_t Font::hash() const {
+    if (!priv) {
+        return 0;
+    }
+    size_t h = std::hash<u8string>()(priv->name);
+    h ^= std::hash<float>()(priv->size) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= (size_t(priv->weight) << 16) | (size_t(priv->style) << 8) | size_t(priv->stretch);
+    return h;
+}
+bool Font::operator ==(const Font &f) const {
+    if (priv == f.priv) {
+        return true;
+    }
+    if (!priv || !f.priv) {
+        return false;
+    }
+    return priv->name == f.priv->name &&
+           priv->size == f.priv->size &&
+           priv->weight == f.priv->weight &&
+           priv->style == f.priv->style &&
+           priv->stretch == f.priv->stretch;
+}
+bool Font::operator !=(const Font &f) const {
+    return !(*this == f);
+}
 void Font::bind_device_resource(void *key, PaintResource *res) const {
     if (priv) {
         priv->add_resource(key, res);
@@ -201,6 +201,48 @@ void Font::begin_mut() {
     COW_MUT(priv);
     priv->reset_manager();
 }
+u8string Font::family() const {
+    if (priv) {
+        return priv->family;
+    }
+    return u8string();
+}
+bool Font::bold() const {
+    if (priv) {
+        return priv->blod;
+    }
+    return false;
+}
+bool Font::italic() const {
+    if (priv) {
+        return priv->italic != 0;
+    }
+    return false;
+}
+size_t Font::hash() const {
+    if (!priv) {
+        return 0;
+    }
+    size_t h = std::hash<u8string>()(priv->family);
+    h ^= std::hash<float>()(priv->size) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= (size_t(priv->blod) << 1) | size_t(priv->italic != 0);
+    return h;
+}
+bool Font::operator ==(const Font &f) const {
+    if (priv == f.priv) {
+        return true;
+    }
+    if (!priv || !f.priv) {
+        return false;
+    }
+    return priv->family.str() == f.priv->family.str() &&
+           priv->size == f.priv->size &&
+           priv->blod == f.priv->blod &&
+           priv->italic == f.priv->italic;
+}
+bool Font::operator !=(const Font &f) const {
+    return !(*this == f);
+}
 void Font::Init() {
     if (!ft_global) {
         ft_global = new FtRuntime();
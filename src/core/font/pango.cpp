@@ -70,6 +70,25 @@ float Font::size() const {
 bool  Font::empty() const {
     return priv == nullptr;
 }
+u8string Font::family() const {
+    if (!priv) {
+        return u8string();
+    }
+    auto family = pango_font_description_get_family(FONT_CAST(priv));
+    return family ? family : "";
+}
+bool  Font::bold() const {
+    if (!priv) {
+        return false;
+    }
+    return pango_font_description_get_weight(FONT_CAST(priv)) >= PANGO_WEIGHT_BOLD;
+}
+bool  Font::italic() const {
+    if (!priv) {
+        return false;
+    }
+    return pango_font_description_get_style(FONT_CAST(priv)) != PANGO_STYLE_NORMAL;
+}
 
 void  Font::set_size(float size) {
     pango_font_description_set_absolute_size(FONT_CAST(priv), size * PANGO_SCALE);
@@ -91,6 +110,21 @@ bool  Font::native_handle(FontHandle what, void *out) const {
     }
     return false;
 }
+size_t Font::hash() const {
+    if (!priv) {
+        return 0;
+    }
+    return pango_font_description_hash(FONT_CAST(priv));
+}
+bool  Font::operator ==(const Font &f) const {
+    if (!priv || !f.priv) {
+        return priv == f.priv;
+    }
+    return pango_font_description_equal(FONT_CAST(priv), FONT_CAST(f.priv));
+}
+bool  Font::operator !=(const Font &f) const {
+    return !(*this == f);
+}
 
 void  Font::Init() {
     // Add ref
@@ -18,6 +18,7 @@
 #include <Btk/font.hpp>
 #include <algorithm>
 #include <variant>
+#include <chrono>
 #include <stack>
 #include <map>
 
@@ -126,6 +127,38 @@ class PainterState {
 
         Alignment      alignment = AlignLeft | AlignTop; //< Alignment of the text
 };
+using PaintClock = std::chrono::steady_clock;
+
+inline double PaintElapsed(PaintClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(PaintClock::now() - start).count();
+}
+
+inline bool SameBrush(const Brush &a, const Brush &b) {
+    if (a == b) {
+        return true;
+    }
+    // Solid brushes are rebuilt by set_color(), compare them by value
+    return a.type() == BrushType::Solid && b.type() == BrushType::Solid && a.color() == b.color();
+}
+inline bool RectOverlapped(const FRect &a, const FRect &b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+inline uint64_t PaintTextureBytes(PixFormat fmt, int w, int h) {
+    uint64_t n = uint64_t(w) * h;
+    switch (fmt) {
+        case PixFormat::RGBA32 : 
+        case PixFormat::BGRA32 : return n * 4;
+        case PixFormat::RGB24  : 
+        case PixFormat::BGR24  : return n * 3;
+        case PixFormat::Gray8  : return n;
+        case PixFormat::NV12   : 
+        case PixFormat::NV21   : 
+        case PixFormat::I420   : return n * 3 / 2;
+        default                : return 0;
+    }
+}
+
 class PainterImpl {
     public:
         PainterImpl(PaintDevice *dev, bool owned);
@@ -141,15 +174,33 @@ class PainterImpl {
 
         // Dirty state 
         void check_dirty();
+        void sync_state();
         void mark_all_dirty();
         void mark_dirty_from(const PainterState &a, const PainterState &b);
+        bool need_update(bool same);
+
+        // Batching
+        void batch_rect(float x, float y, float w, float h);
+        void flush_batch();
 
         std::unique_ptr<PaintDevice> device = { }; //< PaintDevice
         Ref<PaintContext>            ctxt  = { }; //< Painter Context
         std::stack<PainterState>     state = { }; //< Painter State
         PainterState              defstate = { }; //< Default State (used for compare)
+        PainterState                shadow = { }; //< State the context currently holds
+        bool                  shadow_valid = false; //< Is the shadow in sync with the context
+        std::vector<FRect>           batch = { }; //< Pending fill_rect, sharing the current state
 
         bool                         device_owned; //< Does the painter take ownership of this device
+        PaintStats                   stats = { }; //< Counters of the frame
+        PaintClock::time_point       frame_start = { }; //< Time of begin()
+
+        void count(PaintPrimitive p) {
+            stats.draw_calls[size_t(p)] += 1;
+        }
+        void count(PaintContextState s) {
+            stats.state_changes[size_t(s)] += 1;
+        }
 
         struct {
             uint8_t antialias : 1; //< Antialias was changed by user
@@ -172,6 +223,10 @@ inline PainterImpl::PainterImpl(PaintDevice *dev, bool owned) :
     Btk_memset(&dirty, 0, sizeof(dirty));
 }
 inline PainterImpl::~PainterImpl() {
+    if (ctxt && ctxt->stats == &stats) {
+        // Detach the counters from the context
+        ctxt->stats = nullptr;
+    }
     if (!device_owned) {
         // Release ownership
         device.release();
@@ -179,20 +234,39 @@ inline PainterImpl::~PainterImpl() {
 }
 
 inline void PainterImpl::begin() {
+    auto start = PaintClock::now();
+    stats.reset();
+    stats.frame += 1;
+    ctxt->stats = &stats;
+
     ctxt->begin();
+    stats.begin_time = PaintElapsed(start);
+    batch.clear();
+    frame_start = start;
 
     // Clear previous & Create the state object
     if (state.size() != 1) {
         state.pop();
     }
-    // Sync state
+    // Sync state, the context could drop its state in begin()
+    shadow_valid = false;
     mark_all_dirty();
 }
 inline void PainterImpl::end() {
+    auto start = PaintClock::now();
+    flush_batch();
     ctxt->end();
+    stats.end_time = PaintElapsed(start);
+
+    start = PaintClock::now();
     ctxt->swap_buffers();
+    stats.swap_time  = PaintElapsed(start);
+    stats.frame_time = PaintElapsed(frame_start);
 }
 inline void PainterImpl::clear() {
+    // Clear is limited by the scissor, so sync it first
+    check_dirty();
+    count(PaintPrimitive::Clear);
     ctxt->clear(state.top().brush);
 }
 inline void PainterImpl::save() {
@@ -208,51 +282,143 @@ inline void PainterImpl::restore() {
     BTK_ASSERT(state.size() > 1); // At least has one
     
     // Get prev state
-    auto prev = state.top();
+    auto prev = std::move(state.top());
     state.pop();
 
     mark_dirty_from(state.top(), prev);
 }
 
 inline void PainterImpl::check_dirty() {
-    // Keep track of dirty state
+    sync_state();
+    flush_batch();
+}
+inline bool PainterImpl::need_update(bool same) {
+    if (shadow_valid && same) {
+        // The context already has it
+        stats.state_skipped += 1;
+        return false;
+    }
+    // Pending primitives are drawn with the previous state
+    flush_batch();
+    return true;
+}
+inline void PainterImpl::sync_state() {
+    auto &cur = state.top();
+
+    // Keep track of dirty state, only send the changed one
     if (dirty.transform) {
         dirty.transform = false;
-        ctxt->set_transform(&state.top().matrix);
+        if (need_update(cur.matrix == shadow.matrix)) {
+            shadow.matrix = cur.matrix;
+            ctxt->set_transform(&cur.matrix);
+            count(PaintContextState::Transform);
+        }
     }
     if (dirty.scissor) {
-        if (!state.top().has_scissor) {
-            ctxt->set_scissor(nullptr);
+        dirty.scissor = false;
+        bool same = cur.has_scissor == shadow.has_scissor;
+        if (same && cur.has_scissor) {
+            same = (cur.scissor == shadow.scissor) && (cur.scissor_mat == shadow.scissor_mat);
         }
-        else {
-            PaintScissor scissor;
-            scissor.rect = state.top().scissor;
-            scissor.matrix = state.top().scissor_mat;
+        if (need_update(same)) {
+            shadow.has_scissor = cur.has_scissor;
+            shadow.scissor     = cur.scissor;
+            shadow.scissor_mat = cur.scissor_mat;
+            if (!cur.has_scissor) {
+                ctxt->set_scissor(nullptr);
+            }
+            else {
+                PaintScissor scissor;
+                scissor.rect = cur.scissor;
+                scissor.matrix = cur.scissor_mat;
 
-            ctxt->set_scissor(&scissor);
+                ctxt->set_scissor(&scissor);
+            }
+            count(PaintContextState::Scissor);
         }
-        dirty.scissor = false;
     }
     if (dirty.brush) {
         dirty.brush = false;
-        ctxt->set_brush(state.top().brush);
+        if (need_update(SameBrush(cur.brush, shadow.brush))) {
+            shadow.brush = cur.brush;
+            ctxt->set_brush(cur.brush);
+            count(PaintContextState::Brush);
+        }
     }
     if (dirty.pen) {
         dirty.pen = false;
-        ctxt->set_pen(state.top().pen);
+        if (need_update(cur.pen == shadow.pen)) {
+            shadow.pen = cur.pen;
+            ctxt->set_pen(cur.pen);
+            count(PaintContextState::Pen);
+        }
     }
     if (dirty.width) {
         dirty.width = false;
-        ctxt->set_stroke_width(state.top().width);
+        if (need_update(cur.width == shadow.width)) {
+            shadow.width = cur.width;
+            ctxt->set_stroke_width(cur.width);
+            count(PaintContextState::StrokeWidth);
+        }
     }
     if (dirty.alpha) {
         dirty.alpha = false;
-        ctxt->set_alpha(state.top().alpha);
+        if (need_update(cur.alpha == shadow.alpha)) {
+            shadow.alpha = cur.alpha;
+            ctxt->set_alpha(cur.alpha);
+            count(PaintContextState::Alpha);
+        }
     }
     if (dirty.antialias) {
         dirty.antialias = false;
-        ctxt->set_antialias(state.top().antialias);
+        if (need_update(cur.antialias == shadow.antialias)) {
+            shadow.antialias = cur.antialias;
+            ctxt->set_antialias(cur.antialias);
+            count(PaintContextState::Antialias);
+        }
+    }
+    // All state was sent after begin()
+    shadow_valid = true;
+}
+inline void PainterImpl::batch_rect(float x, float y, float w, float h) {
+    constexpr size_t max_batch = 64;
+
+    // Only solid brush could be merged, others depend on the bounding box of the primitive
+    // Overlapped rectangles are also kept apart, they will be blended twice in separate calls
+    FRect rect(x, y, w, h);
+    bool  mergeable = w > 0 && h > 0 && state.top().brush.type() == BrushType::Solid;
+    if (mergeable) {
+        for (auto &prev : batch) {
+            if (RectOverlapped(prev, rect)) {
+                mergeable = false;
+                break;
+            }
+        }
+    }
+    if (!mergeable) {
+        flush_batch();
+        ctxt->fill_rect(x, y, w, h);
+        return;
     }
+    if (batch.size() == max_batch) {
+        flush_batch();
+    }
+    batch.push_back(rect);
+}
+inline void PainterImpl::flush_batch() {
+    if (batch.empty()) {
+        return;
+    }
+    if (batch.size() == 1) {
+        auto &r = batch.front();
+        ctxt->fill_rect(r.x, r.y, r.w, r.h);
+    }
+    else {
+        ctxt->fill_rects(batch.data(), batch.size());
+        stats.batches += 1;
+        stats.batched_rects += batch.size();
+    }
+    batch.clear();
 }
 inline void PainterImpl::mark_dirty_from(const PainterState &self, const PainterState &other) {
     // Transform
@@ -264,9 +430,11 @@ inline void PainterImpl::mark_dirty_from(const PainterState &self, const Painter
     if (self.has_scissor != other.has_scissor) {
         dirty.scissor = true;
     }
-    if (self.has_scissor) {
+    else if (self.has_scissor) {
         // Has sicssor, compare the rectangle
-        dirty.scissor = (self.scissor == other.scissor) && (self.scissor_mat == other.scissor_mat);
+        if ((self.scissor != other.scissor) || (self.scissor_mat != other.scissor_mat)) {
+            dirty.scissor = true;
+        }
     }
 
     // Alpha
@@ -304,6 +472,10 @@ Painter::Painter() {
     priv = nullptr;
 }
 Painter::Painter(PaintDevice *device, bool owned) {
+    if (!device) {
+        priv = nullptr;
+        return;
+    }
     priv = new PainterImpl(device, owned);
     if (!priv->ctxt) {
         // No context provided
@@ -312,7 +484,7 @@ Painter::Painter(PaintDevice *device, bool owned) {
     }
 }
 Painter::Painter(PixBuffer &buffer) : Painter(CreatePaintDevice(&buffer), true) { }
-Painter::Painter(Texture   &texture) : Painter(texture.priv->texture.get()) { }
+Painter::Painter(Texture   &texture) : Painter(texture.empty() ? nullptr : texture.priv->texture.get()) { }
 
 Painter::Painter(Painter &&p) {
     priv = p.priv;
@@ -323,22 +495,27 @@ Painter::~Painter() {
 }
 void Painter::draw_rect(float x, float y, float w, float h) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawRect);
     priv->ctxt->draw_rect(x, y, w, h);
 }
 void Painter::draw_line(float x1, float y1, float x2, float y2) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawLine);
     priv->ctxt->draw_line(x1, y1, x2, y2);
 }
 void Painter::draw_circle(float x, float y, float r) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawEllipse);
     priv->ctxt->draw_ellipse(x, y, r, r);
 }
 void Painter::draw_ellipse(float x, float y, float xr, float yr) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawEllipse);
     priv->ctxt->draw_ellipse(x, y, xr, yr);
 }
 void Painter::draw_rounded_rect(float x, float y, float w, float h, float r) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawRoundedRect);
     priv->ctxt->draw_rounded_rect(x, y, w, h, r);
 }
 void Painter::draw_image(const Texture &tex, const FRect *dst, const FRect *src) {
@@ -346,12 +523,14 @@ void Painter::draw_image(const Texture &tex, const FRect *dst, const FRect *src)
         return;
     }
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawImage);
     priv->ctxt->draw_image(tex.priv->texture.get(), dst, src);
 }
 void Painter::draw_text(u8string_view txt, float x, float y) {
     auto &state = priv->state.top();
 
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawText);
     priv->ctxt->draw_text(state.alignment, state.font, txt, x, y);
 }
 void Painter::draw_text(const TextLayout &lay, float x, float y) {
@@ -361,34 +540,41 @@ void Painter::draw_text(const TextLayout &lay, float x, float y) {
     auto &state = priv->state.top();
 
     priv->check_dirty();
+    priv->count(PaintPrimitive::DrawTextLayout);
     priv->ctxt->draw_text(state.alignment, lay, x, y);
 }
 void Painter::draw_path(const PainterPath &path) {
     if (path.priv) {
         priv->check_dirty();
+        priv->count(PaintPrimitive::DrawPath);
         priv->ctxt->draw_path(path);
     }
 }
 
 void Painter::fill_rect(float x, float y, float w, float h) {
-    priv->check_dirty();
-    priv->ctxt->fill_rect(x, y, w, h);
+    priv->sync_state();
+    priv->count(PaintPrimitive::FillRect);
+    priv->batch_rect(x, y, w, h);
 }
 void Painter::fill_circle(float x, float y, float r) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::FillEllipse);
     priv->ctxt->fill_ellipse(x, y, r, r);
 }
 void Painter::fill_ellipse(float x, float y, float xr, float yr) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::FillEllipse);
     priv->ctxt->fill_ellipse(x, y, xr, yr);
 }
 void Painter::fill_rounded_rect(float x, float y, float w, float h, float r) {
     priv->check_dirty();
+    priv->count(PaintPrimitive::FillRoundedRect);
     priv->ctxt->fill_rounded_rect(x, y, w, h, r);
 }
 void Painter::fill_path(const PainterPath &path) {
     if (path.priv) {
         priv->check_dirty();
+        priv->count(PaintPrimitive::FillPath);
         priv->ctxt->fill_path(path);
     }
 }
@@ -397,6 +583,7 @@ void Painter::fill_mask(const Texture &tex, const FRect *dst, const FRect *src)
         return;
     }
     priv->check_dirty();
+    priv->count(PaintPrimitive::FillMask);
     priv->ctxt->fill_mask(tex.priv->texture.get(), dst, src);
 }
 
@@ -427,11 +614,22 @@ void Painter::set_text_align(Alignment alignment) {
     priv->state.top().alignment = alignment;
 }
 void Painter::set_colorf(float r, float g, float b, float a) {
-    priv->state.top().brush.set_color(GLColor(r, g, b, a));
+    GLColor c(r, g, b, a);
+    auto &brush = priv->state.top().brush;
+    if (brush.type() == BrushType::Solid && brush.color() == c) {
+        // Nothing changed, skip the copy on write of the brush
+        return;
+    }
+    brush.set_color(c);
     priv->dirty.brush = true;
 }
 void Painter::set_color(uint8_t r, uint8_t g , uint8_t b, uint8_t a) {
-    priv->state.top().brush.set_color(Color(r, g, b, a));
+    GLColor c(Color(r, g, b, a));
+    auto &brush = priv->state.top().brush;
+    if (brush.type() == BrushType::Solid && brush.color() == c) {
+        return;
+    }
+    brush.set_color(c);
     priv->dirty.brush = true;
 }
 void Painter::set_brush(const Brush &b) {
@@ -463,8 +661,13 @@ auto Painter::alpha() const -> float {
     return priv->state.top().alpha;
 }
 auto Painter::context() const -> PaintContext * {
+    // Caller may draw on the context directly, submit the pending primitives first
+    priv->flush_batch();
     return priv->ctxt.get();
 }
+auto Painter::stats() const -> const PaintStats & {
+    return priv->stats;
+}
 
 // Transform
 void Painter::transform(const FMatrix &mat) {
@@ -495,6 +698,9 @@ void Painter::reset_transform() {
     priv->state.top().matrix = FMatrix::Identity();
     priv->dirty.transform = true;
 }
+auto Painter::transform_matrix() -> FMatrix {
+    return priv->state.top().matrix;
+}
 
 // Scissor
 void Painter::set_scissor(float x, float y, float w, float h) {
@@ -544,6 +750,9 @@ auto Painter::create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi
     if (!tex) {
         return { };
     }
+    priv->stats.textures_created += 1;
+    priv->stats.texture_created_bytes += PaintTextureBytes(fmt, w, h);
+
     Texture t;
     t.priv = new TextureImpl;
     t.priv->texture = tex;
@@ -563,6 +772,84 @@ auto Painter::create_texture(const PixBuffer &buf) -> Texture {
     return t;
 }
 
+// Statistics
+static_assert(size_t(PaintContextState::Pen) + 1 == PaintStats::NumStates, "PaintStats::NumStates mismatch");
+
+void     PaintStats::reset() {
+    auto f = frame;
+    *this = PaintStats();
+    frame = f;
+}
+uint32_t PaintStats::total_draw_calls() const {
+    uint32_t n = 0;
+    for (auto v : draw_calls) {
+        n += v;
+    }
+    return n;
+}
+uint32_t PaintStats::total_state_changes() const {
+    uint32_t n = 0;
+    for (auto v : state_changes) {
+        n += v;
+    }
+    return n;
+}
+u8string PaintStats::to_json() const {
+    static const char *const primitives[NumPrimitives] = {
+        "clear",
+        "draw_path",
+        "draw_line",
+        "draw_rect",
+        "draw_rounded_rect",
+        "draw_ellipse",
+        "draw_image",
+        "draw_text",
+        "draw_text_layout",
+        "fill_path",
+        "fill_rect",
+        "fill_rounded_rect",
+        "fill_ellipse",
+        "fill_mask",
+    };
+    static const char *const states[NumStates] = {
+        "stroke_width",
+        "antialias",
+        "transform",
+        "scissor",
+        "alpha",
+        "brush",
+        "pen",
+    };
+
+    u8string json;
+    json.append(u8string::format("{\"frame\":%llu,\"draw_calls\":{", (unsigned long long) frame));
+    for (size_t i = 0; i < NumPrimitives; i++) {
+        json.append(u8string::format("%s\"%s\":%u", i ? "," : "", primitives[i], unsigned(draw_calls[i])));
+    }
+    json.append(u8string::format("},\"total_draw_calls\":%u,\"state_changes\":{", unsigned(total_draw_calls())));
+    for (size_t i = 0; i < NumStates; i++) {
+        json.append(u8string::format("%s\"%s\":%u", i ? "," : "", states[i], unsigned(state_changes[i])));
+    }
+    json.append(u8string::format(
+        "},\"total_state_changes\":%u,"
+        "\"textures\":{\"created\":%u,\"created_bytes\":%llu,\"uploads\":%u,\"upload_bytes\":%llu},"
+        "\"text_cache\":{\"hits\":%u,\"misses\":%u},"
+        "\"path_tessellations\":%u,"
+        "\"state_skipped\":%u,"
+        "\"batches\":{\"count\":%u,\"rects\":%u},"
+        "\"timing_ms\":{\"begin\":%.3f,\"end\":%.3f,\"swap_buffers\":%.3f,\"frame\":%.3f}}",
+        unsigned(total_state_changes()),
+        unsigned(textures_created), (unsigned long long) texture_created_bytes,
+        unsigned(texture_uploads), (unsigned long long) texture_upload_bytes,
+        unsigned(text_cache_hits), unsigned(text_cache_misses),
+        unsigned(path_tessellations),
+        unsigned(state_skipped),
+        unsigned(batches), unsigned(batched_rects),
+        begin_time, end_time, swap_time, frame_time
+    ));
+    return json;
+}
+
 // Interface for painter on window
 void Painter::notify_dpi_changed(float xdpi, float ydpi) {
 
@@ -586,8 +873,23 @@ void Painter::notify_resize(int w, int h) {
 
     static_cast<WindowDevice*>(priv->device.get())->resize(w, h);
 }
+bool Painter::content_preserved() const {
+    // Could we only paint a part of it and keep the rest ?
+    bool preserved = false;
+    if (!priv->device->query_value(PaintDeviceValue::ContentPreserved, &preserved)) {
+        return false;
+    }
+    return preserved;
+}
+
+bool Painter::empty() const {
+    return priv == nullptr;
+}
 
 // Move
+void Painter::swap(Painter &p) {
+    std::swap(priv, p.priv);
+}
 void Painter::operator =(Painter && p) {
     delete priv;
     priv = p.priv;
@@ -1,8 +1,42 @@
 #include "build.hpp"
 #include "common/utils.hpp" //< For refcounting
 
+#include <Btk/detail/platform.hpp>
+#include <Btk/context.hpp>
 #include <Btk/pixels.hpp>
+#include <Btk/event.hpp>
+#include <Btk/io.hpp>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <thread>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <deque>
 #include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BTK_PIXELS_SSE2
+    #include <emmintrin.h>
+
+    // AVX2 kernels are selected at runtime
+    #if defined(_MSC_VER)
+        #define BTK_PIXELS_AVX2
+        #define BTK_PIXELS_AVX2_TARGET
+        #include <immintrin.h>
+        #include <intrin.h>
+    #elif defined(__GNUC__)
+        #define BTK_PIXELS_AVX2
+        #define BTK_PIXELS_AVX2_TARGET __attribute__((target("avx2")))
+        #include <immintrin.h>
+    #endif
+#endif
 
 #if  defined(_WIN32)
 #include "common/win32/wincodec.hpp" //< Bulitin Wincodec wrapper
@@ -76,6 +110,25 @@ Color::Color(u8string_view str) {
         this->a = ia;
     }
 }
+namespace {
+
+inline bool PixIsYuv(PixFormat fmt) {
+    return fmt == PixFormat::NV12 || fmt == PixFormat::NV21 || fmt == PixFormat::I420;
+}
+// The chroma planes follow the Y plane, each sample covers 2x2 pixels
+inline size_t PixChromaSize(int w, int h) {
+    return size_t((w + 1) / 2) * ((h + 1) / 2);
+}
+inline size_t PixBufferBytes(PixFormat fmt, int w, int h, int byte) {
+    size_t n = size_t(w) * h * byte;
+    if (PixIsYuv(fmt)) {
+        n += PixChromaSize(w, h) * 2;
+    }
+    return n;
+}
+
+}
+
 PixBuffer::~PixBuffer() {
     clear();
 }
@@ -91,13 +144,18 @@ PixBuffer::PixBuffer(PixFormat fmt, int w, int h) {
     _height = h;
     _pitch = w * byte;
     _owned = true;
-    _pixels = Btk_malloc(w * h * byte);
 
-    // Zero out the buffer
-    Btk_memset(_pixels, 0, w * h * byte);
+    size_t n = PixBufferBytes(fmt, w, h, byte);
+    _pixels = Btk_malloc(n);
+
+    // Zero out the buffer, the chroma planes are neutral (black)
+    Btk_memset(_pixels, 0, n);
+    if (PixIsYuv(fmt)) {
+        Btk_memset(static_cast<uint8_t*>(_pixels) + size_t(w) * h, 128, n - size_t(w) * h);
+    }
 
     // Alloc refcount
-    _refcount = new int(1);
+    _refcount = new std::atomic_int(1);
 }
 PixBuffer::PixBuffer(PixFormat fmt, void *p, int w, int h) {
     _init_format(fmt);
@@ -111,7 +169,7 @@ PixBuffer::PixBuffer(PixFormat fmt, void *p, int w, int h) {
 
 
     // Alloc refcount
-    _refcount = new int(1);
+    _refcount = new std::atomic_int(1);
 }
 PixBuffer::PixBuffer(PixBuffer &&bf) {
     Btk_memcpy(this, &bf, sizeof(PixBuffer));
@@ -176,15 +234,15 @@ Color   PixBuffer::color_at(int x, int y) const {
     c.r = (pix & _rmask) >> _rshift;
     c.g = (pix & _gmask) >> _gshift;
     c.b = (pix & _bmask) >> _bshift;
-    c.a = (pix & _amask) >> _ashift;
+    c.a = _amask ? (pix & _amask) >> _ashift : 0xFF; //< No alpha channel, opaque
     return c;
 }
 void   PixBuffer::set_color(int x, int y, Color c) {
     uint32_t pix = 0;
-    pix |= (c.r << _rshift);
-    pix |= (c.g << _gshift);
-    pix |= (c.b << _bshift);
-    pix |= (c.a << _ashift);
+    pix |= (uint32_t(c.r) << _rshift) & _rmask;
+    pix |= (uint32_t(c.g) << _gshift) & _gmask;
+    pix |= (uint32_t(c.b) << _bshift) & _bmask;
+    pix |= (uint32_t(c.a) << _ashift) & _amask;
     set_pixel(x, y, pix);
 }
 void   PixBuffer::set_pixel(int x, int y, uint32_t pix) {
@@ -215,11 +273,401 @@ PixBuffer PixBuffer::clone() const {
     if (empty()) {
         return PixBuffer();
     }
-    PixBuffer bf(_width, _height);
-    Btk_memcpy(bf._pixels, _pixels, _width * _height * bytes_per_pixel());
+    PixBuffer bf(_format, _width, _height);
+    Btk_memcpy(bf._pixels, _pixels, PixBufferBytes(_format, _width, _height, bytes_per_pixel()));
     return bf;
 }
-PixBuffer PixBuffer::resize(int w, int h) const {
+cpointer_t PixBuffer::plane(int idx) const noexcept {
+    if (idx == 0) {
+        return _pixels;
+    }
+    if (!PixIsYuv(_format) || _pixels == nullptr) {
+        return nullptr;
+    }
+    auto chroma = static_cast<const uint8_t*>(_pixels) + size_t(_pitch) * _height;
+    if (idx == 1) {
+        return chroma;
+    }
+    if (idx == 2 && _format == PixFormat::I420) {
+        return chroma + PixChromaSize(_width, _height);
+    }
+    return nullptr;
+}
+pointer_t  PixBuffer::plane(int idx) noexcept {
+    return const_cast<pointer_t>(static_cast<const PixBuffer*>(this)->plane(idx));
+}
+int PixBuffer::plane_pitch(int idx) const noexcept {
+    if (idx == 0) {
+        return _pitch;
+    }
+    int cw = (_width + 1) / 2;
+    switch (_format) {
+        case PixFormat::NV12 :
+        case PixFormat::NV21 : return idx == 1 ? cw * 2 : 0;
+        case PixFormat::I420 : return idx <= 2 ? cw : 0;
+        default              : return 0;
+    }
+}
+namespace {
+
+// Workers for splitting rows, started on the first large job and kept for the later ones
+class PixRowPool {
+    public:
+        static PixRowPool &Instance() {
+            static PixRowPool pool;
+            return pool;
+        }
+        unsigned concurrency() const {
+            return unsigned(workers.size()) + 1;
+        }
+        // Run fn(begin, end) on n chunks of [0, rows), the caller takes the first one and helps until all done
+        template <typename Callable>
+        void run(int rows, unsigned n, Callable &fn) {
+            int      chunk = (rows + n - 1) / n;
+            unsigned left  = n - 1; //< Guarded by mutex
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+                for (unsigned i = 1; i < n; i++) {
+                    int begin = min(rows, int(i) * chunk);
+                    int end   = min(rows, begin + chunk);
+                    jobs.push_back([this, &fn, &left, begin, end]() {
+                        fn(begin, end);
+                        std::lock_guard<std::mutex> locker(mutex);
+                        if (--left == 0) {
+                            done.notify_all();
+                        }
+                    });
+                }
+            }
+            cond.notify_all();
+            fn(0, min(rows, chunk));
+
+            std::unique_lock<std::mutex> locker(mutex);
+            while (left != 0) {
+                // Take the queued jobs instead of sleeping, the workers may be busy with an other caller
+                if (jobs.empty()) {
+                    done.wait(locker);
+                    continue;
+                }
+                auto job = std::move(jobs.front());
+                jobs.pop_front();
+                locker.unlock();
+                job();
+                locker.lock();
+            }
+        }
+    private:
+        PixRowPool() {
+            unsigned n = std::thread::hardware_concurrency();
+            for (unsigned i = 1; i < n; i++) {
+                workers.emplace_back(&PixRowPool::loop, this);
+            }
+        }
+        ~PixRowPool() {
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+                stop = true;
+            }
+            cond.notify_all();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        }
+        void loop() {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> locker(mutex);
+                    cond.wait(locker, [this]() { return stop || !jobs.empty(); });
+                    if (stop) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::mutex                        mutex;
+        std::condition_variable           cond; //< Jobs posted
+        std::condition_variable           done; //< A caller's jobs finished
+        std::deque<std::function<void()>> jobs;
+        std::vector<std::thread>          workers;
+        bool                              stop = false;
+};
+
+// Split [0, rows) into the row pool when the work is large enough
+template <typename Callable>
+void PixParallelRows(int rows, uint64_t work, Callable &&fn) {
+    constexpr uint64_t work_per_thread = 1 << 20;
+
+    unsigned n = std::thread::hardware_concurrency();
+    n = unsigned(min<uint64_t>(n, work / work_per_thread));
+    n = min(n, unsigned(rows));
+    if (n <= 1) {
+        fn(0, rows);
+        return;
+    }
+    auto &pool = PixRowPool::Instance();
+    pool.run(rows, min(n, pool.concurrency()), fn);
+}
+
+}
+
+#if !defined(_WIN32)
+// Separable resampler, 4 channels in 8 bits, weights in fixed point
+namespace {
+
+constexpr int    PixResamplePrecision = 14;
+constexpr double PixResamplePi        = 3.14159265358979323846;
+
+struct PixResampleFilter {
+    double (*fn)(double x);
+    double support;
+};
+
+double PixFilterBox(double x) {
+    return (x > -0.5 && x <= 0.5) ? 1.0 : 0.0;
+}
+double PixFilterTriangle(double x) {
+    x = std::abs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+double PixFilterBicubic(double x) {
+    // Keys cubic with a = -0.5
+    constexpr double a = -0.5;
+    x = std::abs(x);
+    if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    }
+    if (x < 2.0) {
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+    }
+    return 0.0;
+}
+double PixFilterSinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= PixResamplePi;
+    return std::sin(x) / x;
+}
+double PixFilterLanczos3(double x) {
+    if (x > -3.0 && x < 3.0) {
+        return PixFilterSinc(x) * PixFilterSinc(x / 3.0);
+    }
+    return 0.0;
+}
+
+PixResampleFilter PixGetResampleFilter(ResizeFilter f) {
+    switch (f) {
+        case ResizeFilter::Box      : return {PixFilterBox, 0.5};
+        case ResizeFilter::Bilinear : return {PixFilterTriangle, 1.0};
+        case ResizeFilter::Lanczos3 : return {PixFilterLanczos3, 3.0};
+        case ResizeFilter::Bicubic  : 
+        default                     : return {PixFilterBicubic, 2.0};
+    }
+}
+
+/**
+ * @brief Weights of all output pixels on one axis
+ * 
+ */
+class PixResampleWeights {
+    public:
+        std::vector<int>     first;  //< First input pixel of output pixel
+        std::vector<int>     count;  //< Number of input pixels of output pixel
+        std::vector<int16_t> coeffs; //< taps values per output pixel
+        int                  taps = 0;
+
+        PixResampleWeights(int in, int out, const PixResampleFilter &filter) {
+            double scale  = double(in) / double(out);
+            double fscale = max(scale, 1.0); //< Downscale, stretch the filter to cover all input
+            double support = filter.support * fscale;
+
+            taps = int(std::ceil(support)) * 2 + 1;
+            first.resize(out);
+            count.resize(out);
+            coeffs.resize(size_t(out) * taps);
+
+            std::vector<double> w(taps);
+            for (int i = 0; i < out; i++) {
+                double center = (i + 0.5) * scale;
+                int    xmin   = max(int(center - support + 0.5), 0);
+                int    xmax   = min(int(center + support + 0.5), in);
+                int    n      = min(xmax - xmin, taps);
+
+                double total = 0.0;
+                for (int k = 0; k < n; k++) {
+                    w[k] = filter.fn((k + xmin - center + 0.5) / fscale);
+                    total += w[k];
+                }
+
+                auto dst = coeffs.data() + size_t(i) * taps;
+                for (int k = 0; k < n; k++) {
+                    double v = total != 0.0 ? w[k] / total : 0.0;
+                    dst[k] = int16_t(std::lround(v * (1 << PixResamplePrecision)));
+                }
+                first[i] = xmin;
+                count[i] = n;
+            }
+        }
+};
+
+inline uint8_t PixResampleClamp(int v) {
+    v >>= PixResamplePrecision;
+    return uint8_t(clamp(v, 0, 255));
+}
+
+// Horizontal pass of one row, 4 bytes per pixel
+void PixResampleRow(const uint8_t *src, uint8_t *dst, int out, const PixResampleWeights &wt) {
+    for (int i = 0; i < out; i++) {
+        const int16_t *k = wt.coeffs.data() + size_t(i) * wt.taps;
+        const uint8_t *s = src + wt.first[i] * 4;
+        int n = wt.count[i];
+
+#if defined(BTK_PIXELS_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = _mm_set1_epi32(1 << (PixResamplePrecision - 1));
+        int j = 0;
+        for (; j + 2 <= n; j += 2) {
+            // r0 r1 g0 g1 b0 b1 a0 a1 * w0 w1 w0 w1 ...
+            __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + j * 4)), zero);
+            p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+            __m128i w = _mm_set1_epi32(int((uint32_t(uint16_t(k[j + 1])) << 16) | uint16_t(k[j])));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(p, w));
+        }
+        if (j < n) {
+            uint32_t v;
+            Btk_memcpy(&v, s + j * 4, sizeof(v));
+            __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(v)), zero), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(p, _mm_set1_epi32(uint16_t(k[j]))));
+        }
+        sum = _mm_srai_epi32(sum, PixResamplePrecision);
+        sum = _mm_packs_epi32(sum, sum);
+        uint32_t v = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        Btk_memcpy(dst + i * 4, &v, sizeof(v));
+#else
+        int sum[4] = {
+            1 << (PixResamplePrecision - 1),
+            1 << (PixResamplePrecision - 1),
+            1 << (PixResamplePrecision - 1),
+            1 << (PixResamplePrecision - 1),
+        };
+        for (int j = 0; j < n; j++) {
+            for (int c = 0; c < 4; c++) {
+                sum[c] += s[j * 4 + c] * k[j];
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            dst[i * 4 + c] = PixResampleClamp(sum[c]);
+        }
+#endif
+    }
+}
+// Vertical pass of one row, rows are the input rows of it
+void PixResampleColumn(const uint8_t *const *rows, const int16_t *k, int n, uint8_t *dst, int width) {
+    int bytes = width * 4;
+    int x = 0;
+
+#if defined(BTK_PIXELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(1 << (PixResamplePrecision - 1));
+    for (; x + 16 <= bytes; x += 16) {
+        __m128i s0 = half, s1 = half, s2 = half, s3 = half;
+        int j = 0;
+        for (; j + 2 <= n; j += 2) {
+            // Interleave 2 rows, a0 b0 a1 b1 ... * wa wb wa wb
+            __m128i a  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + x));
+            __m128i b  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j + 1] + x));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            __m128i w  = _mm_set1_epi32(int((uint32_t(uint16_t(k[j + 1])) << 16) | uint16_t(k[j])));
+            s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+            s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+            s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+            s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+        }
+        if (j < n) {
+            __m128i a  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + x));
+            __m128i lo = _mm_unpacklo_epi8(a, zero);
+            __m128i hi = _mm_unpackhi_epi8(a, zero);
+            __m128i w  = _mm_set1_epi32(uint16_t(k[j]));
+            s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), w));
+            s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), w));
+            s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), w));
+            s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), w));
+        }
+        s0 = _mm_srai_epi32(s0, PixResamplePrecision);
+        s1 = _mm_srai_epi32(s1, PixResamplePrecision);
+        s2 = _mm_srai_epi32(s2, PixResamplePrecision);
+        s3 = _mm_srai_epi32(s3, PixResamplePrecision);
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), v);
+    }
+#endif
+
+    for (; x < bytes; x++) {
+        int sum = 1 << (PixResamplePrecision - 1);
+        for (int j = 0; j < n; j++) {
+            sum += rows[j][x] * k[j];
+        }
+        dst[x] = PixResampleClamp(sum);
+    }
+}
+
+// Box reduce by integer factors, used before the filter on large downscale
+void PixResampleReduce(const uint8_t *src, int pitch, int w, int h, int kx, int ky, uint8_t *dst, int dst_pitch, int begin, int end) {
+    int ow = (w + kx - 1) / kx;
+    int bytes = w * 4;
+    std::vector<uint16_t> acc(bytes); //< ky <= 256, fits in 16 bits
+
+    for (int oy = begin; oy < end; oy++) {
+        int y0 = oy * ky;
+        int ny = min(ky, h - y0);
+
+        // Sum the rows of the block
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int y = y0; y < y0 + ny; y++) {
+            const uint8_t *row = src + size_t(y) * pitch;
+            int x = 0;
+#if defined(BTK_PIXELS_SSE2)
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 16 <= bytes; x += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                auto    a = reinterpret_cast<__m128i*>(acc.data() + x);
+                _mm_storeu_si128(a + 0, _mm_add_epi16(_mm_loadu_si128(a + 0), _mm_unpacklo_epi8(v, zero)));
+                _mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), _mm_unpackhi_epi8(v, zero)));
+            }
+#endif
+            for (; x < bytes; x++) {
+                acc[x] += row[x];
+            }
+        }
+        // Then the columns
+        uint8_t *out = dst + size_t(oy) * dst_pitch;
+        for (int ox = 0; ox < ow; ox++) {
+            int x0 = ox * kx;
+            int nx = min(kx, w - x0);
+            uint32_t n = uint32_t(nx * ny);
+            uint32_t sum[4] = {n / 2, n / 2, n / 2, n / 2};
+            for (int x = x0; x < x0 + nx; x++) {
+                for (int c = 0; c < 4; c++) {
+                    sum[c] += acc[x * 4 + c];
+                }
+            }
+            for (int c = 0; c < 4; c++) {
+                out[ox * 4 + c] = uint8_t(sum[c] / n);
+            }
+        }
+    }
+}
+
+}
+#endif
+
+PixBuffer PixBuffer::resize(int w, int h, ResizeFilter filter) const {
 
 #if defined(_WIN32)
     auto wic = Win32::Wincodec::GetInstance();
@@ -234,7 +682,13 @@ PixBuffer PixBuffer::resize(int w, int h) const {
     Win32::IBtkBitmap source(this);
     // Scale the bitmap to the new size
     // Emm, WICBitmapInterpolationModeHighQualityCubic is undefined in MinGW :(
-    hr = scaler->Initialize(&source, w, h, WICBitmapInterpolationModeCubic);
+    WICBitmapInterpolationMode mode;
+    switch (filter) {
+        case ResizeFilter::Box      : mode = WICBitmapInterpolationModeFant; break;
+        case ResizeFilter::Bilinear : mode = WICBitmapInterpolationModeLinear; break;
+        default                     : mode = WICBitmapInterpolationModeCubic; break;
+    }
+    hr = scaler->Initialize(&source, w, h, mode);
 
     hr = converter->Initialize(
         scaler.Get(),
@@ -257,322 +711,1996 @@ PixBuffer PixBuffer::resize(int w, int h) const {
     );
     return buf;
 #else
-    PixBuffer buf(w, h);
+    if (empty() || w <= 0 || h <= 0) {
+        return PixBuffer();
+    }
+    // 4 bytes formats are resampled as is, convert others to RGBA32
+    if (bytes_per_pixel() != 4) {
+        return convert(PixFormat::RGBA32).resize(w, h, filter);
+    }
 
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            int src_x = _width  * (float(w) / float(x));
-            int src_y = _height * (float(h) / float(y));
+    // Large downscale, box reduce by integer factors first, the filter only covers the remaining 2x ~ 4x
+    int kx = clamp(_width  / w / 2, 1, 256);
+    int ky = clamp(_height / h / 2, 1, 256);
+    if (kx > 1 || ky > 1) {
+        PixBuffer reduced(_format, (_width + kx - 1) / kx, (_height + ky - 1) / ky);
+        auto out = static_cast<uint8_t*>(reduced._pixels);
+        PixParallelRows(reduced._height, uint64_t(_width) * _height, [&](int begin, int end) {
+            PixResampleReduce(
+                static_cast<const uint8_t*>(_pixels), _pitch, _width, _height, 
+                kx, ky, out, reduced._pitch, begin, end
+            );
+        });
+        return reduced.resize(w, h, filter);
+    }
+
+    auto f   = PixGetResampleFilter(filter);
+    auto src = static_cast<const uint8_t*>(_pixels);
+
+    // Horizontal pass, only the input rows used by the vertical pass
+    PixResampleWeights ywt(_height, h, f);
+    int ymin = ywt.first[0];
+    int ymax = ywt.first[h - 1] + ywt.count[h - 1];
+
+    PixBuffer tmp;
+    const uint8_t *rows = src + size_t(ymin) * _pitch;
+    int            rows_pitch = _pitch;
+    if (w != _width) {
+        PixResampleWeights xwt(_width, w, f);
+        tmp = PixBuffer(_format, w, ymax - ymin);
+
+        auto out = static_cast<uint8_t*>(tmp._pixels);
+        int  out_pitch = tmp._pitch;
+        PixParallelRows(ymax - ymin, uint64_t(ymax - ymin) * w * xwt.taps, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                PixResampleRow(rows + size_t(y) * rows_pitch, out + size_t(y) * out_pitch, w, xwt);
+            }
+        });
+        rows = out;
+        rows_pitch = out_pitch;
+    }
 
-            buf.set_color(x, y, color_at(src_x, src_y));
+    PixBuffer buf(_format, w, h);
+    if (h == _height) {
+        for (int y = 0; y < h; y++) {
+            Btk_memcpy(static_cast<uint8_t*>(buf._pixels) + size_t(y) * buf._pitch, rows + size_t(y) * rows_pitch, size_t(w) * 4);
         }
+        return buf;
     }
 
+    // Vertical pass
+    auto out = static_cast<uint8_t*>(buf._pixels);
+    int  out_pitch = buf._pitch;
+    PixParallelRows(h, uint64_t(h) * w * ywt.taps, [&](int begin, int end) {
+        std::vector<const uint8_t*> input(ywt.taps);
+        for (int y = begin; y < end; y++) {
+            int n = ywt.count[y];
+            for (int j = 0; j < n; j++) {
+                input[j] = rows + size_t(ywt.first[y] - ymin + j) * rows_pitch;
+            }
+            PixResampleColumn(input.data(), ywt.coeffs.data() + size_t(y) * ywt.taps, n, out + size_t(y) * out_pitch, w);
+        }
+    });
     return buf;
 #endif
 }
 
-PixBuffer PixBuffer::convert(PixFormat fmt) const {
-    PixBuffer dst(fmt, _width, _height);
+// Row conversion kernels, n pixels from src to dst (not overlapped)
+namespace {
 
-    // For each pixel convert to the new format
-    for (int y = 0; y < _height; y++) {
-        for (int x = 0; x < _width; x++) {
-            dst.set_color(x, y, color_at(x, y));
+using PixRowConverter = void (*)(const uint8_t *src, uint8_t *dst, int n);
+
+constexpr int PixNumFormats = int(PixFormat::Gray8) + 1;
+
+template <int Bpp>
+void PixRowCopy(const uint8_t *src, uint8_t *dst, int n) {
+    Btk_memcpy(dst, src, size_t(n) * Bpp);
+}
+
+// RGBA32 <-> BGRA32
+void PixRowSwap4(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        uint32_t p;
+        Btk_memcpy(&p, src + i * 4, sizeof(p));
+        p = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+        Btk_memcpy(dst + i * 4, &p, sizeof(p));
+    }
+}
+// RGB24 <-> BGR24
+void PixRowSwap3(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++, src += 3, dst += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+// RGB24 -> RGBA32, Swap on RGB24 -> BGRA32
+template <bool Swap>
+void PixRow3To4(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++, src += 3, dst += 4) {
+        dst[0] = src[Swap ? 2 : 0];
+        dst[1] = src[1];
+        dst[2] = src[Swap ? 0 : 2];
+        dst[3] = 0xFF;
+    }
+}
+// RGBA32 -> RGB24, Swap on RGBA32 -> BGR24
+template <bool Swap>
+void PixRow4To3(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++, src += 4, dst += 3) {
+        dst[0] = src[Swap ? 2 : 0];
+        dst[1] = src[1];
+        dst[2] = src[Swap ? 0 : 2];
+    }
+}
+// Gray8 keeps the alpha channel, same as color_at / set_color
+void PixRow4ToGray(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i * 4 + 3];
+    }
+}
+void PixRow3ToGray(const uint8_t *, uint8_t *dst, int n) {
+    Btk_memset(dst, 0xFF, n);
+}
+void PixRowGrayTo4(const uint8_t *src, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++) {
+        uint32_t p = uint32_t(src[i]) << 24;
+        Btk_memcpy(dst + i * 4, &p, sizeof(p));
+    }
+}
+void PixRowGrayTo3(const uint8_t *, uint8_t *dst, int n) {
+    Btk_memset(dst, 0, size_t(n) * 3);
+}
+
+#if defined(BTK_PIXELS_SSE2)
+void PixRowSwap4SSE2(const uint8_t *src, uint8_t *dst, int n) {
+    const __m128i ga = _mm_set1_epi32(int(0xFF00FF00));
+    const __m128i lo = _mm_set1_epi32(0x000000FF);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), lo);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(v, lo), 16);
+        v = _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+    }
+    PixRowSwap4(src + i * 4, dst + i * 4, n - i);
+}
+void PixRow4ToGraySSE2(const uint8_t *src, uint8_t *dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto s = reinterpret_cast<const __m128i*>(src + i * 4);
+        __m128i a = _mm_srli_epi32(_mm_loadu_si128(s + 0), 24);
+        __m128i b = _mm_srli_epi32(_mm_loadu_si128(s + 1), 24);
+        __m128i c = _mm_srli_epi32(_mm_loadu_si128(s + 2), 24);
+        __m128i d = _mm_srli_epi32(_mm_loadu_si128(s + 3), 24);
+        // Values are in [0, 255], signed saturation is safe
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    PixRow4ToGray(src + i * 4, dst + i, n - i);
+}
+void PixRowGrayTo4SSE2(const uint8_t *src, uint8_t *dst, int n) {
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(zero, v);
+        __m128i hi = _mm_unpackhi_epi8(zero, v);
+        auto d = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(d + 0, _mm_unpacklo_epi16(zero, lo));
+        _mm_storeu_si128(d + 1, _mm_unpackhi_epi16(zero, lo));
+        _mm_storeu_si128(d + 2, _mm_unpacklo_epi16(zero, hi));
+        _mm_storeu_si128(d + 3, _mm_unpackhi_epi16(zero, hi));
+    }
+    PixRowGrayTo4(src + i, dst + i * 4, n - i);
+}
+#endif
+
+#if defined(BTK_PIXELS_AVX2)
+BTK_PIXELS_AVX2_TARGET
+void PixRowSwap4AVX2(const uint8_t *src, uint8_t *dst, int n) {
+    const __m256i mask = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+    );
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(v, mask));
+    }
+    PixRowSwap4(src + i * 4, dst + i * 4, n - i);
+}
+template <bool Swap>
+BTK_PIXELS_AVX2_TARGET
+void PixRow3To4AVX2(const uint8_t *src, uint8_t *dst, int n) {
+    const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+    const __m256i mask  = _mm256_broadcastsi128_si256(
+        Swap ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+             : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)
+    );
+
+    // 8 pixels (24 bytes) in two lanes, each load reads 4 bytes more
+    int i = 0;
+    for (; i + 10 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+        __m256i v  = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+    }
+    PixRow3To4<Swap>(src + i * 3, dst + i * 4, n - i);
+}
+template <bool Swap>
+BTK_PIXELS_AVX2_TARGET
+void PixRow4To3AVX2(const uint8_t *src, uint8_t *dst, int n) {
+    const __m256i mask  = _mm256_broadcastsi128_si256(
+        Swap ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+             : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+    );
+
+    // Each lane packs into 12 bytes, the store writes 4 bytes more
+    int i = 0;
+    for (; i + 10 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        v = _mm256_shuffle_epi8(v, mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 12), _mm256_extracti128_si256(v, 1));
+    }
+    PixRow4To3<Swap>(src + i * 4, dst + i * 3, n - i);
+}
+
+bool PixHasAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // AVX and OSXSAVE, the OS must save the ymm registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+        return false;
+    }
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+class PixRowTable {
+    public:
+        PixRowConverter fns[PixNumFormats][PixNumFormats] = {};
+
+        PixRowTable() {
+            constexpr int RGBA32 = int(PixFormat::RGBA32);
+            constexpr int BGRA32 = int(PixFormat::BGRA32);
+            constexpr int RGB24  = int(PixFormat::RGB24);
+            constexpr int BGR24  = int(PixFormat::BGR24);
+            constexpr int Gray8  = int(PixFormat::Gray8);
+
+            // Scalar fallback
+            fns[RGBA32][RGBA32] = PixRowCopy<4>;
+            fns[BGRA32][BGRA32] = PixRowCopy<4>;
+            fns[RGB24][RGB24]   = PixRowCopy<3>;
+            fns[BGR24][BGR24]   = PixRowCopy<3>;
+            fns[Gray8][Gray8]   = PixRowCopy<1>;
+
+            fns[RGBA32][BGRA32] = PixRowSwap4;
+            fns[BGRA32][RGBA32] = PixRowSwap4;
+            fns[RGB24][BGR24]   = PixRowSwap3;
+            fns[BGR24][RGB24]   = PixRowSwap3;
+
+            fns[RGB24][RGBA32]  = PixRow3To4<false>;
+            fns[BGR24][BGRA32]  = PixRow3To4<false>;
+            fns[RGB24][BGRA32]  = PixRow3To4<true>;
+            fns[BGR24][RGBA32]  = PixRow3To4<true>;
+
+            fns[RGBA32][RGB24]  = PixRow4To3<false>;
+            fns[BGRA32][BGR24]  = PixRow4To3<false>;
+            fns[RGBA32][BGR24]  = PixRow4To3<true>;
+            fns[BGRA32][RGB24]  = PixRow4To3<true>;
+
+            fns[RGBA32][Gray8]  = PixRow4ToGray;
+            fns[BGRA32][Gray8]  = PixRow4ToGray;
+            fns[RGB24][Gray8]   = PixRow3ToGray;
+            fns[BGR24][Gray8]   = PixRow3ToGray;
+            fns[Gray8][RGBA32]  = PixRowGrayTo4;
+            fns[Gray8][BGRA32]  = PixRowGrayTo4;
+            fns[Gray8][RGB24]   = PixRowGrayTo3;
+            fns[Gray8][BGR24]   = PixRowGrayTo3;
+
+#if defined(BTK_PIXELS_SSE2)
+            fns[RGBA32][BGRA32] = PixRowSwap4SSE2;
+            fns[BGRA32][RGBA32] = PixRowSwap4SSE2;
+            fns[RGBA32][Gray8]  = PixRow4ToGraySSE2;
+            fns[BGRA32][Gray8]  = PixRow4ToGraySSE2;
+            fns[Gray8][RGBA32]  = PixRowGrayTo4SSE2;
+            fns[Gray8][BGRA32]  = PixRowGrayTo4SSE2;
+#endif
+
+#if defined(BTK_PIXELS_AVX2)
+            if (PixHasAVX2()) {
+                fns[RGBA32][BGRA32] = PixRowSwap4AVX2;
+                fns[BGRA32][RGBA32] = PixRowSwap4AVX2;
+
+                fns[RGB24][RGBA32]  = PixRow3To4AVX2<false>;
+                fns[BGR24][BGRA32]  = PixRow3To4AVX2<false>;
+                fns[RGB24][BGRA32]  = PixRow3To4AVX2<true>;
+                fns[BGR24][RGBA32]  = PixRow3To4AVX2<true>;
+
+                fns[RGBA32][RGB24]  = PixRow4To3AVX2<false>;
+                fns[BGRA32][BGR24]  = PixRow4To3AVX2<false>;
+                fns[RGBA32][BGR24]  = PixRow4To3AVX2<true>;
+                fns[BGRA32][RGB24]  = PixRow4To3AVX2<true>;
+            }
+#endif
         }
+};
+
+PixRowConverter PixGetRowConverter(PixFormat src, PixFormat dst) {
+    static const PixRowTable table;
+
+    if (uint32_t(src) >= PixNumFormats || uint32_t(dst) >= PixNumFormats) {
+        // YUV etc.
+        return nullptr;
     }
-    
-    return dst;
+    return table.fns[int(src)][int(dst)];
 }
-PixBuffer PixBuffer::filter2d(const double *kernel, int kw, int kh, uint8_t ft_alpha) const {
-    PixBuffer buf(_width, _height);
-    double sums[4];
-    
-    for (int y = 0; y < _height; y++) {
-        for (int x = 0; x < _width; x++) {
-            // Zero buffer
-            Btk_memset(sums, 0, sizeof(sums));
 
-            for (int ky = 0; ky < kh; ky ++) {
-                for (int kx = 0; kx < kw; kx ++) {
-                    int px = x - (kw) / 2 + kx;
-                    int py = y - (kh) / 2 + ky;
+}
 
-                    Color color;
+// Blend kernels, n pixels of src over dst, alpha in the 4th byte
+namespace {
 
-                    // Map out of range coord
-                    if (px < 0) {
-                        px = -px;
-                    }
-                    if (py < 0) {
-                        py = -py;
-                    }
-                    if (px >= _width) {
-                        px = _width - (px - _width + 1);
-                    }
-                    if (py >= _height) {
-                        py = _height -(py - _height + 1);
-                    }
-                    color = color_at(px, py);
+using PixBlendRowFn = void (*)(const uint8_t *src, uint8_t *dst, int n);
+
+inline uint32_t PixDiv255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
 
-                    sums[0] += color.r * kernel[ky * kw + kx];
-                    sums[1] += color.g * kernel[ky * kw + kx];
-                    sums[2] += color.b * kernel[ky * kw + kx];
-                    sums[3] += color.a * kernel[ky * kw + kx];
+template <BlendMode Mode, bool Premul>
+inline void PixBlendPixel(const uint8_t *s, uint8_t *d) {
+    uint32_t sa = s[3];
+    switch (Mode) {
+        case BlendMode::Alpha : {
+            if (Premul) {
+                // dst = src + dst * (1 - srcA)
+                for (int c = 0; c < 4; c++) {
+                    d[c] = uint8_t(min<uint32_t>(s[c] + PixDiv255(d[c] * (255 - sa)), 255));
                 }
             }
-            
-            for (auto &value : sums) {
-                value = clamp(value, 0.0, 255.0);
+            else {
+                // dstRGB = srcRGB * srcA + dstRGB * (1 - srcA), dstA = srcA + dstA * (1 - srcA)
+                for (int c = 0; c < 3; c++) {
+                    d[c] = uint8_t(PixDiv255(s[c] * sa + d[c] * (255 - sa)));
+                }
+                d[3] = uint8_t(PixDiv255(255 * sa + d[3] * (255 - sa)));
+            }
+            break;
+        }
+        case BlendMode::Add : 
+        case BlendMode::Subtract : {
+            // dstRGB = dstRGB +- srcRGB * srcA, dstA = dstA
+            for (int c = 0; c < 3; c++) {
+                int v = Premul ? s[c] : PixDiv255(s[c] * sa);
+                v = (Mode == BlendMode::Add) ? d[c] + v : d[c] - v;
+                d[c] = uint8_t(clamp(v, 0, 255));
+            }
+            break;
+        }
+        case BlendMode::Modulate : {
+            // dstRGB = srcRGB * dstRGB, dstA = dstA
+            for (int c = 0; c < 3; c++) {
+                d[c] = uint8_t(PixDiv255(s[c] * d[c]));
             }
-            if (!ft_alpha) {
-                sums[3] = 255.0;
+            break;
+        }
+        default : {
+            Btk_memcpy(d, s, 4);
+            break;
+        }
+    }
+}
+
+#if defined(BTK_PIXELS_SSE2)
+inline __m128i PixDiv255SSE2(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+// 2 pixels in 16 bits lanes, products are in [0, 65025], so the unsigned wrap is fine
+template <BlendMode Mode, bool Premul>
+inline __m128i PixBlend2SSE2(__m128i s, __m128i d) {
+    const __m128i amask = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i sa    = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+    switch (Mode) {
+        case BlendMode::Alpha : {
+            __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+            if (Premul) {
+                return _mm_add_epi16(s, PixDiv255SSE2(_mm_mullo_epi16(d, inv)));
             }
+            // Alpha of source as 255, dstA = srcA + dstA * (1 - srcA)
+            s = _mm_or_si128(s, amask);
+            return PixDiv255SSE2(_mm_add_epi16(_mm_mullo_epi16(s, sa), _mm_mullo_epi16(d, inv)));
+        }
+        case BlendMode::Add : 
+        case BlendMode::Subtract : {
+            __m128i c = Premul ? s : PixDiv255SSE2(_mm_mullo_epi16(s, sa));
+            c = _mm_andnot_si128(amask, c);
+            return (Mode == BlendMode::Add) ? _mm_add_epi16(d, c) : _mm_subs_epu16(d, c);
+        }
+        case BlendMode::Modulate : {
+            __m128i m = PixDiv255SSE2(_mm_mullo_epi16(s, d));
+            return _mm_or_si128(_mm_andnot_si128(amask, m), _mm_and_si128(amask, d));
+        }
+        default : {
+            return s;
+        }
+    }
+}
+#endif
+
+template <BlendMode Mode, bool Premul>
+void PixBlendRow(const uint8_t *src, uint8_t *dst, int n) {
+    int i = 0;
+#if defined(BTK_PIXELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i s  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        __m128i d  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+        __m128i lo = PixBlend2SSE2<Mode, Premul>(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = PixBlend2SSE2<Mode, Premul>(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < n; i++) {
+        PixBlendPixel<Mode, Premul>(src + i * 4, dst + i * 4);
+    }
+}
+
+PixBlendRowFn PixGetBlendRow(BlendMode mode, bool premultiplied) {
+    switch (mode) {
+        case BlendMode::Alpha    : return premultiplied ? PixBlendRow<BlendMode::Alpha, true>    : PixBlendRow<BlendMode::Alpha, false>;
+        case BlendMode::Add      : return premultiplied ? PixBlendRow<BlendMode::Add, true>      : PixBlendRow<BlendMode::Add, false>;
+        case BlendMode::Subtract : return premultiplied ? PixBlendRow<BlendMode::Subtract, true> : PixBlendRow<BlendMode::Subtract, false>;
+        case BlendMode::Modulate : return PixBlendRow<BlendMode::Modulate, false>;
+        default                  : return nullptr; //< Copy
+    }
+}
+
+}
+
+// YUV to RGB, the coefficients are in Q13 and the products in Q4 (same rounding in SIMD and scalar)
+namespace {
 
-            Color dst = Color(sums[0], sums[1], sums[2], sums[3]);
-            buf.set_color(x, y, dst);
+struct PixYuvCoeffs {
+    int16_t y_off; //< 16 on limited range
+    int16_t y_mul;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+
+    PixYuvCoeffs(YuvColorSpace space, YuvRange range) {
+        double kr = (space == YuvColorSpace::BT709) ? 0.2126 : 0.299;
+        double kb = (space == YuvColorSpace::BT709) ? 0.0722 : 0.114;
+        double kg = 1.0 - kr - kb;
+        double ys = 1.0;
+        double cs = 1.0;
+        y_off = 0;
+        if (range == YuvRange::Limited) {
+            ys    = 255.0 / 219.0;
+            cs    = 255.0 / 224.0;
+            y_off = 16;
         }
+        auto q13 = [](double v) {
+            return int16_t(std::lround(v * 8192.0));
+        };
+        y_mul = q13(ys);
+        rv    = q13(2.0 * (1.0 - kr) * cs);
+        gu    = q13(-2.0 * kb * (1.0 - kb) / kg * cs);
+        gv    = q13(-2.0 * kr * (1.0 - kr) / kg * cs);
+        bu    = q13(2.0 * (1.0 - kb) * cs);
     }
-    return buf;
+};
+
+enum PixYuvLayout : int {
+    PixYuvPlanar,     //< U and V planes in half width
+    PixYuvSemiPlanar, //< Interleaved UV plane in half width
+    PixYuvPacked,     //< Interleaved UV per pixel (resampled rows)
+};
+
+using PixYuvRowFn = void (*)(const PixYuvCoeffs &c, const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int n);
+
+inline int PixYuvMulHi(int a, int b) {
+    return (a * b) >> 16;
 }
-PixBuffer PixBuffer::blur(float r) const {
-    if (r <= 0) {
-        return ref();
+
+template <bool Bgra>
+inline void PixYuvPixel(const PixYuvCoeffs &c, int y, int u, int v, uint8_t *dst) {
+    y = PixYuvMulHi((y - c.y_off) * 128, c.y_mul);
+    u = (u - 128) * 128;
+    v = (v - 128) * 128;
+
+    int r = (y + PixYuvMulHi(v, c.rv) + 8) >> 4;
+    int g = (y + PixYuvMulHi(u, c.gu) + PixYuvMulHi(v, c.gv) + 8) >> 4;
+    int b = (y + PixYuvMulHi(u, c.bu) + 8) >> 4;
+
+    dst[Bgra ? 2 : 0] = uint8_t(clamp(r, 0, 255));
+    dst[1]            = uint8_t(clamp(g, 0, 255));
+    dst[Bgra ? 0 : 2] = uint8_t(clamp(b, 0, 255));
+    dst[3]            = 0xFF;
+}
+
+template <int Layout, bool Swap, bool Bgra>
+void PixYuvRow(const PixYuvCoeffs &c, const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int n) {
+    int x = 0;
+#if defined(BTK_PIXELS_SSE2)
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i low   = _mm_set1_epi16(0x00FF);
+    const __m128i bias  = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(8);
+    const __m128i alpha = _mm_set1_epi8(char(0xFF));
+    const __m128i y_off = _mm_set1_epi16(c.y_off);
+    const __m128i y_mul = _mm_set1_epi16(c.y_mul);
+    const __m128i rv    = _mm_set1_epi16(c.rv);
+    const __m128i gu    = _mm_set1_epi16(c.gu);
+    const __m128i gv    = _mm_set1_epi16(c.gv);
+    const __m128i bu    = _mm_set1_epi16(c.bu);
+
+    for (; x + 8 <= n; x += 8) {
+        __m128i yy = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x)), zero);
+
+        // 8 UV pairs in 16 bits lanes, U in the low byte
+        __m128i uv;
+        if (Layout == PixYuvPlanar) {
+            int32_t u4, v4;
+            Btk_memcpy(&u4, u + x / 2, 4);
+            Btk_memcpy(&v4, v + x / 2, 4);
+            uv = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), _mm_cvtsi32_si128(v4));
+            uv = _mm_unpacklo_epi16(uv, uv);
+        }
+        else if (Layout == PixYuvSemiPlanar) {
+            uv = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x));
+            uv = _mm_unpacklo_epi16(uv, uv);
+        }
+        else {
+            uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x * 2));
+        }
+        __m128i uu = _mm_and_si128(uv, low);
+        __m128i vv = _mm_srli_epi16(uv, 8);
+        if (Swap) {
+            std::swap(uu, vv);
+        }
+
+        yy = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(yy, y_off), 7), y_mul);
+        uu = _mm_slli_epi16(_mm_sub_epi16(uu, bias), 7);
+        vv = _mm_slli_epi16(_mm_sub_epi16(vv, bias), 7);
+        yy = _mm_add_epi16(yy, round);
+
+        __m128i r = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(vv, rv)), 4);
+        __m128i g = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(uu, gu)), _mm_mulhi_epi16(vv, gv)), 4);
+        __m128i b = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(uu, bu)), 4);
+        if (Bgra) {
+            std::swap(r, b);
+        }
+
+        // Saturate and interleave into 8 pixels
+        __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+        __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),     _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+    for (; x < n; x++) {
+        int cu, cv;
+        if (Layout == PixYuvPlanar) {
+            cu = u[x / 2];
+            cv = v[x / 2];
+        }
+        else if (Layout == PixYuvSemiPlanar) {
+            cu = u[x / 2 * 2];
+            cv = u[x / 2 * 2 + 1];
+        }
+        else {
+            cu = u[x * 2];
+            cv = u[x * 2 + 1];
+        }
+        if (Swap) {
+            std::swap(cu, cv);
+        }
+        PixYuvPixel<Bgra>(c, y[x], cu, cv, dst + x * 4);
+    }
+}
+
+PixYuvRowFn PixGetYuvRow(PixFormat src, bool bgra) {
+    switch (src) {
+        case PixFormat::NV12 : return bgra ? PixYuvRow<PixYuvSemiPlanar, false, true> : PixYuvRow<PixYuvSemiPlanar, false, false>;
+        case PixFormat::NV21 : return bgra ? PixYuvRow<PixYuvSemiPlanar, true, true>  : PixYuvRow<PixYuvSemiPlanar, true, false>;
+        case PixFormat::I420 : return bgra ? PixYuvRow<PixYuvPlanar, false, true>     : PixYuvRow<PixYuvPlanar, false, false>;
+        default              : return nullptr;
+    }
+}
+
+// Bilinear taps for resampling, the weight of i1 in 8 bits
+struct PixYuvTap {
+    int i0;
+    int i1;
+    int f;
+};
+
+std::vector<PixYuvTap> PixYuvTaps(int dst, int src, double ratio) {
+    std::vector<PixYuvTap> taps(dst);
+    for (int i = 0; i < dst; i++) {
+        double pos = clamp((i + 0.5) * ratio - 0.5, 0.0, double(src - 1));
+        int    i0  = int(pos);
+        taps[i].i0 = i0;
+        taps[i].i1 = min(i0 + 1, src - 1);
+        taps[i].f  = int(std::lround((pos - i0) * 256.0));
+    }
+    return taps;
+}
+
+inline uint8_t PixYuvSample(const uint8_t *r0, const uint8_t *r1, int fy, const PixYuvTap &tx, int step, int offset) {
+    int a = r0[tx.i0 * step + offset] * (256 - tx.f) + r0[tx.i1 * step + offset] * tx.f;
+    int b = r1[tx.i0 * step + offset] * (256 - tx.f) + r1[tx.i1 * step + offset] * tx.f;
+    return uint8_t((a * (256 - fy) + b * fy + 32768) >> 16);
+}
+
+}
+
+bool PixConvertYuv(
+    PixFormat src_fmt, const uint8_t *const planes[], const int pitches[], int src_w, int src_h, 
+    PixFormat dst_fmt, void *dst, int dst_pitch, int dst_w, int dst_h, 
+    YuvColorSpace space, YuvRange range) {
+
+    if (!PixIsYuv(src_fmt) || (dst_fmt != PixFormat::RGBA32 && dst_fmt != PixFormat::BGRA32)) {
+        return false;
+    }
+    if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0 || dst == nullptr) {
+        return false;
+    }
+
+    const PixYuvCoeffs coeffs(space, range);
+    const bool     bgra   = (dst_fmt == PixFormat::BGRA32);
+    const bool     planar = (src_fmt == PixFormat::I420);
+    const uint8_t *yp     = planes[0];
+    const uint8_t *up     = planes[1];
+    const uint8_t *vp     = planar ? planes[2] : nullptr;
+    auto           out    = static_cast<uint8_t*>(dst);
+
+    if (src_w == dst_w && src_h == dst_h) {
+        auto row = PixGetYuvRow(src_fmt, bgra);
+        PixParallelRows(dst_h, uint64_t(dst_w) * dst_h, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                row(
+                    coeffs,
+                    yp + ptrdiff_t(y) * pitches[0],
+                    up + ptrdiff_t(y / 2) * pitches[1],
+                    vp ? vp + ptrdiff_t(y / 2) * pitches[2] : nullptr,
+                    out + ptrdiff_t(y) * dst_pitch,
+                    dst_w
+                );
+            }
+        });
+        return true;
+    }
+
+    // Resample the planes into a Y row and a packed UV row, then convert them in the same pass
+    int  cw = (src_w + 1) / 2;
+    int  ch = (src_h + 1) / 2;
+    auto ytx = PixYuvTaps(dst_w, src_w, double(src_w) / dst_w);
+    auto yty = PixYuvTaps(dst_h, src_h, double(src_h) / dst_h);
+    auto ctx = PixYuvTaps(dst_w, cw, double(src_w) / dst_w / 2.0);
+    auto cty = PixYuvTaps(dst_h, ch, double(src_h) / dst_h / 2.0);
+    auto row = bgra ? PixYuvRow<PixYuvPacked, false, true> : PixYuvRow<PixYuvPacked, false, false>;
+
+    // NV21 is stored as VU
+    int uoff = (src_fmt == PixFormat::NV21) ? 1 : 0;
+    int step = planar ? 1 : 2;
+
+    PixParallelRows(dst_h, uint64_t(dst_w) * dst_h * 4, [&](int begin, int end) {
+        std::vector<uint8_t> ybuf(dst_w);
+        std::vector<uint8_t> uvbuf(dst_w * 2);
+        for (int y = begin; y < end; y++) {
+            const uint8_t *y0 = yp + ptrdiff_t(yty[y].i0) * pitches[0];
+            const uint8_t *y1 = yp + ptrdiff_t(yty[y].i1) * pitches[0];
+            const uint8_t *u0 = up + ptrdiff_t(cty[y].i0) * pitches[1];
+            const uint8_t *u1 = up + ptrdiff_t(cty[y].i1) * pitches[1];
+            const uint8_t *v0 = planar ? vp + ptrdiff_t(cty[y].i0) * pitches[2] : u0;
+            const uint8_t *v1 = planar ? vp + ptrdiff_t(cty[y].i1) * pitches[2] : u1;
+            for (int x = 0; x < dst_w; x++) {
+                ybuf[x]          = PixYuvSample(y0, y1, yty[y].f, ytx[x], 1, 0);
+                uvbuf[x * 2]     = PixYuvSample(u0, u1, cty[y].f, ctx[x], step, uoff);
+                uvbuf[x * 2 + 1] = PixYuvSample(v0, v1, cty[y].f, ctx[x], step, planar ? 0 : 1 - uoff);
+            }
+            row(coeffs, ybuf.data(), uvbuf.data(), nullptr, out + ptrdiff_t(y) * dst_pitch, dst_w);
+        }
+    });
+    return true;
+}
+
+PixBuffer PixBuffer::convert(PixFormat fmt) const {
+    if (PixIsYuv(_format)) {
+        // Most of the video / camera frames are BT.601 limited range, go through RGBA32 for other formats
+        if (fmt == _format) {
+            return clone();
+        }
+        if (fmt == PixFormat::RGBA32 || fmt == PixFormat::BGRA32) {
+            return convert(fmt, YuvColorSpace::BT601, YuvRange::Limited);
+        }
+        return convert(PixFormat::RGBA32, YuvColorSpace::BT601, YuvRange::Limited).convert(fmt);
+    }
+    PixBuffer dst(fmt, _width, _height);
+
+    auto row = PixGetRowConverter(_format, fmt);
+    if (row) {
+        auto src_pixels = static_cast<const uint8_t*>(_pixels);
+        auto dst_pixels = static_cast<uint8_t*>(dst._pixels);
+        for (int y = 0; y < _height; y++) {
+            row(src_pixels + y * _pitch, dst_pixels + y * dst._pitch, _width);
+        }
+        return dst;
+    }
+
+    // For each pixel convert to the new format
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            dst.set_color(x, y, color_at(x, y));
+        }
+    }
+    
+    return dst;
+}
+PixBuffer PixBuffer::convert(PixFormat fmt, YuvColorSpace space, YuvRange range, Size size) const {
+    if (size.w <= 0 || size.h <= 0) {
+        size = Size(_width, _height);
+    }
+    if (!PixIsYuv(_format) || empty() || (fmt != PixFormat::RGBA32 && fmt != PixFormat::BGRA32)) {
+        return PixBuffer();
+    }
+    PixBuffer dst(fmt, size.w, size.h);
+
+    const uint8_t *planes [3];
+    int            pitches[3];
+    for (int i = 0; i < 3; i++) {
+        planes[i]  = static_cast<const uint8_t*>(plane(i));
+        pitches[i] = plane_pitch(i);
+    }
+    if (!PixConvertYuv(_format, planes, pitches, _width, _height, fmt, dst._pixels, dst._pitch, dst._width, dst._height, space, range)) {
+        return PixBuffer();
+    }
+    return dst;
+}
+// Convolution on padded float RGBA rows, the borders are mirrored as before
+namespace {
+
+inline int PixMirror(int p, int n) {
+    if (p < 0) {
+        p = -p;
+    }
+    if (p >= n) {
+        p = n - (p - n + 1);
+    }
+    return clamp(p, 0, n - 1);
+}
+
+class PixConvKernel {
+    public:
+        std::vector<float> k;   //< kh * kw weights
+        std::vector<float> row; //< Horizontal weights if separable
+        std::vector<float> col; //< Vertical weights if separable
+        int                kw = 0;
+        int                kh = 0;
+        bool               separable = false;
+
+        PixConvKernel(const double *kernel, int w, int h) : k(kernel, kernel + w * h), kw(w), kh(h) {
+            if (kw == 1 || kh == 1) {
+                return;
+            }
+            // Rank 1 check, pivot on the largest weight
+            int    pivot = 0;
+            for (int i = 1; i < kw * kh; i++) {
+                if (std::abs(kernel[i]) > std::abs(kernel[pivot])) {
+                    pivot = i;
+                }
+            }
+            double top = kernel[pivot];
+            if (top == 0.0) {
+                return;
+            }
+            int pr = pivot / kw;
+            int pc = pivot % kw;
+
+            row.resize(kw);
+            col.resize(kh);
+            for (int x = 0; x < kw; x++) {
+                row[x] = float(kernel[pr * kw + x]);
+            }
+            for (int y = 0; y < kh; y++) {
+                col[y] = float(kernel[y * kw + pc] / top);
+            }
+            for (int y = 0; y < kh; y++) {
+                for (int x = 0; x < kw; x++) {
+                    double v = double(col[y]) * row[x];
+                    if (std::abs(v - kernel[y * kw + x]) > 1e-6 * std::abs(top)) {
+                        return;
+                    }
+                }
+            }
+            separable = true;
+        }
+};
+
+// Load padded rows, row i is the source row y0 + i (mirrored), xmap maps the padded columns
+void PixConvLoad(const uint8_t *pixels, int pitch, int h, const std::vector<int> &xmap, int y0, int rows, float *out) {
+    int pw = int(xmap.size());
+    for (int i = 0; i < rows; i++) {
+        const uint8_t *src = pixels + size_t(PixMirror(y0 + i, h)) * pitch;
+        float         *dst = out + size_t(i) * pw * 4;
+        for (int x = 0; x < pw; x++) {
+            const uint8_t *p = src + xmap[x] * 4;
+            dst[x * 4 + 0] = p[0];
+            dst[x * 4 + 1] = p[1];
+            dst[x * 4 + 2] = p[2];
+            dst[x * 4 + 3] = p[3];
+        }
+    }
+}
+// dst[x] = sum(k[i] * src[x + i * stride]), in pixels of 4 floats
+void PixConvRow(const float *src, size_t stride, const float *k, int n, float *dst, int w) {
+    for (int x = 0; x < w; x++) {
+        const float *s = src + size_t(x) * 4;
+#if defined(BTK_PIXELS_SSE2)
+        __m128 acc = _mm_setzero_ps();
+        for (int i = 0; i < n; i++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(k[i]), _mm_loadu_ps(s + i * stride)));
+        }
+        _mm_storeu_ps(dst + x * 4, acc);
+#else
+        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 4; c++) {
+                acc[c] += k[i] * s[i * stride + c];
+            }
+        }
+        Btk_memcpy(dst + x * 4, acc, sizeof(acc));
+#endif
+    }
+}
+// Add the row into acc
+void PixConvAccumulate(const float *src, float k, float *acc, int w) {
+    int n = w * 4;
+    int i = 0;
+#if defined(BTK_PIXELS_SSE2)
+    __m128 vk = _mm_set1_ps(k);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(vk, _mm_loadu_ps(src + i))));
+    }
+#endif
+    for (; i < n; i++) {
+        acc[i] += k * src[i];
+    }
+}
+// Clamp, truncate and store the row as RGBA32
+void PixConvStore(const float *src, uint8_t *dst, int w, bool keep_alpha) {
+    int x = 0;
+#if defined(BTK_PIXELS_SSE2)
+    const __m128  lo = _mm_setzero_ps();
+    const __m128  hi = _mm_set1_ps(255.0f);
+    const __m128i opaque = _mm_set1_epi32(keep_alpha ? 0 : int(0xFF000000));
+    for (; x + 4 <= w; x += 4) {
+        __m128i v[4];
+        for (int i = 0; i < 4; i++) {
+            v[i] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + (x + i) * 4), lo), hi));
+        }
+        __m128i p = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(p, opaque));
+    }
+#endif
+    for (; x < w; x++) {
+        for (int c = 0; c < 4; c++) {
+            dst[x * 4 + c] = uint8_t(clamp(src[x * 4 + c], 0.0f, 255.0f));
+        }
+        if (!keep_alpha) {
+            dst[x * 4 + 3] = 0xFF;
+        }
+    }
+}
+
+}
+
+PixBuffer PixBuffer::filter2d(const double *kernel, int kw, int kh, uint8_t ft_alpha) const {
+    if (empty() || kernel == nullptr || kw <= 0 || kh <= 0) {
+        return PixBuffer();
+    }
+    if (_format != PixFormat::RGBA32) {
+        return convert(PixFormat::RGBA32).filter2d(kernel, kw, kh, ft_alpha);
+    }
+
+    PixBuffer     buf(_width, _height);
+    PixConvKernel conv(kernel, kw, kh);
+
+    // Columns of the padded rows
+    std::vector<int> xmap(_width + kw - 1);
+    for (int x = 0; x < int(xmap.size()); x++) {
+        xmap[x] = PixMirror(x - kw / 2, _width);
+    }
+
+    auto src = static_cast<const uint8_t*>(_pixels);
+    auto dst = static_cast<uint8_t*>(buf._pixels);
+    int  pw  = int(xmap.size());
+
+    // Strips of rows, each one loads its padded rows
+    constexpr int strip = 32;
+    uint64_t work = uint64_t(_width) * _height * (conv.separable ? kw + kh : kw * kh);
+    PixParallelRows(_height, work, [&](int begin, int end) {
+        std::vector<float> padded(size_t(strip + kh - 1) * pw * 4);
+        std::vector<float> tmp(conv.separable ? size_t(strip + kh - 1) * _width * 4 : 0);
+        std::vector<float> acc(size_t(_width) * 4);
+
+        for (int y0 = begin; y0 < end; y0 += strip) {
+            int rows = min(strip, end - y0);
+            int prow = rows + kh - 1;
+            PixConvLoad(src, _pitch, _height, xmap, y0 - kh / 2, prow, padded.data());
+
+            if (conv.separable) {
+                // Horizontal, then vertical on the unclamped values
+                for (int i = 0; i < prow; i++) {
+                    PixConvRow(padded.data() + size_t(i) * pw * 4, 4, conv.row.data(), kw, tmp.data() + size_t(i) * _width * 4, _width);
+                }
+                for (int y = 0; y < rows; y++) {
+                    PixConvRow(tmp.data() + size_t(y) * _width * 4, size_t(_width) * 4, conv.col.data(), kh, acc.data(), _width);
+                    PixConvStore(acc.data(), dst + size_t(y0 + y) * buf._pitch, _width, ft_alpha);
+                }
+                continue;
+            }
+            for (int y = 0; y < rows; y++) {
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (int ky = 0; ky < kh; ky++) {
+                    const float *prow_ptr = padded.data() + size_t(y + ky) * pw * 4;
+                    for (int kx = 0; kx < kw; kx++) {
+                        float k = conv.k[ky * kw + kx];
+                        if (k != 0.0f) {
+                            PixConvAccumulate(prow_ptr + kx * 4, k, acc.data(), _width);
+                        }
+                    }
+                }
+                PixConvStore(acc.data(), dst + size_t(y0 + y) * buf._pitch, _width, ft_alpha);
+            }
+        }
+    });
+    return buf;
+}
+// Box blur kernels on 4 bytes pixels, edges are clamped
+namespace {
+
+std::array<int, 3> PixGaussianBoxes(float sigma) {
+    // From https://blog.ivank.net/fastest-gaussian-blur.html
+    constexpr int nbox = 3;
+
+    auto ideal = std::sqrt(12 * sigma * sigma / nbox + 1);
+    int  wl = std::floor(ideal);
+
+    if (wl % 2 == 0) {
+        wl -= 1;
+    }
+
+    int wu = wl + 2;
+
+    ideal = (12 * sigma * sigma - nbox * wl * wl - 4 * nbox * wl - 3 * nbox) / (-4 * wl - 4);
+    int m = std::round(ideal);
+
+    std::array<int, 3> ret;
+    for (int i = 0; i < nbox; i ++) {
+        ret[i] = i < m ? wl : wu;
+    }
+    return ret;
+}
+
+// Blur one row, the running sum of 4 channels lives in one register
+void PixBoxBlurRow(const uint8_t *src, uint8_t *dst, int w, int r) {
+    float inv  = 1.0f / float(r + r + 1);
+    auto  at   = [&](int x) { return src + clamp(x, 0, w - 1) * 4; };
+
+#if defined(BTK_PIXELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128  vinv = _mm_set1_ps(inv);
+    auto load = [&](const uint8_t *p) {
+        uint32_t v;
+        Btk_memcpy(&v, p, sizeof(v));
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(v)), zero), zero);
+    };
+
+    auto step = [&](int x, const uint8_t *add, const uint8_t *sub, __m128i &sum) {
+        sum = _mm_add_epi32(sum, load(add));
+        sum = _mm_sub_epi32(sum, load(sub));
+
+        __m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), vinv));
+        v = _mm_packs_epi32(v, v);
+        uint32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+        Btk_memcpy(dst + x * 4, &out, sizeof(out));
+    };
+
+    // Window of x = -1
+    __m128i sum = zero;
+    for (int x = -r - 1; x < r; x++) {
+        sum = _mm_add_epi32(sum, load(at(x)));
+    }
+    // Clamp only on the edges
+    int lend = min(r + 1, w);
+    int mend = max(w - r, lend);
+    int x = 0;
+    for (; x < lend; x++) {
+        step(x, at(x + r), at(x - r - 1), sum);
+    }
+    for (; x < mend; x++) {
+        step(x, src + (x + r) * 4, src + (x - r - 1) * 4, sum);
+    }
+    for (; x < w; x++) {
+        step(x, at(x + r), at(x - r - 1), sum);
+    }
+#else
+    int sum[4] = {0, 0, 0, 0};
+    for (int x = -r - 1; x < r; x++) {
+        for (int c = 0; c < 4; c++) {
+            sum[c] += at(x)[c];
+        }
+    }
+    for (int x = 0; x < w; x++) {
+        auto add = at(x + r);
+        auto sub = at(x - r - 1);
+        for (int c = 0; c < 4; c++) {
+            sum[c] += add[c] - sub[c];
+            dst[x * 4 + c] = uint8_t(clamp(int(std::nearbyint(sum[c] * inv)), 0, 255));
+        }
+    }
+#endif
+}
+
+// Run all boxes on rows [begin, end), in place
+void PixBoxBlurRows(uint8_t *pixels, int pitch, int w, int begin, int end, const std::array<int, 3> &boxes) {
+    std::vector<uint8_t> a(size_t(w) * 4);
+    std::vector<uint8_t> b(size_t(w) * 4);
+    for (int y = begin; y < end; y++) {
+        uint8_t *row = pixels + size_t(y) * pitch;
+        PixBoxBlurRow(row, a.data(), w, (boxes[0] - 1) / 2);
+        PixBoxBlurRow(a.data(), b.data(), w, (boxes[1] - 1) / 2);
+        PixBoxBlurRow(b.data(), row, w, (boxes[2] - 1) / 2);
+    }
+}
+
+// Transpose 4 bytes pixels in tiles, columns [begin, end) of src become rows of dst
+void PixTranspose(const uint8_t *src, int src_pitch, uint8_t *dst, int dst_pitch, int h, int begin, int end) {
+    constexpr int tile = 16;
+
+    for (int tx = begin; tx < end; tx += tile) {
+        int txe = min(tx + tile, end);
+        for (int ty = 0; ty < h; ty += tile) {
+            int tye = min(ty + tile, h);
+
+            int x = tx;
+#if defined(BTK_PIXELS_SSE2)
+            for (; x + 4 <= txe; x += 4) {
+                int y = ty;
+                for (; y + 4 <= tye; y += 4) {
+                    auto ld = [&](int i) {
+                        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + size_t(y + i) * src_pitch + x * 4));
+                    };
+                    __m128i r0 = ld(0), r1 = ld(1), r2 = ld(2), r3 = ld(3);
+                    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+                    __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+                    __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+                    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+                    auto st = [&](int i, __m128i v) {
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + size_t(x + i) * dst_pitch + y * 4), v);
+                    };
+                    st(0, _mm_unpacklo_epi64(t0, t1));
+                    st(1, _mm_unpackhi_epi64(t0, t1));
+                    st(2, _mm_unpacklo_epi64(t2, t3));
+                    st(3, _mm_unpackhi_epi64(t2, t3));
+                }
+                for (; y < tye; y++) {
+                    for (int i = 0; i < 4; i++) {
+                        Btk_memcpy(dst + size_t(x + i) * dst_pitch + y * 4, src + size_t(y) * src_pitch + (x + i) * 4, 4);
+                    }
+                }
+            }
+#endif
+            for (; x < txe; x++) {
+                for (int y = ty; y < tye; y++) {
+                    Btk_memcpy(dst + size_t(x) * dst_pitch + y * 4, src + size_t(y) * src_pitch + x * 4, 4);
+                }
+            }
+        }
+    }
+}
+
+}
+
+PixBuffer PixBuffer::blur(float r) const {
+    if (r <= 0 || empty()) {
+        return ref();
+    }
+    if (bytes_per_pixel() != 4) {
+        return convert(PixFormat::RGBA32).blur(r);
+    }
+
+    // 3 box passes approximate the gaussian, rows first, then rows of the transposed one
+    auto boxes = PixGaussianBoxes(r);
+
+    PixBuffer dest(_format, _width, _height);
+    PixBuffer trans(_format, _height, _width);
+    auto dpixels = static_cast<uint8_t*>(dest._pixels);
+    auto tpixels = static_cast<uint8_t*>(trans._pixels);
+    for (int y = 0; y < _height; y++) {
+        Btk_memcpy(dpixels + size_t(y) * dest._pitch, static_cast<const uint8_t*>(_pixels) + size_t(y) * _pitch, size_t(_width) * 4);
+    }
+
+    uint64_t work = uint64_t(_width) * _height * 3;
+    PixParallelRows(_height, work, [&](int begin, int end) {
+        PixBoxBlurRows(dpixels, dest._pitch, _width, begin, end, boxes);
+    });
+    PixParallelRows(_width, work, [&](int begin, int end) {
+        PixTranspose(dpixels, dest._pitch, tpixels, trans._pitch, _height, begin, end);
+    });
+    PixParallelRows(_width, work, [&](int begin, int end) {
+        PixBoxBlurRows(tpixels, trans._pitch, _height, begin, end, boxes);
+    });
+    PixParallelRows(_height, work, [&](int begin, int end) {
+        PixTranspose(tpixels, trans._pitch, dpixels, dest._pitch, _width, begin, end);
+    });
+    return dest;
+}
+
+void PixBuffer::bilt(const PixBuffer &buf, const Rect *dst, const Rect *src) {
+    bilt(buf, dst, src, BlendMode::None);
+}
+void PixBuffer::bilt(const PixBuffer &buf, const Rect *_dst, const Rect *_src, BlendMode mode, bool premultiplied) {
+    if (empty() || buf.empty()) {
+        return;
+    }
+    if (_dst == nullptr && _src == nullptr && mode == BlendMode::None && 
+        size() == buf.size() && format() == buf.format() && pitch() == buf.pitch()) {
+        // All same, just memcpy
+        Btk_memcpy(_pixels, buf._pixels, size_t(_pitch) * _height);
+        return;
+    }
+
+    Rect dst = _dst ? *_dst : Rect(0, 0, _width, _height);
+    Rect src = _src ? *_src : Rect(0, 0, buf._width, buf._height);
+    if (dst.empty() || src.empty()) {
+        return;
+    }
+
+    // Clip the source, shrink the destination in the same scale
+    Rect sclip = src.intersected(Rect(0, 0, buf._width, buf._height));
+    if (sclip.empty()) {
+        return;
+    }
+    if (sclip != src) {
+        float sx = float(dst.w) / float(src.w);
+        float sy = float(dst.h) / float(src.h);
+        int   x1 = dst.x + int(std::lround((sclip.x - src.x) * sx));
+        int   y1 = dst.y + int(std::lround((sclip.y - src.y) * sy));
+        int   x2 = dst.x + int(std::lround((sclip.x + sclip.w - src.x) * sx));
+        int   y2 = dst.y + int(std::lround((sclip.y + sclip.h - src.y) * sy));
+        dst = Rect(x1, y1, x2 - x1, y2 - y1);
+        src = sclip;
+    }
+    // Clip the destination, the mapping is kept
+    Rect dclip = dst.intersected(Rect(0, 0, _width, _height));
+    if (dclip.empty()) {
+        return;
+    }
+
+    // Blend in 4 bytes, other destination formats are converted by rows
+    bool      direct = bytes_per_pixel() == 4;
+    PixFormat work   = direct ? _format : PixFormat::RGBA32;
+    auto copy_row = PixGetRowConverter(buf._format, _format);
+    auto src_row  = PixGetRowConverter(buf._format, work);
+    auto dst_in   = PixGetRowConverter(_format, work);
+    auto dst_out  = PixGetRowConverter(work, _format);
+    auto blend    = PixGetBlendRow(mode, premultiplied);
+    if (!copy_row || !src_row || !dst_in || !dst_out) {
+        BTK_LOG("[PixBuffer::bilt] Unsupported format\n");
+        return;
+    }
+
+    int  n      = dclip.w;
+    int  sbpp   = buf.bytes_per_pixel();
+    int  dbpp   = bytes_per_pixel();
+    bool scaled = dst.w != src.w || dst.h != src.h;
+
+    // Nearest source column of each destination pixel
+    std::vector<int>     xmap;
+    std::vector<uint8_t> gather;
+    std::vector<uint8_t> srow;
+    std::vector<uint8_t> drow;
+    if (scaled) {
+        xmap.resize(n);
+        gather.resize(size_t(n) * sbpp);
+        for (int i = 0; i < n; i++) {
+            int xoff = dclip.x + i - dst.x;
+            xmap[i] = src.x + int((int64_t(xoff) * 2 + 1) * src.w / (int64_t(dst.w) * 2));
+        }
+    }
+    if (blend) {
+        srow.resize(size_t(n) * 4);
+        if (!direct) {
+            drow.resize(size_t(n) * 4);
+        }
+    }
+
+    auto spixels = static_cast<const uint8_t*>(buf._pixels);
+    auto dpixels = static_cast<uint8_t*>(_pixels);
+    for (int y = dclip.y; y < dclip.y + dclip.h; y++) {
+        int yoff = y - dst.y;
+        int sy   = src.y + int((int64_t(yoff) * 2 + 1) * src.h / (int64_t(dst.h) * 2));
+
+        const uint8_t *sp = spixels + size_t(sy) * buf._pitch;
+        uint8_t       *dp = dpixels + size_t(y) * _pitch + size_t(dclip.x) * dbpp;
+        if (scaled) {
+            for (int i = 0; i < n; i++) {
+                Btk_memcpy(&gather[size_t(i) * sbpp], sp + size_t(xmap[i]) * sbpp, sbpp);
+            }
+            sp = gather.data();
+        }
+        else {
+            sp += size_t(src.x + dclip.x - dst.x) * sbpp;
+        }
+
+        if (!blend) {
+            copy_row(sp, dp, n);
+            continue;
+        }
+        src_row(sp, srow.data(), n);
+        if (direct) {
+            blend(srow.data(), dp, n);
+        }
+        else {
+            dst_in(dp, drow.data(), n);
+            blend(srow.data(), drow.data(), n);
+            dst_out(drow.data(), dp, n);
+        }
+    }
+}
+
+// Write to
+// Encoders, png and qoi are written by ourself on all platforms
+namespace {
+
+uint32_t PixCrc32(uint32_t crc, const uint8_t *p, size_t n) {
+    static const auto table = []() {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+uint32_t PixAdler32(const uint8_t *p, size_t n) {
+    uint32_t a = 1, b = 0;
+    while (n > 0) {
+        // 5552 is the largest block without overflow
+        size_t block = min(n, size_t(5552));
+        for (size_t i = 0; i < block; i++) {
+            a += p[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        p += block;
+        n -= block;
+    }
+    return (b << 16) | a;
+}
+void PixPutBE32(std::vector<uint8_t> &out, uint32_t v) {
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+// LSB first bit writer of deflate
+class PixBitWriter {
+    public:
+        PixBitWriter(std::vector<uint8_t> &o) : out(o) {}
+
+        void put(uint32_t bits, int n) {
+            acc |= uint64_t(bits) << nbits;
+            nbits += n;
+            while (nbits >= 8) {
+                out.push_back(uint8_t(acc));
+                acc >>= 8;
+                nbits -= 8;
+            }
+        }
+        void align() {
+            if (nbits > 0) {
+                out.push_back(uint8_t(acc));
+            }
+            acc = 0;
+            nbits = 0;
+        }
+    private:
+        std::vector<uint8_t> &out;
+        uint64_t              acc = 0;
+        int                   nbits = 0;
+};
+
+// Length limited huffman code lengths, frequencies are flattened until it fits
+void PixHuffmanLengths(const uint32_t *freq, int n, int limit, uint8_t *lengths) {
+    struct Node {
+        uint32_t freq;
+        int      left;
+        int      right;
+    };
+    std::vector<uint32_t> f(freq, freq + n);
+    std::vector<Node>     nodes;
+    std::vector<int>      heap;
+    std::vector<std::pair<int, int>> stack;
+
+    for (;;) {
+        Btk_memset(lengths, 0, n);
+        nodes.clear();
+        heap.clear();
+        for (int i = 0; i < n; i++) {
+            if (f[i] > 0) {
+                nodes.push_back({f[i], -1, i});
+            }
+        }
+        if (nodes.empty()) {
+            return;
+        }
+        if (nodes.size() == 1) {
+            lengths[nodes[0].right] = 1;
+            return;
+        }
+        auto greater = [&](int a, int b) {
+            return nodes[a].freq > nodes[b].freq;
+        };
+        for (int i = 0; i < int(nodes.size()); i++) {
+            heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), greater);
+        while (heap.size() > 1) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            int a = heap.back();
+            heap.pop_back();
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            int b = heap.back();
+            heap.pop_back();
+
+            nodes.push_back({nodes[a].freq + nodes[b].freq, a, b});
+            heap.push_back(int(nodes.size()) - 1);
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+
+        // Walk the tree, leaves have left == -1 and the symbol in right
+        int maxlen = 0;
+        stack.clear();
+        stack.emplace_back(heap[0], 0);
+        while (!stack.empty()) {
+            auto [node, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[node].left < 0) {
+                lengths[nodes[node].right] = uint8_t(min(depth, 255));
+                maxlen = max(maxlen, depth);
+                continue;
+            }
+            stack.emplace_back(nodes[node].left, depth + 1);
+            stack.emplace_back(nodes[node].right, depth + 1);
+        }
+        if (maxlen <= limit) {
+            return;
+        }
+        for (auto &v : f) {
+            if (v > 0) {
+                v = (v >> 1) | 1;
+            }
+        }
+    }
+}
+// Canonical codes, reversed for the LSB first writer
+void PixHuffmanCodes(const uint8_t *lengths, int n, uint16_t *codes) {
+    uint16_t count[16] = {};
+    uint16_t next[16]  = {};
+    for (int i = 0; i < n; i++) {
+        count[lengths[i]] += 1;
+    }
+    count[0] = 0;
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (len == 0) {
+            codes[i] = 0;
+            continue;
+        }
+        uint16_t c = next[len]++;
+        uint16_t r = 0;
+        for (int b = 0; b < len; b++) {
+            r = (r << 1) | ((c >> b) & 1);
+        }
+        codes[i] = r;
+    }
+}
+
+// Deflate symbols, dist == 0 on literal
+struct PixLZSymbol {
+    uint16_t litlen;
+    uint16_t dist;
+};
+
+constexpr uint16_t PixLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+constexpr uint8_t  PixLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+constexpr uint16_t PixDistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+constexpr uint8_t  PixDistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Code index of length 3 ~ 258 and distance 1 ~ 32768
+struct PixDeflateTables {
+    std::array<uint8_t, 259>   length;
+    std::vector<uint8_t>       dist;
+
+    PixDeflateTables() : dist(32769) {
+        for (int c = 0; c < 29; c++) {
+            int end = (c == 28) ? 259 : PixLengthBase[c] + (1 << PixLengthExtra[c]);
+            for (int l = PixLengthBase[c]; l < end && l < 259; l++) {
+                length[l] = uint8_t(c);
+            }
+        }
+        length[258] = 28;
+        for (int c = 0; c < 30; c++) {
+            int end = min(PixDistBase[c] + (1 << PixDistExtra[c]), 32769);
+            for (int d = PixDistBase[c]; d < end; d++) {
+                dist[d] = uint8_t(c);
+            }
+        }
+    }
+    static const PixDeflateTables &Get() {
+        static PixDeflateTables tables;
+        return tables;
+    }
+};
+
+// Write a dynamic huffman block
+void PixDeflateBlock(PixBitWriter &bw, const std::vector<PixLZSymbol> &syms, bool final) {
+    static constexpr uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    auto &tables = PixDeflateTables::Get();
+
+    uint32_t lfreq[286] = {};
+    uint32_t dfreq[30]  = {};
+    for (auto sym : syms) {
+        if (sym.dist == 0) {
+            lfreq[sym.litlen] += 1;
+            continue;
+        }
+        lfreq[257 + tables.length[sym.litlen]] += 1;
+        dfreq[tables.dist[sym.dist]] += 1;
+    }
+    lfreq[256] = 1;
+
+    uint8_t  llen[286], dlen[30];
+    uint16_t lcode[286], dcode[30];
+    PixHuffmanLengths(lfreq, 286, 15, llen);
+    PixHuffmanLengths(dfreq, 30, 15, dlen);
+
+    // Keep the distance code complete, it may be unused or single
+    int used = 0;
+    for (int i = 0; i < 30; i++) {
+        used += dlen[i] != 0;
+    }
+    if (used < 2) {
+        for (int i = 0; i < 30 && used < 2; i++) {
+            if (dlen[i] == 0) {
+                dlen[i] = 1;
+                used += 1;
+            }
+        }
+    }
+    PixHuffmanCodes(llen, 286, lcode);
+    PixHuffmanCodes(dlen, 30, dcode);
+
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && llen[hlit - 1] == 0) {
+        hlit -= 1;
+    }
+    while (hdist > 1 && dlen[hdist - 1] == 0) {
+        hdist -= 1;
+    }
+
+    // Run length of the code lengths, (symbol, extra bits value)
+    uint8_t lens[286 + 30];
+    int     nlens = 0;
+    for (int i = 0; i < hlit; i++) {
+        lens[nlens++] = llen[i];
+    }
+    for (int i = 0; i < hdist; i++) {
+        lens[nlens++] = dlen[i];
+    }
+    std::vector<std::pair<uint8_t, uint8_t>> rle;
+    uint32_t cfreq[19] = {};
+    for (int i = 0; i < nlens;) {
+        int v   = lens[i];
+        int run = 1;
+        while (i + run < nlens && lens[i + run] == v) {
+            run += 1;
+        }
+        if (v == 0 && run >= 3) {
+            int n = min(run, 138);
+            if (n >= 11) {
+                rle.emplace_back(18, n - 11);
+            }
+            else {
+                rle.emplace_back(17, n - 3);
+            }
+            i += n;
+        }
+        else if (v != 0 && run >= 4) {
+            rle.emplace_back(v, 0);
+            int n = min(run - 1, 6);
+            rle.emplace_back(16, n - 3);
+            i += n + 1;
+        }
+        else {
+            rle.emplace_back(v, 0);
+            i += 1;
+        }
+    }
+    for (auto [sym, extra] : rle) {
+        cfreq[sym] += 1;
+    }
+    uint8_t  clen[19];
+    uint16_t ccode[19];
+    PixHuffmanLengths(cfreq, 19, 7, clen);
+    PixHuffmanCodes(clen, 19, ccode);
+
+    int hclen = 19;
+    while (hclen > 4 && clen[order[hclen - 1]] == 0) {
+        hclen -= 1;
+    }
+
+    // Header
+    bw.put(final ? 1 : 0, 1);
+    bw.put(2, 2);
+    bw.put(hlit - 257, 5);
+    bw.put(hdist - 1, 5);
+    bw.put(hclen - 4, 4);
+    for (int i = 0; i < hclen; i++) {
+        bw.put(clen[order[i]], 3);
+    }
+    for (auto [sym, extra] : rle) {
+        bw.put(ccode[sym], clen[sym]);
+        if (sym == 16) {
+            bw.put(extra, 2);
+        }
+        else if (sym == 17) {
+            bw.put(extra, 3);
+        }
+        else if (sym == 18) {
+            bw.put(extra, 7);
+        }
+    }
+
+    // Data
+    for (auto sym : syms) {
+        if (sym.dist == 0) {
+            bw.put(lcode[sym.litlen], llen[sym.litlen]);
+            continue;
+        }
+        int lc = tables.length[sym.litlen];
+        bw.put(lcode[257 + lc], llen[257 + lc]);
+        bw.put(sym.litlen - PixLengthBase[lc], PixLengthExtra[lc]);
+
+        int dc = tables.dist[sym.dist];
+        bw.put(dcode[dc], dlen[dc]);
+        bw.put(sym.dist - PixDistBase[dc], PixDistExtra[dc]);
+    }
+    bw.put(lcode[256], llen[256]);
+}
+
+// Zlib stream of data, level 0 stores, higher levels search longer hash chains
+void PixZlibCompress(const uint8_t *data, size_t n, int level, std::vector<uint8_t> &out) {
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    PixBitWriter bw(out);
+    if (level <= 0) {
+        size_t pos = 0;
+        do {
+            size_t len = min(n - pos, size_t(65535));
+            bool   final = pos + len == n;
+            bw.put(final ? 1 : 0, 1);
+            bw.put(0, 2);
+            bw.align();
+            out.push_back(uint8_t(len));
+            out.push_back(uint8_t(len >> 8));
+            out.push_back(uint8_t(~len));
+            out.push_back(uint8_t(~len >> 8));
+            out.insert(out.end(), data + pos, data + pos + len);
+            pos += len;
+        }
+        while (pos < n);
+    }
+    else {
+        static constexpr int chains[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+
+        constexpr int    window = 32768;
+        constexpr size_t block  = 1 << 16; //< Symbols per block
+        int max_chain = chains[min(level, 9)];
+        int nice_len  = level < 4 ? 32 : (level < 7 ? 128 : 258);
+
+        std::vector<int32_t>     head(1 << 15, -1);
+        std::vector<int32_t>     prev(window, -1);
+        std::vector<PixLZSymbol> syms;
+        syms.reserve(block);
+
+        auto hash = [&](size_t i) {
+            uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+            return (v * 2654435761u) >> 17;
+        };
+        auto insert = [&](size_t i) {
+            auto h = hash(i);
+            prev[i & (window - 1)] = head[h];
+            head[h] = int32_t(i);
+        };
+
+        size_t i = 0;
+        while (i < n) {
+            int best_len  = 0;
+            int best_dist = 0;
+            if (i + 3 <= n) {
+                int     limit = int(min(n - i, size_t(258)));
+                int32_t cand  = head[hash(i)];
+                int     chain = max_chain;
+                while (cand >= 0 && i - cand <= size_t(window) && chain-- > 0 && best_len < limit) {
+                    const uint8_t *a = data + cand;
+                    const uint8_t *b = data + i;
+                    if (a[best_len] == b[best_len]) {
+                        int len = 0;
+                        while (len + 8 <= limit) {
+                            uint64_t x, y;
+                            Btk_memcpy(&x, a + len, 8);
+                            Btk_memcpy(&y, b + len, 8);
+                            if (x != y) {
+#if defined(_MSC_VER)
+                                unsigned long bit;
+                                _BitScanForward64(&bit, x ^ y);
+                                len += int(bit >> 3);
+#else
+                                len += __builtin_ctzll(x ^ y) >> 3;
+#endif
+                                goto matched;
+                            }
+                            len += 8;
+                        }
+                        while (len < limit && a[len] == b[len]) {
+                            len += 1;
+                        }
+                    matched:
+                        if (len > best_len) {
+                            best_len  = len;
+                            best_dist = int(i - cand);
+                            if (len >= nice_len) {
+                                break;
+                            }
+                        }
+                    }
+                    cand = prev[cand & (window - 1)];
+                }
+                insert(i);
+            }
+            if (best_len >= 3) {
+                syms.push_back({uint16_t(best_len), uint16_t(best_dist)});
+                for (size_t j = i + 1; j < i + best_len && j + 3 <= n; j++) {
+                    insert(j);
+                }
+                i += best_len;
+            }
+            else {
+                syms.push_back({data[i], 0});
+                i += 1;
+            }
+            if (syms.size() == block) {
+                PixDeflateBlock(bw, syms, i == n);
+                syms.clear();
+            }
+        }
+        if (!syms.empty() || n == 0) {
+            PixDeflateBlock(bw, syms, true);
+        }
+        bw.align();
+    }
+    PixPutBE32(out, PixAdler32(data, n));
+}
+
+uint8_t PixPaeth(int a, int b, int c) {
+    int p  = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return uint8_t(a);
+    }
+    return uint8_t(pb <= pc ? b : c);
+}
+// Filter a row with the given type, prev is nullptr on the first row
+void PixPngFilter(int type, const uint8_t *row, const uint8_t *prev, int bytes, int bpp, uint8_t *out) {
+    if (!prev) {
+        // Without the previous row, up is none and paeth is sub
+        if (type == 0 || type == 2) {
+            Btk_memcpy(out, row, bytes);
+            return;
+        }
+        for (int i = 0; i < bytes; i++) {
+            int a = i >= bpp ? row[i - bpp] : 0;
+            out[i] = uint8_t(row[i] - (type == 3 ? a >> 1 : a));
+        }
+        return;
+    }
+    int i = 0;
+    switch (type) {
+        case 0 :
+            Btk_memcpy(out, row, bytes);
+            break;
+        case 1 :
+            for (; i < bpp; i++) {
+                out[i] = row[i];
+            }
+            for (; i < bytes; i++) {
+                out[i] = uint8_t(row[i] - row[i - bpp]);
+            }
+            break;
+        case 2 :
+            for (; i < bytes; i++) {
+                out[i] = uint8_t(row[i] - prev[i]);
+            }
+            break;
+        case 3 :
+            for (; i < bpp; i++) {
+                out[i] = uint8_t(row[i] - (prev[i] >> 1));
+            }
+            for (; i < bytes; i++) {
+                out[i] = uint8_t(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+            }
+            break;
+        default :
+            for (; i < bpp; i++) {
+                out[i] = uint8_t(row[i] - prev[i]);
+            }
+            for (; i < bytes; i++) {
+                out[i] = uint8_t(row[i] - PixPaeth(row[i - bpp], prev[i], prev[i - bpp]));
+            }
+            break;
     }
+}
+void PixPngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t n) {
+    PixPutBE32(out, uint32_t(n));
+    size_t begin = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + n);
+    PixPutBE32(out, PixCrc32(0, out.data() + begin, n + 4));
+}
 
-    // Fast blur algorithm from https://blog.ivank.net/fastest-gaussian-blur.html
-    PixBuffer dest(_width, _height);
-    PixBuffer source = clone();
-
-    auto make_guassion_box = [](float sigma, int nbox) -> std::array<int, 3> {
-        assert(nbox == 3);
-
-        auto ideal = std::sqrt(12 * sigma * sigma *nbox + 1);
-        int  wl = std::floor(ideal);
-
-        if (wl % 2 == 0) {
-            wl -= 1;
-        }
-
-        int wu = wl + 2;
-
-        ideal = (12 * sigma * sigma - nbox * wl * wl - 4 * nbox *wl - 3 * nbox) / (-4 * wl - 4);
-        int m = std::round(ideal);
-
-        std::array<int, 3> ret;
-        for (int i = 0;i < nbox; i ++) {
-            ret[i] = i < m ? wl : wu;
+// Encode 8 bits RGB or RGBA rows as png
+void PixEncodePng(const uint8_t *pixels, int pitch, int w, int h, int channels, int level, std::vector<uint8_t> &out) {
+    static constexpr uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.insert(out.end(), signature, signature + 8);
+
+    std::vector<uint8_t> ihdr;
+    PixPutBE32(ihdr, w);
+    PixPutBE32(ihdr, h);
+    ihdr.push_back(8);
+    ihdr.push_back(channels == 4 ? 6 : 2);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    PixPngChunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    // Level 0 keeps rows as is, 1 uses sub, others choose the filter with the least sum per row
+    int    bytes = w * channels;
+    size_t line  = size_t(bytes) + 1;
+    std::vector<uint8_t> filtered(line * h);
+    PixParallelRows(h, uint64_t(bytes) * h * (level >= 2 ? 5 : 1), [&](int begin, int end) {
+        std::vector<uint8_t> trial(bytes);
+        for (int y = begin; y < end; y++) {
+            const uint8_t *row  = pixels + size_t(y) * pitch;
+            const uint8_t *prev = y > 0 ? row - pitch : nullptr;
+            uint8_t       *dst  = filtered.data() + line * y;
+
+            int type = level <= 0 ? 0 : 1;
+            if (level >= 2) {
+                uint64_t best = UINT64_MAX;
+                for (int t = 0; t < 5; t++) {
+                    PixPngFilter(t, row, prev, bytes, channels, trial.data());
+                    uint64_t sum = 0;
+                    for (int i = 0; i < bytes; i++) {
+                        sum += std::abs(int8_t(trial[i]));
+                    }
+                    if (sum < best) {
+                        best = sum;
+                        type = t;
+                    }
+                }
+            }
+            dst[0] = uint8_t(type);
+            PixPngFilter(type, row, prev, bytes, channels, dst + 1);
         }
-        return ret;
-    };
-    auto round_color = [](int64_t sums[4], float factor) -> Color {
-        return Color(
-            std::round(sums[0] * factor),
-            std::round(sums[1] * factor),
-            std::round(sums[2] * factor),
-            std::round(sums[3] * factor)
-        );
-    };
-    auto do_boxlur_h = [&](PixBuffer &dst, const PixBuffer &src, int r) {
-        float factor = 1.0f / (r + r + 1);
-        for (int i = 0;i < src.height(); i++) {
-            int ti = i * src.width(), li = ti, ri = ti + r;
-            auto fv = src.color_at(ti, 0);
-            auto lv = src.color_at(ti + src.width() - 1, 0);
+    });
 
-            int64_t sums[4];
-            sums[0] = (r + 1) * int64_t(fv.r);
-            sums[1] = (r + 1) * int64_t(fv.g);
-            sums[2] = (r + 1) * int64_t(fv.b);
-            sums[3] = (r + 1) * int64_t(fv.a);
-
-            for(int j = 0  ; j <  r ; j++) {
-                auto c = src.color_at(ti + j, 0);
-                sums[0] += c.r;
-                sums[1] += c.g;
-                sums[2] += c.b;
-                sums[3] += c.a;
-            }
-            for(int j = 0  ; j <= r ; j++) {
-                auto c = src.color_at(ri++, 0);
-                sums[0] += c.r - fv.r;
-                sums[1] += c.g - fv.g;
-                sums[2] += c.b - fv.b;
-                sums[3] += c.a - fv.a;
+    std::vector<uint8_t> zlib;
+    PixZlibCompress(filtered.data(), filtered.size(), level, zlib);
+    PixPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    PixPngChunk(out, "IEND", nullptr, 0);
+}
 
-                dst.set_color(ti++, 0, round_color(sums, factor));
+// Encode 8 bits RGB or RGBA rows as qoi
+void PixEncodeQoi(const uint8_t *pixels, int pitch, int w, int h, int channels, std::vector<uint8_t> &out) {
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    PixPutBE32(out, w);
+    PixPutBE32(out, h);
+    out.push_back(uint8_t(channels));
+    out.push_back(0);
+    out.reserve(out.size() + size_t(w) * h * (channels + 1) + 8);
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4]   = {0, 0, 0, 255};
+    uint8_t prev[4] = {0, 0, 0, 255};
+    int     run = 0;
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = pixels + size_t(y) * pitch;
+        for (int x = 0; x < w; x++) {
+            Btk_memcpy(px, row + x * channels, channels);
+            if (Btk_memcmp(px, prev, 4) == 0) {
+                run += 1;
+                if (run == 62) {
+                    out.push_back(uint8_t(0xC0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
             }
-            for(int j = r + 1; j < src.width() - r; j++) { 
-                auto a = src.color_at(ri++, 0);
-                auto b = src.color_at(li++, 0);
-
-                sums[0] += int64_t(a.r) - int64_t(b.r);
-                sums[1] += int64_t(a.g) - int64_t(b.g);
-                sums[2] += int64_t(a.b) - int64_t(b.b);
-                sums[3] += int64_t(a.a) - int64_t(b.a);
-
-                dst.set_color(ti++, 0, round_color(sums, factor));
+            if (run > 0) {
+                out.push_back(uint8_t(0xC0 | (run - 1)));
+                run = 0;
             }
-            for(int j = src.width() - r; j < src.width()  ; j++) { 
-                auto b = src.color_at(li++, 0);
-                sums[0] += int64_t(lv.r) - int64_t(b.r);
-                sums[1] += int64_t(lv.g) - int64_t(b.g);
-                sums[2] += int64_t(lv.b) - int64_t(b.b);
-                sums[3] += int64_t(lv.a) - int64_t(b.a);
-
-                dst.set_color(ti++, 0, round_color(sums, factor));
+            int slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (Btk_memcmp(index[slot], px, 4) == 0) {
+                out.push_back(uint8_t(slot));
             }
-
-        }
-    };
-    auto do_boxlur_v = [&](PixBuffer &dst, const PixBuffer &src, int r) {
-        float factor = 1.0f / (r + r + 1);
-        for (int i = 0;i < src.width(); i++) {
-            int ti = i, li = ti, ri = ti + r * src.width();
-            auto fv = src.color_at(ti, 0);
-            auto lv = src.color_at(ti + src.width() * (src.height() - 1), 0);
-
-            int64_t sums[4];
-            sums[0] = (r + 1) * int64_t(fv.r);
-            sums[1] = (r + 1) * int64_t(fv.g);
-            sums[2] = (r + 1) * int64_t(fv.b);
-            sums[3] = (r + 1) * int64_t(fv.a);
-
-            for(int j = 0  ; j <  r ; j++) {
-                auto c = src.color_at(ti + j * src.width(), 0);
-                sums[0] += c.r;
-                sums[1] += c.g;
-                sums[2] += c.b;
-                sums[3] += c.a;
-            }
-            for(int j = 0  ; j <= r ; j++) {
-                auto c = src.color_at(ri, 0);
-                sums[0] += c.r - fv.r;
-                sums[1] += c.g - fv.g;
-                sums[2] += c.b - fv.b;
-                sums[3] += c.a - fv.a;
-
-                dst.set_color(ti, 0, round_color(sums, factor));
-
-                ri += src.width();
-                ti += src.width();
-            }
-            for(int j = r + 1; j < src.height() - r; j++) { 
-                auto a = src.color_at(ri, 0);
-                auto b = src.color_at(li, 0);
-
-                sums[0] += int64_t(a.r) - int64_t(b.r);
-                sums[1] += int64_t(a.g) - int64_t(b.g);
-                sums[2] += int64_t(a.b) - int64_t(b.b);
-                sums[3] += int64_t(a.a) - int64_t(b.a);
-
-                dst.set_color(ti, 0, round_color(sums, factor));
-
-                li += src.width();
-                ri += src.width();
-                ti += src.width();
-            }
-            for(int j = src.height() - r; j < src.height()  ; j++) { 
-                auto b = src.color_at(li, 0);
-                sums[0] += int64_t(lv.r) - int64_t(b.r);
-                sums[1] += int64_t(lv.g) - int64_t(b.g);
-                sums[2] += int64_t(lv.b) - int64_t(b.b);
-                sums[3] += int64_t(lv.a) - int64_t(b.a);
-
-                dst.set_color(ti, 0, round_color(sums, factor));
-
-                li += src.width();
-                ti += src.width();
+            else {
+                Btk_memcpy(index[slot], px, 4);
+                if (px[3] == prev[3]) {
+                    int8_t dr = int8_t(px[0] - prev[0]);
+                    int8_t dg = int8_t(px[1] - prev[1]);
+                    int8_t db = int8_t(px[2] - prev[2]);
+                    int8_t rg = int8_t(dr - dg);
+                    int8_t bg = int8_t(db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(uint8_t(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                    }
+                    else if (dg >= -32 && dg <= 31 && rg >= -8 && rg <= 7 && bg >= -8 && bg <= 7) {
+                        out.push_back(uint8_t(0x80 | (dg + 32)));
+                        out.push_back(uint8_t(((rg + 8) << 4) | (bg + 8)));
+                    }
+                    else {
+                        out.insert(out.end(), {0xFE, px[0], px[1], px[2]});
+                    }
+                }
+                else {
+                    out.insert(out.end(), {0xFF, px[0], px[1], px[2], px[3]});
+                }
             }
+            Btk_memcpy(prev, px, 4);
         }
-    };
-    auto do_boxblur = [&](PixBuffer &dst, PixBuffer &src, int r) {
-        dst.bilt(src, nullptr, nullptr);
-        do_boxlur_h(src, dst, r);
-        do_boxlur_v(dst, src, r);
-    };
-    // for (int value : make_guassion_box(r, 3)) {
-    //     do_boxblur(buf, *this, (value - 1) / 2);
-    // }
-    auto box = make_guassion_box(r, 3);
-    do_boxblur(dest, source, (box[0] - 1) / 2);
-    do_boxblur(source, dest, (box[1] - 1) / 2);
-    do_boxblur(dest, source, (box[2] - 1) / 2);
-
-    return dest;
+    }
+    if (run > 0) {
+        out.push_back(uint8_t(0xC0 | (run - 1)));
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
 }
 
-// TODO : Optomize
-void PixBuffer::bilt(const PixBuffer &buf, const Rect *_dst, const Rect *_src) {
-    if (_dst == nullptr && _src == nullptr && size() == buf.size() && format() == buf.format()) {
-        // All same, just memcpy
-        Btk_memcpy(_pixels, buf._pixels, _width * _height * bytes_per_pixel());
-        return;
-    }
+}
 
-    Rect dst, src;
-    if (_dst) {
-        dst = *_dst;
-    }
-    else {
-        dst.x = 0;
-        dst.y = 0;
-        dst.w = _width;
-        dst.h = _height;
+bool PixBuffer::write_to(u8string_view path, int level) const {
+    if (empty()) {
+        return false;
     }
-    if (_src) {
-        src = *_src;
+    u8string file(path);
+    auto     dot = std::strrchr(file.c_str(), '.');
+    if (!dot || std::strpbrk(dot, "/\\")) {
+        // No EXT
+        return false;
     }
-    else {
-        src.x = 0;
-        src.y = 0;
-        src.w = buf.width();
-        src.h = buf.height();
+    char ext[8] = {};
+    for (int i = 0; i < 7 && dot[i + 1]; i++) {
+        ext[i] = char(std::tolower(static_cast<unsigned char>(dot[i + 1])));
     }
 
-    // Begin bilt
-    for (int yoff = 0; yoff < dst.h; yoff++) {
-        for (int xoff = 0; xoff < dst.w; xoff++) {
-            int x = dst.x + xoff;
-            int y = dst.y + yoff;
-
-            // Map pixels (temp use Nearest)
-            int src_x = src.x + src.w * (float(dst.w) / float(xoff));
-            int src_y = src.y + src.h * (float(dst.h) / float(yoff));
+#if defined(_WIN32)
+    if (std::strcmp(ext, "qoi") != 0) {
+        auto u16 = path.to_utf16();
+        auto ws  = reinterpret_cast<const wchar_t*>(u16.c_str());
+        ComPtr<IStream> stream;
+        HRESULT hr;
 
-            set_color(x, y, buf.color_at(src_x, src_y));
+        // Open File
+        hr = SHCreateStreamOnFileW(ws, STGM_WRITE | STGM_CREATE, &stream);
+        if (FAILED(hr)) {
+            return false;
         }
+        return wic_save_to(this, stream.Get(), reinterpret_cast<const wchar_t*>(u8string_view(ext).to_utf16().c_str()));
     }
-}
+#endif
 
-// Write to
-bool PixBuffer::write_to(u8string_view path) const {
-    if (empty()) {
+    FileStream stream;
+    if (!stream.open(file.c_str(), "wb")) {
         return false;
     }
-#if defined(_WIN32)
-    auto u16 = path.to_utf16();
-    auto ws  = reinterpret_cast<const wchar_t*>(u16.c_str());
-    ComPtr<IStream> stream;
-    HRESULT hr;
-
-    // Get ext name
-    auto ext = PathFindExtensionW(ws);
-    if (ext == ws + path.size()) {
-        // No EXT
+    return write_to(&stream, ext, level) && stream.close();
+}
+bool PixBuffer::write_to(IOStream *stream, u8string_view type, int level) const {
+    if (empty() || !stream) {
         return false;
     }
-    ext += 1; //< Skip the dot
-    // Open File
-    hr = SHCreateStreamOnFileW(ws, STGM_WRITE | STGM_CREATE, &stream);
-    if (FAILED(hr)) {
+    bool png = (type == "png");
+    bool qoi = (type == "qoi");
+    if (!png && !qoi) {
+        BTK_LOG("[PixBuffer] Unsupported image type to write\n");
         return false;
     }
 
-    return wic_save_to(this, stream.Get(), ext);
-#else
-    return false;
-#endif
+    // Only read from this, it could be called from a worker thread
+    const PixBuffer *src = this;
+    PixBuffer        converted;
+    if (_format != PixFormat::RGBA32 && _format != PixFormat::RGB24) {
+        converted = convert(PixFormat::RGBA32);
+        src = &converted;
+    }
+    int channels = src->_format == PixFormat::RGB24 ? 3 : 4;
+    auto pixels  = static_cast<const uint8_t*>(src->_pixels);
+
+    std::vector<uint8_t> out;
+    if (png) {
+        PixEncodePng(pixels, src->_pitch, _width, _height, channels, level < 0 ? 6 : min(level, 9), out);
+    }
+    else {
+        PixEncodeQoi(pixels, src->_pitch, _width, _height, channels, out);
+    }
+    return stream->write(out.data(), out.size()) == int64_t(out.size());
+}
+bool PixBuffer::write_to(IOStream *stream) const {
+    return write_to(stream, "png");
 }
 
 // Operators
@@ -594,6 +2722,27 @@ PixBuffer &PixBuffer::operator =(PixBuffer &&bf) {
     return *this;
 }
 
+#if !defined(_WIN32)
+namespace {
+
+// Take the stb decoded pixels, RGB is expanded by our kernel
+PixBuffer PixFromStb(stbi_uc *data, int w, int h, int req) {
+    if (!data) {
+        return PixBuffer();
+    }
+    if (req == STBI_rgb) {
+        PixBuffer rgb(PixFormat::RGB24, data, w, h);
+        rgb.set_managed(true);
+        return rgb.convert(PixFormat::RGBA32);
+    }
+    PixBuffer buf(PixFormat::RGBA32, data, w, h);
+    buf.set_managed(true);
+    return buf;
+}
+
+}
+#endif
+
 // Load from ...
 PixBuffer PixBuffer::FromFile(u8string_view path) {
 
@@ -619,41 +2768,14 @@ PixBuffer PixBuffer::FromFile(u8string_view path) {
     }
     return PixBuffer();
 #else
+    u8string file(path);
     int w, h, comp;
-    auto data = stbi_load(u8string(path).c_str(),&w, &h, &comp, STBI_rgb_alpha);
-    if (!data) {
+    if (!stbi_info(file.c_str(), &w, &h, &comp)) {
         return PixBuffer();
     }
-
-    // Manage by pixbuffer
-    if (comp == STBI_rgb_alpha) {
-        PixBuffer buf(PixFormat::RGBA32, data, w, h);
-        buf.set_managed(true);
-        return buf;
-    }
-    else if (comp == STBI_rgb) {
-        // We need to convert to RGBA32 (ABGR in little ed)
-        PixBuffer buf(PixFormat::RGBA32, w, h);
-        auto dst = buf.pixels<uint32_t>();
-
-        for (int i = 0; i < w * h; i++) {
-            uint32_t pix = 0xFF000000;
-            uint32_t r = data[i * 4 + 0];
-            uint32_t g = data[i * 4 + 1];
-            uint32_t b = data[i * 4 + 2];
-
-            pix |= b << 16;
-            pix |= g << 8;
-            pix |= r << 0;
-
-            dst[i] = pix;
-
-        }
-        Btk_free(data);
-        return buf;
-    }
-    // Unsupport
-    abort();
+    // Keep RGB as is and expand it by our kernel, let stb expand the gray ones
+    int req = (comp == STBI_rgb) ? STBI_rgb : STBI_rgb_alpha;
+    return PixFromStb(stbi_load(file.c_str(), &w, &h, &comp, req), w, h, req);
 #endif
 
 }
@@ -687,7 +2809,32 @@ PixBuffer PixBuffer::FromMem(cpointer_t data, size_t n) {
     }
     return PixBuffer();
 #else
-    return PixBuffer();
+    if (!data || n == 0 || n > size_t(INT_MAX)) {
+        return PixBuffer();
+    }
+    auto buffer = static_cast<const stbi_uc*>(data);
+    int  len    = int(n);
+    int  w, h, comp;
+    if (!stbi_info_from_memory(buffer, len, &w, &h, &comp)) {
+        return PixBuffer();
+    }
+    int req = (comp == STBI_rgb) ? STBI_rgb : STBI_rgb_alpha;
+    return PixFromStb(stbi_load_from_memory(buffer, len, &w, &h, &comp, req), w, h, req);
+#endif
+
+}
+PixBuffer PixBuffer::FromFileMapped(u8string_view path) {
+
+#if defined(_WIN32)
+    // Wincodec already reads from the file directly
+    return FromFile(path);
+#else
+    // Decode from the mapped pages, no heap copy of the file
+    FileMapping mapping;
+    if (!mapping.open(path)) {
+        return PixBuffer();
+    }
+    return FromMem(mapping.data(), mapping.size());
 #endif
 
 }
@@ -707,16 +2854,44 @@ void PixBuffer::_init_format(PixFormat fmt) {
 
         _bpp = 32;
     }
+    else if (fmt == PixFormat::BGRA32) {
+        // Little endian ARGB
+        _rmask = 0x00FF0000;
+        _gmask = 0x0000FF00;
+        _bmask = 0x000000FF;
+        _amask = 0xFF000000;
+
+        _rshift = 16;
+        _gshift = 8;
+        _bshift = 0;
+        _ashift = 24;
+
+        _bpp = 32;
+    }
     else if(fmt == PixFormat::RGB24) {
-        // RR GG BB
-        _rmask = 0xFF00000000;
-        _gmask = 0x00FF000000;
-        _bmask = 0x0000FF0000;
-        _amask = 0x0000000000;
-
-        _rshift = 24;
-        _gshift = 16;
-        _bshift = 8;
+        // RR GG BB (Little endian BGR)
+        _rmask = 0x000000FF;
+        _gmask = 0x0000FF00;
+        _bmask = 0x00FF0000;
+        _amask = 0x00000000;
+
+        _rshift = 0;
+        _gshift = 8;
+        _bshift = 16;
+        _ashift = 0;
+
+        _bpp = 24;
+    }
+    else if(fmt == PixFormat::BGR24) {
+        // BB GG RR (Little endian RGB)
+        _rmask = 0x00FF0000;
+        _gmask = 0x0000FF00;
+        _bmask = 0x000000FF;
+        _amask = 0x00000000;
+
+        _rshift = 16;
+        _gshift = 8;
+        _bshift = 0;
         _ashift = 0;
 
         _bpp = 24;
@@ -735,15 +2910,160 @@ void PixBuffer::_init_format(PixFormat fmt) {
 
         _bpp = 8;
     } 
+    else if (PixIsYuv(fmt)) {
+        // Y plane in 8 bits, the chroma planes are behind it
+        _rmask = 0;
+        _gmask = 0;
+        _bmask = 0;
+        _amask = 0;
+
+        _rshift = 0;
+        _gshift = 0;
+        _bshift = 0;
+        _ashift = 0;
+
+        _bpp = 8;
+    }
     _format = fmt;
 }
 
+#if !defined(_WIN32)
+// Incremental gif decoding, only the canvas and a few composed frames are kept
+namespace {
+
+class PixGifDecoder {
+    public:
+        PixGifDecoder(FILE *f) : file(f) {
+            Btk_memset(&gif, 0, sizeof(gif));
+            rewind();
+        }
+        PixGifDecoder(const PixGifDecoder &) = delete;
+        ~PixGifDecoder() {
+            reset_state();
+            fclose(file);
+        }
+
+        // Walk the blocks without decoding the raster, collect the frame delays
+        bool scan(std::vector<int> &delays) {
+            stbi__context *s = &ctxt;
+            stbi__skip(s, 10);
+            int flags = stbi__get8(s);
+            stbi__skip(s, 2);
+            if (flags & 0x80) {
+                stbi__skip(s, 3 * (2 << (flags & 7)));
+            }
+
+            int delay = 0; //< Like stb, the delay is kept until the next control extension
+            for (;;) {
+                int tag = stbi__get8(s);
+                if (tag == 0x2C) {
+                    stbi__skip(s, 8);
+                    int lflags = stbi__get8(s);
+                    if (lflags & 0x80) {
+                        stbi__skip(s, 3 * (2 << (lflags & 7)));
+                    }
+                    stbi__skip(s, 1); //< LZW code size
+                    skip_blocks();
+                    delays.push_back(delay);
+                }
+                else if (tag == 0x21) {
+                    int ext = stbi__get8(s);
+                    if (ext == 0xF9) {
+                        // Same as stb, a control extension in other size is skipped
+                        int size = stbi__get8(s);
+                        if (size == 4) {
+                            stbi__skip(s, 1);
+                            delay = 10 * stbi__get16le(s);
+                            stbi__skip(s, 1);
+                        }
+                        else {
+                            stbi__skip(s, size);
+                        }
+                    }
+                    skip_blocks();
+                }
+                else {
+                    // 0x3B or truncated file
+                    break;
+                }
+                if (stbi__at_eof(s)) {
+                    break;
+                }
+            }
+            rewind();
+            return !delays.empty();
+        }
+        // Compose frames until idx, restart from the beginning on seeking backward
+        bool read(size_t idx, PixBuffer &buf) {
+            auto &slot = ring[idx % ring.size()];
+            if (slot.first == idx && !slot.second.empty()) {
+                buf = slot.second;
+                return true;
+            }
+            if (idx < next) {
+                rewind();
+            }
+            while (next <= idx) {
+                stbi_uc *two_back = nullptr;
+                if (next >= 2) {
+                    auto &prev = ring[(next - 2) % ring.size()];
+                    if (prev.first == next - 2) {
+                        two_back = prev.second.pixels<stbi_uc>();
+                    }
+                }
+                int comp;
+                auto out = stbi__gif_load_next(&ctxt, &gif, &comp, STBI_rgb_alpha, two_back);
+                if (out == nullptr || out == reinterpret_cast<stbi_uc*>(&ctxt)) {
+                    BTK_LOG("[Image] Failed to decode gif frame %ld\n", long(next));
+                    rewind();
+                    return false;
+                }
+                PixBuffer frame(PixFormat::RGBA32, gif.w, gif.h);
+                Btk_memcpy(frame.pixels(), out, size_t(gif.w) * gif.h * 4);
+                ring[next % ring.size()] = {next, std::move(frame)};
+                next += 1;
+            }
+            buf = slot.second;
+            return true;
+        }
+    private:
+        void skip_blocks() {
+            int len;
+            while ((len = stbi__get8(&ctxt)) != 0) {
+                stbi__skip(&ctxt, len);
+            }
+        }
+        void reset_state() {
+            STBI_FREE(gif.out);
+            STBI_FREE(gif.background);
+            STBI_FREE(gif.history);
+            Btk_memset(&gif, 0, sizeof(gif));
+        }
+        void rewind() {
+            reset_state();
+            fseek(file, 0, SEEK_SET);
+            stbi__start_file(&ctxt, file);
+            next = 0;
+        }
+
+        FILE         *file;
+        stbi__context ctxt;
+        stbi__gif     gif;
+        size_t        next = 0; //< Index of the next frame to decode
+
+        std::array<std::pair<size_t, PixBuffer>, 4> ring; //< Recently composed frames, by idx % 4
+};
+
+}
+#endif
+
 // Image
 class ImageImpl : public Refable<ImageImpl> {
     public:
         std::vector<PixBuffer> buffers  = {};
         std::vector<int>       delays   = {};
         size_t                 nframe = 0;
+        std::mutex             mutex; //< The decoder state is shared by the copies of Image
 
 #if     defined(_WIN32)
         // Wincodec 
@@ -754,6 +3074,8 @@ class ImageImpl : public Refable<ImageImpl> {
         PixBuffer               cframe = {};
         int                     last = -1; //< Last decoded frame  
         bool                    gif = false;
+#else
+        std::unique_ptr<PixGifDecoder> gif; //< Streaming decoder for animated gif
 #endif
 };
 
@@ -778,7 +3100,7 @@ Image::~Image() {
 size_t Image::count_frame() const {
     return priv->nframe;
 }
-bool   Image::read_frame(size_t idx, PixBuffer &buf, int *delay) const {
+bool   Image::read_frame(size_t idx, PixBuffer &buf, int *delay) {
     if (idx >= priv->nframe) {
         BTK_LOG("[Image] Request frame %ld equal or bigger than %ld\n", idx, priv->nframe);
         return false;
@@ -787,6 +3109,7 @@ bool   Image::read_frame(size_t idx, PixBuffer &buf, int *delay) const {
     if (delay) {
         *delay = priv->delays[idx];
     }
+    std::lock_guard locker(priv->mutex);
 
 #if defined(_WIN32)
     if (priv->decoder) {
@@ -828,6 +3151,9 @@ bool   Image::read_frame(size_t idx, PixBuffer &buf, int *delay) const {
         return true;
     }
 #else
+    if (priv->gif) {
+        return priv->gif->read(idx, buf);
+    }
     if (idx < priv->buffers.size()) {
         buf = priv->buffers[idx];
         return true;
@@ -932,29 +3258,19 @@ Image Image::FromFile(u8string_view path) {
 
     bool gif = stbi__gif_test(&s);
     if (gif) {
-        int w, h, nframe, comp;
-        int *delays;
-
-        stbi_uc *frames = static_cast<stbi_uc*>(stbi__load_gif_main(&s, &delays, &w, &h, &nframe, &comp, STBI_rgb_alpha));
-        if (!frames) {
-            fclose(f);
+        // Frames are decoded on demand, the decoder owns the file from now
+        image.priv->gif = std::make_unique<PixGifDecoder>(f);
+        if (!image.priv->gif->scan(image.priv->delays)) {
             return Image();
         }
-        
-        image.priv->nframe = nframe;
-        image.priv->delays.resize(nframe);
-        image.priv->buffers.resize(nframe);
-        assert(comp == STBI_rgb_alpha);
-
-        for (int n = 0; n < nframe; n++) {
-            image.priv->buffers[n] = PixBuffer(PixFormat::RGBA32, w, h);
-            image.priv->delays[n] = delays[n];
+        image.priv->nframe = image.priv->delays.size();
 
-            // Write frame
-            Btk_memcpy(image.priv->buffers[n].pixels(), frames + n * (w * h *comp), (w * h *comp));
+        // Make sure the first frame is ready
+        PixBuffer first;
+        if (!image.priv->gif->read(0, first)) {
+            return Image();
         }
-        stbi_image_free(frames);
-        stbi_image_free(delays);
+        return image;
     }
     else {
         // TODO : Finish it
@@ -976,6 +3292,259 @@ Image Image::FromFile(u8string_view path) {
 #endif
 }
 
+// ImageCache
+class ImageCacheImpl {
+    public:
+        struct Entry {
+            std::string key;
+            PixBuffer   buffer;
+            size_t      bytes;
+        };
+
+        std::mutex                                                  mutex; //< The cache is shared with the async loaders
+        std::list<Entry>                                            lru; //< Most recently used at the front
+        std::unordered_map<std::string, std::list<Entry>::iterator> map;
+        ImageCacheStats                                             stats;
+
+        static std::string MakeKey(u8string_view source, Size size) {
+            std::string key(source.data(), source.size());
+            key.push_back('\0');
+            key.append(reinterpret_cast<const char*>(&size.w), sizeof(size.w));
+            key.append(reinterpret_cast<const char*>(&size.h), sizeof(size.h));
+            return key;
+        }
+        void evict() {
+            while (stats.bytes > stats.budget && !lru.empty()) {
+                auto &entry = lru.back();
+                stats.bytes -= entry.bytes;
+                stats.evictions += 1;
+                map.erase(entry.key);
+                lru.pop_back();
+            }
+            stats.entries = lru.size();
+        }
+};
+
+ImageCache::ImageCache(size_t budget) {
+    priv = new ImageCacheImpl;
+    priv->stats.budget = budget;
+}
+ImageCache::~ImageCache() {
+    delete priv;
+}
+
+PixBuffer ImageCache::load(u8string_view path, Size size) {
+    auto buf = find(path, size);
+    if (!buf.empty()) {
+        return buf;
+    }
+    buf = PixBuffer::FromFile(path);
+    if (buf.empty()) {
+        return buf;
+    }
+    if (size.w > 0 && size.h > 0 && buf.size() != size) {
+        buf = buf.resize(size.w, size.h);
+    }
+    insert(path, buf, size);
+    return buf;
+}
+PixBuffer ImageCache::find(u8string_view key, Size size) {
+    std::lock_guard<std::mutex> locker(priv->mutex);
+    auto iter = priv->map.find(ImageCacheImpl::MakeKey(key, size));
+    if (iter == priv->map.end()) {
+        priv->stats.misses += 1;
+        return PixBuffer();
+    }
+    priv->stats.hits += 1;
+    priv->lru.splice(priv->lru.begin(), priv->lru, iter->second);
+    return iter->second->buffer;
+}
+void ImageCache::insert(u8string_view key, const PixBuffer &buf, Size size) {
+    if (buf.empty()) {
+        return;
+    }
+    auto k     = ImageCacheImpl::MakeKey(key, size);
+    auto bytes = size_t(buf.pitch()) * buf.height();
+    if (PixIsYuv(buf.format())) {
+        // The chroma planes are allocated after the Y plane
+        bytes += PixChromaSize(buf.width(), buf.height()) * 2;
+    }
+    std::lock_guard<std::mutex> locker(priv->mutex);
+    auto iter  = priv->map.find(k);
+    if (iter != priv->map.end()) {
+        // Replace
+        priv->stats.bytes -= iter->second->bytes;
+        priv->lru.erase(iter->second);
+        priv->map.erase(iter);
+    }
+    if (bytes > priv->stats.budget) {
+        // Never fits, do not flush the others for it
+        priv->stats.entries = priv->lru.size();
+        return;
+    }
+    priv->lru.push_front({k, buf, bytes});
+    priv->map.emplace(std::move(k), priv->lru.begin());
+    priv->stats.bytes += bytes;
+    priv->evict();
+}
+void ImageCache::set_budget(size_t bytes) {
+    std::lock_guard<std::mutex> locker(priv->mutex);
+    priv->stats.budget = bytes;
+    priv->evict();
+}
+void ImageCache::clear() {
+    std::lock_guard<std::mutex> locker(priv->mutex);
+    priv->map.clear();
+    priv->lru.clear();
+    priv->stats.bytes = 0;
+    priv->stats.entries = 0;
+}
+ImageCacheStats ImageCache::stats() const {
+    std::lock_guard<std::mutex> locker(priv->mutex);
+    return priv->stats;
+}
+ImageCache &ImageCache::GetInstance() {
+    static ImageCache cache;
+    return cache;
+}
+
+// Async loading
+namespace {
+
+// Workers for decoding, started on the first request
+class PixLoaderPool {
+    public:
+        static PixLoaderPool &Instance() {
+            static PixLoaderPool pool;
+            return pool;
+        }
+        void post(std::function<void()> &&job) {
+            std::lock_guard<std::mutex> locker(mutex);
+            jobs.push_back(std::move(job));
+            cond.notify_one();
+        }
+        // Keep the result until the dispatcher delivers it, a dropped event leaves it here instead of leaking
+        uintptr_t keep(std::function<void()> &&fn) {
+            std::lock_guard<std::mutex> locker(mutex);
+            uintptr_t id = ++pending_id;
+            pending.emplace(id, std::move(fn));
+            return id;
+        }
+        std::function<void()> take(uintptr_t id) {
+            std::lock_guard<std::mutex> locker(mutex);
+            std::function<void()> fn;
+            auto iter = pending.find(id);
+            if (iter != pending.end()) {
+                fn = std::move(iter->second);
+                pending.erase(iter);
+            }
+            return fn;
+        }
+    private:
+        PixLoaderPool() {
+            int n = clamp(int(std::thread::hardware_concurrency()) / 2, 1, 4);
+            for (int i = 0; i < n; i++) {
+                workers.emplace_back(&PixLoaderPool::run, this);
+            }
+        }
+        ~PixLoaderPool() {
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+                stop = true;
+                jobs.clear();
+            }
+            cond.notify_all();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            pending.clear();
+        }
+        void run() {
+            for (;;) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> locker(mutex);
+                    cond.wait(locker, [this]() { return stop || !jobs.empty(); });
+                    if (stop) {
+                        return;
+                    }
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::mutex                        mutex;
+        std::condition_variable           cond;
+        std::deque<std::function<void()>> jobs;
+        std::vector<std::thread>          workers;
+        bool                              stop = false;
+
+        std::unordered_map<uintptr_t, std::function<void()>> pending; //< Results waiting in the dispatcher queue
+        uintptr_t                                            pending_id = 0;
+};
+
+// Run the job on the pool, then hand the result to the dispatcher (or the worker if there is none)
+template <typename T>
+void PixLoadAsync(const std::shared_ptr<std::atomic_bool> &canceled, std::function<T()> &&load, std::function<void(T &)> &&done) {
+    auto dispatcher = GetDispatcher();
+
+    PixLoaderPool::Instance().post([=, load = std::move(load), done = std::move(done)]() {
+        if (*canceled) {
+            return;
+        }
+        auto result = load();
+        if (*canceled) {
+            return;
+        }
+        if (!dispatcher) {
+            done(result);
+            return;
+        }
+        auto &pool = PixLoaderPool::Instance();
+        auto  id   = pool.keep([=, result = std::move(result)]() mutable {
+            // Check again, it may be canceled while the event is in the queue
+            if (!*canceled) {
+                done(result);
+            }
+        });
+        CallEvent event;
+        event.set_func([](void *user) {
+            auto fn = PixLoaderPool::Instance().take(reinterpret_cast<uintptr_t>(user));
+            if (fn) {
+                fn();
+            }
+        });
+        event.set_user(reinterpret_cast<void*>(id));
+        // The dispatcher may be destroyed since the request, drop the result then
+        if (!PostCall(dispatcher, event)) {
+            pool.take(id);
+        }
+    });
+}
+
+}
+
+LoadToken PixBuffer::LoadAsync(u8string_view path, std::function<void(PixBuffer &)> done, Size size) {
+    std::function<PixBuffer()> load = [file = u8string(path), size]() {
+        // Share the decoded one with other loaders of the same file
+        return ImageCache::GetInstance().load(file, size);
+    };
+    auto canceled = std::make_shared<std::atomic_bool>(false);
+    PixLoadAsync(canceled, std::move(load), std::move(done));
+    return LoadToken(canceled);
+}
+LoadToken Image::LoadAsync(u8string_view path, std::function<void(Image &)> done) {
+    std::function<Image()> load = [file = u8string(path)]() {
+        return Image::FromFile(file);
+    };
+    auto canceled = std::make_shared<std::atomic_bool>(false);
+    PixLoadAsync(canceled, std::move(load), std::move(done));
+    return LoadToken(canceled);
+}
+
+
 BTK_NS_END
 
 
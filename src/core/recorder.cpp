@@ -0,0 +1,1475 @@
+#include "build.hpp"
+#include "common/utils.hpp"
+
+#include <Btk/detail/reference.hpp>
+#include <Btk/detail/device.hpp>
+#include <Btk/painter.hpp>
+#include <Btk/object.hpp>
+#include <Btk/font.hpp>
+#include <Btk/io.hpp>
+#include <iterator>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <cmath>
+
+// Display list of the painter, all commands are stored in an uint32_t buffer (reused across frames)
+// Objects (brush, pen, font ...) are stored in side tables and referenced by index
+
+#define BTK_MAKE_PAINT_RESOURCE      \
+    public:                          \
+        uint32_t _refcount = 0;      \
+        void ref() override final {  \
+            ++_refcount;             \
+        }                            \
+        void unref() override final {\
+            if (--_refcount == 0) {  \
+                delete this;         \
+            }                        \
+        }                            \
+    public:                          \
+
+
+BTK_PRIV_BEGIN
+
+enum class RecordOp : uint32_t {
+    Clear,
+    DrawPath,
+    DrawLine,
+    DrawRect,
+    DrawRoundedRect,
+    DrawEllipse,
+    DrawImage,
+    DrawText,
+    DrawLayout,
+    FillPath,
+    FillRect,
+    FillRoundedRect,
+    FillEllipse,
+    FillMask,
+    SetStrokeWidth,
+    SetAntialias,
+    SetTransform,
+    SetScissor,
+    SetAlpha,
+    SetBrush,
+    SetPen,
+    Max
+};
+
+// Arguments of each opcode, one word per char
+// f : float, u : uint32_t
+// B : brush, P : pen, F : font, S : string, L : text layout, H : path, I : image (index of the side tables)
+static const char *const RecordArgs[] = {
+    "B",           // Clear
+    "H",           // DrawPath
+    "ffff",        // DrawLine
+    "ffff",        // DrawRect
+    "fffff",       // DrawRoundedRect
+    "ffff",        // DrawEllipse
+    "Iuffffffff",  // DrawImage (image, flags, dst, src)
+    "uFSff",       // DrawText (align, font, text, x, y)
+    "uLff",        // DrawLayout (align, layout, x, y)
+    "H",           // FillPath
+    "ffff",        // FillRect
+    "fffff",       // FillRoundedRect
+    "ffff",        // FillEllipse
+    "Iuffffffff",  // FillMask (image, flags, dst, src)
+    "f",           // SetStrokeWidth
+    "u",           // SetAntialias
+    "uffffff",     // SetTransform (has, matrix)
+    "uffffffffff", // SetScissor (has, matrix, rect)
+    "f",           // SetAlpha
+    "B",           // SetBrush
+    "P",           // SetPen
+};
+
+static_assert(std::size(RecordArgs) == size_t(RecordOp::Max));
+
+// Flags of DrawImage / FillMask
+enum : uint32_t {
+    RecordHasDst = 1 << 0,
+    RecordHasSrc = 1 << 1,
+};
+
+// Opcode of path stream
+enum : uint32_t {
+    RecordMoveTo,
+    RecordLineTo,
+    RecordBezierTo,
+    RecordClosePath,
+    RecordSetWinding,
+};
+
+constexpr uint32_t RecordMagic   = 0x524B5442; //< BTKR
+constexpr uint32_t RecordVersion = 1;
+constexpr uint32_t RecordMaxSize = 1 << 15; //< Max size of image in stream
+
+inline uint32_t f2u(float v) {
+    uint32_t u;
+    Btk_memcpy(&u, &v, sizeof(u));
+    return u;
+}
+inline float    u2f(uint32_t u) {
+    float v;
+    Btk_memcpy(&v, &u, sizeof(v));
+    return v;
+}
+inline size_t   record_nargs(uint32_t op) {
+    return ::strlen(RecordArgs[op]);
+}
+
+/**
+ * @brief Snapshot of the texture
+ *
+ */
+class RecordImage {
+    public:
+        PixBuffer         buffer;
+        FPoint            dpi  = {96.0f, 96.0f};
+        InterpolationMode mode = InterpolationMode::Linear;
+};
+
+/**
+ * @brief Collect the path into words
+ *
+ */
+class RecordPathSink final : public PainterPathSink {
+    public:
+        RecordPathSink(std::vector<uint32_t> &words) : words(words) { }
+
+        void open() override { }
+        void close() override { }
+
+        void move_to(float x, float y) override {
+            words.insert(words.end(), {RecordMoveTo, f2u(x), f2u(y)});
+        }
+        void line_to(float x, float y) override {
+            words.insert(words.end(), {RecordLineTo, f2u(x), f2u(y)});
+        }
+        void bezier_to(float x1, float y1, float x2, float y2, float x3, float y3) override {
+            words.insert(words.end(), {RecordBezierTo, f2u(x1), f2u(y1), f2u(x2), f2u(y2), f2u(x3), f2u(y3)});
+        }
+        void close_path() override {
+            words.push_back(RecordClosePath);
+        }
+        void set_winding(PathWinding winding) override {
+            words.insert(words.end(), {RecordSetWinding, uint32_t(winding)});
+        }
+    private:
+        std::vector<uint32_t> &words;
+};
+
+/**
+ * @brief Texture created by recording painter, keep the pixels in memory
+ *
+ */
+class RecordTexture final : public AbstractTexture {
+    public:
+        BTK_MAKE_PAINT_RESOURCE
+
+        RecordTexture(PixFormat fmt, int w, int h, float xdpi, float ydpi) : buffer(fmt, w, h), dpi(xdpi, ydpi) { }
+
+        auto signal_destroyed() -> Signal<void()> & override {
+            // Never destroyed by context, the pixels are in memory
+            return signal;
+        }
+
+        // Inhertied from PaintDevice
+        auto paint_context() -> Ref<PaintContext> override {
+            return nullptr;
+        }
+        bool query_value(PaintDeviceValue v, void *out) override;
+
+        void update(const Rect *area, cpointer_t ptr, int pitch) override;
+        void set_interpolation_mode(InterpolationMode m) override {
+            mode = m;
+            shared = false;
+        }
+    private:
+        Signal<void()>    signal;
+        PixBuffer         buffer;
+        FPoint            dpi;
+        InterpolationMode mode = InterpolationMode::Linear;
+
+        // Last snapshot
+        bool              shared   = false; //< The buffer was referenced by a snapshot
+        const void       *owner    = nullptr;
+        size_t            generation = 0;
+        uint32_t          snapshot = 0;
+    friend class RecordContext;
+};
+
+class RecordDevice;
+class RecordContext final : public PaintContext {
+    public:
+        RecordContext(RecordDevice *device, PainterRecorderImpl *recorder) : device(device), recorder(recorder) { }
+        ~RecordContext() {
+            signal.emit();
+        }
+
+        // PaintResource
+        void ref() override { }
+        void unref() override { }
+        auto signal_destroyed() -> Signal<void()> & override { return signal; }
+
+        // Inherit from GraphicsContext
+        void begin() override;
+        void end() override { }
+        void swap_buffers() override { }
+
+        // Inherit from PaintContext
+        void clear(Brush &) override;
+        // Draw
+        bool draw_path(const PainterPath &path) override;
+        bool draw_line(float x1, float y1, float x2, float y2) override;
+        bool draw_rect(float x, float y, float w, float h) override;
+        bool draw_rounded_rect(float x, float y, float w, float h, float r) override;
+        bool draw_ellipse(float x, float y, float xr, float yr) override;
+        bool draw_image(AbstractTexture *image, const FRect *dst, const FRect *src) override;
+
+        // Text
+        bool draw_text(Alignment, Font &font, u8string_view text, float x, float y) override;
+        bool draw_text(Alignment, const TextLayout &layout      , float x, float y) override;
+
+        // Fill
+        bool fill_path(const PainterPath &path) override;
+        bool fill_rect(float x, float y, float w, float h) override;
+        bool fill_rounded_rect(float x, float y, float w, float h, float r) override;
+        bool fill_ellipse(float x, float y, float xr, float yr) override;
+        bool fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) override;
+
+        // State
+        bool set_state(PaintContextState state, const void *what) override;
+
+        // Extra
+        bool native_handle(PaintContextHandle h, void *out) override {
+            BTK_UNUSED(h);
+            BTK_UNUSED(out);
+            return false;
+        }
+
+        // Texture
+        auto create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi) -> Ref<AbstractTexture> override;
+    private:
+        void push(RecordOp op, std::initializer_list<uint32_t> args);
+        bool push_image(RecordOp op, AbstractTexture *image, const FRect *dst, const FRect *src);
+
+        RecordDevice        *device;
+        PainterRecorderImpl *recorder;
+        Signal<void()>       signal;
+};
+
+class RecordDevice final : public PaintDevice {
+    public:
+        RecordDevice(PainterRecorderImpl *recorder) : recorder(recorder), ctxt(this, recorder) { }
+
+        auto paint_context() -> Ref<PaintContext> override {
+            return &ctxt;
+        }
+        bool query_value(PaintDeviceValue value, void *out) override;
+    private:
+        PainterRecorderImpl *recorder;
+        RecordContext        ctxt;
+};
+
+BTK_PRIV_END
+
+BTK_NS_BEGIN
+
+class PainterRecorderImpl {
+    public:
+        std::vector<uint32_t>    words;   //< Opcode + arguments
+        size_t                   ncmds = 0;
+
+        // Side tables
+        std::vector<Brush>       brushes;
+        std::vector<Pen>         pens;
+        std::vector<Font>        fonts;
+        std::vector<u8string>    strings;
+        std::vector<TextLayout>  layouts;
+        std::vector<PainterPath> paths;
+        std::vector<RecordImage> images;
+
+        FSize                    size = {0.0f, 0.0f};
+        FPoint                   dpi  = {96.0f, 96.0f};
+        size_t                   generation = 0; //< Increased on clear, for invalidating texture snapshots
+
+        // Textures created on the last played context
+        mutable PaintContext        *cache_ctxt = nullptr;
+        mutable std::vector<Texture> cache_textures;
+
+        void clear();
+        void play(Painter &p) const;
+        bool validate() const;
+        bool same_command(size_t offset, const PainterRecorderImpl &other, size_t other_offset) const;
+        auto offsets() const -> std::vector<size_t>;
+
+        uint32_t add_brush(const Brush &brush);
+        uint32_t add_pen(const Pen &pen);
+        uint32_t add_font(const Font &font);
+
+        bool write_to(IOStream *stream) const;
+        bool read_from(IOStream *stream);
+};
+
+BTK_NS_END
+
+BTK_PRIV_BEGIN
+
+// Serialization helpers
+class RecordWriter {
+    public:
+        RecordWriter(IOStream *stream) : stream(stream) { }
+
+        void bytes(const void *data, size_t n) {
+            if (ok && n != 0) {
+                ok = stream->write(data, n) == int64_t(n);
+            }
+        }
+        void u32(uint32_t v) {
+            bytes(&v, sizeof(v));
+        }
+        void f32(float v) {
+            bytes(&v, sizeof(v));
+        }
+        void str(u8string_view s) {
+            u32(s.size());
+            bytes(s.data(), s.size());
+        }
+        void words(const std::vector<uint32_t> &w) {
+            u32(w.size());
+            bytes(w.data(), w.size() * sizeof(uint32_t));
+        }
+        void color(const GLColor &c) {
+            f32(c.r); f32(c.g); f32(c.b); f32(c.a);
+        }
+        void point(const FPoint &p) {
+            f32(p.x); f32(p.y);
+        }
+        void gradient(const Gradient &g) {
+            u32(g.stops().size());
+            for (auto &stop : g.stops()) {
+                f32(stop.offset);
+                color(stop.color);
+            }
+        }
+        void pixbuffer(const PixBuffer &buf) {
+            u32(uint32_t(buf.format()));
+            u32(buf.width());
+            u32(buf.height());
+            auto row = size_t(buf.width()) * buf.bytes_per_pixel();
+            for (int y = 0; y < buf.height(); y++) {
+                bytes(static_cast<const uint8_t*>(buf.pixels()) + size_t(y) * buf.pitch(), row);
+            }
+        }
+        void font(const Font &f) {
+            u32(!f.empty());
+            if (!f.empty()) {
+                str(f.family());
+                f32(f.size());
+                u32(f.bold());
+                u32(f.italic());
+            }
+        }
+
+        bool ok = true;
+    private:
+        IOStream *stream;
+};
+class RecordReader {
+    public:
+        RecordReader(IOStream *stream) : stream(stream) { }
+
+        bool bytes(void *data, size_t n) {
+            if (ok && n != 0) {
+                ok = stream->read(data, n) == int64_t(n);
+            }
+            return ok;
+        }
+        uint32_t u32() {
+            uint32_t v = 0;
+            bytes(&v, sizeof(v));
+            return v;
+        }
+        float f32() {
+            float v = 0.0f;
+            bytes(&v, sizeof(v));
+            return v;
+        }
+        u8string str() {
+            u8string s;
+            auto n = u32();
+            // Read by chunk, avoid allocating huge memory on a broken stream
+            char buf[256];
+            while (ok && n != 0) {
+                auto len = min<uint32_t>(n, sizeof(buf));
+                if (bytes(buf, len)) {
+                    s.append(u8string_view(buf, len));
+                }
+                n -= len;
+            }
+            return s;
+        }
+        void words(std::vector<uint32_t> &w) {
+            auto n = u32();
+            w.clear();
+            while (ok && n != 0) {
+                auto len  = min<uint32_t>(n, 16384);
+                auto prev = w.size();
+                w.resize(prev + len);
+                bytes(w.data() + prev, len * sizeof(uint32_t));
+                n -= len;
+            }
+        }
+        GLColor color() {
+            GLColor c;
+            c.r = f32(); c.g = f32(); c.b = f32(); c.a = f32();
+            return c;
+        }
+        FPoint point() {
+            FPoint p;
+            p.x = f32(); p.y = f32();
+            return p;
+        }
+        void gradient(Gradient &g) {
+            auto n = u32();
+            for (uint32_t i = 0; ok && i < n; i++) {
+                float offset = f32();
+                g.add_stop(offset, color());
+            }
+        }
+        PixBuffer pixbuffer() {
+            auto fmt = PixFormat(u32());
+            auto w   = u32();
+            auto h   = u32();
+            if (!ok || w > RecordMaxSize || h > RecordMaxSize) {
+                ok = false;
+                return PixBuffer();
+            }
+            switch (fmt) {
+                case PixFormat::RGBA32 :
+                case PixFormat::RGB24 :
+                case PixFormat::BGRA32 :
+                case PixFormat::BGR24 :
+                case PixFormat::Gray8 : break;
+                default : ok = false; return PixBuffer();
+            }
+            PixBuffer buf(fmt, w, h);
+            auto row = size_t(buf.width()) * buf.bytes_per_pixel();
+            for (int y = 0; ok && y < buf.height(); y++) {
+                bytes(static_cast<uint8_t*>(buf.pixels()) + size_t(y) * buf.pitch(), row);
+            }
+            return buf;
+        }
+        Font font() {
+            if (!u32()) {
+                return Font();
+            }
+            auto family = str();
+            auto size   = f32();
+            auto bold   = u32();
+            auto italic = u32();
+            if (!ok) {
+                return Font();
+            }
+            Font f(family, size);
+            f.set_bold(bold);
+            f.set_italic(italic);
+            return f;
+        }
+
+        bool ok = true;
+    private:
+        IOStream *stream;
+};
+
+// Texture
+bool RecordTexture::query_value(PaintDeviceValue v, void *out) {
+    switch (v) {
+        case PaintDeviceValue::PixelSize : {
+            *static_cast<Size*>(out) = buffer.size();
+            break;
+        }
+        case PaintDeviceValue::LogicalSize : {
+            auto fs = static_cast<FSize*>(out);
+            fs->w = buffer.width() * 96.0f / dpi.x;
+            fs->h = buffer.height() * 96.0f / dpi.y;
+            break;
+        }
+        case PaintDeviceValue::Dpi : {
+            *static_cast<FPoint*>(out) = dpi;
+            break;
+        }
+        case PaintDeviceValue::PixelFormat : {
+            *static_cast<PixFormat*>(out) = buffer.format();
+            break;
+        }
+        default : return false;
+    }
+    return true;
+}
+void RecordTexture::update(const Rect *area, cpointer_t ptr, int pitch) {
+    if (shared) {
+        // The snapshot still hold the pixels, copy on write
+        buffer = buffer.clone();
+        shared = false;
+    }
+    Rect dst = area ? *area : Rect(0, 0, buffer.width(), buffer.height());
+    dst = dst.intersected(Rect(0, 0, buffer.width(), buffer.height()));
+    if (dst.empty()) {
+        return;
+    }
+
+    auto bpp = buffer.bytes_per_pixel();
+    auto src = static_cast<const uint8_t*>(ptr);
+    for (int y = 0; y < dst.h; y++) {
+        auto line = static_cast<uint8_t*>(buffer.pixels()) + size_t(dst.y + y) * buffer.pitch() + size_t(dst.x) * bpp;
+        Btk_memcpy(line, src + size_t(y) * pitch, size_t(dst.w) * bpp);
+    }
+}
+
+// Device
+bool RecordDevice::query_value(PaintDeviceValue value, void *out) {
+    switch (value) {
+        case PaintDeviceValue::PixelSize : {
+            auto s = static_cast<Size*>(out);
+            s->w = int(std::ceil(recorder->size.w * recorder->dpi.x / 96.0f));
+            s->h = int(std::ceil(recorder->size.h * recorder->dpi.y / 96.0f));
+            break;
+        }
+        case PaintDeviceValue::LogicalSize : {
+            *static_cast<FSize*>(out) = recorder->size;
+            break;
+        }
+        case PaintDeviceValue::Dpi : {
+            *static_cast<FPoint*>(out) = recorder->dpi;
+            break;
+        }
+        case PaintDeviceValue::PixelFormat : {
+            *static_cast<PixFormat*>(out) = PixFormat::RGBA32;
+            break;
+        }
+        default : return false;
+    }
+    return true;
+}
+
+// Context
+void RecordContext::begin() {
+    // New frame, drop the previous commands
+    recorder->clear();
+}
+void RecordContext::push(RecordOp op, std::initializer_list<uint32_t> args) {
+    BTK_ASSERT(args.size() == record_nargs(uint32_t(op)));
+    recorder->words.push_back(uint32_t(op));
+    recorder->words.insert(recorder->words.end(), args);
+    recorder->ncmds += 1;
+}
+bool RecordContext::push_image(RecordOp op, AbstractTexture *image, const FRect *dst, const FRect *src) {
+#if !defined(BTK_NO_RTTI)
+    auto texture = dynamic_cast<RecordTexture*>(image);
+    if (!texture) {
+        BTK_ONCE(BTK_LOG("[Recorder] Texture not created by recording painter, ignored\n"));
+        return false;
+    }
+#else
+    auto texture = static_cast<RecordTexture*>(image);
+#endif
+
+    // Take a snapshot if the pixels changed
+    if (!texture->shared || texture->owner != recorder || texture->generation != recorder->generation) {
+        RecordImage snapshot;
+        snapshot.buffer = texture->buffer;
+        snapshot.dpi    = texture->dpi;
+        snapshot.mode   = texture->mode;
+
+        texture->shared     = true;
+        texture->owner      = recorder;
+        texture->generation = recorder->generation;
+        texture->snapshot   = recorder->images.size();
+        recorder->images.emplace_back(std::move(snapshot));
+    }
+
+    uint32_t flags = 0;
+    FRect    d     = {0.0f, 0.0f, 0.0f, 0.0f};
+    FRect    s     = {0.0f, 0.0f, 0.0f, 0.0f};
+    if (dst) {
+        flags |= RecordHasDst;
+        d = *dst;
+    }
+    if (src) {
+        flags |= RecordHasSrc;
+        s = *src;
+    }
+    push(op, {
+        texture->snapshot, flags,
+        f2u(d.x), f2u(d.y), f2u(d.w), f2u(d.h),
+        f2u(s.x), f2u(s.y), f2u(s.w), f2u(s.h)
+    });
+    return true;
+}
+void RecordContext::clear(Brush &b) {
+    push(RecordOp::Clear, {recorder->add_brush(b)});
+}
+bool RecordContext::draw_path(const PainterPath &path) {
+    recorder->paths.push_back(path);
+    push(RecordOp::DrawPath, {uint32_t(recorder->paths.size() - 1)});
+    return true;
+}
+bool RecordContext::draw_line(float x1, float y1, float x2, float y2) {
+    push(RecordOp::DrawLine, {f2u(x1), f2u(y1), f2u(x2), f2u(y2)});
+    return true;
+}
+bool RecordContext::draw_rect(float x, float y, float w, float h) {
+    push(RecordOp::DrawRect, {f2u(x), f2u(y), f2u(w), f2u(h)});
+    return true;
+}
+bool RecordContext::draw_rounded_rect(float x, float y, float w, float h, float r) {
+    push(RecordOp::DrawRoundedRect, {f2u(x), f2u(y), f2u(w), f2u(h), f2u(r)});
+    return true;
+}
+bool RecordContext::draw_ellipse(float x, float y, float xr, float yr) {
+    push(RecordOp::DrawEllipse, {f2u(x), f2u(y), f2u(xr), f2u(yr)});
+    return true;
+}
+bool RecordContext::draw_image(AbstractTexture *image, const FRect *dst, const FRect *src) {
+    return push_image(RecordOp::DrawImage, image, dst, src);
+}
+bool RecordContext::draw_text(Alignment align, Font &font, u8string_view text, float x, float y) {
+    recorder->strings.emplace_back(text);
+    push(RecordOp::DrawText, {
+        uint32_t(align), recorder->add_font(font), uint32_t(recorder->strings.size() - 1), f2u(x), f2u(y)
+    });
+    return true;
+}
+bool RecordContext::draw_text(Alignment align, const TextLayout &layout, float x, float y) {
+    recorder->layouts.push_back(layout);
+    push(RecordOp::DrawLayout, {uint32_t(align), uint32_t(recorder->layouts.size() - 1), f2u(x), f2u(y)});
+    return true;
+}
+bool RecordContext::fill_path(const PainterPath &path) {
+    recorder->paths.push_back(path);
+    push(RecordOp::FillPath, {uint32_t(recorder->paths.size() - 1)});
+    return true;
+}
+bool RecordContext::fill_rect(float x, float y, float w, float h) {
+    push(RecordOp::FillRect, {f2u(x), f2u(y), f2u(w), f2u(h)});
+    return true;
+}
+bool RecordContext::fill_rounded_rect(float x, float y, float w, float h, float r) {
+    push(RecordOp::FillRoundedRect, {f2u(x), f2u(y), f2u(w), f2u(h), f2u(r)});
+    return true;
+}
+bool RecordContext::fill_ellipse(float x, float y, float xr, float yr) {
+    push(RecordOp::FillEllipse, {f2u(x), f2u(y), f2u(xr), f2u(yr)});
+    return true;
+}
+bool RecordContext::fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) {
+    return push_image(RecordOp::FillMask, mask, dst, src);
+}
+bool RecordContext::set_state(PaintContextState state, const void *v) {
+    switch (state) {
+        case PaintContextState::StrokeWidth : {
+            push(RecordOp::SetStrokeWidth, {f2u(*static_cast<const float*>(v))});
+            break;
+        }
+        case PaintContextState::Antialias : {
+            push(RecordOp::SetAntialias, {uint32_t(*static_cast<const bool*>(v))});
+            break;
+        }
+        case PaintContextState::Alpha : {
+            push(RecordOp::SetAlpha, {f2u(*static_cast<const float*>(v))});
+            break;
+        }
+        case PaintContextState::Transform : {
+            FMatrix m;
+            if (v) {
+                m = *static_cast<const FMatrix*>(v);
+            }
+            push(RecordOp::SetTransform, {
+                uint32_t(v != nullptr),
+                f2u(m[0][0]), f2u(m[0][1]), f2u(m[1][0]), f2u(m[1][1]), f2u(m[2][0]), f2u(m[2][1])
+            });
+            break;
+        }
+        case PaintContextState::Scissor : {
+            // Unset scissor records zeros, FRect is not initialized by default
+            FMatrix m;
+            FRect   r(0, 0, 0, 0);
+            if (v) {
+                m = static_cast<const PaintScissor*>(v)->matrix;
+                r = static_cast<const PaintScissor*>(v)->rect;
+            }
+            push(RecordOp::SetScissor, {
+                uint32_t(v != nullptr),
+                f2u(m[0][0]), f2u(m[0][1]), f2u(m[1][0]), f2u(m[1][1]), f2u(m[2][0]), f2u(m[2][1]),
+                f2u(r.x), f2u(r.y), f2u(r.w), f2u(r.h)
+            });
+            break;
+        }
+        case PaintContextState::Brush : {
+            push(RecordOp::SetBrush, {recorder->add_brush(*static_cast<const Brush*>(v))});
+            break;
+        }
+        case PaintContextState::Pen : {
+            push(RecordOp::SetPen, {recorder->add_pen(*static_cast<const Pen*>(v))});
+            break;
+        }
+        default : return false;
+    }
+    return true;
+}
+auto RecordContext::create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi) -> Ref<AbstractTexture> {
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+    return new RecordTexture(fmt, w, h, xdpi, ydpi);
+}
+
+// Compare helpers
+bool same_pixels(const PixBuffer &a, const PixBuffer &b) {
+    if (a.pixels() == b.pixels()) {
+        return true;
+    }
+    if (a.format() != b.format() || a.size() != b.size()) {
+        return false;
+    }
+    auto row = size_t(a.width()) * a.bytes_per_pixel();
+    for (int y = 0; y < a.height(); y++) {
+        auto la = static_cast<const uint8_t*>(a.pixels()) + size_t(y) * a.pitch();
+        auto lb = static_cast<const uint8_t*>(b.pixels()) + size_t(y) * b.pitch();
+        if (Btk_memcmp(la, lb, row) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+// Brush and Pen compare the shared data pointer, a loaded or rerecorded one is compared by value
+bool same_brush(const Brush &a, const Brush &b) {
+    if (a == b) {
+        return true;
+    }
+    // Empty one has no data
+    Brush empty;
+    if (a == empty || b == empty) {
+        return false;
+    }
+    if (a.type() != b.type() || a.coordinate_mode() != b.coordinate_mode() || !(a.rect() == b.rect())) {
+        return false;
+    }
+    if (!(a.matrix() == b.matrix())) {
+        return false;
+    }
+    switch (a.type()) {
+        case BrushType::Solid : {
+            return a.color() == b.color();
+        }
+        case BrushType::LinearGradient : {
+            auto &ga = a.linear_gradient();
+            auto &gb = b.linear_gradient();
+            return ga == gb && ga.start_point() == gb.start_point() && ga.end_point() == gb.end_point();
+        }
+        case BrushType::RadialGradient : {
+            auto &ga = a.radial_gradient();
+            auto &gb = b.radial_gradient();
+            return ga == gb && 
+                   ga.center_point() == gb.center_point() && 
+                   ga.origin_offset() == gb.origin_offset() &&
+                   ga.radius_x() == gb.radius_x() && 
+                   ga.radius_y() == gb.radius_y();
+        }
+        case BrushType::Bitmap : {
+            return same_pixels(a.bitmap(), b.bitmap());
+        }
+        case BrushType::Texture : {
+            return a.texture() == b.texture();
+        }
+        default : {
+            return false;
+        }
+    }
+}
+bool same_pen(const Pen &a, const Pen &b) {
+    if (a == b) {
+        return true;
+    }
+    if (a.empty() || b.empty()) {
+        return false;
+    }
+    return a.dash_style()   == b.dash_style()   &&
+           a.line_join()    == b.line_join()    &&
+           a.line_cap()     == b.line_cap()     &&
+           a.dash_offset()  == b.dash_offset()  &&
+           a.miter_limit()  == b.miter_limit()  &&
+           a.dash_pattern() == b.dash_pattern();
+}
+bool same_path(const PainterPath &a, const PainterPath &b) {
+    std::vector<uint32_t> wa, wb;
+    RecordPathSink sa(wa);
+    RecordPathSink sb(wb);
+    a.stream(&sa);
+    b.stream(&sb);
+    return wa == wb;
+}
+PainterPath path_from_words(const uint32_t *iter, const uint32_t *end) {
+    PainterPath path;
+    path.open();
+    while (iter < end) {
+        size_t left = end - iter;
+        switch (iter[0]) {
+            case RecordMoveTo : {
+                if (left < 3) return path;
+                path.move_to(u2f(iter[1]), u2f(iter[2]));
+                iter += 3;
+                break;
+            }
+            case RecordLineTo : {
+                if (left < 3) return path;
+                path.line_to(u2f(iter[1]), u2f(iter[2]));
+                iter += 3;
+                break;
+            }
+            case RecordBezierTo : {
+                if (left < 7) return path;
+                path.bezier_to(u2f(iter[1]), u2f(iter[2]), u2f(iter[3]), u2f(iter[4]), u2f(iter[5]), u2f(iter[6]));
+                iter += 7;
+                break;
+            }
+            case RecordClosePath : {
+                path.close_path();
+                iter += 1;
+                break;
+            }
+            case RecordSetWinding : {
+                if (left < 2) return path;
+                path.set_winding(PathWinding(iter[1]));
+                iter += 2;
+                break;
+            }
+            default : {
+                // Broken, stop here
+                path.close();
+                return path;
+            }
+        }
+    }
+    path.close();
+    return path;
+}
+
+BTK_PRIV_END
+
+BTK_NS_BEGIN
+
+// Impl
+void PainterRecorderImpl::clear() {
+    // Keep the capacity of buffer, it will be reused in the next frame
+    words.clear();
+    ncmds = 0;
+
+    brushes.clear();
+    pens.clear();
+    fonts.clear();
+    strings.clear();
+    layouts.clear();
+    paths.clear();
+    images.clear();
+
+    cache_textures.clear();
+    generation += 1;
+}
+uint32_t PainterRecorderImpl::add_brush(const Brush &brush) {
+    if (brushes.empty() || brushes.back() != brush) {
+        brushes.push_back(brush);
+    }
+    return brushes.size() - 1;
+}
+uint32_t PainterRecorderImpl::add_pen(const Pen &pen) {
+    if (pens.empty() || pens.back() != pen) {
+        pens.push_back(pen);
+    }
+    return pens.size() - 1;
+}
+uint32_t PainterRecorderImpl::add_font(const Font &font) {
+    if (fonts.empty() || fonts.back() != font) {
+        fonts.push_back(font);
+    }
+    return fonts.size() - 1;
+}
+auto PainterRecorderImpl::offsets() const -> std::vector<size_t> {
+    std::vector<size_t> result;
+    result.reserve(ncmds);
+    for (size_t offset = 0; offset < words.size(); offset += 1 + record_nargs(words[offset])) {
+        result.push_back(offset);
+    }
+    return result;
+}
+bool PainterRecorderImpl::validate() const {
+    // Check all commands and the index of side tables
+    size_t n = 0;
+    for (size_t offset = 0; offset < words.size(); n++) {
+        auto op = words[offset];
+        if (op >= uint32_t(RecordOp::Max)) {
+            return false;
+        }
+        auto args = RecordArgs[op];
+        auto nargs = record_nargs(op);
+        if (offset + 1 + nargs > words.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < nargs; i++) {
+            auto v = words[offset + 1 + i];
+            size_t limit = SIZE_MAX;
+            switch (args[i]) {
+                case 'B' : limit = brushes.size(); break;
+                case 'P' : limit = pens.size(); break;
+                case 'F' : limit = fonts.size(); break;
+                case 'S' : limit = strings.size(); break;
+                case 'L' : limit = layouts.size(); break;
+                case 'H' : limit = paths.size(); break;
+                case 'I' : limit = images.size(); break;
+                default : break;
+            }
+            if (v >= limit) {
+                return false;
+            }
+        }
+        offset += 1 + nargs;
+    }
+    return n == ncmds;
+}
+bool PainterRecorderImpl::same_command(size_t offset, const PainterRecorderImpl &other, size_t other_offset) const {
+    auto op = words[offset];
+    if (op != other.words[other_offset]) {
+        return false;
+    }
+    auto args = RecordArgs[op];
+    for (size_t i = 0; args[i] != '\0'; i++) {
+        auto a = words[offset + 1 + i];
+        auto b = other.words[other_offset + 1 + i];
+        bool same = true;
+        switch (args[i]) {
+            case 'B' : same = same_brush(brushes[a], other.brushes[b]); break;
+            case 'P' : same = same_pen(pens[a], other.pens[b]); break;
+            case 'F' : same = fonts[a] == other.fonts[b]; break;
+            case 'S' : same = u8string_view(strings[a]) == u8string_view(other.strings[b]); break;
+            case 'L' : {
+                auto &la = layouts[a];
+                auto &lb = other.layouts[b];
+                same = la.text() == lb.text() && la.font() == lb.font();
+                break;
+            }
+            case 'H' : same = same_path(paths[a], other.paths[b]); break;
+            case 'I' : {
+                auto &ia = images[a];
+                auto &ib = other.images[b];
+                same = ia.dpi == ib.dpi && ia.mode == ib.mode && same_pixels(ia.buffer, ib.buffer);
+                break;
+            }
+            default  : same = a == b; break;
+        }
+        if (!same) {
+            return false;
+        }
+    }
+    return true;
+}
+void PainterRecorderImpl::play(Painter &p) const {
+    if (p.empty() || words.empty()) {
+        return;
+    }
+    // Textures are per-context
+    if (cache_ctxt != p.context()) {
+        cache_ctxt = p.context();
+        cache_textures.clear();
+    }
+    cache_textures.resize(images.size());
+
+    auto texture_of = [&](uint32_t idx) -> const Texture & {
+        auto &tex = cache_textures[idx];
+        if (tex.empty()) {
+            // Not created or destroyed with context
+            auto &image = images[idx];
+            tex = p.create_texture(image.buffer.format(), image.buffer.width(), image.buffer.height(), image.dpi.x, image.dpi.y);
+            if (!tex.empty()) {
+                tex.update(nullptr, image.buffer.pixels(), image.buffer.pitch());
+                tex.set_interpolation_mode(image.mode);
+            }
+        }
+        return tex;
+    };
+    auto matrix_of = [](const uint32_t *a) {
+        return FMatrix(u2f(a[0]), u2f(a[1]), u2f(a[2]), u2f(a[3]), u2f(a[4]), u2f(a[5]));
+    };
+    auto rect_of = [](const uint32_t *a) {
+        return FRect(u2f(a[0]), u2f(a[1]), u2f(a[2]), u2f(a[3]));
+    };
+
+    // All commands are relative to the current state of painter
+    FMatrix base   = p.transform_matrix();
+    float   alpha  = p.alpha();
+    FMatrix matrix = FMatrix::Identity();
+    Brush   brush  = Color::Black;
+
+    auto apply_transform = [&](const FMatrix &m) {
+        p.reset_transform();
+        p.transform(base);
+        p.transform(m);
+    };
+
+    p.save();
+    for (size_t offset = 0; offset < words.size(); ) {
+        auto op   = RecordOp(words[offset]);
+        auto args = words.data() + offset + 1;
+        offset   += 1 + record_nargs(words[offset]);
+
+        switch (op) {
+            case RecordOp::Clear : {
+                p.set_brush(brushes[args[0]]);
+                p.clear();
+                p.set_brush(brush);
+                break;
+            }
+            case RecordOp::DrawPath : {
+                p.draw_path(paths[args[0]]);
+                break;
+            }
+            case RecordOp::DrawLine : {
+                p.draw_line(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::DrawRect : {
+                p.draw_rect(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::DrawRoundedRect : {
+                p.draw_rounded_rect(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]), u2f(args[4]));
+                break;
+            }
+            case RecordOp::DrawEllipse : {
+                p.draw_ellipse(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::DrawImage :
+            case RecordOp::FillMask : {
+                FRect dst = rect_of(args + 2);
+                FRect src = rect_of(args + 6);
+                auto &tex = texture_of(args[0]);
+                auto  d   = (args[1] & RecordHasDst) ? &dst : nullptr;
+                auto  s   = (args[1] & RecordHasSrc) ? &src : nullptr;
+                if (op == RecordOp::DrawImage) {
+                    p.draw_image(tex, d, s);
+                }
+                else {
+                    p.fill_mask(tex, d, s);
+                }
+                break;
+            }
+            case RecordOp::DrawText : {
+                p.set_text_align(Alignment(args[0]));
+                p.set_font(fonts[args[1]]);
+                p.draw_text(strings[args[2]], u2f(args[3]), u2f(args[4]));
+                break;
+            }
+            case RecordOp::DrawLayout : {
+                p.set_text_align(Alignment(args[0]));
+                p.draw_text(layouts[args[1]], u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::FillPath : {
+                p.fill_path(paths[args[0]]);
+                break;
+            }
+            case RecordOp::FillRect : {
+                p.fill_rect(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::FillRoundedRect : {
+                p.fill_rounded_rect(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]), u2f(args[4]));
+                break;
+            }
+            case RecordOp::FillEllipse : {
+                p.fill_ellipse(u2f(args[0]), u2f(args[1]), u2f(args[2]), u2f(args[3]));
+                break;
+            }
+            case RecordOp::SetStrokeWidth : {
+                p.set_stroke_width(u2f(args[0]));
+                break;
+            }
+            case RecordOp::SetAntialias : {
+                p.set_antialias(args[0] != 0);
+                break;
+            }
+            case RecordOp::SetAlpha : {
+                p.set_alpha(alpha * u2f(args[0]));
+                break;
+            }
+            case RecordOp::SetTransform : {
+                matrix = args[0] ? matrix_of(args + 1) : FMatrix::Identity();
+                apply_transform(matrix);
+                break;
+            }
+            case RecordOp::SetScissor : {
+                if (!args[0]) {
+                    p.reset_scissor();
+                    break;
+                }
+                // The scissor is in the space of its matrix
+                apply_transform(matrix_of(args + 1));
+                p.set_scissor(rect_of(args + 7));
+                apply_transform(matrix);
+                break;
+            }
+            case RecordOp::SetBrush : {
+                brush = brushes[args[0]];
+                p.set_brush(brush);
+                break;
+            }
+            case RecordOp::SetPen : {
+                p.set_pen(pens[args[0]]);
+                break;
+            }
+            default : BTK_ASSERT(false);
+        }
+    }
+    p.restore();
+}
+bool PainterRecorderImpl::write_to(IOStream *stream) const {
+    RecordWriter w(stream);
+    w.u32(RecordMagic);
+    w.u32(RecordVersion);
+    w.f32(size.w);
+    w.f32(size.h);
+    w.point(dpi);
+
+    w.u32(ncmds);
+    w.words(words);
+
+    // Brushes
+    w.u32(brushes.size());
+    for (auto &brush : brushes) {
+        auto type = brush.type();
+        if (type == BrushType::Texture) {
+            // Texture is device depended, keep the color only
+            type = BrushType::Solid;
+        }
+        w.u32(uint32_t(type));
+        w.u32(uint32_t(brush.coordinate_mode()));
+        auto r = brush.rect();
+        w.f32(r.x); w.f32(r.y); w.f32(r.w); w.f32(r.h);
+
+        switch (type) {
+            case BrushType::Solid : {
+                w.color(brush.color());
+                break;
+            }
+            case BrushType::LinearGradient : {
+                auto &g = brush.linear_gradient();
+                w.point(g.start_point());
+                w.point(g.end_point());
+                w.gradient(g);
+                break;
+            }
+            case BrushType::RadialGradient : {
+                auto &g = brush.radial_gradient();
+                w.point(g.center_point());
+                w.point(g.origin_offset());
+                w.f32(g.radius_x());
+                w.f32(g.radius_y());
+                w.gradient(g);
+                break;
+            }
+            case BrushType::Bitmap : {
+                w.pixbuffer(brush.bitmap());
+                break;
+            }
+            default : break;
+        }
+    }
+
+    // Pens
+    w.u32(pens.size());
+    for (auto &pen : pens) {
+        w.u32(!pen.empty());
+        if (pen.empty()) {
+            continue;
+        }
+        w.u32(uint32_t(pen.dash_style()));
+        w.u32(uint32_t(pen.line_join()));
+        w.u32(uint32_t(pen.line_cap()));
+        w.f32(pen.dash_offset());
+        w.f32(pen.miter_limit());
+        auto &pattern = pen.dash_pattern();
+        w.u32(pattern.size());
+        for (auto v : pattern) {
+            w.f32(v);
+        }
+    }
+
+    // Fonts
+    w.u32(fonts.size());
+    for (auto &font : fonts) {
+        w.font(font);
+    }
+
+    // Strings
+    w.u32(strings.size());
+    for (auto &str : strings) {
+        w.str(str);
+    }
+
+    // Layouts
+    w.u32(layouts.size());
+    for (auto &layout : layouts) {
+        w.str(layout.text());
+        w.font(layout.font());
+    }
+
+    // Paths
+    std::vector<uint32_t> path_words;
+    w.u32(paths.size());
+    for (auto &path : paths) {
+        RecordPathSink sink(path_words);
+        path_words.clear();
+        path.stream(&sink);
+        w.words(path_words);
+    }
+
+    // Images
+    w.u32(images.size());
+    for (auto &image : images) {
+        w.point(image.dpi);
+        w.u32(uint32_t(image.mode));
+        w.pixbuffer(image.buffer);
+    }
+
+    return w.ok;
+}
+bool PainterRecorderImpl::read_from(IOStream *stream) {
+    RecordReader r(stream);
+    if (r.u32() != RecordMagic || r.u32() != RecordVersion) {
+        return false;
+    }
+    size.w = r.f32();
+    size.h = r.f32();
+    dpi    = r.point();
+
+    ncmds  = r.u32();
+    r.words(words);
+
+    // Brushes
+    auto n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        auto type  = BrushType(r.u32());
+        auto cmode = CoordinateMode(r.u32());
+        FRect rect;
+        rect.x = r.f32(); rect.y = r.f32(); rect.w = r.f32(); rect.h = r.f32();
+
+        Brush brush;
+        switch (type) {
+            case BrushType::Solid : {
+                brush.set_color(r.color());
+                break;
+            }
+            case BrushType::LinearGradient : {
+                LinearGradient g;
+                g.set_start_point(r.point());
+                g.set_end_point(r.point());
+                r.gradient(g);
+                brush.set_gradient(g);
+                break;
+            }
+            case BrushType::RadialGradient : {
+                RadialGradient g;
+                g.set_center_point(r.point());
+                g.set_origin_offset(r.point());
+                float rx = r.f32();
+                float ry = r.f32();
+                g.set_radius(rx, ry);
+                r.gradient(g);
+                brush.set_gradient(g);
+                break;
+            }
+            case BrushType::Bitmap : {
+                brush.set_image(r.pixbuffer());
+                break;
+            }
+            default : return false;
+        }
+        brush.set_coordinate_mode(cmode);
+        brush.set_rect(rect);
+        brushes.emplace_back(std::move(brush));
+    }
+
+    // Pens
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        Pen pen;
+        if (r.u32()) {
+            auto style  = DashStyle(r.u32());
+            auto join   = LineJoin(r.u32());
+            auto cap    = LineCap(r.u32());
+            auto offset = r.f32();
+            auto miter  = r.f32();
+            std::vector<float> pattern;
+            auto count  = r.u32();
+            for (uint32_t j = 0; r.ok && j < count; j++) {
+                pattern.push_back(r.f32());
+            }
+            pen.set_dash_pattern(pattern);
+            pen.set_dash_style(style);
+            pen.set_line_join(join);
+            pen.set_line_cap(cap);
+            pen.set_dash_offset(offset);
+            pen.set_miter_limit(miter);
+        }
+        pens.emplace_back(std::move(pen));
+    }
+
+    // Fonts
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        fonts.emplace_back(r.font());
+    }
+
+    // Strings
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        strings.emplace_back(r.str());
+    }
+
+    // Layouts
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        TextLayout layout;
+        auto text = r.str();
+        layout.set_font(r.font());
+        layout.set_text(text);
+        layouts.emplace_back(std::move(layout));
+    }
+
+    // Paths
+    std::vector<uint32_t> path_words;
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        r.words(path_words);
+        paths.emplace_back(path_from_words(path_words.data(), path_words.data() + path_words.size()));
+    }
+
+    // Images
+    n = r.u32();
+    for (uint32_t i = 0; r.ok && i < n; i++) {
+        RecordImage image;
+        image.dpi    = r.point();
+        image.mode   = InterpolationMode(r.u32());
+        image.buffer = r.pixbuffer();
+        if (image.dpi.x <= 0.0f || image.dpi.y <= 0.0f) {
+            return false;
+        }
+        images.emplace_back(std::move(image));
+    }
+
+    return r.ok && validate();
+}
+
+// PainterRecorder
+PainterRecorder::PainterRecorder() {
+    priv = new PainterRecorderImpl;
+}
+PainterRecorder::PainterRecorder(PainterRecorder &&r) {
+    priv = r.priv;
+    r.priv = nullptr;
+}
+PainterRecorder::~PainterRecorder() {
+    delete priv;
+}
+void PainterRecorder::set_size(float w, float h, float xdpi, float ydpi) {
+    if (!priv) {
+        priv = new PainterRecorderImpl;
+    }
+    priv->size = FSize(w, h);
+    priv->dpi  = FPoint(xdpi, ydpi);
+}
+void PainterRecorder::clear() {
+    if (priv) {
+        priv->clear();
+    }
+}
+bool PainterRecorder::empty() const {
+    return count() == 0;
+}
+size_t PainterRecorder::count() const {
+    if (priv) {
+        return priv->ncmds;
+    }
+    return 0;
+}
+size_t PainterRecorder::memory_usage() const {
+    if (priv) {
+        return priv->words.capacity() * sizeof(uint32_t);
+    }
+    return 0;
+}
+void PainterRecorder::play(Painter &painter) const {
+    if (priv) {
+        priv->play(painter);
+    }
+}
+auto PainterRecorder::diff(const PainterRecorder &other) const -> PainterRecorderDiff {
+    PainterRecorderDiff result;
+    std::vector<size_t> a;
+    std::vector<size_t> b;
+    if (priv) {
+        a = priv->offsets();
+    }
+    if (other.priv) {
+        b = other.priv->offsets();
+    }
+
+    // Same commands at begin
+    while (result.prefix < a.size() && result.prefix < b.size()) {
+        if (!priv->same_command(a[result.prefix], *other.priv, b[result.prefix])) {
+            break;
+        }
+        result.prefix += 1;
+    }
+    // Same commands at end
+    while (result.prefix + result.suffix < a.size() && result.prefix + result.suffix < b.size()) {
+        auto ia = a.size() - result.suffix - 1;
+        auto ib = b.size() - result.suffix - 1;
+        if (!priv->same_command(a[ia], *other.priv, b[ib])) {
+            break;
+        }
+        result.suffix += 1;
+    }
+    result.removed = a.size() - result.prefix - result.suffix;
+    result.added   = b.size() - result.prefix - result.suffix;
+    return result;
+}
+bool PainterRecorder::write_to(IOStream *stream) const {
+    if (!priv || !stream) {
+        return false;
+    }
+    return priv->write_to(stream);
+}
+PainterRecorder &PainterRecorder::operator =(PainterRecorder &&r) {
+    if (this != &r) {
+        delete priv;
+        priv = r.priv;
+        r.priv = nullptr;
+    }
+    return *this;
+}
+PainterRecorder PainterRecorder::FromStream(IOStream *stream) {
+    PainterRecorder recorder;
+    if (!stream || !recorder.priv->read_from(stream)) {
+        recorder.priv->clear();
+    }
+    return recorder;
+}
+
+// Painter on recorder
+Painter::Painter(PainterRecorder &recorder) : Painter(recorder.priv ? new RecordDevice(recorder.priv) : nullptr, true) { }
+
+BTK_NS_END
@@ -5,9 +5,127 @@
 #include <Btk/context.hpp>
 #include <Btk/widget.hpp>
 #include <Btk/event.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <list>
 
 BTK_NS_BEGIN
 
+// Uniform grid of the children, the z-order comes from Widget::_zorder
+class WidgetIndex {
+    public:
+        static constexpr int CellShift = 7; //< 128 x 128 cells
+        static constexpr int MaxCells  = 64; //< Children covering more cells are kept in a list
+
+        void insert(Widget *w, const Rect &r) {
+            auto &e = entries[w];
+            e.large = false;
+            e.cells = {0, 0, 0, 0};
+            link(w, e, r);
+        }
+        void remove(Widget *w) {
+            auto iter = entries.find(w);
+            if (iter == entries.end()) {
+                return;
+            }
+            unlink(w, iter->second);
+            entries.erase(iter);
+        }
+        void update(Widget *w, const Rect &r) {
+            auto iter = entries.find(w);
+            if (iter == entries.end()) {
+                return;
+            }
+            auto &e = iter->second;
+            if (!e.large && e.cells == cell_range(r)) {
+                // Still in the same cells
+                return;
+            }
+            unlink(w, e);
+            link(w, e, r);
+        }
+        /**
+         * @brief Visit the children may contain the point
+         * 
+         * @param fn void(Widget *w)
+         */
+        template <typename Callable>
+        void query(int x, int y, Callable &&fn) const {
+            auto iter = cells.find(cell_key(x >> CellShift, y >> CellShift));
+            if (iter != cells.end()) {
+                for (auto w : iter->second) {
+                    fn(w);
+                }
+            }
+            for (auto w : large) {
+                fn(w);
+            }
+        }
+    private:
+        struct Entry {
+            Rect    cells; //< Range of the covered cells
+            bool    large; //< In the large list
+        };
+
+        static uint64_t cell_key(int cx, int cy) {
+            return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+        }
+        static Rect cell_range(const Rect &r) {
+            if (r.empty()) {
+                return {0, 0, 0, 0};
+            }
+            int x0 = r.x >> CellShift;
+            int y0 = r.y >> CellShift;
+            int x1 = int((int64_t(r.x) + r.w - 1) >> CellShift);
+            int y1 = int((int64_t(r.y) + r.h - 1) >> CellShift);
+            return {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+        }
+        void link(Widget *w, Entry &e, const Rect &r) {
+            e.cells = cell_range(r);
+            e.large = int64_t(e.cells.w) * e.cells.h > MaxCells;
+            if (e.large) {
+                large.push_back(w);
+                return;
+            }
+            for (int cy = e.cells.y; cy < e.cells.y + e.cells.h; cy++) {
+                for (int cx = e.cells.x; cx < e.cells.x + e.cells.w; cx++) {
+                    cells[cell_key(cx, cy)].push_back(w);
+                }
+            }
+        }
+        void unlink(Widget *w, Entry &e) {
+            auto erase = [w](std::vector<Widget *> &vec) {
+                auto iter = std::find(vec.begin(), vec.end(), w);
+                if (iter != vec.end()) {
+                    *iter = vec.back();
+                    vec.pop_back();
+                }
+            };
+            if (e.large) {
+                erase(large);
+                return;
+            }
+            for (int cy = e.cells.y; cy < e.cells.y + e.cells.h; cy++) {
+                for (int cx = e.cells.x; cx < e.cells.x + e.cells.w; cx++) {
+                    auto iter = cells.find(cell_key(cx, cy));
+                    if (iter == cells.end()) {
+                        continue;
+                    }
+                    erase(iter->second);
+                    if (iter->second.empty()) {
+                        cells.erase(iter);
+                    }
+                }
+            }
+        }
+
+        std::unordered_map<Widget *, Entry>                 entries;
+        std::unordered_map<uint64_t, std::vector<Widget *>> cells;
+        std::vector<Widget *>                               large;
+};
+
 Widget::Widget(Widget *parent) {
     _context = GetUIContext();
     BTK_ASSERT(_context);
@@ -32,8 +150,8 @@ Widget::Widget(Widget *parent, WindowFlags f) : Widget(parent) {
 Widget::~Widget() {
 
     // Auto detach from parent
-    if(_in_child_iter != std::list<Widget *>::iterator{}){
-        parent()->_children.erase(_in_child_iter);
+    if(_child_index != SIZE_MAX){
+        _parent->child_detach(this);
 
         // Notify parent
         ChildEvent event(Event::ChildRemoved, this);
@@ -43,10 +161,11 @@ Widget::~Widget() {
     }
     // Clear children
     for(auto w : _children) {
-        // Set iter to {}
-        w->_in_child_iter = std::list<Widget *>::iterator{};
+        // Mark as detached
+        w->_child_index = SIZE_MAX;
         delete w;
     }
+    delete _index;
     // Destroy window if needed
     if (is_window()) {
         window_destroy();
@@ -76,6 +195,11 @@ void Widget::set_visible(bool v) {
         _parent->focused_widget = nullptr;
     }
     request_layout();
+
+    if (!is_window()) {
+        // Let the area covered by self be painted again
+        repaint();
+    }
 }
 void Widget::show() {
     set_visible(true);
@@ -88,19 +212,15 @@ void Widget::raise() {
         _win->raise();
     }
     if (parent()) {
-        parent()->_children.erase(_in_child_iter);
-        parent()->_children.push_front(this);
-
-        _in_child_iter = parent()->_children.begin();
+        _zorder = ++parent()->_zorder_top;
+        parent()->_zchildren_dirty = true;
         repaint();
     }
 }
 void Widget::lower() {
     if (parent()) {
-        parent()->_children.erase(_in_child_iter);
-        parent()->_children.push_back(this);
-
-        _in_child_iter = --parent()->_children.end();
+        _zorder = --parent()->_zorder_bottom;
+        parent()->_zchildren_dirty = true;
         repaint();
     }
 }
@@ -128,8 +248,15 @@ void Widget::resize(int w, int h) {
 
     int old_w = _rect.w;
     int old_h = _rect.h;
+    // The area it left should be repainted, the device may keep the previous frame
+    if (_parent && _visible) {
+        _parent->repaint(_rect);
+    }
     _rect.w = w;
     _rect.h = h;
+    if (_parent && _parent->_index) {
+        _parent->_index->update(this, _rect);
+    }
     
     if (_win != nullptr) {
         _win->resize(w, h);
@@ -149,8 +276,14 @@ void Widget::resize(int w, int h) {
 void Widget::move(int x, int y) {
     int old_x = _rect.x;
     int old_y = _rect.y;
+    if (_parent && _visible) {
+        _parent->repaint(_rect);
+    }
     _rect.x = x;
     _rect.y = y;
+    if (_parent && _parent->_index) {
+        _parent->_index->update(this, _rect);
+    }
 
     if (_win != nullptr) {
         _win->move(x, y);
@@ -236,9 +369,24 @@ bool Widget::handle(Event &event) {
     switch (event.type()) {
         case Event::Paint : {
             bool restore_state = false;
+            bool partial = false;
             auto &p = painter();
 
-            if (_win) {
+            // Window, or a root rendered by render()
+            if (is_window()) {
+                auto &paint = event.as<PaintEvent>();
+
+                // Only repaint the damaged area if the device still has the previous frame
+                partial = !_damage_full && !_damage.empty() && _painter.content_preserved();
+                if (partial) {
+                    paint.set_damage(_damage.intersected(Rect(0, 0, _rect.w, _rect.h)));
+                }
+                else {
+                    paint.reset_damage();
+                }
+                _damage = Rect(0, 0, 0, 0);
+                _damage_full = false;
+
                 if (uint8_t(_attrs & WidgetAttrs::BackgroundTransparent)) {
                     _painter.set_color(Color::Transparent);
                 }
@@ -246,6 +394,9 @@ bool Widget::handle(Event &event) {
                     _painter.set_brush(_palette.window());
                 }
                 _painter.begin();
+                if (partial) {
+                    _painter.set_scissor(paint.damage());
+                }
                 _painter.clear();
             }
             else {
@@ -278,12 +429,18 @@ bool Widget::handle(Event &event) {
             //     p.scissor(Rect(0, 0, size()));
             // }
 
-            // Paint current widget first (background)
-            ret = paint_event(event.as<PaintEvent>());
+            // Reuse the cached content if it is a layer
+            if (parent() && (_attrs & WidgetAttrs::CacheLayer) == WidgetAttrs::CacheLayer && paint_layer(event.as<PaintEvent>())) {
+                ret = true;
+            }
+            else {
+                // Paint current widget first (background)
+                ret = paint_event(event.as<PaintEvent>());
 
-            // Paint children second (foreground)
-            if (uint8_t(_attrs & WidgetAttrs::PaintChildren)) {
-                paint_children(event.as<PaintEvent>());
+                // Paint children second (foreground)
+                if (uint8_t(_attrs & WidgetAttrs::PaintChildren)) {
+                    paint_children(event.as<PaintEvent>());
+                }
             }
 
 #if         !defined(NDEBUG)
@@ -297,13 +454,19 @@ bool Widget::handle(Event &event) {
                 p.restore();
             }
 
-            if (_win) {
+            if (is_window()) {
+                if (partial) {
+                    _painter.reset_scissor();
+                }
                 _painter.end();
             }
             break;
         }
         case Event::Hide : {
             _visible = false;
+            // Drop the cached layer, it will be repainted on show
+            _layer.clear();
+            _layer_dirty = true;
             break;
         }
         case Event::Show : {
@@ -664,10 +827,32 @@ void Widget::repaint() {
     //     return;
     // }
     if (!is_window()) {
-        return root()->repaint();
+        // Only the area of self
+        return repaint(Rect(0, 0, _rect.w, _rect.h));
     }
-    if (_win) {
-        _win->repaint();
+    _damage_full = true;
+    if (_clock) {
+        _clock->request_frame();
+    }
+}
+void Widget::repaint(const Rect &r) {
+    if (r.empty()) {
+        return;
+    }
+    // Map it to the window coord
+    Rect area = r;
+    Widget *cur = this;
+    while (!cur->is_window()) {
+        // The layers contain it are out of date
+        cur->_layer_dirty = true;
+        area.x += cur->_rect.x;
+        area.y += cur->_rect.y;
+        cur = cur->_parent;
+    }
+    // Merge into the damaged area of window
+    cur->_damage = cur->_damage.empty() ? area : cur->_damage.united(area);
+    if (cur->_clock) {
+        cur->_clock->request_frame();
     }
 }
 void Widget::repaint_now() {
@@ -681,6 +866,23 @@ void Widget::repaint_now() {
         handle(event);
     }
 }
+void Widget::render(Painter &painter) {
+    if (!is_window()) {
+        return root()->render(painter);
+    }
+    // Children paint by root()->_painter, so let them use the given one
+    _painter.swap(painter);
+
+    PaintEvent event;
+    event.set_widget(this);
+    event.set_timestamp(GetTicks());
+    handle(event);
+
+    _painter.swap(painter);
+}
+FrameClock *Widget::frame_clock() const {
+    return root()->_clock;
+}
 
 // Query
 
@@ -762,7 +964,17 @@ Painter &Widget::painter() const {
 
 // Child widgets
 Widget *Widget::child_at(int x, int y) const {
-    for(auto w : _children) {
+    if (_index) {
+        // Topmost one of the candidates in the cell
+        Widget *ret = nullptr;
+        _index->query(x, y, [&](Widget *w) {
+            if ((ret == nullptr || w->_zorder > ret->_zorder) && w->_visible && w->_rect.contains(x, y)) {
+                ret = w;
+            }
+        });
+        return ret;
+    }
+    for(auto w : zorder_children()) {
         if (w->_visible && w->rect().contains(x, y)) {
             return w;
         }
@@ -777,10 +989,14 @@ void Widget::add_child(Widget *w) {
 
     // Set parent
     w->_parent = this;
-    // Add to children
-    _children.push_front(w);
-    // Set iterator
-    w->_in_child_iter = _children.begin();
+    // Add to children, on the top
+    w->_child_index = _children.size();
+    w->_zorder      = ++_zorder_top;
+    _children.push_back(w);
+    _zchildren_dirty = true;
+    if (_index) {
+        _index->insert(w, w->_rect);
+    }
 
     // Notify
     ChildEvent event(Event::ChildAdded, w);
@@ -791,15 +1007,12 @@ void Widget::remove_child(Widget *w) {
     if (w == nullptr) {
         return;
     }
-    // Find in children
-    auto it = std::find(_children.begin(), _children.end(), w);
-    if (it == _children.end()) {
+    if (!has_child(w)) {
         return;
     }
 
     // Remove from children
-    w->_in_child_iter = {};
-    _children.erase(it);
+    child_detach(w);
 
     // Notify
     ChildEvent event(Event::ChildRemoved, w);
@@ -807,8 +1020,30 @@ void Widget::remove_child(Widget *w) {
     handle(event);
 }
 bool Widget::has_child(Widget *w) const {
-    auto it = std::find(_children.begin(), _children.end(), w);
-    return it != _children.end();
+    return w != nullptr && w->_child_index < _children.size() && _children[w->_child_index] == w;
+}
+void Widget::child_detach(Widget *w) {
+    // Swap with the last one, z-order is kept by the key
+    size_t idx = w->_child_index;
+    _children[idx] = _children.back();
+    _children[idx]->_child_index = idx;
+    _children.pop_back();
+    w->_child_index = SIZE_MAX;
+
+    _zchildren_dirty = true;
+    if (_index) {
+        _index->remove(w);
+    }
+}
+const std::vector<Widget *> &Widget::zorder_children() const {
+    if (_zchildren_dirty) {
+        _zchildren = _children;
+        std::sort(_zchildren.begin(), _zchildren.end(), [](Widget *a, Widget *b) {
+            return a->_zorder > b->_zorder;
+        });
+        _zchildren_dirty = false;
+    }
+    return _zchildren;
 }
 void Widget::set_parent(Widget *w) {
     if (parent() == w) {
@@ -826,19 +1061,140 @@ void Widget::set_parent(Widget *w) {
     }
 }
 void Widget::paint_children(PaintEvent &event) {
+    bool has_damage = event.has_damage();
+    Rect damage     = event.damage();
+
+    // The area could be seen, children out of it are culled
+    Rect clip = Rect(0, 0, _rect.w, _rect.h);
+    if (has_damage) {
+        clip = clip.intersected(damage);
+    }
+    if (clip.empty()) {
+        return;
+    }
+
+    // Collect opaque children from top to bottom, siblings fully under them could be skipped
+    struct Occluder {
+        Rect   rect;
+        size_t index; //< Index from the top
+    };
+    Occluder occluders[8];
+    size_t   noccluders = 0;
+    size_t   index      = 0;
+
+    auto &children = zorder_children();
+    for (auto w : children) {
+        if (noccluders == std::size(occluders)) {
+            break;
+        }
+        if (w->_visible && w->_opacity == 1.0f && (w->_attrs & WidgetAttrs::Opaque) == WidgetAttrs::Opaque) {
+            Rect area = w->_rect.intersected(clip);
+            if (!area.empty()) {
+                occluders[noccluders++] = {area, index};
+            }
+        }
+        index += 1;
+    }
+    auto occluded = [&](const Rect &area, size_t index) {
+        for (size_t i = 0; i < noccluders && occluders[i].index < index; i++) {
+            auto &r = occluders[i].rect;
+            if (r.x <= area.x && r.y <= area.y && r.x + r.w >= area.x + area.w && r.y + r.h >= area.y + area.h) {
+                return true;
+            }
+        }
+        return false;
+    };
+
     // From bottom to top
-    for(auto iter = _children.rbegin(); iter != _children.rend(); ++iter) {
+    index = children.size();
+    for(auto iter = children.rbegin(); iter != children.rend(); ++iter) {
         auto w = *iter;
+        index -= 1;
         if (!w->_visible || w->_rect.empty()) {
             // Invisible
             continue;
         }
-        // if (!w->_rect.is_intersected(_rect)) {
-        //     // Out of parent 
-        //     continue;
-        // }
+        Rect area = w->_rect.intersected(clip);
+        if (area.empty()) {
+            // Out of parent or the damaged area
+            continue;
+        }
+        if (occluded(area, index)) {
+            // Under a opaque sibling
+            continue;
+        }
+        // Translate the visible area to child coord
+        area.x -= w->_rect.x;
+        area.y -= w->_rect.y;
+        event.set_damage(area);
+
         w->handle(event);
     }
+
+    // Restore
+    if (has_damage) {
+        event.set_damage(damage);
+    }
+    else {
+        event.reset_damage();
+    }
+}
+
+bool Widget::paint_layer(PaintEvent &event) {
+    auto &p = painter();
+    auto [xdpi, ydpi] = window_dpi();
+
+    int pw = std::ceil(_rect.w * xdpi / 96.0f);
+    int ph = std::ceil(_rect.h * ydpi / 96.0f);
+    if (pw <= 0 || ph <= 0) {
+        return false;
+    }
+
+    // Size or dpi changed, recreate it
+    if (_layer.empty() || _layer.pixel_size() != Size(pw, ph) || _layer.dpi() != FPoint(xdpi, ydpi)) {
+        _layer = p.create_texture(PixFormat::RGBA32, pw, ph, xdpi, ydpi);
+        _layer_dirty = true;
+        if (_layer.empty()) {
+            return false;
+        }
+    }
+
+    if (_layer_dirty) {
+        Painter lp(_layer);
+        if (lp.empty()) {
+            // The texture could not be a render target on this backend
+            _layer.clear();
+            return false;
+        }
+
+        // Let self and children paint into the layer
+        auto &rp = root()->_painter;
+        rp.swap(lp);
+        rp.begin();
+        rp.set_color(Color::Transparent);
+        rp.clear();
+
+        bool has_damage = event.has_damage();
+        Rect damage     = event.damage();
+        event.reset_damage();
+
+        paint_event(event);
+        if (uint8_t(_attrs & WidgetAttrs::PaintChildren)) {
+            paint_children(event);
+        }
+
+        if (has_damage) {
+            event.set_damage(damage);
+        }
+        rp.end();
+        rp.swap(lp);
+
+        _layer_dirty = false;
+    }
+
+    FRect dst(0.0f, 0.0f, _rect.w, _rect.h);
+    p.draw_image(_layer, &dst, nullptr);
+    return true;
 }
 
 // Root
@@ -1002,6 +1358,22 @@ void Widget::set_attribute(WidgetAttrs attr, bool on) {
     else {
         _attrs &= ~ attr;
     }
+    if ((attr & WidgetAttrs::CacheLayer) == WidgetAttrs::CacheLayer && !on) {
+        _layer.clear();
+    }
+    if ((attr & WidgetAttrs::ChildIndex) == WidgetAttrs::ChildIndex) {
+        if (on && !_index) {
+            _index = new WidgetIndex;
+            for (auto w : _children) {
+                _index->insert(w, w->_rect);
+            }
+        }
+        else if (!on) {
+            delete _index;
+            _index = nullptr;
+        }
+    }
+    _layer_dirty = true;
 }
 
 // Mouse
@@ -1154,6 +1526,7 @@ void Widget::window_init() {
     _win->bind_widget(this);
     _painter = Painter::FromWindow(_win);
     _painter_inited = true;
+    _clock = new FrameClock(this);
 
     // Check opacity if had
     if (_opacity != 1.0f) {
@@ -1164,6 +1537,8 @@ void Widget::window_init() {
 }
 void Widget::window_destroy() {
     if (_win) {
+        delete _clock;
+        _clock = nullptr;
         // Release painter first
         _painter = {};
         _painter_inited = false;
@@ -1267,4 +1642,119 @@ Cursor::Cursor(const Cursor &c) = default;
 Cursor::~Cursor() = default;
 Cursor &Cursor::operator =(const Cursor &c) = default;
 
-BTK_NS_END
\ No newline at end of file
+// FrameClock
+FrameClock::FrameClock(Widget *window) : _window(window) { }
+FrameClock::~FrameClock() { }
+
+void FrameClock::request_frame() {
+    _requests += 1;
+    schedule();
+}
+int  FrameClock::add_tick_callback(TickCallback cb) {
+    int id = ++_next_id;
+    _callbacks.push_back({id, std::move(cb)});
+    schedule();
+    return id;
+}
+void FrameClock::remove_tick_callback(int id) {
+    auto iter = std::find_if(_callbacks.begin(), _callbacks.end(), [id](const Callback &c) {
+        return c.id == id;
+    });
+    if (iter == _callbacks.end()) {
+        return;
+    }
+    if (_ticking) {
+        // Running the callbacks, just mark it, tick() will sweep it
+        iter->fn = nullptr;
+        return;
+    }
+    _callbacks.erase(iter);
+}
+void FrameClock::set_refresh_rate(float hz) {
+    _hz = max(hz, 0.0f);
+}
+float FrameClock::refresh_rate() const {
+    if (_hz > 0.0f) {
+        return _hz;
+    }
+    float hz = 0.0f;
+    auto win = _window->winhandle();
+    if (win && win->query_value(AbstractWindow::RefreshRate, &hz) && hz > 0.0f) {
+        return hz;
+    }
+    return 60.0f;
+}
+void FrameClock::schedule() {
+    if (_timerid != 0 || _ticking) {
+        // Already armed, or tick() will schedule itself
+        return;
+    }
+    double period = 1000.0 / refresh_rate();
+    double now    = double(GetTicks());
+    if (now - double(_last_tick) >= period) {
+        // Idle for more than a period, tick as soon as possible
+        _deadline = now;
+    }
+    else {
+        // Keep the phase of the previous tick
+        _deadline = double(_last_tick) + period;
+    }
+    _timerid = add_timer(max<uint32_t>(uint32_t(_deadline - now), 1));
+}
+bool FrameClock::timer_event(TimerEvent &event) {
+    if (event.timerid() != _timerid) {
+        return false;
+    }
+    // Timers are periodic, we only want once
+    del_timer(_timerid);
+    _timerid = 0;
+
+    tick(GetTicks());
+    return true;
+}
+void FrameClock::tick(timestamp_t now) {
+    using namespace std::chrono;
+
+    double period = 1000.0 / refresh_rate();
+
+    _stats.frame     += 1;
+    _stats.interval   = _last_tick ? uint32_t(now - _last_tick) : 0;
+    _stats.skipped    = _stats.interval > period ? uint32_t(_stats.interval / period + 0.5) - 1 : 0;
+    _stats.time       = now;
+    _stats.tick_time  = 0.0;
+    _stats.paint_time = 0.0;
+    _last_tick        = now;
+    _ticking          = true;
+
+    // Animations first, they usually request a frame
+    auto start = steady_clock::now();
+    size_t n   = _callbacks.size(); //< Callbacks added now run on the next tick
+    for (size_t i = 0; i < n; i++) {
+        if (_callbacks[i].fn && !_callbacks[i].fn(now)) {
+            _callbacks[i].fn = nullptr;
+        }
+    }
+    _callbacks.erase(
+        std::remove_if(_callbacks.begin(), _callbacks.end(), [](const Callback &c) { return !c.fn; }),
+        _callbacks.end()
+    );
+    auto ticked = steady_clock::now();
+    _stats.tick_time = duration<double, std::milli>(ticked - start).count();
+
+    // Layout is done lazily in the paint event
+    _stats.requests = _requests;
+    _requests       = 0;
+    if (_stats.requests) {
+        _window->repaint_now();
+        _stats.paint_time = duration<double, std::milli>(steady_clock::now() - ticked).count();
+    }
+    _ticking = false;
+
+    _frame_done.emit();
+
+    if (_requests || !_callbacks.empty()) {
+        schedule();
+    }
+}
+
+BTK_NS_END
@@ -6852,8 +6852,8 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
                      g->transparent = -1;
                   }
                } else {
+                  // Btk: the size is the first sub-block, the terminator still follows it
                   stbi__skip(s, len);
-                  break;
                }
             }
             while ((len = stbi__get8(s)) != 0) {
@@ -9,6 +9,7 @@ BTK_NS_BEGIN
 extern "C" void __BtkPlatform_D2D_Init();
 extern "C" void __BtkPlatform_NVG_Init();
 extern "C" void __BtkPlatform_CAIRO_Init();
+extern "C" void __BtkPlatform_SOFT_Init();
 
 
 extern "C" void __BtkPlatform_Init() {
@@ -29,6 +30,10 @@ extern "C" void __BtkPlatform_Init() {
     __BtkPlatform_NVG_Init();
 #endif
 
+#if defined(BTK_SOFTWARE_PAINTER)
+    __BtkPlatform_SOFT_Init();
+#endif
+
     inited = true;
 }
 
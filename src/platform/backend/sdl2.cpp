@@ -7,6 +7,10 @@
 #include <SDL2/SDL_syswm.h>
 #include <SDL2/SDL.h>
 #include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <climits>
+#include <vector>
 
 // Import compile platfrom common headers
 
@@ -28,6 +32,8 @@
 
 // Internal use helper functions
 
+#include "common/sdl_coalesce.hpp"
+#include "common/timer_wheel.hpp"
 #include "sdl2_trkey.hpp"
 
 BTK_PRIV_BEGIN
@@ -41,7 +47,6 @@ using namespace BTK_NAMESPACE;
 
 // Event
 
-#define SDL_TIMER_EVENT   (SDL_LASTEVENT - 10086)
 #define SDL_REPAINT_EVENT (SDL_LASTEVENT - 10087)
 
 // Type checker
@@ -70,12 +75,6 @@ static_assert(offsetof(SDL_FRect, h) == offsetof(FRect, h));
 class SDLDriver ;
 class SDLWindow ;
 
-class SDLTimer {
-    public:
-        SDL_TimerID timer  = 0;
-        Object     *object = nullptr;
-};
-
 class SDLWindow final : public AbstractWindow {
     public:
         SDLWindow(SDL_Window *w, SDLDriver *dr, WindowFlags f);
@@ -131,7 +130,7 @@ class SDLWindow final : public AbstractWindow {
         SDL_SysWMinfo info;
 
         // For merge paint events
-        Uint32      last_repaint_ticks = 0; //< Last time request repaint ticks
+        bool        repaint_pending = false; //< A SDL_REPAINT_EVENT is in the queue
         Uint32      last_paint_time = 0;    //< Last time the paint was doned
     friend class SDLDispatcher;
     friend class SDLDriver;
@@ -153,11 +152,23 @@ class SDLDispatcher final : public EventDispatcher {
     private:
         bool      dispatch_sdl(SDL_Event *event);
         void      dispatch_sdl_window(SDL_Event *event);
+        bool      fetch_batch(); //< Wait and drain the SDL queue into batch (empty on timer due), false on error
+        void      dispatch_timers();
 
-        using TimersMap = std::unordered_map<timerid_t, SDLTimer>;
+        static constexpr size_t MaxBatch = 256; //< Limit the latency of a batch
+
+        static constexpr uint32_t CoarseSlack = 64; //< Max ms a coarse timer could be delayed for sharing the wakeup
 
         SDLDriver *driver = nullptr;
-        TimersMap  timers;
+        TimerWheel timers {GetTicks()};
+
+        // Events drained from the SDL queue, left ones are kept for the next run()
+        std::vector<SDL_Event>      batch;
+        std::vector<SDLMotionRange> batch_ranges; //< History range of the events in batch
+        std::vector<SDL_Point>      batch_history;
+        size_t                      batch_pos = 0;
+        const SDL_Point            *motion_history  = nullptr; //< Coalesced positions of the dispatching motion
+        size_t                      motion_nhistory = 0;
 
         Uint32    alloc_events = SDL_RegisterEvents(2);
         Uint32    btk_event    = alloc_events;
@@ -283,6 +294,19 @@ bool SDLDispatcher::dispatch_sdl(SDL_Event *event) {
             );
             tr_event.set_widget(win->widget);
 
+            // Positions coalesced into it, as offsets from the latest one
+            std::vector<Point> history;
+            if (motion_nhistory > 0) {
+                history.reserve(motion_nhistory);
+                for (size_t i = 0; i < motion_nhistory; i++) {
+                    history.emplace_back(
+                        win->sdl_to_btk(motion_history[i].x) - tr_event.x(),
+                        win->sdl_to_btk(motion_history[i].y) - tr_event.y()
+                    );
+                }
+                tr_event.set_history(history.data(), history.size());
+            }
+
             win->widget->handle(tr_event);
             break;
         }
@@ -509,11 +533,61 @@ void SDLDispatcher::dispatch_sdl_window(SDL_Event *event) {
     }
 }
 
+bool SDLDispatcher::fetch_batch() {
+    SDL_Event events[64];
+
+    batch.clear();
+    batch_ranges.clear();
+    batch_history.clear();
+    batch_pos = 0;
+
+    // Sleep until the nearest timer
+    int64_t timeout = timers.next_timeout(GetTicks());
+    if (timeout < 0) {
+        if (!SDL_WaitEvent(&events[0])) {
+            return false;
+        }
+    }
+    else if (!SDL_WaitEventTimeout(&events[0], int(min<int64_t>(timeout, INT_MAX)))) {
+        // Timeout, let the timers run
+        return true;
+    }
+    batch.push_back(events[0]);
+
+    // Drain the queue, so a burst of motion / resize could be merged
+    while (batch.size() < MaxBatch) {
+        size_t want = min(std::size(events), MaxBatch - batch.size());
+        int    n    = SDL_PeepEvents(events, int(want), SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+        if (n <= 0) {
+            break;
+        }
+        batch.insert(batch.end(), events, events + n);
+    }
+
+    SDLCoalesceEvents(batch, batch_ranges, batch_history);
+    return true;
+}
 int SDLDispatcher::run() {
     int retcode = EXIT_SUCCESS;
 
     SDL_Event event;
-    while (SDL_WaitEvent(&event)) {
+    while (true) {
+        // Timers are checked between events, so a busy queue could not starve them
+        dispatch_timers();
+        if (batch_pos >= batch.size()) {
+            if (!fetch_batch()) {
+                break;
+            }
+            if (batch.empty()) {
+                continue;
+            }
+        }
+        // Copy it out, a nested loop could refill the batch
+        event           = batch[batch_pos];
+        motion_history  = batch_history.data() + batch_ranges[batch_pos].begin;
+        motion_nhistory = batch_ranges[batch_pos].size;
+        batch_pos      += 1;
+
         if (!dispatch_sdl(&event)) {
             // It cannot handle it, event defined by ous
 
@@ -533,22 +607,6 @@ int SDLDispatcher::run() {
             if (event.type == interrupt_event) {
                 break;
             }
-            if (event.type == SDL_TIMER_EVENT) {
-                auto timerid = reinterpret_cast<timerid_t>(event.user.data1);
-                auto timestamp = reinterpret_cast<timestamp_t>(event.user.data2);
-                auto iter = timers.find(timerid);
-                if (iter != timers.end()) {
-                    auto object = iter->second.object;
-                    TimerEvent tevent(
-                        object,
-                        timerid
-                    );
-                    tevent.set_timestamp(timestamp);
-
-                    dispatch(&tevent);
-                }
-                continue;
-            }
             if (event.type == SDL_REPAINT_EVENT) {
                 auto winid = event.user.windowID;
                 auto timestamp = reinterpret_cast<timestamp_t>(event.user.data1);
@@ -583,40 +641,27 @@ bool SDLDispatcher::send(Event *event, EventDtor dtor) {
 bool SDLDispatcher::timer_del(Object *obj, timerid_t id) {
     BTK_UNUSED(obj);
 
-    auto iter = timers.find(id);
-    if (iter != timers.end()) {
-        auto timer = iter->second.timer;
-        timers.erase(iter);
-        return SDL_RemoveTimer(timer);
-    }
-    return false;
+    return timers.del(id);
 }
-timerid_t SDLDispatcher::timer_add(Object *obj, timertype_t, uint32_t ms) {
-    // Alloc id
-    timerid_t id;
-    do {
-        id = std::rand();
+timerid_t SDLDispatcher::timer_add(Object *obj, timertype_t type, uint32_t ms) {
+    // Coarse timers could be late for 1/8 of the interval, so they are fired together
+    uint32_t slack = 0;
+    if (type == TimerType::Coarse) {
+        slack = min(ms / 8, CoarseSlack);
     }
-    while(timers.find(id) != timers.end());  
-
-    SDL_TimerID timer = SDL_AddTimer(ms, [](Uint32 interval, void *id) -> Uint32 {
-        SDL_Event event;
-        event.type = SDL_TIMER_EVENT;
-        event.user.data1 = id;
-        event.user.data2 = reinterpret_cast<void*>(GetTicks());
-
-        SDL_PushEvent(&event);
-        return interval;
-    }, reinterpret_cast<void*>(id));
-
-    if (timer == 0) {
-        return 0;
-    }
-
-    timers[id].object = obj;
-    timers[id].timer  = timer;
-
-    return id;
+    return timers.add(obj, GetTicks(), ms, slack);
+}
+void SDLDispatcher::dispatch_timers() {
+    timestamp_t now = GetTicks();
+    timers.expire(now, [&, this](Object *object, timerid_t timerid) {
+        TimerEvent tevent(
+            object,
+            timerid
+        );
+        tevent.set_timestamp(now);
+
+        dispatch(&tevent);
+    });
 }
 
 // Driver
@@ -822,12 +867,11 @@ void SDLWindow::repaint() {
     // event.window.timestamp = SDL_GetTicks();
     // event.window.type = SDL_WINDOWEVENT;
     // event.window.windowID = SDL_GetWindowID(win);
-    Uint32 current = SDL_GetTicks();
-    if (current - last_repaint_ticks < 1) {
+    if (repaint_pending) {
         // Merge
         return;
     }
-    last_repaint_ticks = current;
+    repaint_pending = true;
 
     event.type = SDL_REPAINT_EVENT;
     event.user.windowID = SDL_GetWindowID(win);
@@ -983,6 +1027,15 @@ bool     SDLWindow::query_value(int what, ...) {
             p->h = sdl_to_btk(p->h);
             break;
         }
+        case RefreshRate : {
+            SDL_DisplayMode mode;
+            if (SDL_GetWindowDisplayMode(win, &mode) != 0 || mode.refresh_rate <= 0) {
+                ret = false;
+                break;
+            }
+            *va_arg(varg, float*) = float(mode.refresh_rate);
+            break;
+        }
         case Opacity : {
             ret = (SDL_GetWindowOpacity(win, va_arg(varg, float*)) == 0);
             break;
@@ -1146,6 +1199,8 @@ void   SDLWindow::load_dpi(Uint32 idx) {
 #endif
 }
 void   SDLWindow::do_repaint() {
+    repaint_pending = false;
+
     PaintEvent event;
     event.set_widget(widget);
     event.set_timestamp(GetTicks());
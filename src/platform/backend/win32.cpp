@@ -1278,6 +1278,18 @@ bool     Win32Window::query_value(int query, ...) {
             *va_arg(varg, Point*) = p;
             break;
         }
+        case RefreshRate : {
+            HDC hdc = GetDC(hwnd);
+            int hz  = GetDeviceCaps(hdc, VREFRESH);
+            ReleaseDC(hwnd, hdc);
+            // 0 and 1 mean the default rate of the hardware
+            if (hz <= 1) {
+                ret = false;
+                break;
+            }
+            *va_arg(varg, float*) = float(hz);
+            break;
+        }
         default : {
             ret = false;
             break;
@@ -254,6 +254,7 @@ class D2DHwndDeviceEx final  : public D2DPaintDevice {
         D2DHwndDeviceEx(HWND hwnd);
 
         auto paint_context() -> Ref<PaintContext> override;
+        bool query_value(PaintDeviceValue value, void *out) override;
         void resize(int w, int h) override;
 
         HWND                 hwnd = nullptr;
@@ -1316,6 +1317,11 @@ bool D2DPaintDevice::query_value(PaintDeviceValue value, void *out) {
             target->GetDpi(&fp->x, &fp->y);
             break;
         }
+        case PaintDeviceValue::ContentPreserved : {
+            // Hwnd target is created with D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS, Wic bitmap is always kept
+            *static_cast<bool*>(out) = true;
+            break;
+        }
         default : return false;
     }
     return true;
@@ -1370,7 +1376,7 @@ D2DHwndDevice::D2DHwndDevice(HWND h) {
                 DXGI_FORMAT_UNKNOWN, D2D1_ALPHA_MODE_PREMULTIPLIED
             )
         ),
-        D2D1::HwndRenderTargetProperties(hwnd),
+        D2D1::HwndRenderTargetProperties(hwnd, D2D1::SizeU(), D2D1_PRESENT_OPTIONS_RETAIN_CONTENTS),
         reinterpret_cast<ID2D1HwndRenderTarget**>(target.GetAddressOf())
     );
     if (FAILED(hr)) {
@@ -1493,6 +1499,14 @@ void D2DHwndDeviceEx::resize(int w, int h) {
     );
     d2d_context->SetTarget(bitmap.Get());
 }
+bool D2DHwndDeviceEx::query_value(PaintDeviceValue value, void *out) {
+    if (value == PaintDeviceValue::ContentPreserved) {
+        // Flip model swapchain, the back buffer is undefined after Present
+        *static_cast<bool*>(out) = false;
+        return true;
+    }
+    return D2DPaintDevice::query_value(value, out);
+}
 auto D2DHwndDeviceEx::paint_context() -> Ref<PaintContext> {
     if 	(!context) {
         context.reset(new D2DDeviceContext(this, d3d_swapchain.Get(), d2d_context.Get()));
@@ -6,6 +6,12 @@
 #include <Btk/opengl/opengl.hpp>
 #include <Btk/painter.hpp>
 
+#include "common/rectpack.hpp"
+
+#include <unordered_map>
+#include <vector>
+#include <cmath>
+
 extern "C" {
     #define NANOVG_GLES3_IMPLEMENTATION
     #include "libs/nanovg.hpp"
@@ -30,6 +36,80 @@ extern "C" {
 BTK_PRIV_BEGIN
 
 class NanoVGContext;
+class NanoVGTexture;
+/**
+ * @brief Shared alpha atlas for rasterized text runs
+ * 
+ * Runs are packed into a few big pages, each page has a CPU copy, only the dirty area is uploaded.
+ * When all pages are full, the least recently used page (not used in this frame) is reset.
+ * Quads are batched per page until the draw state changed or somebody else want to draw.
+ */
+class NanoVGGlyphAtlas {
+    public:
+        class Page {
+            public:
+                int                  id = -1;         //< NanoVG image id
+                RectPacker           packer;
+                std::vector<uint8_t> pixels;          //< CPU copy of the page
+                Rect                 dirty = {0, 0, 0, 0}; //< Area need to upload
+                uint64_t             last_used = 0;   //< Frame of the last use
+                uint32_t             generation = 0;  //< Increased when the page was reset
+        };
+        class Slot {
+            public:
+                int      page = -1;
+                uint32_t generation = 0;
+                Rect     rect = {0, 0, 0, 0}; //< Usable area in page (padding excluded)
+        };
+
+        void init(NVGcontext *ctxt, int page_size);
+        void release();
+        void new_frame(PaintStats *stats);
+
+        uint64_t current_frame() const {
+            return frame;
+        }
+
+        /**
+         * @brief Check the slot is still alive (page not reset)
+         */
+        bool valid(const Slot &slot) const;
+        /**
+         * @brief Alloc a area in atlas
+         * 
+         * @return false on too big or no page can be reused in this frame
+         */
+        bool alloc(int w, int h, Slot *slot);
+        /**
+         * @brief Copy a Gray8 bitmap into the slot, mark it dirty
+         */
+        void write(const Slot &slot, int x, int y, const PixBuffer &bitmap);
+        /**
+         * @brief Add a textured quad (in device pixel) of slot into the batch
+         */
+        void draw(const Slot &slot, float x, float y);
+        /**
+         * @brief Upload dirty area and submit the pending batch
+         */
+        void flush();
+    private:
+        void upload(Page &page);
+        bool same_state(const NVGpaint &paint, const NVGcompositeOperationState &op, const NVGscissor &scissor) const;
+
+        NVGcontext       *nvgctxt = nullptr;
+        std::vector<Page> pages;
+        int               page_size = 0;
+        int               max_pages = 4;
+        uint64_t          frame = 0;
+        PaintStats       *stats = nullptr; //< Counters of the frame
+
+        // Pending batch
+        int                        batch_page = -1;
+        NVGpaint                   batch_paint;
+        NVGcompositeOperationState batch_op;
+        NVGscissor                 batch_scissor;
+        std::vector<NVGvertex>     batch_verts;
+};
 class NanoVGWindowDevice final : public WindowDevice {
     public:
         NanoVGWindowDevice(AbstractWindow *);
@@ -84,6 +164,7 @@ class NanoVGContext final : public PaintContext, PainterPathSink, OpenGLES3Funct
         // Fill
         bool fill_path(const PainterPath &path) override;
         bool fill_rect(float x, float y, float w, float h) override;
+        bool fill_rects(const FRect *rects, size_t n) override;
         bool fill_rounded_rect(float x, float y, float w, float h, float r) override;
         bool fill_ellipse(float x, float y, float xr, float yr) override;
         bool fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) override;
@@ -107,10 +188,52 @@ class NanoVGContext final : public PaintContext, PainterPathSink, OpenGLES3Funct
         void set_winding(PathWinding winding) override;
 
         auto current_transform() -> FMatrix *;
+
+        /**
+         * @brief Check the offscreen framebuffer still has the last frame
+         * 
+         * @param w The pixel width of the drawable
+         * @param h The pixel height of the drawable
+         */
+        bool content_preserved(int w, int h) const;
+
+        /**
+         * @brief Redirect the drawing into the texture, the frame in progress will be submitted and resumed in pop_target()
+         * 
+         * @param texture The RGBA texture (with framebuffer prepared)
+         */
+        void push_target(NanoVGTexture *texture);
+        void pop_target();
     private:
+        /**
+         * @brief Shaped text for draw_text(Font, u8string_view)
+         * 
+         */
+        class TextRun {
+            public:
+                Font       font;
+                u8string   text;
+                float      dpi = 0.0f;
+                TextLayout layout; //< Rasterized run is bound to it
+                FSize      size;
+                uint64_t   last_used = 0;
+        };
+
         void apply_brush(float x, float y, float w, float h);
         void apply_brush(const FRect &rect);
 
+        auto text_run_of(const Font &font, u8string_view text, float dpi) -> TextRun &;
+        bool draw_layout(Alignment align, const TextLayout &layout, const FSize &size, float x, float y);
+
+        void prepare_framebuffer(int w, int h);
+        void release_framebuffer();
+        void begin_target_frame();
+        void reapply_state();
+
+        // Tessellate and submit the current path
+        void submit_fill();
+        void submit_stroke();
+
         NanoVGWindowDevice *device;
         GLContext *glctxt;
         NVGcontext *nvgctxt;
@@ -128,9 +251,51 @@ class NanoVGContext final : public PaintContext, PainterPathSink, OpenGLES3Funct
         // Texture
         Size max_texture_size;
 
+        // Scissor bounding box (in logical coord), used by clear
+        FRect scissor_box = {0.0f, 0.0f, 0.0f, 0.0f};
+        bool  has_scissor = false;
+        float pixel_ratio = 1.0f;
+
+        // State from the Painter, nvgBeginFrame() reset all of them
+        class SavedState {
+            public:
+                float        alpha = 1.0f;
+                bool         antialias = true;
+                float        stroke_width = 1.0f;
+                bool         has_transform = false;
+                FMatrix      transform;
+                bool         has_scissor = false;
+                PaintScissor scissor;
+                bool         has_pen = false;
+                Pen          pen;
+                bool         has_brush = false;
+                Brush        brush;
+
+                void record(PaintContextState state, const void *in);
+        };
+        class RenderTarget {
+            public:
+                NanoVGTexture *texture;
+                bool           resume; //< The previous frame was in progress
+                SavedState     state;  //< State of the previous target
+        };
+        SavedState                saved;
+        std::vector<RenderTarget> targets; //< Texture targets, empty on window
+        bool                      in_frame = false;
+
+        // Offscreen framebuffer, the content is kept between frames, so we can only repaint the damaged area
+        GLuint fbo               = 0;
+        GLuint fbo_color         = 0;
+        GLuint fbo_depth_stencil = 0;
+        GLint  fbo_prev          = 0;     //< Framebuffer bound before begin()
+        Size   fbo_size          = {0, 0};
+        bool   fbo_valid         = false; //< Has a complete frame
+        bool   fbo_failed        = false; //< Unsupported, render to the window directly
+
         // TextCache
-        int numof_cache = 0;
-        int max_cache_size = 100;
+        NanoVGGlyphAtlas atlas;
+        std::unordered_multimap<size_t, TextRun> text_runs; //< Hash of (font, text, dpi) => run
+        size_t                                   max_text_runs = 512;
     friend class NanoVGTexture;
     friend class NanoVGTextCache;
 };
@@ -138,7 +303,8 @@ class NanoVGTexture final : public AbstractTexture {
     public:
         BTK_MAKE_PAINT_RESOURCE        
 
-        NanoVGTexture(NanoVGContext *ctxt, int id) : ctxt(ctxt), id(id) { }
+        NanoVGTexture(NanoVGContext *ctxt, int id, float xdpi = 96.0f, float ydpi = 96.0f) : 
+            ctxt(ctxt), id(id), xdpi(xdpi), ydpi(ydpi) { }
         ~NanoVGTexture();
 
         // Inhertied from PaintResource
@@ -147,16 +313,22 @@ class NanoVGTexture final : public AbstractTexture {
         }
 
         // Inhertied from PaintDevice
-        auto paint_context() -> Ref<PaintContext > override {
-            return nullptr;
-        }
+        auto paint_context() -> Ref<PaintContext > override;
         bool query_value(PaintDeviceValue v, void *out) override;
 
         void update(const Rect *area, cpointer_t ptr, int pitch) override;
         void set_interpolation_mode(InterpolationMode mode) override;
     private:
+        bool prepare_framebuffer();
+
         NanoVGContext *ctxt;
         int            id;
+        float          xdpi;
+        float          ydpi;
+
+        // Framebuffer for render to it
+        GLuint         fbo = 0;
+        GLuint         fbo_stencil = 0;
     friend class NanoVGContext;
     friend class NanoVGTextCache;
 };
@@ -164,7 +336,7 @@ class NanoVGTextCache final : public PaintResource {
     public:
         BTK_MAKE_PAINT_RESOURCE
 
-        NanoVGTextCache(NanoVGContext *ctxt, const TextLayout &layout);
+        NanoVGTextCache(NanoVGContext *ctxt) : ctxt(ctxt) { }
         ~NanoVGTextCache() = default;
 
         // Inhertied from PaintResource
@@ -172,11 +344,98 @@ class NanoVGTextCache final : public PaintResource {
             return ctxt->signal_text_cache_destroyed();
         }
 
-        void draw(NVGcontext *ctxt, float x, float y);
+        /**
+         * @brief Make sure the run is in the atlas, rasterize it again if it was evicted
+         * 
+         * @return false on the run could not be placed in the atlas
+         */
+        bool prepare(const TextLayout &layout);
+        void draw(float x, float y);
+    private:
+        NanoVGContext           *ctxt;
+        NanoVGGlyphAtlas::Slot   slot;
+        Rect                     run = {0, 0, 0, 0}; //< Bounds of the run, relative to the layout origin
+};
+
+/**
+ * @brief Paint context for render to NanoVGTexture, forward all to the NanoVGContext
+ * 
+ */
+class NanoVGTextureContext final : public PaintContext {
+    public:
+        BTK_MAKE_PAINT_RESOURCE
+
+        NanoVGTextureContext(NanoVGContext *ctxt, NanoVGTexture *texture) : ctxt(ctxt), texture(texture) { }
+
+        auto signal_destroyed() -> Signal<void()> & override {
+            return ctxt->signal_destroyed();
+        }
+
+        void begin() override {
+            ctxt->push_target(texture.get());
+        }
+        void end() override {
+            ctxt->pop_target();
+        }
+        void swap_buffers() override { }
+
+        void clear(Brush &b) override {
+            ctxt->clear(b);
+        }
+        bool draw_path(const PainterPath &path) override {
+            return ctxt->draw_path(path);
+        }
+        bool draw_line(float x1, float y1, float x2, float y2) override {
+            return ctxt->draw_line(x1, y1, x2, y2);
+        }
+        bool draw_rect(float x, float y, float w, float h) override {
+            return ctxt->draw_rect(x, y, w, h);
+        }
+        bool draw_rounded_rect(float x, float y, float w, float h, float r) override {
+            return ctxt->draw_rounded_rect(x, y, w, h, r);
+        }
+        bool draw_ellipse(float x, float y, float xr, float yr) override {
+            return ctxt->draw_ellipse(x, y, xr, yr);
+        }
+        bool draw_image(AbstractTexture *image, const FRect *dst, const FRect *src) override {
+            return ctxt->draw_image(image, dst, src);
+        }
+        bool draw_text(Alignment align, Font &font, u8string_view text, float x, float y) override {
+            return ctxt->draw_text(align, font, text, x, y);
+        }
+        bool draw_text(Alignment align, const TextLayout &layout, float x, float y) override {
+            return ctxt->draw_text(align, layout, x, y);
+        }
+        bool fill_path(const PainterPath &path) override {
+            return ctxt->fill_path(path);
+        }
+        bool fill_rect(float x, float y, float w, float h) override {
+            return ctxt->fill_rect(x, y, w, h);
+        }
+        bool fill_rects(const FRect *rects, size_t n) override {
+            return ctxt->fill_rects(rects, n);
+        }
+        bool fill_rounded_rect(float x, float y, float w, float h, float r) override {
+            return ctxt->fill_rounded_rect(x, y, w, h, r);
+        }
+        bool fill_ellipse(float x, float y, float xr, float yr) override {
+            return ctxt->fill_ellipse(x, y, xr, yr);
+        }
+        bool fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) override {
+            return ctxt->fill_mask(mask, dst, src);
+        }
+        bool set_state(PaintContextState state, const void *v) override {
+            return ctxt->set_state(state, v);
+        }
+        bool native_handle(PaintContextHandle h, void *out) override {
+            return ctxt->native_handle(h, out);
+        }
+        auto create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi) -> Ref<AbstractTexture> override {
+            return ctxt->create_texture(fmt, w, h, xdpi, ydpi);
+        }
     private:
         NanoVGContext *ctxt;
-        Ref<NanoVGTexture> bitmap; //< Bitmap hold the data
-        std::vector<Rect>  bounds;
+        Ref<NanoVGTexture> texture;
 };
 
 class GLGuard {
@@ -192,19 +451,9 @@ class GLGuard {
 };
 
 // Helper for NVG
-static void nvgRenderText(NVGcontext* ctx, int id, NVGvertex* verts, int nverts)
+static void nvgRenderText(NVGcontext* ctx, NVGpaint *paint, NVGcompositeOperationState op, NVGscissor *scissor, NVGvertex* verts, int nverts)
 {
-	NVGstate* state = nvg__getState(ctx);
-	NVGpaint paint = state->fill;
-
-	// Render triangles.
-	paint.image = id;
-
-	// Apply global alpha
-	paint.innerColor.a *= state->alpha;
-	paint.outerColor.a *= state->alpha;
-
-	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts, ctx->fringeWidth);
+	ctx->params.renderTriangles(ctx->params.userPtr, paint, op, scissor, verts, nverts, ctx->fringeWidth);
 
 	ctx->drawCallCount++;
 	ctx->textTriCount += nverts/3;
@@ -238,35 +487,60 @@ NanoVGContext::NanoVGContext(NanoVGWindowDevice *dev) : device(dev), glctxt(dev-
 #endif
 
     nvgctxt = nvgCreateGLES3(flags, this);
+
+    atlas.init(nvgctxt, min(1024, min(max_texture_size.w, max_texture_size.h)));
 }
 NanoVGContext::~NanoVGContext() {
     // Release 
     GLGuard guard(glctxt);
 
+    text_runs.clear();
     signal_txt_cache.emit();
     signal.emit();
 
+    atlas.release();
+    release_framebuffer();
+
     nvgDeleteGLES3(nvgctxt);
 }
 void NanoVGContext::begin() {
     glctxt->begin();
 
     auto [glw, glh] = glctxt->get_drawable_size();
-    auto [w, h] = device->size();
 
-    glViewport(0, 0, glw, glh);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo_prev);
+    prepare_framebuffer(glw, glh);
 
-    nvgBeginFrame(nvgctxt, w, h, float(glw) / w);
+    begin_target_frame();
+    atlas.new_frame(stats);
 }
 void NanoVGContext::end() {
+    atlas.flush();
     nvgEndFrame(nvgctxt);
+    in_frame = false;
 
-    if (numof_cache > max_cache_size) {
-        BTK_LOG("[NanoVG::Text] Too much cache, cleaning\n");
-        numof_cache = 0;
+    if (fbo) {
+        // Present the offscreen framebuffer
+        auto [w, h] = fbo_size;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_prev);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_prev);
 
-        // Destroy this cache
-        signal_txt_cache.emit();
+        fbo_valid = true;
+    }
+
+    if (text_runs.size() > max_text_runs) {
+        // Too much runs, drop the ones not used in this frame
+        auto frame = atlas.current_frame();
+        for (auto it = text_runs.begin(); it != text_runs.end(); ) {
+            if (it->second.last_used != frame) {
+                it = text_runs.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
     }
 
     glctxt->end();
@@ -283,21 +557,40 @@ void NanoVGContext::clear(Brush &what) {
     // glClearStencil(0);
     // glClearDepthf(0);
 
+    if (has_scissor) {
+        // Only clear the area in scissor, GL origin is at the bottom left
+        GLint fb_size[4];
+        glGetIntegerv(GL_VIEWPORT, fb_size);
+
+        int x0 = int(std::floor(scissor_box.x * pixel_ratio));
+        int y0 = int(std::floor(scissor_box.y * pixel_ratio));
+        int x1 = int(std::ceil((scissor_box.x + scissor_box.w) * pixel_ratio));
+        int y1 = int(std::ceil((scissor_box.y + scissor_box.h) * pixel_ratio));
+
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x0, fb_size[3] - y1, max(x1 - x0, 0), max(y1 - y0, 0));
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+        return;
+    }
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);;
 }
 
 // Draw
 bool NanoVGContext::draw_path(const PainterPath &path) {
+    atlas.flush();
     // TODO : Need calc position
     auto rect = path.bounding_box();
     nvgBeginPath(nvgctxt);
     path.stream(this);
     apply_brush(rect);
-    nvgStroke(nvgctxt);
+    submit_stroke();
 
     return true;
 }
 bool NanoVGContext::draw_line(float x1, float y1, float x2, float y2) {
+    atlas.flush();
     // Get Rectangle of the line
     if (need_apply_brush) {
         FRect rect;
@@ -315,11 +608,12 @@ bool NanoVGContext::draw_line(float x1, float y1, float x2, float y2) {
     nvgBeginPath(nvgctxt);
     nvgMoveTo(nvgctxt, x1, y1);
     nvgLineTo(nvgctxt, x2, y2);
-    nvgStroke(nvgctxt);
+    submit_stroke();
 
     return true;
 }
 bool NanoVGContext::draw_rect(float x, float y, float w, float h) {
+    atlas.flush();
     if (w <= 0 || h <= 0) {
         return true;
     }
@@ -328,29 +622,32 @@ bool NanoVGContext::draw_rect(float x, float y, float w, float h) {
 
     nvgBeginPath(nvgctxt);
     nvgRect(nvgctxt, x, y, w, h);
-    nvgStroke(nvgctxt);
+    submit_stroke();
 
     return true;
 }
 bool NanoVGContext::draw_rounded_rect(float x, float y, float w, float h, float r) {
+    atlas.flush();
     apply_brush(x, y, w, h);
 
     nvgBeginPath(nvgctxt);
     nvgRoundedRect(nvgctxt, x, y, w, h, r);
-    nvgStroke(nvgctxt);
+    submit_stroke();
 
     return true;
 }
 bool NanoVGContext::draw_ellipse(float x, float y, float xr, float yr) {
+    atlas.flush();
     apply_brush(x - xr, y - yr, xr * 2, yr * 2);
 
     nvgBeginPath(nvgctxt);
     nvgEllipse(nvgctxt, x, y, xr, yr);
-    nvgStroke(nvgctxt);
+    submit_stroke();
 
     return true;
 }
 bool NanoVGContext::draw_image(AbstractTexture *image, const FRect *_dst, const FRect *_src) {
+    atlas.flush();
     auto nvgimage = static_cast<NanoVGTexture*>(image);
     auto tex_size = nvgimage->size();
     float tex_w = tex_size.w;
@@ -405,50 +702,24 @@ bool NanoVGContext::draw_image(AbstractTexture *image, const FRect *_dst, const
         nvgimage->id,
         1.0f
     ));
-    nvgFill(nvgctxt);
+    submit_fill();
     nvgRestore(nvgctxt);
     return true;
 }
 
 // Text
 bool NanoVGContext::draw_text(Alignment align, Font &font, u8string_view text, float x, float y) {
-    TextLayout layout;
-    layout.set_font(font);
-    layout.set_text(text);
-
     auto [xdpi, ydpi] = device->dpi();
-    auto [width, height] = layout.size();
+    auto &run = text_run_of(font, text, xdpi);
 
-    auto path = layout.outline(xdpi);
-    
-    if ((align & Alignment::Right) == Alignment::Right) {
-        x -= width;
-    }
-    if ((align & Alignment::Bottom) == Alignment::Bottom) {
-        y -= height;
-    }
-    if ((align & Alignment::Center) == Alignment::Center) {
-        x -= width / 2;
-    }
-    if ((align & Alignment::Middle) == Alignment::Middle) {
-        y -= height / 2;
-    }
-
-    apply_brush(x, y, width, height);
-
-    nvgSave(nvgctxt);
-    nvgShapeAntiAlias(nvgctxt, false);
-    nvgTranslate(nvgctxt, x, y);
-    fill_path(path);
-    nvgRestore(nvgctxt);
-
-    return true;
+    return draw_layout(align, run.layout, run.size, x, y);
 }
 bool NanoVGContext::draw_text(Alignment align, const TextLayout &layout      , float x, float y) {
+    return draw_layout(align, layout, layout.size(), x, y);
+}
+bool NanoVGContext::draw_layout(Alignment align, const TextLayout &layout, const FSize &size, float x, float y) {
     auto [xdpi, ydpi] = device->dpi();
-    auto [width, height] = layout.size();
-
-    auto path = layout.outline(xdpi);
+    auto [width, height] = size;
     
     if ((align & Alignment::Right) == Alignment::Right) {
         x -= width;
@@ -463,35 +734,68 @@ bool NanoVGContext::draw_text(Alignment align, const TextLayout &layout      , f
         y -= height / 2;
     }
 
-    apply_brush(x, y, width, height);
-
-    nvgBeginPath(nvgctxt);
     auto resource = layout.query_device_resource(nvgctxt);
     if (!resource) {
-        resource = new NanoVGTextCache(this, layout);
+        resource = new NanoVGTextCache(this);
         layout.bind_device_resource(nvgctxt, resource);
-
-        numof_cache += 1;
     }
     auto cache = static_cast<NanoVGTextCache*>(resource);
-    cache->draw(nvgctxt, x, y);
+    if (!cache->prepare(layout)) {
+        // Too big for the atlas or it is full, fallback to outline
+        nvgSave(nvgctxt);
+        nvgShapeAntiAlias(nvgctxt, false);
+        nvgTranslate(nvgctxt, x, y);
+        fill_path(layout.outline(xdpi));
+        nvgRestore(nvgctxt);
+        return true;
+    }
 
-    nvgFill(nvgctxt);
+    apply_brush(x, y, width, height);
+    cache->draw(x, y);
     return true;
 }
+auto NanoVGContext::text_run_of(const Font &font, u8string_view text, float dpi) -> TextRun & {
+    size_t hash = font.hash();
+    hash ^= std::hash<u8string_view>()(text) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<float>()(dpi) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+    auto frame = atlas.current_frame();
+    auto [begin, end] = text_runs.equal_range(hash);
+    for (auto it = begin; it != end; ++it) {
+        auto &run = it->second;
+        if (run.dpi == dpi && run.text == text && run.font == font) {
+            run.last_used = frame;
+            return run;
+        }
+    }
+
+    // Not found, shape it
+    TextRun run;
+    run.font = font;
+    run.text = text;
+    run.dpi  = dpi;
+    run.layout.set_font(font);
+    run.layout.set_text(text);
+    run.size = run.layout.size();
+    run.last_used = frame;
+
+    return text_runs.emplace(hash, std::move(run))->second;
+}
 
 // Fill
 bool NanoVGContext::fill_path(const PainterPath &path) {
+    atlas.flush();
     nvgBeginPath(nvgctxt);
     auto rect = path.bounding_box();
     path.stream(this);
 
     apply_brush(rect);
-    nvgFill(nvgctxt);
+    submit_fill();
 
     return false;
 }
 bool NanoVGContext::fill_rect(float x, float y, float w, float h) {
+    atlas.flush();
     if (w <= 0 || h <= 0) {
         return true;
     }
@@ -500,25 +804,43 @@ bool NanoVGContext::fill_rect(float x, float y, float w, float h) {
 
     nvgBeginPath(nvgctxt);
     nvgRect(nvgctxt, x, y, w, h);
-    nvgFill(nvgctxt);
+    submit_fill();
 
     return false;
 }
+bool NanoVGContext::fill_rects(const FRect *rects, size_t n) {
+    if (need_apply_brush) {
+        // Paint depends on the bounding box of each rectangle
+        return PaintContext::fill_rects(rects, n);
+    }
+    atlas.flush();
+
+    // Put them in one path, tessellated and drawn in one call
+    nvgBeginPath(nvgctxt);
+    for (size_t i = 0; i < n; i++) {
+        nvgRect(nvgctxt, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+    }
+    submit_fill();
+
+    return true;
+}
 bool NanoVGContext::fill_rounded_rect(float x, float y, float w, float h, float r) {
+    atlas.flush();
     apply_brush(x, y, w, h);
 
     nvgBeginPath(nvgctxt);
     nvgRoundedRect(nvgctxt, x, y, w, h, r);
-    nvgFill(nvgctxt);
+    submit_fill();
 
     return false;
 }
 bool NanoVGContext::fill_ellipse(float x, float y, float xr, float yr) {
+    atlas.flush();
     apply_brush(x - xr, y - yr, xr * 2, yr * 2);
 
     nvgBeginPath(nvgctxt);
     nvgEllipse(nvgctxt, x, y, xr, yr);
-    nvgFill(nvgctxt);
+    submit_fill();
 
     return false;
 }
@@ -578,9 +900,12 @@ auto NanoVGContext::create_texture(PixFormat fmt, int w, int h, float xdpi, floa
     if (id < 0) {
         return nullptr;
     }
-    return new NanoVGTexture(this, id);
+    return new NanoVGTexture(this, id, xdpi, ydpi);
 }
 bool NanoVGContext::set_state(PaintContextState state, const void *in) {
+    // Keep a copy, for resuming the frame after render to texture
+    saved.record(state, in);
+
     switch (state) {
         case PaintContextState::Alpha : {
             nvgGlobalAlpha(nvgctxt, *static_cast<const float *>(in));
@@ -605,12 +930,31 @@ bool NanoVGContext::set_state(PaintContextState state, const void *in) {
             if (!in) {
                 // No Scissor
                 nvgResetScissor(nvgctxt);
+                has_scissor = false;
             }
             else {
                 auto *scissor = static_cast<const PaintScissor*>(in);
                 auto &matrix = scissor->matrix;
                 auto [x, y, w, h] = scissor->rect;
 
+                // Bounding box for clear
+                FPoint points [4] = {
+                    matrix.transform_point(FPoint(x, y)),
+                    matrix.transform_point(FPoint(x + w, y)),
+                    matrix.transform_point(FPoint(x, y + h)),
+                    matrix.transform_point(FPoint(x + w, y + h))
+                };
+                FPoint lt = points[0];
+                FPoint rb = points[0];
+                for (auto &pt : points) {
+                    lt.x = min(lt.x, pt.x);
+                    lt.y = min(lt.y, pt.y);
+                    rb.x = max(rb.x, pt.x);
+                    rb.y = max(rb.y, pt.y);
+                }
+                scissor_box = FRect(lt, rb);
+                has_scissor = true;
+
                 // Content of nanovg scissor
                 NVGstate* state = nvg__getState(nvgctxt);
 
@@ -788,6 +1132,183 @@ void NanoVGContext::apply_brush(const FRect &object) {
 void NanoVGContext::apply_brush(float x, float y, float w, float h) {
     apply_brush(FRect(x, y, w, h));
 }
+void NanoVGContext::submit_fill() {
+    if (stats) {
+        stats->path_tessellations += 1;
+    }
+    nvgFill(nvgctxt);
+}
+void NanoVGContext::submit_stroke() {
+    if (stats) {
+        stats->path_tessellations += 1;
+    }
+    nvgStroke(nvgctxt);
+}
+void NanoVGContext::begin_target_frame() {
+    int   pw, ph;
+    FSize size;
+    if (targets.empty()) {
+        // Window
+        auto [glw, glh] = glctxt->get_drawable_size();
+        pw   = glw;
+        ph   = glh;
+        size = device->size();
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo ? fbo : fbo_prev);
+    }
+    else {
+        auto texture = targets.back().texture;
+        nvgImageSize(nvgctxt, texture->id, &pw, &ph);
+        size = texture->size();
+        glBindFramebuffer(GL_FRAMEBUFFER, texture->fbo);
+    }
+
+    glViewport(0, 0, pw, ph);
+
+    pixel_ratio = float(pw) / size.w;
+    nvgBeginFrame(nvgctxt, size.w, size.h, pixel_ratio);
+    in_frame = true;
+}
+void NanoVGContext::push_target(NanoVGTexture *texture) {
+    GLGuard guard(glctxt);
+
+    RenderTarget target;
+    target.texture = texture;
+    target.resume  = in_frame;
+    target.state   = saved;
+
+    if (in_frame) {
+        // NanoVG could not nest frames, submit the current one
+        atlas.flush();
+        nvgEndFrame(nvgctxt);
+        in_frame = false;
+    }
+    else if (targets.empty()) {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo_prev);
+    }
+
+    saved = SavedState();
+    has_scissor = false;
+    targets.push_back(target);
+    begin_target_frame();
+}
+void NanoVGContext::pop_target() {
+    BTK_ASSERT(!targets.empty());
+
+    atlas.flush();
+    nvgEndFrame(nvgctxt);
+    in_frame = false;
+
+    auto target = targets.back();
+    targets.pop_back();
+
+    saved = target.state;
+    has_scissor = false;
+    if (target.resume) {
+        // Continue the previous frame
+        begin_target_frame();
+        reapply_state();
+    }
+    else if (targets.empty()) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_prev);
+    }
+}
+void NanoVGContext::reapply_state() {
+    // Copy it, set_state() will record again
+    auto s = saved;
+
+    set_state(PaintContextState::Alpha, &s.alpha);
+    set_state(PaintContextState::Antialias, &s.antialias);
+    set_state(PaintContextState::StrokeWidth, &s.stroke_width);
+    set_state(PaintContextState::Transform, s.has_transform ? &s.transform : nullptr);
+    set_state(PaintContextState::Scissor, s.has_scissor ? &s.scissor : nullptr);
+    if (s.has_pen) {
+        set_state(PaintContextState::Pen, &s.pen);
+    }
+    if (s.has_brush) {
+        set_state(PaintContextState::Brush, &s.brush);
+    }
+}
+void NanoVGContext::SavedState::record(PaintContextState state, const void *in) {
+    switch (state) {
+        case PaintContextState::Alpha : alpha = *static_cast<const float*>(in); break;
+        case PaintContextState::Antialias : antialias = *static_cast<const bool*>(in); break;
+        case PaintContextState::StrokeWidth : stroke_width = *static_cast<const float*>(in); break;
+        case PaintContextState::Transform : {
+            has_transform = (in != nullptr);
+            if (in) {
+                transform = *static_cast<const FMatrix*>(in);
+            }
+            break;
+        }
+        case PaintContextState::Scissor : {
+            has_scissor = (in != nullptr);
+            if (in) {
+                scissor = *static_cast<const PaintScissor*>(in);
+            }
+            break;
+        }
+        case PaintContextState::Pen : {
+            has_pen = true;
+            pen = *static_cast<const Pen*>(in);
+            break;
+        }
+        case PaintContextState::Brush : {
+            has_brush = true;
+            brush = *static_cast<const Brush*>(in);
+            break;
+        }
+        default : break;
+    }
+}
+bool NanoVGContext::content_preserved(int w, int h) const {
+    return fbo && fbo_valid && fbo_size.w == w && fbo_size.h == h;
+}
+void NanoVGContext::prepare_framebuffer(int w, int h) {
+    if (fbo_failed) {
+        return;
+    }
+    if (fbo && fbo_size.w == w && fbo_size.h == h) {
+        return;
+    }
+    release_framebuffer();
+
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &fbo_color);
+    glGenRenderbuffers(1, &fbo_depth_stencil);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, fbo_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, fbo_depth_stencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fbo_color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fbo_depth_stencil);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_prev);
+
+    if (!complete) {
+        BTK_LOG("[NanoVG::OpenGL] Offscreen framebuffer unsupported, partial repaint disabled\n");
+        release_framebuffer();
+        fbo_failed = true;
+        return;
+    }
+    fbo_size.w = w;
+    fbo_size.h = h;
+}
+void NanoVGContext::release_framebuffer() {
+    if (fbo) {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &fbo_color);
+        glDeleteRenderbuffers(1, &fbo_depth_stencil);
+    }
+    fbo = 0;
+    fbo_color = 0;
+    fbo_depth_stencil = 0;
+    fbo_size = Size(0, 0);
+    fbo_valid = false;
+}
 auto NanoVGContext::current_transform() -> FMatrix * {
     NVGstate* s = nvg__getState(nvgctxt);
 
@@ -800,11 +1321,68 @@ NanoVGTexture::~NanoVGTexture() {
     auto nvgctxt = ctxt->nvg_context();
 
     GLGuard guard(glctxt);
+    if (fbo) {
+        ctxt->glDeleteFramebuffers(1, &fbo);
+        ctxt->glDeleteRenderbuffers(1, &fbo_stencil);
+    }
     nvgDeleteImage(nvgctxt, id);
 }
+auto NanoVGTexture::paint_context() -> Ref<PaintContext> {
+    if (!prepare_framebuffer()) {
+        return nullptr;
+    }
+    return new NanoVGTextureContext(ctxt, this);
+}
+bool NanoVGTexture::prepare_framebuffer() {
+    if (fbo) {
+        return true;
+    }
+    GLGuard guard(ctxt->gl_context());
+
+    // Only RGBA texture could be the render target
+    auto tex = glnvg__findTexture((GLNVGcontext*) nvgInternalParams(ctxt->nvg_context()), id);
+    if (tex == nullptr || tex->type != NVG_TEXTURE_RGBA) {
+        return false;
+    }
+    // The content is premultiplied and upside down in GL
+    tex->flags |= NVG_IMAGE_FLIPY | NVG_IMAGE_PREMULTIPLIED;
+
+    GLint prev;
+    ctxt->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev);
+
+    ctxt->glGenFramebuffers(1, &fbo);
+    ctxt->glGenRenderbuffers(1, &fbo_stencil);
+
+    ctxt->glBindRenderbuffer(GL_RENDERBUFFER, fbo_stencil);
+    ctxt->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, tex->width, tex->height);
+    ctxt->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    ctxt->glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    ctxt->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->tex, 0);
+    ctxt->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fbo_stencil);
+    bool complete = ctxt->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    ctxt->glBindFramebuffer(GL_FRAMEBUFFER, prev);
+
+    if (!complete) {
+        BTK_LOG("[NanoVG::OpenGL] Texture %d could not be the render target\n", id);
+        ctxt->glDeleteFramebuffers(1, &fbo);
+        ctxt->glDeleteRenderbuffers(1, &fbo_stencil);
+        fbo = 0;
+        fbo_stencil = 0;
+        return false;
+    }
+    return true;
+}
 void NanoVGTexture::update(const Rect *r, cpointer_t data, int pitch) {
     GLGuard guard(ctxt->gl_context());
     nvgUpdateImage(ctxt->nvg_context(), id, static_cast<const uint8_t*>(data));
+
+    if (auto stats = ctxt->stats; stats) {
+        int w, h;
+        nvgImageSize(ctxt->nvg_context(), id, &w, &h);
+        stats->texture_uploads += 1;
+        stats->texture_upload_bytes += uint64_t(h) * pitch;
+    }
 }
 void NanoVGTexture::set_interpolation_mode(InterpolationMode mode) {
     // TODO 
@@ -840,14 +1418,14 @@ bool NanoVGTexture::query_value(PaintDeviceValue value, void *out) {
             int w;
             int h;
             nvgImageSize(ctxt->nvg_context(), id, &w, &h);
-            fs->w = w;
-            fs->h = h;
+            fs->w = w * 96.0f / xdpi;
+            fs->h = h * 96.0f / ydpi;
             break;
         }
         case PaintDeviceValue::Dpi : {
             auto fp = static_cast<FPoint*>(out);
-            fp->x = 96.0f;
-            fp->y = 96.0f;
+            fp->x = xdpi;
+            fp->y = ydpi;
             break;
         }
         default : {
@@ -857,118 +1435,251 @@ bool NanoVGTexture::query_value(PaintDeviceValue value, void *out) {
     return true;
 }
 
-// NanoVG Text cache
-NanoVGTextCache::NanoVGTextCache(NanoVGContext *ctxt, const TextLayout &layout) : ctxt(ctxt) {
-    std::vector<PixBuffer> bitmaps;
+// NanoVG Glyph atlas
+void NanoVGGlyphAtlas::init(NVGcontext *ctxt, int size) {
+    nvgctxt = ctxt;
+    page_size = size;
+}
+void NanoVGGlyphAtlas::release() {
+    batch_verts.clear();
+    batch_page = -1;
 
-    auto [xdpi, ydpi] = ctxt->device->dpi();
-    layout.rasterize(xdpi, &bitmaps, &bounds);
+    for (auto &page : pages) {
+        nvgDeleteImage(nvgctxt, page.id);
+    }
+    pages.clear();
+}
+void NanoVGGlyphAtlas::new_frame(PaintStats *s) {
+    frame += 1;
+    stats  = s;
+}
+bool NanoVGGlyphAtlas::valid(const Slot &slot) const {
+    if (slot.page < 0 || slot.page >= int(pages.size())) {
+        return false;
+    }
+    return pages[slot.page].generation == slot.generation;
+}
+bool NanoVGGlyphAtlas::alloc(int w, int h, Slot *slot) {
+    // Keep 1px empty border around it, avoid bleeding on linear filter
+    int pw = w + 2;
+    int ph = h + 2;
+    if (pw > page_size || ph > page_size) {
+        return false;
+    }
 
-    int width = 0, height = 0;
-    for (auto &rect : bounds) {
-        // BTK_ASSERT(rect.x >= 0);
-        // BTK_ASSERT(rect.h >= 0);
+    auto place = [&, this](int idx) -> bool {
+        auto &page = pages[idx];
+        auto rect = page.packer.alloc_rect(pw, ph);
+        if (!rect) {
+            return false;
+        }
+        // Clear the content of the previous generation
+        for (int y = rect->y; y < rect->y + rect->h; y++) {
+            Btk_memset(&page.pixels[size_t(y) * page_size + rect->x], 0, rect->w);
+        }
+        page.dirty = page.dirty.empty() ? *rect : page.dirty.united(*rect);
+        page.last_used = frame;
+
+        slot->page = idx;
+        slot->generation = page.generation;
+        slot->rect = Rect(rect->x + 1, rect->y + 1, w, h);
+        return true;
+    };
 
-        width = max(width, rect.x + rect.w);
-        height = max(height, rect.y + rect.h);
+    for (int i = 0; i < int(pages.size()); i++) {
+        if (place(i)) {
+            return true;
+        }
     }
 
-    // Make Bitmap on it
-    bitmap = ctxt->create_texture(PixFormat::Gray8, width, height, 96, 96).as<NanoVGTexture>();
+    // Add a new page
+    if (int(pages.size()) < max_pages) {
+        int id = nvgctxt->params.renderCreateTexture(
+            nvgctxt->params.userPtr, NVG_TEXTURE_ALPHA, page_size, page_size, 0, nullptr
+        );
+        if (id <= 0) {
+            return false;
+        }
+        Page page;
+        page.id = id;
+        page.packer.reset(page_size, page_size);
+        page.pixels.resize(size_t(page_size) * page_size);
+        pages.push_back(std::move(page));
+
+        BTK_LOG("[NanoVG::Text] Atlas page %d created (%d x %d)\n", int(pages.size()), page_size, page_size);
+        return place(pages.size() - 1);
+    }
 
-    // Because nanovg use a big texture to update a part of it, So we also like it
-    PixBuffer hole_texture(PixFormat::Gray8, width, height);
-    auto pixels = hole_texture.pixels<uint8_t>();
+    // Reset the least recently used page
+    // Pages used in this frame are still referenced by the pending draw calls, we could not touch them
+    int lru = -1;
+    for (int i = 0; i < int(pages.size()); i++) {
+        if (pages[i].last_used == frame) {
+            continue;
+        }
+        if (lru == -1 || pages[i].last_used < pages[lru].last_used) {
+            lru = i;
+        }
+    }
+    if (lru == -1) {
+        return false;
+    }
 
-    Btk_memset(pixels, 0, width * height);
+    BTK_LOG("[NanoVG::Text] Atlas page %d evicted\n", lru);
 
-    int i = 0;
-    for (auto &buf : bitmaps) {
-        // Copy part of it 
-        auto &rect = bounds[i];
-        auto src = buf.pixels<uint8_t>();
-        auto dst = pixels;
+    auto &page = pages[lru];
+    page.packer.reset(page_size, page_size);
+    page.generation += 1;
+    page.dirty = Rect(0, 0, 0, 0);
+    return place(lru);
+}
+void NanoVGGlyphAtlas::write(const Slot &slot, int x, int y, const PixBuffer &bitmap) {
+    BTK_ASSERT(valid(slot));
+    BTK_ASSERT(bitmap.format() == PixFormat::Gray8);
 
-        for (int y = 0; y < rect.h; y++) {
-            for (int x = 0; x < rect.w; x++) {
-                dst[(y + rect.y) * width + (x + rect.x)] = src[y * buf.pitch() + x];
-            }
-        }
+    auto &page = pages[slot.page];
 
-        i += 1;
+    // Clip it into the slot
+    int w = min(bitmap.width(), slot.rect.w - x);
+    int h = min(bitmap.height(), slot.rect.h - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0) {
+        return;
     }
 
-    bitmap->update(nullptr, hole_texture.pixels(), hole_texture.pitch());
+    auto src = bitmap.pixels<uint8_t>();
+    auto dst = &page.pixels[size_t(slot.rect.y + y) * page_size + slot.rect.x + x];
+    for (int row = 0; row < h; row++) {
+        Btk_memcpy(dst + size_t(row) * page_size, src + size_t(row) * bitmap.pitch(), w);
+    }
 }
+void NanoVGGlyphAtlas::draw(const Slot &slot, float x, float y) {
+    BTK_ASSERT(valid(slot));
 
-void NanoVGTextCache::draw(NVGcontext *nvgctxt, float x, float y) {
-    // TODO : Better cache way
-    class Quad {
-        public:
-            float x0,y0,s0,t0;
-            float x1,y1,s1,t1;
-            // X Y Is 
-    };
-
-    int cverts = bounds.size() * 6;
-    int nverts = 0;
-    NVGvertex *verts = nvg__allocTempVerts(nvgctxt, cverts);
     NVGstate *state = nvg__getState(nvgctxt);
+    auto     &page  = pages[slot.page];
+    page.last_used  = frame;
+
+    NVGpaint paint = state->fill;
+    paint.image = page.id;
+
+    // Apply global alpha
+    paint.innerColor.a *= state->alpha;
+    paint.outerColor.a *= state->alpha;
+
+    if (batch_page != slot.page || !same_state(paint, state->compositeOperation, state->scissor)) {
+        flush();
+
+        batch_page    = slot.page;
+        batch_paint   = paint;
+        batch_op      = state->compositeOperation;
+        batch_scissor = state->scissor;
+    }
 
     float invscale = 1.0f / nvgctxt->devicePxRatio;
+    float itex = 1.0f / page_size;
+
+    // Make Quad
+    float x0 = x;
+    float y0 = y;
+    float x1 = x + slot.rect.w;
+    float y1 = y + slot.rect.h;
+
+    float s0 = slot.rect.x * itex;
+    float t0 = slot.rect.y * itex;
+    float s1 = (slot.rect.x + slot.rect.w) * itex;
+    float t1 = (slot.rect.y + slot.rect.h) * itex;
+
+    if (nvg__isTransformFlipped(state->xform)) {
+        std::swap(y0, y1);
+        std::swap(t0, t1);
+    }
 
-    auto [tex_w, tex_h] = bitmap->pixel_size();
-    float itw = 1.0f / tex_w;
-    float ith = 1.0f / tex_h;
+    // Transform corners.
+    float c[4*2];
+    nvgTransformPoint(&c[0],&c[1], state->xform, x0*invscale, y0*invscale);
+    nvgTransformPoint(&c[2],&c[3], state->xform, x1*invscale, y0*invscale);
+    nvgTransformPoint(&c[4],&c[5], state->xform, x1*invscale, y1*invscale);
+    nvgTransformPoint(&c[6],&c[7], state->xform, x0*invscale, y1*invscale);
+
+    // Create triangles
+    size_t n = batch_verts.size();
+    batch_verts.resize(n + 6);
+
+    NVGvertex *verts = &batch_verts[n];
+    nvg__vset(&verts[0], c[0], c[1], s0, t0);
+    nvg__vset(&verts[1], c[4], c[5], s1, t1);
+    nvg__vset(&verts[2], c[2], c[3], s1, t0);
+    nvg__vset(&verts[3], c[0], c[1], s0, t0);
+    nvg__vset(&verts[4], c[6], c[7], s0, t1);
+    nvg__vset(&verts[5], c[4], c[5], s1, t1);
+}
+void NanoVGGlyphAtlas::flush() {
+    if (batch_verts.empty()) {
+        return;
+    }
+    upload(pages[batch_page]);
+    nvgRenderText(nvgctxt, &batch_paint, batch_op, &batch_scissor, batch_verts.data(), batch_verts.size());
+    batch_verts.clear();
+}
+void NanoVGGlyphAtlas::upload(Page &page) {
+    if (page.dirty.empty()) {
+        return;
+    }
+    auto [x, y, w, h] = page.dirty;
+    nvgctxt->params.renderUpdateTexture(nvgctxt->params.userPtr, page.id, x, y, w, h, page.pixels.data());
+    if (stats) {
+        stats->texture_uploads += 1;
+        stats->texture_upload_bytes += uint64_t(w) * h;
+    }
+    page.dirty = Rect(0, 0, 0, 0);
+}
+bool NanoVGGlyphAtlas::same_state(const NVGpaint &paint, const NVGcompositeOperationState &op, const NVGscissor &scissor) const {
+    return Btk_memcmp(&paint, &batch_paint, sizeof(NVGpaint)) == 0 &&
+           Btk_memcmp(&op, &batch_op, sizeof(NVGcompositeOperationState)) == 0 &&
+           Btk_memcmp(&scissor, &batch_scissor, sizeof(NVGscissor)) == 0;
+}
 
-	int isFlipped = nvg__isTransformFlipped(state->xform);
+// NanoVG Text cache
+bool NanoVGTextCache::prepare(const TextLayout &layout) {
+    auto &atlas = ctxt->atlas;
+    auto  stats = ctxt->stats;
+    if (atlas.valid(slot)) {
+        if (stats) {
+            stats->text_cache_hits += 1;
+        }
+        return true;
+    }
+    if (stats) {
+        stats->text_cache_misses += 1;
+    }
 
-    // X & Y Is In DiP, so convert it back
-    x /= invscale;
-    y /= invscale;
+    std::vector<PixBuffer> bitmaps;
+    std::vector<Rect>      bounds;
 
+    auto [xdpi, ydpi] = ctxt->device->dpi();
+    if (!layout.rasterize(xdpi, &bitmaps, &bounds) || bounds.empty()) {
+        return false;
+    }
 
-    // Render each glyph
+    // Get the bounds of the whole run
+    run = bounds[0];
     for (auto &rect : bounds) {
-        float c[4*2];
-
-        // Make Quad
-        Quad q;
-        q.x0 = x + rect.x;
-        q.x1 = x + rect.x + rect.w;
-        q.y0 = y + rect.y;
-        q.y1 = y + rect.y + rect.h;
-
-        // Calc in texture
-        q.s0 = rect.x * itw;
-        q.s1 = (rect.x + rect.w) * itw;
-        q.t0 = rect.y * ith;
-        q.t1 = (rect.y + rect.h) * ith;
-
-		if(isFlipped) {
-			float tmp;
-
-			tmp = q.y0; q.y0 = q.y1; q.y1 = tmp;
-			tmp = q.t0; q.t0 = q.t1; q.t1 = tmp;
-		}
-
-		// Transform corners.
-		nvgTransformPoint(&c[0],&c[1], state->xform, q.x0*invscale, q.y0*invscale);
-		nvgTransformPoint(&c[2],&c[3], state->xform, q.x1*invscale, q.y0*invscale);
-		nvgTransformPoint(&c[4],&c[5], state->xform, q.x1*invscale, q.y1*invscale);
-		nvgTransformPoint(&c[6],&c[7], state->xform, q.x0*invscale, q.y1*invscale);
-		// Create triangles
-		if (nverts+6 <= cverts) {
-			nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0); nverts++;
-			nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1); nverts++;
-			nvg__vset(&verts[nverts], c[2], c[3], q.s1, q.t0); nverts++;
-			nvg__vset(&verts[nverts], c[0], c[1], q.s0, q.t0); nverts++;
-			nvg__vset(&verts[nverts], c[6], c[7], q.s0, q.t1); nverts++;
-			nvg__vset(&verts[nverts], c[4], c[5], q.s1, q.t1); nverts++;
-		}
-
-    }
-    nvgRenderText(nvgctxt, bitmap->id, verts, nverts);
+        run = run.united(rect);
+    }
+    if (!atlas.alloc(run.w, run.h, &slot)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < bitmaps.size(); i++) {
+        atlas.write(slot, bounds[i].x - run.x, bounds[i].y - run.y, bitmaps[i]);
+    }
+    return true;
+}
+void NanoVGTextCache::draw(float x, float y) {
+    // X & Y Is In DiP, the run is in pixel
+    // Snap to the pixel grid, the run is rasterized at the integer origin
+    float ratio = ctxt->nvgctxt->devicePxRatio;
+    ctxt->atlas.draw(slot, std::round(x * ratio) + run.x, std::round(y * ratio) + run.y);
 }
 
 // NanoVG Device
@@ -1009,6 +1720,15 @@ bool NanoVGWindowDevice::query_value(PaintDeviceValue value, void *out) {
             auto fp = static_cast<FPoint*>(out);
             return window->query_value(AbstractWindow::Dpi, fp);            
         }
+        case PaintDeviceValue::ContentPreserved : {
+            GLGuard guard(glctxt);
+            auto [w, h] = glctxt->get_drawable_size();
+            *static_cast<bool*>(out) = nvgctxt->content_preserved(w, h);
+            break;
+        }
+        default : {
+            return false;
+        }
     }
     return true;
 }
@@ -0,0 +1,1868 @@
+#include "build.hpp"
+
+#include <Btk/detail/reference.hpp>
+#include <Btk/detail/device.hpp>
+#include <Btk/painter.hpp>
+#include <Btk/object.hpp>
+#include <Btk/font.hpp>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+// Software painter, render into a RGBA32 pixbuffer (premultiplied alpha)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BTK_SOFT_SSE2
+    #include <emmintrin.h>
+#endif
+
+#define BTK_MAKE_PAINT_RESOURCE      \
+    public:                          \
+        uint32_t _refcount = 0;      \
+        void ref() override final {  \
+            ++_refcount;             \
+        }                            \
+        void unref() override final {\
+            if (--_refcount == 0) {  \
+                delete this;         \
+            }                        \
+        }                            \
+    public:                          \
+
+
+BTK_PRIV_BEGIN
+
+constexpr float SoftPi = 3.14159265358979323846f;
+
+class SoftContext;
+class SoftTexture;
+
+/**
+ * @brief Edge for scanline rasterizer (y0 always less than y1)
+ *
+ */
+class SoftEdge {
+    public:
+        float x0, y0;
+        float x1, y1;
+        float dxdy;
+        float dir; //< 1 on downward, -1 on upward
+};
+
+/**
+ * @brief Scanline rasterizer with analytic coverage (signed area accumulation)
+ *
+ */
+class SoftRasterizer {
+    public:
+        /**
+         * @brief Reset the rasterizer
+         *
+         * @param clip The clip rectangle in device pixels (could not be empty)
+         */
+        void reset(const Rect &clip);
+        /**
+         * @brief Add a line in device space
+         *
+         */
+        void add_line(float x0, float y0, float x1, float y1);
+        /**
+         * @brief Rasterize all edges, call the callback on each span
+         *
+         * @param opacity The opacity of the coverage [0 => 255]
+         * @param antialias Use analytic coverage or not
+         * @param cb void(int y, int x, int n, const uint8_t *covers)
+         */
+        template <typename Callback>
+        void render(int opacity, bool antialias, Callback &&cb);
+
+        bool empty() const noexcept {
+            return edges.empty();
+        }
+    private:
+        void push_edge(float x0, float y0, float x1, float y1);
+        void accumulate(const SoftEdge &edge, float top, float bottom);
+
+        std::vector<SoftEdge> edges;
+        std::vector<size_t>   active;
+        std::vector<float>    cells;
+        std::vector<uint8_t>  covers;
+        Rect                  clip = {0, 0, 0, 0};
+        int                   cell_min = 0;
+        int                   cell_max = 0;
+};
+
+/**
+ * @brief Source of the pixels in a span
+ *
+ */
+class SoftPaint {
+    public:
+        enum Kind : uint8_t {
+            Solid,
+            Linear,
+            Radial,
+            Image
+        };
+
+        void fetch(int x, int y, int n, uint32_t *out) const;
+
+        Kind             kind  = Solid;
+        uint32_t         color = 0xFF000000; //< Premultiplied solid color
+        FMatrix          inv;                //< Device pixel => Paint space
+        uint32_t         lut[256];           //< Gradient lookup table
+        const PixBuffer *image    = nullptr; //< Premultiplied RGBA32 image
+        bool             bilinear = true;
+        bool             repeat   = false;
+};
+
+/**
+ * @brief Coverage mask (alpha of texture)
+ *
+ */
+class SoftMask {
+    public:
+        void apply(int x, int y, int n, uint8_t *covers) const;
+
+        const PixBuffer *mask = nullptr;
+        FMatrix          inv; //< Device pixel => Mask pixel
+        bool             bilinear = true;
+};
+
+class SoftContext final : public PaintContext, PainterPathSink {
+    public:
+        SoftContext(PaintDevice *device, PixBuffer *target);
+        ~SoftContext();
+
+        // PaintResource
+        void ref() { }
+        void unref() { }
+        auto signal_destroyed() -> Signal<void()> & { return signal; }
+
+        // Inherit from GraphicsContext
+        void begin() override;
+        void end() override;
+        void swap_buffers() override;
+
+        // Inherit from PaintContext
+        void clear(Brush &) override;
+        // Draw
+        bool draw_path(const PainterPath &path) override;
+        bool draw_line(float x1, float y1, float x2, float y2) override;
+        bool draw_rect(float x, float y, float w, float h) override;
+        bool draw_rounded_rect(float x, float y, float w, float h, float r) override;
+        bool draw_ellipse(float x, float y, float xr, float yr) override;
+        bool draw_image(AbstractTexture *image, const FRect *dst, const FRect *src) override;
+
+        // Text
+        bool draw_text(Alignment, Font &font, u8string_view text, float x, float y) override;
+        bool draw_text(Alignment, const TextLayout &layout      , float x, float y) override;
+
+        // Fill
+        bool fill_path(const PainterPath &path) override;
+        bool fill_rect(float x, float y, float w, float h) override;
+        bool fill_rounded_rect(float x, float y, float w, float h, float r) override;
+        bool fill_ellipse(float x, float y, float xr, float yr) override;
+        bool fill_mask(AbstractTexture *mask, const FRect *dst, const FRect *src) override;
+
+        // State
+        bool set_state(PaintContextState state, const void *what) override;
+
+        // Extra
+        bool native_handle(PaintContextHandle h, void *out) override;
+
+        // Texture
+        auto create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi) -> Ref<AbstractTexture> override;
+
+        // Vector Graphics Sink
+        void open() override;
+        void close() override;
+        void move_to(float x, float y) override;
+        void line_to(float x, float y) override;
+        void bezier_to(float x1, float y1, float x2, float y2, float x3, float y3) override;
+        void close_path() override;
+        void set_winding(PathWinding winding) override;
+    private:
+        class Contour {
+            public:
+                size_t first;
+                size_t count;
+                bool   closed;
+        };
+
+        // Path building
+        void begin_path();
+        void begin_contour(float x, float y);
+        void add_rect_path(float x, float y, float w, float h);
+        void add_ellipse_path(float x, float y, float xr, float yr);
+        void add_rounded_rect_path(float x, float y, float w, float h, float r);
+        auto path_bounds() const -> FRect;
+
+        // Geometry => Rasterizer
+        void add_polygon(const FPoint *pts, size_t n);
+        void add_oriented_polygon(const FPoint *pts, size_t n);
+        void add_circle(const FPoint &center, float r);
+        void stroke_polyline(const FPoint *pts, size_t n, bool closed);
+        void stroke_contour(const FPoint *pts, size_t n, bool closed);
+        void fill_current_path();
+        void stroke_current_path();
+
+        // Paint
+        bool setup_paint(const FRect &object);
+        bool setup_image(SoftPaint &paint, const PixBuffer *image, const FRect &dst, const FRect &src);
+        void build_gradient(const Gradient &gradient);
+        void render(const SoftMask *mask = nullptr);
+        void blend_span(int y, int x, int n, const uint8_t *covers, const SoftMask *mask);
+        auto texture_of_brush() -> SoftTexture *;
+
+        // Text
+        bool draw_glyphs(Alignment align, const PixBuffer &bitmap, float scale, float x, float y, float w, float h);
+
+        // Misc
+        auto device_scale() const -> float;
+        auto device_matrix() const -> FMatrix;
+
+        PaintDevice *device;
+        PixBuffer   *target;
+
+        Signal<void()> signal; //< Signal for cleanup resource
+
+        // State
+        FMatrix      matrix;           //< User => Device
+        FPoint       base_scale = {1.0f, 1.0f}; //< Dpi scale of the target
+        Rect         clip;             //< Current clip in device pixels
+        float        alpha      = 1.0f;
+        float        stroke_width = 1.0f;
+        bool         antialias  = true;
+        Brush        brush      = { Color::Black };
+        Pen          pen        = { };
+
+        // Path
+        std::vector<FPoint>  points;
+        std::vector<Contour> contours;
+        bool                 need_move = true;
+
+        // Scratch
+        SoftRasterizer        raster;
+        SoftPaint             paint;
+        std::vector<uint32_t> span_buffer;
+        std::vector<uint8_t>  cover_buffer;
+        std::vector<FPoint>   stroke_buffer;
+    friend class SoftTexture;
+};
+
+class SoftTexture final : public AbstractTexture {
+    public:
+        BTK_MAKE_PAINT_RESOURCE
+
+        SoftTexture(SoftContext *ctxt, PixFormat fmt, int w, int h, float xdpi, float ydpi);
+        ~SoftTexture();
+
+        // Inhertied from PaintResource
+        auto signal_destroyed() -> Signal<void()> & override {
+            return ctxt->signal_destroyed();
+        }
+
+        // Inhertied from PaintDevice
+        auto paint_context() -> Ref<PaintContext> override;
+        bool query_value(PaintDeviceValue v, void *out) override;
+
+        void update(const Rect *area, cpointer_t ptr, int pitch) override;
+        void set_interpolation_mode(InterpolationMode mode) override;
+    private:
+        SoftContext                 *ctxt;
+        std::unique_ptr<SoftContext> target; //< Context for painting on it
+        PixBuffer                    buffer;
+        FPoint                       dpi;
+        InterpolationMode            mode = InterpolationMode::Linear;
+    friend class SoftContext;
+};
+
+class SoftTextCache final : public PaintResource {
+    public:
+        BTK_MAKE_PAINT_RESOURCE
+
+        SoftTextCache(SoftContext *ctxt) : ctxt(ctxt) { }
+
+        // Inhertied from PaintResource
+        auto signal_destroyed() -> Signal<void()> & override {
+            return ctxt->signal_destroyed();
+        }
+
+        PixBuffer bitmap;
+        float     scale = 1.0f; //< Pixels per logical unit
+    private:
+        SoftContext *ctxt;
+};
+
+class SoftPaintDevice final : public PaintDevice {
+    public:
+        SoftPaintDevice(PixBuffer *buffer);
+        ~SoftPaintDevice();
+
+        auto paint_context() -> Ref<PaintContext> override;
+        bool query_value(PaintDeviceValue value, void *out) override;
+    private:
+        PixBuffer   *buffer;
+        SoftContext *ctxt;
+};
+
+// Pixel helpers, all colors are premultiplied RGBA32 (R in the low byte)
+inline uint32_t byte_mul(uint32_t x, uint32_t a) {
+    uint32_t rb = (x & 0x00FF00FF) * a;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF) + 0x00800080) >> 8) & 0x00FF00FF;
+
+    uint32_t ag = ((x >> 8) & 0x00FF00FF) * a;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF) + 0x00800080) & 0xFF00FF00;
+
+    return rb | ag;
+}
+inline uint32_t blend_over(uint32_t dst, uint32_t src) {
+    return src + byte_mul(dst, 255 - (src >> 24));
+}
+inline uint32_t premultiply(const GLColor &c) {
+    float a = clamp(c.a, 0.0f, 1.0f);
+    uint32_t r = uint32_t(clamp(c.r, 0.0f, 1.0f) * a * 255.0f + 0.5f);
+    uint32_t g = uint32_t(clamp(c.g, 0.0f, 1.0f) * a * 255.0f + 0.5f);
+    uint32_t b = uint32_t(clamp(c.b, 0.0f, 1.0f) * a * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (uint32_t(a * 255.0f + 0.5f) << 24);
+}
+inline uint32_t premultiply(uint32_t c) {
+    uint32_t a = c >> 24;
+    if (a == 255) {
+        return c;
+    }
+    return (byte_mul(c, a) & 0x00FFFFFF) | (a << 24);
+}
+inline uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t t) {
+    // t in [0, 256]
+    uint32_t rb = (((b & 0x00FF00FF) - (a & 0x00FF00FF)) * t >> 8) + (a & 0x00FF00FF);
+    uint32_t ag = ((((b >> 8) & 0x00FF00FF) - ((a >> 8) & 0x00FF00FF)) * t >> 8) + ((a >> 8) & 0x00FF00FF);
+    return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+#if defined(BTK_SOFT_SSE2)
+inline __m128i sse2_div255(__m128i x) {
+    // (x + 128 + ((x + 128) >> 8)) >> 8
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+inline __m128i sse2_alpha(__m128i x) {
+    // Broadcast the alpha channel of two 16 bits pixels
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+inline __m128i sse2_expand_covers(const uint8_t *covers) {
+    // c0 c1 c2 c3 => c0 c0 c0 c0 c1 c1 c1 c1 ...
+    int32_t packed;
+    Btk_memcpy(&packed, covers, sizeof(packed));
+    __m128i c = _mm_cvtsi32_si128(packed);
+    c = _mm_unpacklo_epi8(c, c);
+    return _mm_unpacklo_epi16(c, c);
+}
+inline __m128i sse2_blend4(__m128i dst, __m128i src, __m128i cov) {
+    __m128i zero   = _mm_setzero_si128();
+    __m128i full   = _mm_set1_epi16(255);
+
+    __m128i src_lo = sse2_div255(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(cov, zero)));
+    __m128i src_hi = sse2_div255(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(cov, zero)));
+
+    __m128i dst_lo = _mm_unpacklo_epi8(dst, zero);
+    __m128i dst_hi = _mm_unpackhi_epi8(dst, zero);
+
+    dst_lo = sse2_div255(_mm_mullo_epi16(dst_lo, _mm_sub_epi16(full, sse2_alpha(src_lo))));
+    dst_hi = sse2_div255(_mm_mullo_epi16(dst_hi, _mm_sub_epi16(full, sse2_alpha(src_hi))));
+
+    return _mm_packus_epi16(_mm_add_epi16(src_lo, dst_lo), _mm_add_epi16(src_hi, dst_hi));
+}
+#endif
+
+/**
+ * @brief Blend a solid color into span by coverage
+ *
+ */
+void composite_solid(uint32_t *dst, const uint8_t *covers, uint32_t color, int n) {
+    bool opaque = (color >> 24) == 255;
+    int  i      = 0;
+
+#if defined(BTK_SOFT_SSE2)
+    __m128i src = _mm_set1_epi32(int32_t(color));
+    for (; i + 4 <= n; i += 4) {
+        uint32_t packed;
+        Btk_memcpy(&packed, covers + i, sizeof(packed));
+        if (packed == 0) {
+            continue;
+        }
+        auto out = reinterpret_cast<__m128i*>(dst + i);
+        if (packed == 0xFFFFFFFF && opaque) {
+            _mm_storeu_si128(out, src);
+            continue;
+        }
+        _mm_storeu_si128(out, sse2_blend4(_mm_loadu_si128(out), src, sse2_expand_covers(covers + i)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        uint32_t c = covers[i];
+        if (c == 0) {
+            continue;
+        }
+        if (c == 255 && opaque) {
+            dst[i] = color;
+            continue;
+        }
+        dst[i] = blend_over(dst[i], byte_mul(color, c));
+    }
+}
+/**
+ * @brief Blend a span of colors into span by coverage
+ *
+ */
+void composite_span(uint32_t *dst, const uint8_t *covers, const uint32_t *src, int n) {
+    int  i = 0;
+
+#if defined(BTK_SOFT_SSE2)
+    for (; i + 4 <= n; i += 4) {
+        uint32_t packed;
+        Btk_memcpy(&packed, covers + i, sizeof(packed));
+        if (packed == 0) {
+            continue;
+        }
+        auto out = reinterpret_cast<__m128i*>(dst + i);
+        auto in  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(out, sse2_blend4(_mm_loadu_si128(out), in, sse2_expand_covers(covers + i)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        uint32_t c = covers[i];
+        if (c == 0) {
+            continue;
+        }
+        if (c == 255) {
+            dst[i] = blend_over(dst[i], src[i]);
+            continue;
+        }
+        dst[i] = blend_over(dst[i], byte_mul(src[i], c));
+    }
+}
+
+// Rasterizer
+void SoftRasterizer::reset(const Rect &c) {
+    clip = c;
+    edges.clear();
+}
+void SoftRasterizer::add_line(float x0, float y0, float x1, float y1) {
+    if (y0 == y1 || !std::isfinite(x0 + y0 + x1 + y1)) {
+        return;
+    }
+
+    // Split the line at the left / right boundary, the part outside is clamped on the boundary
+    // So the winding of the pixels inside is still correct
+    float left  = clip.x;
+    float right = clip.x + clip.w;
+
+    if ((x0 < left) != (x1 < left)) {
+        float ym = y0 + (left - x0) * (y1 - y0) / (x1 - x0);
+        if (x0 < left) {
+            push_edge(left, y0, left, ym);
+            add_line(left, ym, x1, y1);
+        }
+        else {
+            add_line(x0, y0, left, ym);
+            push_edge(left, ym, left, y1);
+        }
+        return;
+    }
+    if ((x0 > right) != (x1 > right)) {
+        float ym = y0 + (right - x0) * (y1 - y0) / (x1 - x0);
+        if (x0 > right) {
+            push_edge(right, y0, right, ym);
+            add_line(right, ym, x1, y1);
+        }
+        else {
+            add_line(x0, y0, right, ym);
+            push_edge(right, ym, right, y1);
+        }
+        return;
+    }
+    push_edge(
+        clamp(x0, left, right), y0,
+        clamp(x1, left, right), y1
+    );
+}
+void SoftRasterizer::push_edge(float x0, float y0, float x1, float y1) {
+    SoftEdge edge;
+    if (y0 == y1) {
+        return;
+    }
+    if (y0 < y1) {
+        edge.x0  = x0; edge.y0 = y0;
+        edge.x1  = x1; edge.y1 = y1;
+        edge.dir = 1.0f;
+    }
+    else {
+        edge.x0  = x1; edge.y0 = y1;
+        edge.x1  = x0; edge.y1 = y0;
+        edge.dir = -1.0f;
+    }
+    // Out of range
+    if (edge.y1 <= clip.y || edge.y0 >= clip.y + clip.h) {
+        return;
+    }
+    edge.dxdy = (edge.x1 - edge.x0) / (edge.y1 - edge.y0);
+    edges.push_back(edge);
+}
+void SoftRasterizer::accumulate(const SoftEdge &edge, float top, float bottom) {
+    float ya = max(edge.y0, top);
+    float yb = min(edge.y1, bottom);
+    float dy = yb - ya;
+    if (dy <= 0.0f) {
+        return;
+    }
+
+    // Into cell space
+    float width = clip.w;
+    float x     = clamp(edge.x0 + (ya - edge.y0) * edge.dxdy - clip.x, 0.0f, width);
+    float xnext = clamp(x + edge.dxdy * dy, 0.0f, width);
+    float d     = dy * edge.dir;
+
+    float x0 = min(x, xnext);
+    float x1 = max(x, xnext);
+
+    float x0floor = std::floor(x0);
+    float x1ceil  = std::ceil(x1);
+    int   x0i     = int(x0floor);
+    int   x1i     = int(x1ceil);
+
+    float *a = cells.data();
+
+    if (x1i <= x0i + 1) {
+        // Inside a single cell
+        float xmf = 0.5f * (x + xnext) - x0floor;
+        a[x0i]     += d - d * xmf;
+        a[x0i + 1] += d * xmf;
+
+        cell_min = min(cell_min, x0i);
+        cell_max = max(cell_max, x0i + 1);
+        return;
+    }
+
+    // Cross cells, distribute the trapezoid area
+    float s   = 1.0f / (x1 - x0);
+    float x0f = x0 - x0floor;
+    float a0  = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+    float x1f = x1 - x1ceil + 1.0f;
+    float am  = 0.5f * s * x1f * x1f;
+
+    a[x0i] += d * a0;
+    if (x1i == x0i + 2) {
+        a[x0i + 1] += d * (1.0f - a0 - am);
+    }
+    else {
+        float a1 = s * (1.5f - x0f);
+        a[x0i + 1] += d * (a1 - a0);
+        for (int xi = x0i + 2; xi < x1i - 1; xi++) {
+            a[xi] += d * s;
+        }
+        float a2 = a1 + float(x1i - x0i - 3) * s;
+        a[x1i - 1] += d * (1.0f - a2 - am);
+    }
+    a[x1i] += d * am;
+
+    cell_min = min(cell_min, x0i);
+    cell_max = max(cell_max, x1i);
+}
+template <typename Callback>
+void SoftRasterizer::render(int opacity, bool antialias, Callback &&cb) {
+    if (edges.empty() || opacity <= 0) {
+        return;
+    }
+    std::sort(edges.begin(), edges.end(), [](const SoftEdge &a, const SoftEdge &b) {
+        return a.y0 < b.y0;
+    });
+
+    float ymax = edges.front().y1;
+    for (auto &edge : edges) {
+        ymax = max(ymax, edge.y1);
+    }
+
+    int y_begin = max(clip.y, int(std::floor(edges.front().y0)));
+    int y_end   = min(clip.y + clip.h, int(std::ceil(ymax)));
+
+    cells.assign(clip.w + 2, 0.0f);
+    covers.resize(clip.w + 2);
+    active.clear();
+
+    float  scale = opacity;
+    size_t next  = 0;
+
+    for (int y = y_begin; y < y_end; y++) {
+        float top    = y;
+        float bottom = y + 1;
+
+        while (next < edges.size() && edges[next].y0 < bottom) {
+            active.push_back(next++);
+        }
+        active.erase(
+            std::remove_if(active.begin(), active.end(), [&](size_t idx) {
+                return edges[idx].y1 <= top;
+            }),
+            active.end()
+        );
+        if (active.empty()) {
+            if (next == edges.size()) {
+                break;
+            }
+            continue;
+        }
+
+        cell_min = clip.w + 1;
+        cell_max = -1;
+        for (auto idx : active) {
+            accumulate(edges[idx], top, bottom);
+        }
+        if (cell_max < 0) {
+            continue;
+        }
+
+        // Sum up the coverage, cells between edges are zero, so fill them as a run
+        int   end = min(cell_max, clip.w - 1);
+        float acc = 0.0f;
+        auto  to_cover = [&](float value) -> uint8_t {
+            float area = std::fabs(value);
+            if (antialias) {
+                return area >= 1.0f ? uint8_t(opacity) : uint8_t(area * scale + 0.5f);
+            }
+            return area >= 0.5f ? uint8_t(opacity) : 0;
+        };
+        for (int i = cell_min; i <= end; ) {
+            if (cells[i] != 0.0f) {
+                acc += cells[i];
+                cells[i] = 0.0f;
+                covers[i] = to_cover(acc);
+                i += 1;
+                continue;
+            }
+            int j = i + 1;
+            while (j <= end && cells[j] == 0.0f) {
+                j += 1;
+            }
+            Btk_memset(covers.data() + i, to_cover(acc), j - i);
+            i = j;
+        }
+        for (int i = end + 1; i <= cell_max; i++) {
+            cells[i] = 0.0f;
+        }
+        if (end >= cell_min) {
+            cb(y, clip.x + cell_min, end - cell_min + 1, covers.data() + cell_min);
+        }
+    }
+}
+
+// Paint
+void SoftPaint::fetch(int x, int y, int n, uint32_t *out) const {
+    // Sample at pixel center
+    float px = inv.m[0][0] * (x + 0.5f) + inv.m[1][0] * (y + 0.5f) + inv.m[2][0];
+    float py = inv.m[0][1] * (x + 0.5f) + inv.m[1][1] * (y + 0.5f) + inv.m[2][1];
+    float dx = inv.m[0][0];
+    float dy = inv.m[0][1];
+
+    switch (kind) {
+        case Solid : {
+            std::fill_n(out, n, color);
+            break;
+        }
+        case Linear : {
+            for (int i = 0; i < n; i++, px += dx) {
+                int idx = int(px * 255.0f + 0.5f);
+                out[i] = lut[clamp(idx, 0, 255)];
+            }
+            break;
+        }
+        case Radial : {
+            for (int i = 0; i < n; i++, px += dx, py += dy) {
+                int idx = int(std::sqrt(px * px + py * py) * 255.0f + 0.5f);
+                out[i] = lut[clamp(idx, 0, 255)];
+            }
+            break;
+        }
+        case Image : {
+            int w = image->width();
+            int h = image->height();
+            int pitch = image->pitch() / 4;
+            auto pixels = image->pixels<uint32_t>();
+
+            auto wrap = [this](int v, int size) {
+                if (repeat) {
+                    v %= size;
+                    return v < 0 ? v + size : v;
+                }
+                return clamp(v, 0, size - 1);
+            };
+
+            if (!bilinear) {
+                for (int i = 0; i < n; i++, px += dx, py += dy) {
+                    int ix = wrap(int(std::floor(px)), w);
+                    int iy = wrap(int(std::floor(py)), h);
+                    out[i] = pixels[iy * pitch + ix];
+                }
+                break;
+            }
+            for (int i = 0; i < n; i++, px += dx, py += dy) {
+                float fx = px - 0.5f;
+                float fy = py - 0.5f;
+                float flx = std::floor(fx);
+                float fly = std::floor(fy);
+
+                int x0 = int(flx);
+                int y0 = int(fly);
+                uint32_t tx = uint32_t((fx - flx) * 256.0f);
+                uint32_t ty = uint32_t((fy - fly) * 256.0f);
+
+                int ix0 = wrap(x0, w), ix1 = wrap(x0 + 1, w);
+                int iy0 = wrap(y0, h), iy1 = wrap(y0 + 1, h);
+
+                uint32_t top = lerp_pixel(pixels[iy0 * pitch + ix0], pixels[iy0 * pitch + ix1], tx);
+                uint32_t bot = lerp_pixel(pixels[iy1 * pitch + ix0], pixels[iy1 * pitch + ix1], tx);
+                out[i] = lerp_pixel(top, bot, ty);
+            }
+            break;
+        }
+    }
+}
+void SoftMask::apply(int x, int y, int n, uint8_t *covers) const {
+    float px = inv.m[0][0] * (x + 0.5f) + inv.m[1][0] * (y + 0.5f) + inv.m[2][0];
+    float py = inv.m[0][1] * (x + 0.5f) + inv.m[1][1] * (y + 0.5f) + inv.m[2][1];
+    float dx = inv.m[0][0];
+    float dy = inv.m[0][1];
+
+    int w = mask->width();
+    int h = mask->height();
+    int bpp   = mask->bytes_per_pixel();
+    int pitch = mask->pitch();
+    int off   = bpp == 4 ? 3 : 0; //< Alpha channel offset
+    auto pixels = mask->pixels<uint8_t>();
+
+    auto sample = [&](int sx, int sy) -> uint32_t {
+        if (sx < 0 || sy < 0 || sx >= w || sy >= h) {
+            return 0;
+        }
+        return pixels[sy * pitch + sx * bpp + off];
+    };
+
+    for (int i = 0; i < n; i++, px += dx, py += dy) {
+        if (covers[i] == 0) {
+            continue;
+        }
+        uint32_t value;
+        if (bilinear) {
+            float fx  = px - 0.5f;
+            float fy  = py - 0.5f;
+            float flx = std::floor(fx);
+            float fly = std::floor(fy);
+            int   x0  = int(flx);
+            int   y0  = int(fly);
+            uint32_t tx = uint32_t((fx - flx) * 256.0f);
+            uint32_t ty = uint32_t((fy - fly) * 256.0f);
+
+            uint32_t top = (sample(x0, y0) * (256 - tx) + sample(x0 + 1, y0) * tx) >> 8;
+            uint32_t bot = (sample(x0, y0 + 1) * (256 - tx) + sample(x0 + 1, y0 + 1) * tx) >> 8;
+            value = (top * (256 - ty) + bot * ty) >> 8;
+        }
+        else {
+            value = sample(int(std::floor(px)), int(std::floor(py)));
+        }
+        covers[i] = uint8_t((covers[i] * value + 127) / 255);
+    }
+}
+
+// Context
+SoftContext::SoftContext(PaintDevice *dev, PixBuffer *buf) : device(dev), target(buf) {
+    auto [xdpi, ydpi] = device->dpi();
+    base_scale.x = xdpi / 96.0f;
+    base_scale.y = ydpi / 96.0f;
+
+    matrix = device_matrix();
+    clip   = Rect(0, 0, target->width(), target->height());
+}
+SoftContext::~SoftContext() {
+    signal.emit();
+}
+void SoftContext::begin() {
+    // Target may be resized between frames, a frame starts without scissor
+    clip = Rect(0, 0, target->width(), target->height());
+}
+void SoftContext::end() {
+
+}
+void SoftContext::swap_buffers() {
+
+}
+void SoftContext::clear(Brush &what) {
+    if (clip.empty()) {
+        return;
+    }
+    uint32_t color = premultiply(what.color());
+    auto     pixels = target->pixels<uint8_t>();
+    for (int y = clip.y; y < clip.y + clip.h; y++) {
+        auto row = reinterpret_cast<uint32_t*>(pixels + y * target->pitch());
+        std::fill_n(row + clip.x, clip.w, color);
+    }
+}
+
+// Draw
+bool SoftContext::draw_path(const PainterPath &path) {
+    begin_path();
+    path.stream(this);
+    if (!setup_paint(path_bounds())) {
+        return false;
+    }
+    stroke_current_path();
+    return true;
+}
+bool SoftContext::draw_line(float x1, float y1, float x2, float y2) {
+    begin_path();
+    move_to(x1, y1);
+    line_to(x2, y2);
+    if (!setup_paint(FRect(FPoint(x1, y1), FPoint(x2, y2)))) {
+        return false;
+    }
+    stroke_current_path();
+    return true;
+}
+bool SoftContext::draw_rect(float x, float y, float w, float h) {
+    if (w <= 0 || h <= 0) {
+        return true;
+    }
+    begin_path();
+    add_rect_path(x, y, w, h);
+    if (!setup_paint(FRect(x, y, w, h))) {
+        return false;
+    }
+    stroke_current_path();
+    return true;
+}
+bool SoftContext::draw_rounded_rect(float x, float y, float w, float h, float r) {
+    if (w <= 0 || h <= 0) {
+        return true;
+    }
+    begin_path();
+    add_rounded_rect_path(x, y, w, h, r);
+    if (!setup_paint(FRect(x, y, w, h))) {
+        return false;
+    }
+    stroke_current_path();
+    return true;
+}
+bool SoftContext::draw_ellipse(float x, float y, float xr, float yr) {
+    begin_path();
+    add_ellipse_path(x, y, xr, yr);
+    if (!setup_paint(FRect(x - xr, y - yr, xr * 2, yr * 2))) {
+        return false;
+    }
+    stroke_current_path();
+    return true;
+}
+bool SoftContext::draw_image(AbstractTexture *image, const FRect *_dst, const FRect *_src) {
+    auto texture = static_cast<SoftTexture*>(image);
+    auto &buffer = texture->buffer;
+
+    FRect dst;
+    FRect src;
+
+    if (_dst) {
+        dst = *_dst;
+    }
+    else {
+        auto [w, h] = device->size();
+        dst = FRect(0, 0, w, h);
+    }
+    if (_src) {
+        src = *_src;
+    }
+    else {
+        src = FRect(0, 0, buffer.width(), buffer.height());
+    }
+    if (dst.empty() || src.empty() || buffer.format() != PixFormat::RGBA32) {
+        return true;
+    }
+
+    if (!setup_image(paint, &buffer, dst, src)) {
+        return false;
+    }
+    paint.bilinear = texture->mode == InterpolationMode::Linear;
+    paint.repeat   = false;
+
+    begin_path();
+    add_rect_path(dst.x, dst.y, dst.w, dst.h);
+    fill_current_path();
+    return true;
+}
+
+// Text
+bool SoftContext::draw_text(Alignment align, Font &font, u8string_view text, float x, float y) {
+    TextLayout layout;
+    layout.set_font(font);
+    layout.set_text(text);
+
+    // Temporary layout, no need to cache it
+    std::vector<PixBuffer> bitmaps;
+    std::vector<Rect>      rects;
+
+    float scale = device_scale();
+    if (!layout.rasterize(96.0f * scale, &bitmaps, &rects) || bitmaps.empty()) {
+        return false;
+    }
+    auto [width, height] = layout.size();
+    return draw_glyphs(align, bitmaps[0], scale, x, y, width, height);
+}
+bool SoftContext::draw_text(Alignment align, const TextLayout &layout      , float x, float y) {
+    float scale    = device_scale();
+    auto  resource = layout.query_device_resource(this);
+    auto  cache    = static_cast<SoftTextCache*>(resource);
+    if (cache && cache->scale != scale) {
+        cache = nullptr;
+    }
+    if (!cache) {
+        std::vector<PixBuffer> bitmaps;
+        std::vector<Rect>      rects;
+        if (!layout.rasterize(96.0f * scale, &bitmaps, &rects) || bitmaps.empty()) {
+            return false;
+        }
+        cache = new SoftTextCache(this);
+        cache->bitmap = std::move(bitmaps[0]);
+        cache->scale  = scale;
+        layout.bind_device_resource(this, cache);
+    }
+    auto [width, height] = layout.size();
+    return draw_glyphs(align, cache->bitmap, scale, x, y, width, height);
+}
+bool SoftContext::draw_glyphs(Alignment align, const PixBuffer &bitmap, float scale, float x, float y, float width, float height) {
+    if ((align & Alignment::Right) == Alignment::Right) {
+        x -= width;
+    }
+    if ((align & Alignment::Bottom) == Alignment::Bottom) {
+        y -= height;
+    }
+    if ((align & Alignment::Center) == Alignment::Center) {
+        x -= width / 2;
+    }
+    if ((align & Alignment::Middle) == Alignment::Middle) {
+        y -= height / 2;
+    }
+    if (bitmap.empty()) {
+        return true;
+    }
+
+    FRect dst(x, y, bitmap.width() / scale, bitmap.height() / scale);
+    if (!setup_paint(dst)) {
+        return false;
+    }
+
+    // Map device pixel => bitmap pixel
+    FMatrix user_to_mask(scale, 0, 0, scale, -x * scale, -y * scale);
+    FMatrix dev_to_user = matrix.inverted();
+
+    SoftMask mask;
+    mask.mask = &bitmap;
+    mask.inv  = user_to_mask.multiply(dev_to_user);
+
+    // Pixel aligned translation, use nearest sampling to keep glyphs sharp
+    bool axis_aligned = mask.inv.m[0][0] == 1.0f && mask.inv.m[1][1] == 1.0f &&
+                        mask.inv.m[0][1] == 0.0f && mask.inv.m[1][0] == 0.0f;
+    if (axis_aligned) {
+        mask.inv.m[2][0] = std::round(mask.inv.m[2][0]);
+        mask.inv.m[2][1] = std::round(mask.inv.m[2][1]);
+    }
+    mask.bilinear = !axis_aligned;
+
+    begin_path();
+    add_rect_path(dst.x, dst.y, dst.w, dst.h);
+
+    raster.reset(clip);
+    for (auto &c : contours) {
+        add_polygon(&points[c.first], c.count);
+    }
+    render(&mask);
+    return true;
+}
+
+// Fill
+bool SoftContext::fill_path(const PainterPath &path) {
+    begin_path();
+    path.stream(this);
+    if (!setup_paint(path_bounds())) {
+        return false;
+    }
+    fill_current_path();
+    return true;
+}
+bool SoftContext::fill_rect(float x, float y, float w, float h) {
+    if (w <= 0 || h <= 0) {
+        return true;
+    }
+    begin_path();
+    add_rect_path(x, y, w, h);
+    if (!setup_paint(FRect(x, y, w, h))) {
+        return false;
+    }
+    fill_current_path();
+    return true;
+}
+bool SoftContext::fill_rounded_rect(float x, float y, float w, float h, float r) {
+    if (w <= 0 || h <= 0) {
+        return true;
+    }
+    begin_path();
+    add_rounded_rect_path(x, y, w, h, r);
+    if (!setup_paint(FRect(x, y, w, h))) {
+        return false;
+    }
+    fill_current_path();
+    return true;
+}
+bool SoftContext::fill_ellipse(float x, float y, float xr, float yr) {
+    begin_path();
+    add_ellipse_path(x, y, xr, yr);
+    if (!setup_paint(FRect(x - xr, y - yr, xr * 2, yr * 2))) {
+        return false;
+    }
+    fill_current_path();
+    return true;
+}
+bool SoftContext::fill_mask(AbstractTexture *tex, const FRect *_dst, const FRect *_src) {
+    auto &buffer = static_cast<SoftTexture*>(tex)->buffer;
+
+    FRect dst;
+    FRect src;
+    if (_dst) {
+        dst = *_dst;
+    }
+    else {
+        auto [w, h] = device->size();
+        dst = FRect(0, 0, w, h);
+    }
+    if (_src) {
+        src = *_src;
+    }
+    else {
+        src = FRect(0, 0, buffer.width(), buffer.height());
+    }
+    if (dst.empty() || src.empty()) {
+        return true;
+    }
+    if (!setup_paint(dst)) {
+        return false;
+    }
+
+    FMatrix user_to_mask;
+    user_to_mask.m[0][0] = src.w / dst.w;
+    user_to_mask.m[1][1] = src.h / dst.h;
+    user_to_mask.m[2][0] = src.x - dst.x * user_to_mask.m[0][0];
+    user_to_mask.m[2][1] = src.y - dst.y * user_to_mask.m[1][1];
+
+    SoftMask mask;
+    mask.mask = &buffer;
+    mask.inv  = user_to_mask.multiply(matrix.inverted());
+
+    begin_path();
+    add_rect_path(dst.x, dst.y, dst.w, dst.h);
+
+    raster.reset(clip);
+    for (auto &c : contours) {
+        add_polygon(&points[c.first], c.count);
+    }
+    render(&mask);
+    return true;
+}
+
+// Vector Graphics Sink
+void SoftContext::open() {
+
+}
+void SoftContext::close() {
+
+}
+void SoftContext::move_to(float x, float y) {
+    contours.push_back(Contour{points.size(), 1, false});
+    points.emplace_back(x, y);
+    need_move = false;
+}
+void SoftContext::line_to(float x, float y) {
+    if (need_move) {
+        begin_contour(x, y);
+        if (contours.back().count == 1 && points.back() == FPoint(x, y)) {
+            return;
+        }
+    }
+    points.emplace_back(x, y);
+    contours.back().count += 1;
+}
+void SoftContext::bezier_to(float x1, float y1, float x2, float y2, float x3, float y3) {
+    if (need_move) {
+        begin_contour(x1, y1);
+    }
+    FPoint p0 = points.back();
+
+    // Segments count by the flatness of control polygon, in device space
+    float ddx = max(std::fabs(p0.x - 2 * x1 + x2), std::fabs(x1 - 2 * x2 + x3));
+    float ddy = max(std::fabs(p0.y - 2 * y1 + y2), std::fabs(y1 - 2 * y2 + y3));
+    float dd  = std::sqrt(ddx * ddx + ddy * ddy) * device_scale();
+    int   n   = clamp(int(std::ceil(std::sqrt(dd * 3.0f))), 1, 128);
+
+    for (int i = 1; i <= n; i++) {
+        float t  = float(i) / n;
+        float mt = 1.0f - t;
+        float a  = mt * mt * mt;
+        float b  = 3.0f * mt * mt * t;
+        float c  = 3.0f * mt * t * t;
+        float d  = t * t * t;
+        points.emplace_back(
+            a * p0.x + b * x1 + c * x2 + d * x3,
+            a * p0.y + b * y1 + c * y2 + d * y3
+        );
+    }
+    contours.back().count += n;
+}
+void SoftContext::close_path() {
+    if (!contours.empty() && !need_move) {
+        contours.back().closed = true;
+        need_move = true;
+    }
+}
+void SoftContext::set_winding(PathWinding) {
+    // Nonzero fill rule is always used, holes are given by the reversed contours
+}
+
+// Path building
+void SoftContext::begin_path() {
+    points.clear();
+    contours.clear();
+    need_move = true;
+}
+void SoftContext::begin_contour(float x, float y) {
+    // Drawing after close_path() continue from the start of the closed contour
+    if (!contours.empty() && contours.back().closed) {
+        auto start = points[contours.back().first];
+        move_to(start.x, start.y);
+        return;
+    }
+    move_to(x, y);
+}
+void SoftContext::add_rect_path(float x, float y, float w, float h) {
+    move_to(x, y);
+    line_to(x + w, y);
+    line_to(x + w, y + h);
+    line_to(x, y + h);
+    close_path();
+}
+void SoftContext::add_ellipse_path(float cx, float cy, float rx, float ry) {
+    // Approximation by four bezier curves
+    constexpr float kappa = 0.5522847493f;
+    move_to(cx - rx, cy);
+    bezier_to(cx - rx, cy + ry * kappa, cx - rx * kappa, cy + ry, cx, cy + ry);
+    bezier_to(cx + rx * kappa, cy + ry, cx + rx, cy + ry * kappa, cx + rx, cy);
+    bezier_to(cx + rx, cy - ry * kappa, cx + rx * kappa, cy - ry, cx, cy - ry);
+    bezier_to(cx - rx * kappa, cy - ry, cx - rx, cy - ry * kappa, cx - rx, cy);
+    close_path();
+}
+void SoftContext::add_rounded_rect_path(float x, float y, float w, float h, float r) {
+    r = min(r, min(w, h) * 0.5f);
+    if (r < 0.1f) {
+        add_rect_path(x, y, w, h);
+        return;
+    }
+    constexpr float kappa = 0.5522847493f;
+    float k = r * (1.0f - kappa);
+
+    move_to(x, y + r);
+    line_to(x, y + h - r);
+    bezier_to(x, y + h - k, x + k, y + h, x + r, y + h);
+    line_to(x + w - r, y + h);
+    bezier_to(x + w - k, y + h, x + w, y + h - k, x + w, y + h - r);
+    line_to(x + w, y + r);
+    bezier_to(x + w, y + k, x + w - k, y, x + w - r, y);
+    line_to(x + r, y);
+    bezier_to(x + k, y, x, y + k, x, y + r);
+    close_path();
+}
+auto SoftContext::path_bounds() const -> FRect {
+    if (points.empty()) {
+        return FRect(0, 0, 0, 0);
+    }
+    FPoint lt = points[0];
+    FPoint rb = points[0];
+    for (auto &p : points) {
+        lt.x = min(lt.x, p.x);
+        lt.y = min(lt.y, p.y);
+        rb.x = max(rb.x, p.x);
+        rb.y = max(rb.y, p.y);
+    }
+    return FRect(lt, rb);
+}
+
+// Geometry => Rasterizer
+void SoftContext::add_polygon(const FPoint *pts, size_t n) {
+    if (n < 2) {
+        return;
+    }
+    FPoint prev = matrix.transform_point(pts[n - 1]);
+    for (size_t i = 0; i < n; i++) {
+        FPoint cur = matrix.transform_point(pts[i]);
+        raster.add_line(prev.x, prev.y, cur.x, cur.y);
+        prev = cur;
+    }
+}
+void SoftContext::add_oriented_polygon(const FPoint *pts, size_t n) {
+    // Stroke pieces overlap each other, keep them in the same orientation
+    // So the nonzero rule union them instead of cancel out
+    float area = 0.0f;
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        area += pts[j].x * pts[i].y - pts[i].x * pts[j].y;
+    }
+    if (area >= 0.0f) {
+        add_polygon(pts, n);
+        return;
+    }
+    FPoint prev = matrix.transform_point(pts[0]);
+    for (size_t i = n; i > 0; i--) {
+        FPoint cur = matrix.transform_point(pts[i - 1]);
+        raster.add_line(prev.x, prev.y, cur.x, cur.y);
+        prev = cur;
+    }
+}
+void SoftContext::add_circle(const FPoint &c, float r) {
+    float dev_r = r * device_scale();
+    if (dev_r <= 0.0f) {
+        return;
+    }
+    // Keep the error less than 0.25 pixel
+    float tol = min(0.25f / dev_r, 1.0f);
+    int   n   = clamp(int(std::ceil(2.0f * SoftPi / std::acos(1.0f - tol))), 8, 128);
+
+    FPoint *pts = static_cast<FPoint*>(Btk_alloca(sizeof(FPoint) * n));
+    for (int i = 0; i < n; i++) {
+        float angle = 2.0f * SoftPi * i / n;
+        pts[i].x = c.x + std::cos(angle) * r;
+        pts[i].y = c.y + std::sin(angle) * r;
+    }
+    add_oriented_polygon(pts, n);
+}
+void SoftContext::stroke_polyline(const FPoint *pts, size_t n, bool closed) {
+    float hw   = stroke_width * 0.5f;
+    auto  cap  = pen.line_cap();
+    auto  join = pen.line_join();
+
+    if (n == 1) {
+        if (cap == LineCap::Round) {
+            add_circle(pts[0], hw);
+        }
+        return;
+    }
+
+    size_t segs = closed ? n : n - 1;
+    auto direction = [&](size_t i) {
+        FPoint a = pts[i % n];
+        FPoint b = pts[(i + 1) % n];
+        FPoint d = b - a;
+        float len = std::sqrt(d.x * d.x + d.y * d.y);
+        return len > 0.0f ? d / len : FPoint(1.0f, 0.0f);
+    };
+
+    // Body
+    for (size_t i = 0; i < segs; i++) {
+        FPoint a = pts[i];
+        FPoint b = pts[(i + 1) % n];
+        FPoint d = direction(i);
+        FPoint nrm(-d.y * hw, d.x * hw);
+
+        if (!closed && cap == LineCap::Square) {
+            if (i == 0) {
+                a -= d * hw;
+            }
+            if (i == segs - 1) {
+                b += d * hw;
+            }
+        }
+        FPoint quad[4] = {a + nrm, b + nrm, b - nrm, a - nrm};
+        add_oriented_polygon(quad, 4);
+    }
+
+    // Joins
+    size_t first = closed ? 0 : 1;
+    size_t last  = closed ? n : n - 1;
+    for (size_t j = first; j < last; j++) {
+        FPoint d0 = direction(j + n - 1);
+        FPoint d1 = direction(j);
+        FPoint p  = pts[j];
+
+        float cross = d0.x * d1.y - d0.y * d1.x;
+        float dot   = d0.x * d1.x + d0.y * d1.y;
+        if (std::fabs(cross) < 1e-4f && dot > 0.0f) {
+            continue;
+        }
+
+        // Outer side is opposite to the turning
+        float  side = cross > 0.0f ? -hw : hw;
+        FPoint o0   = p + FPoint(-d0.y, d0.x) * side;
+        FPoint o1   = p + FPoint(-d1.y, d1.x) * side;
+
+        // Tiny angle, bevel is good enough
+        if (join == LineJoin::Round && std::fabs(cross) * hw * device_scale() > 0.25f) {
+            add_circle(p, hw);
+            continue;
+        }
+        if (join == LineJoin::Miter) {
+            FPoint m   = FPoint(-d0.y - d1.y, d0.x + d1.x);
+            float  len = std::sqrt(m.x * m.x + m.y * m.y);
+            if (len > 0.0f) {
+                m = m / len;
+                float cos_half = m.x * -d0.y + m.y * d0.x;
+                if (cos_half > 0.0f && 1.0f / cos_half <= pen.miter_limit()) {
+                    FPoint tip = p + m * (side / cos_half);
+                    FPoint kite[4] = {p, o0, tip, o1};
+                    add_oriented_polygon(kite, 4);
+                    continue;
+                }
+            }
+        }
+        FPoint bevel[3] = {p, o0, o1};
+        add_oriented_polygon(bevel, 3);
+    }
+
+    // Caps
+    if (!closed && cap == LineCap::Round) {
+        add_circle(pts[0], hw);
+        add_circle(pts[n - 1], hw);
+    }
+}
+void SoftContext::stroke_contour(const FPoint *pts, size_t n, bool closed) {
+    // Remove the duplicated points
+    stroke_buffer.clear();
+    for (size_t i = 0; i < n; i++) {
+        if (stroke_buffer.empty() || stroke_buffer.back() != pts[i]) {
+            stroke_buffer.push_back(pts[i]);
+        }
+    }
+    if (closed && stroke_buffer.size() > 1 && stroke_buffer.front() == stroke_buffer.back()) {
+        stroke_buffer.pop_back();
+    }
+    if (stroke_buffer.empty()) {
+        return;
+    }
+
+    // Dash pattern, in the unit of stroke width
+    std::vector<float> dashes;
+    switch (pen.dash_style()) {
+        case DashStyle::Solid      : break;
+        case DashStyle::Dash       : dashes = {2, 2}; break;
+        case DashStyle::Dot        : dashes = {0, 2}; break;
+        case DashStyle::DashDot    : dashes = {2, 2, 0, 2}; break;
+        case DashStyle::DashDotDot : dashes = {2, 2, 0, 2, 0, 2}; break;
+        case DashStyle::Custom     : dashes = pen.dash_pattern(); break;
+    }
+    float total = 0.0f;
+    for (auto &v : dashes) {
+        v = max(v, 0.0f) * stroke_width;
+        total += v;
+    }
+    if (dashes.empty() || total <= 0.0f || stroke_buffer.size() < 2) {
+        stroke_polyline(stroke_buffer.data(), stroke_buffer.size(), closed);
+        return;
+    }
+    if (closed) {
+        stroke_buffer.push_back(stroke_buffer.front());
+    }
+
+    // Walk along the polyline
+    size_t idx    = 0;
+    float  remain = std::fmod(pen.dash_offset() * stroke_width, total);
+    if (remain < 0.0f) {
+        remain += total;
+    }
+    while (remain > dashes[idx]) {
+        remain -= dashes[idx];
+        idx = (idx + 1) % dashes.size();
+    }
+    remain = dashes[idx] - remain;
+
+    std::vector<FPoint> dash;
+    FPoint last_dir(1.0f, 0.0f);
+    auto flush = [&]() {
+        if (dash.size() == 1) {
+            // Zero length dash (dot), give it a direction for caps
+            dash.push_back(dash[0] + last_dir * 1e-3f);
+        }
+        if (!dash.empty()) {
+            stroke_polyline(dash.data(), dash.size(), false);
+        }
+        dash.clear();
+    };
+
+    if (idx % 2 == 0) {
+        dash.push_back(stroke_buffer[0]);
+    }
+    for (size_t i = 0; i + 1 < stroke_buffer.size(); i++) {
+        FPoint a   = stroke_buffer[i];
+        FPoint b   = stroke_buffer[i + 1];
+        FPoint d   = b - a;
+        float  len = std::sqrt(d.x * d.x + d.y * d.y);
+        float  pos = 0.0f;
+        last_dir   = d / len;
+
+        while (len - pos > remain) {
+            pos += remain;
+            FPoint cut = a + last_dir * pos;
+            if (idx % 2 == 0) {
+                dash.push_back(cut);
+                flush();
+            }
+            else {
+                dash.push_back(cut);
+            }
+            idx    = (idx + 1) % dashes.size();
+            remain = dashes[idx];
+        }
+        remain -= len - pos;
+        if (idx % 2 == 0) {
+            dash.push_back(b);
+        }
+    }
+    if (idx % 2 == 0) {
+        flush();
+    }
+}
+void SoftContext::fill_current_path() {
+    if (stats) {
+        stats->path_tessellations += 1;
+    }
+    raster.reset(clip);
+    for (auto &c : contours) {
+        add_polygon(&points[c.first], c.count);
+    }
+    render();
+}
+void SoftContext::stroke_current_path() {
+    if (stats) {
+        stats->path_tessellations += 1;
+    }
+    raster.reset(clip);
+    for (auto &c : contours) {
+        stroke_contour(&points[c.first], c.count, c.closed);
+    }
+    render();
+}
+
+// Paint
+bool SoftContext::setup_paint(const FRect &object) {
+    if (clip.empty()) {
+        return false;
+    }
+    switch (brush.type()) {
+        case BrushType::Solid : {
+            paint.kind  = SoftPaint::Solid;
+            paint.color = premultiply(brush.color());
+            return true;
+        }
+        case BrushType::LinearGradient : {
+            auto &lg = brush.linear_gradient();
+            if (lg.stops().empty()) {
+                return false;
+            }
+            auto start = brush.point_to_abs(device, object, lg.start_point());
+            auto end   = brush.point_to_abs(device, object, lg.end_point());
+            auto d     = end - start;
+            float dd   = d.x * d.x + d.y * d.y;
+            if (dd <= 0.0f || !matrix.invertible()) {
+                return false;
+            }
+
+            // t = dot(p - start, d) / |d|^2
+            FMatrix user_to_grad;
+            user_to_grad.m[0][0] = d.x / dd;
+            user_to_grad.m[1][0] = d.y / dd;
+            user_to_grad.m[2][0] = -(start.x * d.x + start.y * d.y) / dd;
+            user_to_grad.m[0][1] = 0.0f;
+            user_to_grad.m[1][1] = 0.0f;
+            user_to_grad.m[2][1] = 0.0f;
+
+            paint.kind = SoftPaint::Linear;
+            paint.inv  = user_to_grad.multiply(matrix.inverted());
+            build_gradient(lg);
+            return true;
+        }
+        case BrushType::RadialGradient : {
+            auto &rg = brush.radial_gradient();
+            if (rg.stops().empty()) {
+                return false;
+            }
+            auto center = brush.point_to_abs(device, object, rg.center_point());
+            auto origin = brush.point_to_abs(device, object, FPoint(0.0f, 0.0f));
+            auto radius = brush.point_to_abs(device, object, FPoint(rg.radius_x(), rg.radius_y())) - origin;
+            if (radius.x <= 0.0f || radius.y <= 0.0f || !matrix.invertible()) {
+                return false;
+            }
+
+            // Normalize the ellipse into unit circle
+            FMatrix user_to_grad(
+                1.0f / radius.x, 0.0f,
+                0.0f, 1.0f / radius.y,
+                -center.x / radius.x, -center.y / radius.y
+            );
+
+            paint.kind = SoftPaint::Radial;
+            paint.inv  = user_to_grad.multiply(matrix.inverted());
+            build_gradient(rg);
+            return true;
+        }
+        case BrushType::Bitmap :
+        case BrushType::Texture : {
+            auto texture = texture_of_brush();
+            if (!texture || texture->buffer.format() != PixFormat::RGBA32) {
+                return false;
+            }
+            auto &buffer = texture->buffer;
+            auto  rect   = brush.rect_to_abs(device, object, brush.rect());
+            if (!setup_image(paint, &buffer, rect, FRect(0, 0, buffer.width(), buffer.height()))) {
+                return false;
+            }
+            paint.bilinear = texture->mode == InterpolationMode::Linear;
+            paint.repeat   = true;
+            return true;
+        }
+    }
+    return false;
+}
+bool SoftContext::setup_image(SoftPaint &p, const PixBuffer *image, const FRect &dst, const FRect &src) {
+    if (dst.empty() || src.empty() || image->empty() || !matrix.invertible()) {
+        return false;
+    }
+    // Map dst => src
+    FMatrix user_to_image;
+    user_to_image.m[0][0] = src.w / dst.w;
+    user_to_image.m[1][1] = src.h / dst.h;
+    user_to_image.m[2][0] = src.x - dst.x * user_to_image.m[0][0];
+    user_to_image.m[2][1] = src.y - dst.y * user_to_image.m[1][1];
+
+    p.kind  = SoftPaint::Image;
+    p.image = image;
+    p.inv   = user_to_image.multiply(matrix.inverted());
+    return true;
+}
+void SoftContext::build_gradient(const Gradient &gradient) {
+    auto stops = gradient.stops();
+    std::stable_sort(stops.begin(), stops.end(), [](const ColorStop &a, const ColorStop &b) {
+        return a.offset < b.offset;
+    });
+
+    size_t cur = 0;
+    for (int i = 0; i < 256; i++) {
+        float t = i / 255.0f;
+        while (cur + 1 < stops.size() && stops[cur + 1].offset < t) {
+            cur += 1;
+        }
+        GLColor color;
+        if (t <= stops[cur].offset || cur + 1 == stops.size()) {
+            color = stops[cur].color;
+        }
+        else {
+            auto &a = stops[cur];
+            auto &b = stops[cur + 1];
+            float span = b.offset - a.offset;
+            color = span > 0.0f ? lerp(a.color, b.color, (t - a.offset) / span) : b.color;
+        }
+        paint.lut[i] = premultiply(color);
+    }
+}
+auto SoftContext::texture_of_brush() -> SoftTexture * {
+    if (brush.type() == BrushType::Texture) {
+        return static_cast<SoftTexture*>(static_cast<AbstractTexture*>(brush.texture()));
+    }
+    auto resource = brush.query_device_resource(this);
+    if (!resource) {
+        auto pixbuffer = brush.bitmap();
+        if (pixbuffer.format() != PixFormat::RGBA32) {
+            pixbuffer = pixbuffer.convert(PixFormat::RGBA32);
+        }
+        auto tex = create_texture(pixbuffer.format(), pixbuffer.width(), pixbuffer.height(), 96, 96);
+        if (!tex) {
+            return nullptr;
+        }
+        tex->update(nullptr, pixbuffer.pixels(), pixbuffer.pitch());
+
+        resource = tex.get();
+        brush.bind_device_resource(this, tex.get());
+    }
+    return static_cast<SoftTexture*>(resource);
+}
+void SoftContext::render(const SoftMask *mask) {
+    int opacity = int(clamp(alpha, 0.0f, 1.0f) * 255.0f + 0.5f);
+    if (opacity == 0 || clip.empty()) {
+        return;
+    }
+    span_buffer.resize(clip.w);
+    cover_buffer.resize(clip.w);
+
+    raster.render(opacity, antialias, [&, this](int y, int x, int n, const uint8_t *covers) {
+        blend_span(y, x, n, covers, mask);
+    });
+}
+void SoftContext::blend_span(int y, int x, int n, const uint8_t *covers, const SoftMask *mask) {
+    auto dst = reinterpret_cast<uint32_t*>(target->pixels<uint8_t>() + y * target->pitch()) + x;
+
+    if (mask) {
+        Btk_memcpy(cover_buffer.data(), covers, n);
+        mask->apply(x, y, n, cover_buffer.data());
+        covers = cover_buffer.data();
+    }
+    if (paint.kind == SoftPaint::Solid) {
+        composite_solid(dst, covers, paint.color, n);
+        return;
+    }
+    paint.fetch(x, y, n, span_buffer.data());
+    composite_span(dst, covers, span_buffer.data(), n);
+}
+
+// State
+bool SoftContext::set_state(PaintContextState state, const void *in) {
+    switch (state) {
+        case PaintContextState::Alpha : {
+            alpha = *static_cast<const float *>(in);
+            break;
+        }
+        case PaintContextState::Antialias : {
+            antialias = *static_cast<const bool *>(in);
+            break;
+        }
+        case PaintContextState::StrokeWidth : {
+            stroke_width = *static_cast<const float*>(in);
+            break;
+        }
+        case PaintContextState::Transform : {
+            matrix = device_matrix();
+            if (in) {
+                matrix = matrix.multiply(*static_cast<const FMatrix*>(in));
+            }
+            break;
+        }
+        case PaintContextState::Scissor : {
+            Rect bounds(0, 0, target->width(), target->height());
+            if (!in) {
+                clip = bounds;
+                break;
+            }
+            // Use the device bounding box of the transformed scissor
+            auto *scissor = static_cast<const PaintScissor*>(in);
+            auto  mat     = device_matrix().multiply(scissor->matrix);
+            auto &r       = scissor->rect;
+
+            FPoint corners[4] = {
+                mat.transform_point(r.top_left()),
+                mat.transform_point(r.top_right()),
+                mat.transform_point(r.bottom_left()),
+                mat.transform_point(r.bottom_right())
+            };
+            FPoint lt = corners[0];
+            FPoint rb = corners[0];
+            for (auto &p : corners) {
+                lt.x = min(lt.x, p.x);
+                lt.y = min(lt.y, p.y);
+                rb.x = max(rb.x, p.x);
+                rb.y = max(rb.y, p.y);
+            }
+            int x0 = int(std::round(lt.x));
+            int y0 = int(std::round(lt.y));
+            int x1 = int(std::round(rb.x));
+            int y1 = int(std::round(rb.y));
+            clip = Rect(x0, y0, x1 - x0, y1 - y0).intersected(bounds);
+            if (clip.empty()) {
+                clip = Rect(0, 0, 0, 0);
+            }
+            break;
+        }
+        case PaintContextState::Pen : {
+            pen = *static_cast<const Pen*>(in);
+            break;
+        }
+        case PaintContextState::Brush : {
+            brush = *static_cast<const Brush *>(in);
+            break;
+        }
+        default : return false;
+    }
+    return true;
+}
+bool SoftContext::native_handle(PaintContextHandle, void *) {
+    return false;
+}
+auto SoftContext::create_texture(PixFormat fmt, int w, int h, float xdpi, float ydpi) -> Ref<AbstractTexture> {
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+    if (fmt != PixFormat::RGBA32 && fmt != PixFormat::Gray8) {
+        return nullptr;
+    }
+    return new SoftTexture(this, fmt, w, h, xdpi, ydpi);
+}
+
+// Misc
+auto SoftContext::device_scale() const -> float {
+    float det = matrix.m[0][0] * matrix.m[1][1] - matrix.m[0][1] * matrix.m[1][0];
+    return max(std::sqrt(std::fabs(det)), 1e-3f);
+}
+auto SoftContext::device_matrix() const -> FMatrix {
+    FMatrix mat;
+    mat.scale(base_scale.x, base_scale.y);
+    return mat;
+}
+
+// Texture
+SoftTexture::SoftTexture(SoftContext *c, PixFormat fmt, int w, int h, float xdpi, float ydpi) :
+    ctxt(c), buffer(fmt, w, h), dpi(xdpi, ydpi)
+{
+    if (dpi.x <= 0 || dpi.y <= 0) {
+        dpi = ctxt->device->dpi();
+    }
+    Btk_memset(buffer.pixels(), 0, size_t(buffer.pitch()) * buffer.height());
+}
+SoftTexture::~SoftTexture() {
+
+}
+auto SoftTexture::paint_context() -> Ref<PaintContext> {
+    if (buffer.format() != PixFormat::RGBA32) {
+        return nullptr;
+    }
+    if (!target) {
+        target = std::make_unique<SoftContext>(this, &buffer);
+    }
+    return target.get();
+}
+bool SoftTexture::query_value(PaintDeviceValue value, void *out) {
+    switch (value) {
+        case PaintDeviceValue::PixelSize : {
+            *static_cast<Size*>(out) = buffer.size();
+            break;
+        }
+        case PaintDeviceValue::LogicalSize : {
+            auto fs = static_cast<FSize*>(out);
+            fs->w = buffer.width() * 96.0f / dpi.x;
+            fs->h = buffer.height() * 96.0f / dpi.y;
+            break;
+        }
+        case PaintDeviceValue::Dpi : {
+            *static_cast<FPoint*>(out) = dpi;
+            break;
+        }
+        case PaintDeviceValue::PixelFormat : {
+            *static_cast<PixFormat*>(out) = buffer.format();
+            break;
+        }
+        default : {
+            return false;
+        }
+    }
+    return true;
+}
+void SoftTexture::update(const Rect *r, cpointer_t data, int pitch) {
+    Rect area(0, 0, buffer.width(), buffer.height());
+    if (r) {
+        area = area.intersected(*r);
+    }
+    if (area.empty()) {
+        return;
+    }
+
+    int  bpp = buffer.bytes_per_pixel();
+    auto src = static_cast<const uint8_t*>(data);
+    auto dst = buffer.pixels<uint8_t>();
+
+    if (ctxt->stats) {
+        ctxt->stats->texture_uploads += 1;
+        ctxt->stats->texture_upload_bytes += uint64_t(area.w) * area.h * bpp;
+    }
+
+    for (int y = 0; y < area.h; y++) {
+        auto src_row = src + y * pitch;
+        auto dst_row = dst + (y + area.y) * buffer.pitch() + area.x * bpp;
+
+        if (buffer.format() != PixFormat::RGBA32) {
+            Btk_memcpy(dst_row, src_row, area.w * bpp);
+            continue;
+        }
+        // Store in premultiplied alpha
+        for (int x = 0; x < area.w; x++) {
+            uint32_t pixel;
+            Btk_memcpy(&pixel, src_row + x * 4, sizeof(pixel));
+            pixel = premultiply(pixel);
+            Btk_memcpy(dst_row + x * 4, &pixel, sizeof(pixel));
+        }
+    }
+}
+void SoftTexture::set_interpolation_mode(InterpolationMode m) {
+    mode = m;
+}
+
+// Device
+SoftPaintDevice::SoftPaintDevice(PixBuffer *buf) : buffer(buf) {
+    if (buffer->format() != PixFormat::RGBA32) {
+        BTK_THROW(std::runtime_error("PixBuffer must have RGBA32 format"));
+    }
+    ctxt = new SoftContext(this, buffer);
+}
+SoftPaintDevice::~SoftPaintDevice() {
+    delete ctxt;
+}
+bool SoftPaintDevice::query_value(PaintDeviceValue value, void *out) {
+    switch (value) {
+        case PaintDeviceValue::PixelSize : {
+            *static_cast<Size*>(out) = buffer->size();
+            break;
+        }
+        case PaintDeviceValue::LogicalSize : {
+            auto fs = static_cast<FSize*>(out);
+            fs->w = buffer->width();
+            fs->h = buffer->height();
+            break;
+        }
+        case PaintDeviceValue::Dpi : {
+            auto fp = static_cast<FPoint*>(out);
+            fp->x = 96.0f;
+            fp->y = 96.0f;
+            break;
+        }
+        case PaintDeviceValue::PixelFormat : {
+            *static_cast<PixFormat*>(out) = buffer->format();
+            break;
+        }
+        case PaintDeviceValue::ContentPreserved : {
+            *static_cast<bool*>(out) = true;
+            break;
+        }
+        default : {
+            return false;
+        }
+    }
+    return true;
+}
+auto SoftPaintDevice::paint_context() -> Ref<PaintContext> {
+    return ctxt;
+}
+
+extern "C" {
+    void __BtkPlatform_SOFT_Init() {
+        RegisterPaintDevice<PixBuffer>([](PixBuffer *buf) -> PaintDevice * {
+            BTK_TRY {
+                return new SoftPaintDevice(buf);
+            }
+            BTK_CATCH (std::exception &err) {
+                printf("WARN %s\n", err.what());
+                return nullptr;
+            }
+        });
+    }
+}
+
+BTK_PRIV_END
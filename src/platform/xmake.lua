@@ -87,5 +87,13 @@ target("btk_platform")
         add_defines("BTK_NANOVG_PAINTER")
     end 
 
+    -- Software painter for PixBuffer (headless rendering)
+    if not (win32_plat and native_painter) then
+        add_files("painter/soft_device.cpp")
+
+        -- Register it
+        add_defines("BTK_SOFTWARE_PAINTER")
+    end
+
     -- Add extra sources
     add_files("backend/init.cpp")
\ No newline at end of file
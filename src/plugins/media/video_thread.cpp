@@ -26,6 +26,23 @@ namespace {
                 return AV_PIX_FMT_NONE;
         }
     }
+    // YUV formats could be converted by PixConvertYuv without swscale
+    bool find_yuv_fmt(int fmt, PixFormat *yuv_fmt) {
+        switch (fmt) {
+            case AV_PIX_FMT_YUV420P :
+            case AV_PIX_FMT_YUVJ420P :
+                *yuv_fmt = PixFormat::I420;
+                return true;
+            case AV_PIX_FMT_NV12 :
+                *yuv_fmt = PixFormat::NV12;
+                return true;
+            case AV_PIX_FMT_NV21 :
+                *yuv_fmt = PixFormat::NV21;
+                return true;
+            default : 
+                return false;
+        }
+    }
 }
 
 
@@ -235,6 +252,38 @@ bool VideoThread::video_decode_frame(AVPacket *packet, AVFrame **ret_frame) {
     return true;
 }
 void VideoThread::video_write_frame(AVFrame *source) {
+    PixFormat yuv_fmt;
+    if (find_yuv_fmt(source->format, &yuv_fmt)) {
+        YuvColorSpace space = (source->colorspace == AVCOL_SPC_BT709) ? YuvColorSpace::BT709 : YuvColorSpace::BT601;
+        YuvRange      range = YuvRange::Limited;
+        if (source->color_range == AVCOL_RANGE_JPEG || source->format == AV_PIX_FMT_YUVJ420P) {
+            range = YuvRange::Full;
+        }
+
+        std::lock_guard locker(dst_frame_mtx);
+
+        int64_t cvt_begin_time = av_gettime_relative();
+        bool ok = PixConvertYuv(
+            yuv_fmt,
+            source->data,
+            source->linesize,
+            ctxt->width,
+            ctxt->height,
+            PixFormat::RGBA32,
+            dst_frame->data[0],
+            dst_frame->linesize[0],
+            ctxt->width,
+            ctxt->height,
+            space,
+            range
+        );
+        sws_scale_duration = (av_gettime_relative() - cvt_begin_time) / 1000000.0;
+
+        if (ok) {
+            manager.add_task(&VideoThread::video_surface_ui_callback, this);
+            return;
+        }
+    }
     
     // Lazy eval beacuse of the hardware access
     if (!sws_ctxt) {
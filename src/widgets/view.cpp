@@ -72,12 +72,14 @@ ImageView::ImageView(Widget *p, const PixBuffer *image) : Widget(p) {
     }
 }
 ImageView::~ImageView() {
+    loading.cancel();
     if (timer) {
         del_timer(timer);
     }
 }
 
 void ImageView::set_image(const PixBuffer &img) {
+    loading.cancel();
     image.clear();
     pixbuf = img;
     dirty = true;
@@ -92,6 +94,7 @@ void ImageView::set_image(const PixBuffer &img) {
     repaint();
 }
 void ImageView::set_image(const Image &img) {
+    loading.cancel();
     pixbuf.clear();
     image = img;
     dirty = true;
@@ -111,6 +114,36 @@ void ImageView::set_image(const Image &img) {
 
     repaint();
 }
+void ImageView::load_image(u8string_view path) {
+    // Decoded by others before ?
+    auto cached = ImageCache::GetInstance().find(path);
+    if (!cached.empty()) {
+        set_image(cached);
+        return;
+    }
+    set_image(placeholder);
+    loading = Image::LoadAsync(path, [this, file = u8string(path)](Image &img) {
+        if (img.empty()) {
+            BTK_LOG("[ImageView] Failed to load image\n");
+            loading = LoadToken();
+            return;
+        }
+        set_image(img);
+        if (img.count_frame() == 1 && timer == 0 && !pixbuf.empty()) {
+            // Still image, pixbuf is never decoded into again, share it
+            ImageCache::GetInstance().insert(file, pixbuf);
+        }
+    });
+}
+void ImageView::set_placeholder(const PixBuffer &img) {
+    placeholder = img;
+    if (!loading.empty() && !loading.canceled()) {
+        // Still loading, show the new one
+        pixbuf = placeholder;
+        dirty = true;
+        repaint();
+    }
+}
 void ImageView::set_keep_aspect_ratio(bool keep) {
     keep_aspect = keep;
     repaint();
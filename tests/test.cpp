@@ -2,14 +2,26 @@
 #include <gtest/gtest.h>
 #include <Btk/painter.hpp>
 #include <Btk/context.hpp>
+#include <Btk/event.hpp>
 #include <Btk/comctl.hpp>
 #include <Btk/string.hpp>
 #include <Btk/pixels.hpp>
 #include <Btk/rect.hpp>
+#include <Btk/io.hpp>
+#include <Btk/detail/device.hpp>
+#include <Btk/plugins/animation.hpp>
+#include <algorithm>
+#include <future>
 
 // Import internal libs
+#include "../src/common/timer_wheel.hpp"
 #include "../src/common/utils.hpp"
 
+#if __has_include(<SDL2/SDL.h>)
+#include "../src/common/sdl_coalesce.hpp"
+#define BTK_TEST_SDL
+#endif
+
 using namespace BTK_NAMESPACE;
 
 TEST(StringTest, RunIterator) {
@@ -183,6 +195,490 @@ TEST(PixBufferTest, Grayscale) {
     }
 }
 
+TEST(PixBufferTest, Convert) {
+    PixFormat fmts[] = {
+        PixFormat::RGBA32,
+        PixFormat::BGRA32,
+        PixFormat::RGB24,
+        PixFormat::BGR24,
+        PixFormat::Gray8
+    };
+    // Odd width, test the tail of the SIMD kernels
+    PixBuffer src(PixFormat::RGBA32, 37, 5);
+    for (int y = 0; y < src.height(); y++) {
+        for (int x = 0; x < src.width(); x++) {
+            src.set_color(x, y, Color(x * 7, y * 13, x + y, 255 - x));
+        }
+    }
+
+    for (auto fmt : fmts) {
+        auto dst = src.convert(fmt);
+        ASSERT_EQ(dst.format(), fmt);
+
+        for (int y = 0; y < src.height(); y++) {
+            for (int x = 0; x < src.width(); x++) {
+                auto c = src.color_at(x, y);
+                auto d = dst.color_at(x, y);
+                if (fmt == PixFormat::Gray8) {
+                    // Gray8 keeps the alpha channel
+                    ASSERT_EQ(d.a, c.a);
+                    continue;
+                }
+                ASSERT_EQ(d.r, c.r);
+                ASSERT_EQ(d.g, c.g);
+                ASSERT_EQ(d.b, c.b);
+            }
+        }
+
+        // Back to RGBA32
+        auto back = dst.convert(PixFormat::RGBA32);
+        if (fmt == PixFormat::RGBA32 || fmt == PixFormat::BGRA32) {
+            ASSERT_EQ(Btk_memcmp(back.pixels(), src.pixels(), src.pitch() * src.height()), 0);
+        }
+    }
+}
+
+TEST(PixBufferTest, Resize) {
+    ResizeFilter filters[] = {
+        ResizeFilter::Box,
+        ResizeFilter::Bilinear,
+        ResizeFilter::Bicubic,
+        ResizeFilter::Lanczos3
+    };
+    PixBuffer src(PixFormat::RGBA32, 123, 77);
+    for (int y = 0; y < src.height(); y++) {
+        for (int x = 0; x < src.width(); x++) {
+            src.set_color(x, y, Color(10, 200, 99, 255));
+        }
+    }
+
+    // Flat color should stay flat in any scale
+    for (auto filter : filters) {
+        for (auto [w, h] : {std::pair{50, 30}, {300, 200}, {123, 40}, {7, 77}, {1, 1}}) {
+            auto dst = src.resize(w, h, filter);
+            ASSERT_EQ(dst.width(), w);
+            ASSERT_EQ(dst.height(), h);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    ASSERT_EQ(dst.color_at(x, y), Color(10, 200, 99, 255));
+                }
+            }
+        }
+    }
+
+    // Box on half size is the average of 2 pixels
+    PixBuffer ramp(PixFormat::RGBA32, 256, 4);
+    for (int y = 0; y < ramp.height(); y++) {
+        for (int x = 0; x < ramp.width(); x++) {
+            ramp.set_color(x, y, Color(x, x, x, 255));
+        }
+    }
+    auto half = ramp.resize(128, 2, ResizeFilter::Box);
+    ASSERT_EQ(half.color_at(10, 1).r, 21);
+    ASSERT_EQ(half.color_at(127, 0).r, 255);
+}
+
+TEST(PixBufferTest, Bilt) {
+    PixBuffer dst(PixFormat::RGBA32, 8, 8);
+    PixBuffer src(PixFormat::RGBA32, 4, 4);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            dst.set_color(x, y, Color(0, 0, 200, 255));
+        }
+    }
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            src.set_color(x, y, Color(255, 0, 0, 128));
+        }
+    }
+
+    // Straight alpha over an opaque destination
+    Rect r(6, 6, 4, 4); //< Clipped by the destination
+    dst.bilt(src, &r, nullptr, BlendMode::Alpha);
+    ASSERT_EQ(dst.color_at(7, 7), Color(128, 0, 100, 255));
+    ASSERT_EQ(dst.color_at(5, 5), Color(0, 0, 200, 255));
+
+    // Add / Subtract keep the destination alpha
+    PixBuffer add = dst.clone();
+    add.bilt(src, nullptr, nullptr, BlendMode::Add);
+    ASSERT_EQ(add.color_at(0, 0), Color(128, 0, 200, 255));
+    add.bilt(src, nullptr, nullptr, BlendMode::Subtract);
+    ASSERT_EQ(add.color_at(0, 0), Color(0, 0, 200, 255));
+
+    // Premultiplied source
+    PixBuffer pre(PixFormat::RGBA32, 1, 1);
+    pre.set_color(0, 0, Color(128, 0, 0, 128));
+    PixBuffer one(PixFormat::RGBA32, 1, 1);
+    one.set_color(0, 0, Color(0, 0, 200, 255));
+    one.bilt(pre, nullptr, nullptr, BlendMode::Alpha, true);
+    ASSERT_EQ(one.color_at(0, 0), Color(128, 0, 100, 255));
+}
+
+TEST(PixBufferTest, Blur) {
+    PixBuffer buf(PixFormat::RGBA32, 61, 33);
+    for (int y = 0; y < buf.height(); y++) {
+        for (int x = 0; x < buf.width(); x++) {
+            buf.set_color(x, y, Color(30, 60, 90, 255));
+        }
+    }
+    // Flat color stays flat, edges are clamped
+    auto flat = buf.blur(4.0f);
+    ASSERT_EQ(flat.color_at(0, 0), Color(30, 60, 90, 255));
+    ASSERT_EQ(flat.color_at(60, 32), Color(30, 60, 90, 255));
+
+    // A dot spreads symmetrically
+    buf.set_color(30, 16, Color::White);
+    auto dot = buf.blur(2.0f);
+    ASSERT_EQ(dot.color_at(28, 16), dot.color_at(32, 16));
+    ASSERT_EQ(dot.color_at(30, 14), dot.color_at(30, 18));
+    ASSERT_GT(dot.color_at(30, 16).r, dot.color_at(28, 16).r);
+    ASSERT_GT(dot.color_at(28, 16).r, 30);
+}
+
+TEST(PixBufferTest, Filter2d) {
+    PixBuffer buf(PixFormat::RGBA32, 23, 17);
+    for (int y = 0; y < buf.height(); y++) {
+        for (int x = 0; x < buf.width(); x++) {
+            buf.set_color(x, y, Color(x * 10, y * 10, 77, 200));
+        }
+    }
+    // Identity keeps the image, alpha is opaque without ft_alpha
+    double identity[3][3] = {
+        {0, 0, 0},
+        {0, 1, 0},
+        {0, 0, 0}
+    };
+    auto same = buf.filter2d(identity, true);
+    auto opaque = buf.filter2d(identity, false);
+    ASSERT_EQ(same.color_at(5, 7), Color(50, 70, 77, 200));
+    ASSERT_EQ(opaque.color_at(5, 7), Color(50, 70, 77, 255));
+
+    // Separable and general kernels agree on a ramp
+    double box[3][3] = {
+        {1 / 9.0, 1 / 9.0, 1 / 9.0},
+        {1 / 9.0, 1 / 9.0, 1 / 9.0},
+        {1 / 9.0, 1 / 9.0, 1 / 9.0}
+    };
+    double cross[3][3] = {
+        {0,       1 / 3.0, 0      },
+        {1 / 3.0, 0,       1 / 3.0},
+        {0,       0,       0      }
+    };
+    auto blurred = buf.filter2d(box, true);
+    auto crossed = buf.filter2d(cross, true);
+    ASSERT_NEAR(blurred.color_at(10, 8).r, 100, 1);
+    ASSERT_NEAR(blurred.color_at(10, 8).g, 80, 1);
+    ASSERT_NEAR(crossed.color_at(10, 8).r, 100, 1);
+    ASSERT_NEAR(crossed.color_at(10, 8).g, 76, 1);
+
+    // Mirrored borders
+    ASSERT_NEAR(blurred.color_at(0, 8).r, 6, 1);
+}
+TEST(PixBufferTest, Yuv) {
+    // Left half red, right half white in BT.601 limited range
+    PixFormat fmts[] = {
+        PixFormat::NV12,
+        PixFormat::NV21,
+        PixFormat::I420,
+    };
+    for (auto fmt : fmts) {
+        PixBuffer buf(fmt, 34, 10);
+        ASSERT_EQ(buf.plane_pitch(0), 34);
+        ASSERT_EQ(buf.plane_pitch(1), fmt == PixFormat::I420 ? 17 : 34);
+
+        auto y  = static_cast<uint8_t*>(buf.plane(0));
+        auto uv = static_cast<uint8_t*>(buf.plane(1));
+        for (int i = 0; i < 34 * 10; i++) {
+            y[i] = (i % 34) < 16 ? 81 : 235;
+        }
+        for (int cy = 0; cy < 5; cy++) {
+            for (int cx = 0; cx < 17; cx++) {
+                uint8_t u = cx < 8 ? 90 : 128;
+                uint8_t v = cx < 8 ? 240 : 128;
+                if (fmt == PixFormat::I420) {
+                    uv[cy * 17 + cx] = u;
+                    static_cast<uint8_t*>(buf.plane(2))[cy * 17 + cx] = v;
+                }
+                else {
+                    uv[cy * 34 + cx * 2]     = fmt == PixFormat::NV12 ? u : v;
+                    uv[cy * 34 + cx * 2 + 1] = fmt == PixFormat::NV12 ? v : u;
+                }
+            }
+        }
+
+        auto rgba = buf.convert(PixFormat::RGBA32);
+        auto bgra = buf.convert(PixFormat::BGRA32, YuvColorSpace::BT601, YuvRange::Limited);
+        ASSERT_EQ(rgba.format(), PixFormat::RGBA32);
+        for (auto &out : {rgba, bgra}) {
+            Color red   = out.color_at(3, 5);
+            Color white = out.color_at(30, 9);
+            ASSERT_NEAR(red.r, 255, 1);
+            ASSERT_NEAR(red.g, 0, 1);
+            ASSERT_NEAR(red.b, 0, 1);
+            ASSERT_EQ(red.a, 255);
+            ASSERT_EQ(white, Color(255, 255, 255, 255));
+        }
+
+        // Resampled in the same pass
+        auto half = buf.convert(PixFormat::RGBA32, YuvColorSpace::BT601, YuvRange::Limited, {17, 5});
+        ASSERT_EQ(half.size(), Size(17, 5));
+        ASSERT_NEAR(half.color_at(2, 2).r, 255, 1);
+        ASSERT_EQ(half.color_at(15, 2), Color(255, 255, 255, 255));
+    }
+
+    // Full range gray, a new buffer is black
+    PixBuffer gray(PixFormat::I420, 4, 4);
+    ASSERT_EQ(gray.convert(PixFormat::RGBA32).color_at(1, 1), Color(0, 0, 0, 255));
+    Btk_memset(gray.plane(0), 128, 16);
+    ASSERT_EQ(gray.convert(PixFormat::RGBA32, YuvColorSpace::BT709, YuvRange::Full).color_at(1, 1), Color(128, 128, 128, 255));
+}
+
+// 4x4, 3 frames: red canvas, green 2x2 at (1, 1), blue dot at (0, 0)
+static const uint8_t TestGif[] = {
+    0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x04, 0x00, 0x04, 0x00, 0x81, 0x00, 0x00, 0xFF, 0x00, 0x00,
+    0x00, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x21, 0xF9, 0x04, 0x04, 0x0A, 0x00, 0x00,
+    0x00, 0x2C, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00, 0x00, 0x02, 0x0D, 0x04, 0x41, 0x10,
+    0x04, 0x41, 0x10, 0x04, 0x41, 0x10, 0x04, 0x41, 0x10, 0x05, 0x00, 0x21, 0xF9, 0x04, 0x04, 0x14,
+    0x00, 0x00, 0x00, 0x2C, 0x01, 0x00, 0x01, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00, 0x02, 0x04, 0x0C,
+    0xC3, 0x30, 0x05, 0x00, 0x21, 0xF9, 0x04, 0x04, 0x1E, 0x00, 0x00, 0x00, 0x2C, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x02, 0x02, 0x54, 0x01, 0x00, 0x3B
+};
+static void WriteTestGif(const char *path) {
+    FILE *f = std::fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    std::fwrite(TestGif, 1, sizeof(TestGif), f);
+    std::fclose(f);
+}
+
+TEST(ImageTest, GifFrames) {
+    WriteTestGif("btk_test.gif");
+
+    auto image = Image::FromFile("btk_test.gif");
+    ASSERT_FALSE(image.empty());
+    ASSERT_EQ(image.count_frame(), 3);
+
+    // Frames are composed, going backward restarts the decoder
+    PixBuffer buf;
+    int       delay;
+    for (size_t idx : {0, 1, 2, 0, 2, 1}) {
+        ASSERT_TRUE(image.read_frame(idx, buf, &delay));
+        ASSERT_EQ(delay, int(idx + 1) * 100);
+        ASSERT_EQ(buf.color_at(3, 3), Color(255, 0, 0, 255));
+        ASSERT_EQ(buf.color_at(1, 1), idx >= 1 ? Color(0, 255, 0, 255) : Color(255, 0, 0, 255));
+        ASSERT_EQ(buf.color_at(0, 0), idx >= 2 ? Color(0, 0, 255, 255) : Color(255, 0, 0, 255));
+    }
+    image.clear();
+    std::remove("btk_test.gif");
+}
+
+TEST(ImageTest, GifControlSize) {
+    // A control extension not in size 4 before the first one, the scan must stay in sync
+    std::vector<uint8_t> data(TestGif, TestGif + sizeof(TestGif));
+    const uint8_t gce[] = {0x21, 0xF9, 0x04};
+    auto pos = std::search(data.begin(), data.end(), std::begin(gce), std::end(gce));
+    ASSERT_NE(pos, data.end());
+    const uint8_t odd[] = {0x21, 0xF9, 0x05, 0x01, 0x02, 0x03, 0x04, 0x05, 0x00};
+    data.insert(pos, std::begin(odd), std::end(odd));
+
+    FILE *f = std::fopen("btk_gce.gif", "wb");
+    ASSERT_NE(f, nullptr);
+    std::fwrite(data.data(), 1, data.size(), f);
+    std::fclose(f);
+
+    auto image = Image::FromFile("btk_gce.gif");
+    ASSERT_EQ(image.count_frame(), 3);
+
+    PixBuffer buf;
+    int       delay;
+    ASSERT_TRUE(image.read_frame(2, buf, &delay));
+    ASSERT_EQ(delay, 300);
+    ASSERT_EQ(buf.color_at(0, 0), Color(0, 0, 255, 255));
+    image.clear();
+    std::remove("btk_gce.gif");
+}
+
+TEST(PixBufferTest, FromMem) {
+    auto mem = PixBuffer::FromMem(TestGif, sizeof(TestGif));
+    ASSERT_EQ(mem.size(), Size(4, 4));
+    ASSERT_EQ(mem.color_at(0, 0), Color(255, 0, 0, 255));
+    ASSERT_TRUE(PixBuffer::FromMem(TestGif, 10).empty());
+
+    WriteTestGif("btk_mapped.gif");
+    auto mapped = PixBuffer::FromFileMapped("btk_mapped.gif");
+    ASSERT_EQ(mapped.size(), Size(4, 4));
+    ASSERT_EQ(Btk_memcmp(mapped.pixels(), mem.pixels(), mem.pitch() * mem.height()), 0);
+    std::remove("btk_mapped.gif");
+}
+
+TEST(PixBufferTest, WriteTo) {
+    PixBuffer src(PixFormat::RGBA32, 67, 41);
+    for (int y = 0; y < src.height(); y++) {
+        for (int x = 0; x < src.width(); x++) {
+            src.set_color(x, y, Color(x * 3, y * 5, (x ^ y) & 0xFF, 255 - y));
+        }
+    }
+    auto encode = [&](const char *type, int level) {
+        FileStream stream;
+        stream.attach(::tmpfile());
+        EXPECT_TRUE(src.write_to(&stream, type, level));
+
+        std::vector<uint8_t> data(stream.tell());
+        stream.seek(0, SEEK_SET);
+        stream.read(data.data(), data.size());
+        return data;
+    };
+
+    // Png in every level decodes back to the same pixels
+    for (int level : {0, 1, 6, 9}) {
+        auto png = encode("png", level);
+        auto dst = PixBuffer::FromMem(png.data(), png.size());
+        ASSERT_EQ(dst.size(), src.size());
+        ASSERT_EQ(Btk_memcmp(dst.pixels(), src.pixels(), src.pitch() * src.height()), 0);
+    }
+
+    // Qoi header and end marker
+    auto qoi = encode("qoi", -1);
+    ASSERT_GT(qoi.size(), 22);
+    ASSERT_EQ(Btk_memcmp(qoi.data(), "qoif", 4), 0);
+    ASSERT_EQ(qoi[12], 4);
+    ASSERT_EQ(qoi.back(), 1);
+
+    FileStream stream;
+    stream.attach(::tmpfile());
+    ASSERT_FALSE(src.write_to(&stream, "xyz"));
+}
+
+TEST(ImageTest, Cache) {
+    ImageCache cache(3 * 16 * 16 * 4);
+    PixBuffer  bufs[4];
+    for (auto &buf : bufs) {
+        buf = PixBuffer(PixFormat::RGBA32, 16, 16);
+    }
+    cache.insert("a", bufs[0]);
+    cache.insert("b", bufs[1]);
+    cache.insert("c", bufs[2]);
+
+    // Touch a, so b is the least recently used one
+    ASSERT_EQ(cache.find("a").pixels(), bufs[0].pixels());
+    cache.insert("d", bufs[3]);
+    ASSERT_TRUE(cache.find("b").empty());
+    ASSERT_FALSE(cache.find("c").empty());
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.entries, 3);
+    ASSERT_EQ(stats.evictions, 1);
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.bytes, 3 * 16 * 16 * 4);
+
+    // Same source with another size is another entry, decoded once
+    WriteTestGif("btk_cache.gif");
+    cache.clear();
+    auto first  = cache.load("btk_cache.gif", Size(2, 2));
+    auto second = cache.load("btk_cache.gif", Size(2, 2));
+    ASSERT_EQ(first.size(), Size(2, 2));
+    ASSERT_EQ(first.pixels(), second.pixels());
+    ASSERT_EQ(cache.load("btk_cache.gif").size(), Size(4, 4));
+    ASSERT_EQ(cache.stats().entries, 2);
+
+    cache.set_budget(0);
+    ASSERT_EQ(cache.stats().entries, 0);
+    ASSERT_EQ(cache.stats().bytes, 0);
+    std::remove("btk_cache.gif");
+
+    // Planar YUV counts the chroma planes
+    cache.set_budget(1024);
+    cache.insert("yuv", PixBuffer(PixFormat::I420, 4, 4));
+    ASSERT_EQ(cache.stats().bytes, 4 * 4 + 2 * 2 * 2);
+
+    // Shared with the workers
+    std::thread worker([&]() {
+        for (int i = 0; i < 1000; i++) {
+            cache.insert("w", bufs[i % 4]);
+        }
+    });
+    for (int i = 0; i < 1000; i++) {
+        cache.find("w");
+    }
+    worker.join();
+    ASSERT_LE(cache.stats().bytes, 1024);
+}
+
+TEST(ImageTest, LoadAsync) {
+    WriteTestGif("btk_async.gif");
+
+    // Without dispatcher, the callback runs on the worker
+    auto dispatcher = GetDispatcher();
+    SetDispatcher(nullptr);
+
+    std::promise<PixBuffer> pix;
+    auto token = PixBuffer::LoadAsync("btk_async.gif", [&](PixBuffer &buf) {
+        pix.set_value(buf);
+    }, Size(2, 2));
+    auto buf = pix.get_future().get();
+    ASSERT_EQ(buf.size(), Size(2, 2));
+    ASSERT_EQ(buf.color_at(1, 1).r, 255);
+
+    // Decoded through the shared cache
+    ASSERT_FALSE(ImageCache::GetInstance().find("btk_async.gif", Size(2, 2)).empty());
+
+    std::promise<Image> img;
+    Image::LoadAsync("btk_async.gif", [&](Image &image) {
+        img.set_value(image);
+    });
+    ASSERT_EQ(img.get_future().get().count_frame(), 3);
+
+    // Failed loading still calls back
+    std::promise<bool> failed;
+    PixBuffer::LoadAsync("btk_no_such_file.png", [&](PixBuffer &buf) {
+        failed.set_value(buf.empty());
+    });
+    ASSERT_TRUE(failed.get_future().get());
+
+    token.cancel();
+    ASSERT_TRUE(token.canceled());
+
+    SetDispatcher(dispatcher);
+
+    {
+        // Delivered by the running loop on its thread
+        UIContext ctxt;
+        EventLoop loop(ctxt.dispatcher());
+        auto      ui = std::this_thread::get_id();
+
+        bool delivered = false;
+        PixBuffer::LoadAsync("btk_async.gif", [&](PixBuffer &buf) {
+            delivered = !buf.empty() && std::this_thread::get_id() == ui;
+            loop.stop();
+        });
+        loop.run();
+        ASSERT_TRUE(delivered);
+
+        // Canceled while decoding, and while the result is in the queue
+        bool called = false;
+        auto decoding = PixBuffer::LoadAsync("btk_async.gif", [&](PixBuffer &) {
+            called = true;
+        });
+        decoding.cancel();
+
+        auto queued = PixBuffer::LoadAsync("btk_async.gif", [&](PixBuffer &) {
+            called = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        queued.cancel();
+
+        Object object;
+        object.defer_call([&]() {
+            loop.stop();
+        });
+        loop.run();
+        ASSERT_FALSE(called);
+    }
+
+    ImageCache::GetInstance().clear();
+    std::remove("btk_async.gif");
+}
+
 TEST(RefTest, Weak) {
     // struct Data : public WeakRefable<Data> {
 
@@ -204,6 +700,152 @@ TEST(PainterTest, ListFamily) {
     }
 }
 
+TEST(PainterTest, FontCompare) {
+    PainterInitializer init;
+
+    Font a("Arial", 12);
+    Font b(a);
+    Font c("Arial", 20);
+
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(a.hash(), b.hash());
+    ASSERT_NE(a, c);
+}
+
+TEST(PainterTest, PaintOnPixBuffer) {
+    UIContext ctxt;
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+
+    Painter painter(buf);
+    painter.begin();
+    painter.set_color(Color::White);
+    painter.clear();
+    painter.set_color(Color::Red);
+    painter.fill_rect(10, 10, 50, 50);
+    painter.end();
+
+    ASSERT_EQ(buf.color_at(30, 30), Color::Red);
+    ASSERT_EQ(buf.color_at(80, 80), Color::White);
+
+    // Shrink then grow the target, the clip must follow it
+    buf = PixBuffer(PixFormat::RGBA32, 20, 20);
+    painter.begin();
+    painter.clear();
+    painter.end();
+
+    buf = PixBuffer(PixFormat::RGBA32, 100, 100);
+    painter.begin();
+    painter.set_color(Color::White);
+    painter.clear();
+    painter.set_color(Color::Red);
+    painter.fill_rect(60, 60, 30, 30);
+    painter.end();
+
+    ASSERT_EQ(buf.color_at(70, 70), Color::Red);
+    ASSERT_EQ(buf.color_at(50, 50), Color::White);
+}
+
+TEST(PainterTest, Recorder) {
+    UIContext ctxt;
+    PainterRecorder recorder;
+    recorder.set_size(100, 100);
+
+    Painter rp(recorder);
+    rp.begin();
+    rp.set_color(Color::White);
+    rp.clear();
+    rp.set_color(Color::Red);
+    rp.fill_rect(10, 10, 50, 50);
+    rp.end();
+    ASSERT_FALSE(recorder.empty());
+
+    // Replay on pixbuffer
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+    Painter painter(buf);
+    painter.begin();
+    recorder.play(painter);
+    painter.end();
+
+    ASSERT_EQ(buf.color_at(30, 30), Color::Red);
+    ASSERT_EQ(buf.color_at(80, 80), Color::White);
+
+    // Serialize and load it back
+    FileStream stream;
+    stream.attach(::tmpfile());
+    ASSERT_TRUE(recorder.write_to(&stream));
+    stream.seek(0, SEEK_SET);
+
+    auto loaded = PainterRecorder::FromStream(&stream);
+    ASSERT_EQ(loaded.count(), recorder.count());
+    ASSERT_TRUE(recorder.diff(loaded).same());
+
+    // Change the last command
+    rp.begin();
+    rp.set_color(Color::White);
+    rp.clear();
+    rp.set_color(Color::Red);
+    rp.fill_rect(10, 10, 60, 60);
+    rp.end();
+
+    auto diff = loaded.diff(recorder);
+    ASSERT_FALSE(diff.same());
+    ASSERT_EQ(diff.removed, 1);
+    ASSERT_EQ(diff.added, 1);
+}
+
+TEST(PainterTest, Stats) {
+    UIContext ctxt;
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+
+    Painter painter(buf);
+    painter.begin();
+    painter.set_color(Color::White);
+    painter.clear();
+    painter.set_color(Color::Red);
+    painter.fill_rect(10, 10, 50, 50);
+    painter.fill_rect(20, 20, 50, 50);
+    painter.end();
+
+    auto &stats = painter.stats();
+    ASSERT_EQ(stats.frame, 1);
+    ASSERT_EQ(stats.draw_calls[size_t(PaintPrimitive::Clear)], 1);
+    ASSERT_EQ(stats.draw_calls[size_t(PaintPrimitive::FillRect)], 2);
+    ASSERT_EQ(stats.total_draw_calls(), 3);
+    ASSERT_FALSE(stats.to_json().empty());
+}
+
+TEST(PainterTest, StateShadow) {
+    UIContext ctxt;
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+
+    Painter painter(buf);
+    painter.begin();
+    painter.set_color(Color::White);
+    painter.clear();
+
+    // Same state again, should not reach the context
+    painter.set_color(Color::Red);
+    painter.fill_rect(0, 0, 10, 10);
+    painter.save();
+    painter.set_color(Color::Red);
+    painter.set_alpha(1.0f);
+    painter.fill_rect(20, 0, 10, 10);
+    painter.restore();
+    painter.fill_rect(40, 0, 10, 10);
+    painter.end();
+
+    auto &stats = painter.stats();
+    ASSERT_EQ(stats.state_changes[size_t(PaintContextState::Brush)], 2);
+    ASSERT_GT(stats.state_skipped, 0);
+    ASSERT_EQ(stats.batches, 1);
+    ASSERT_EQ(stats.batched_rects, 3);
+
+    ASSERT_EQ(buf.color_at(5, 5), Color::Red);
+    ASSERT_EQ(buf.color_at(25, 5), Color::Red);
+    ASSERT_EQ(buf.color_at(45, 5), Color::Red);
+    ASSERT_EQ(buf.color_at(15, 5), Color::White);
+}
+
 TEST(PixelTest, ParseColor) {
     Color white("rgba(255, 255, 255, 1.0)");
     Color white1("rgb(255, 255, 255)");
@@ -239,6 +881,379 @@ TEST(EventTest, TestObject) {
     loop.run();
 }
 
+#if defined(BTK_TEST_SDL)
+static SDL_Event SDLMotion(Uint32 win, int x, int y, Uint32 state = 0) {
+    SDL_Event event = {};
+    event.motion.type     = SDL_MOUSEMOTION;
+    event.motion.windowID = win;
+    event.motion.state    = state;
+    event.motion.x        = x;
+    event.motion.y        = y;
+    event.motion.xrel     = 1;
+    event.motion.yrel     = 1;
+    return event;
+}
+static SDL_Event SDLWindow(Uint32 win, Uint8 what, int w, int h) {
+    SDL_Event event = {};
+    event.window.type     = SDL_WINDOWEVENT;
+    event.window.windowID = win;
+    event.window.event    = what;
+    event.window.data1    = w;
+    event.window.data2    = h;
+    return event;
+}
+TEST(EventTest, SDLCoalesce) {
+    std::vector<SDL_Event>      events;
+    std::vector<SDLMotionRange> ranges;
+    std::vector<SDL_Point>      history;
+
+    // A click splits the motion
+    SDL_Event click = {};
+    click.button.type     = SDL_MOUSEBUTTONDOWN;
+    click.button.windowID = 1;
+    events = {SDLMotion(1, 0, 0), SDLMotion(1, 1, 1), click, SDLMotion(1, 2, 2, SDL_BUTTON_LMASK), SDLMotion(1, 3, 3, SDL_BUTTON_LMASK)};
+    SDLCoalesceEvents(events, ranges, history);
+    ASSERT_EQ(events.size(), 3u);
+    ASSERT_EQ(ranges.size(), 3u);
+    ASSERT_EQ(events[0].motion.x, 1);
+    ASSERT_EQ(events[0].motion.xrel, 2);
+    ASSERT_EQ(events[1].type, Uint32(SDL_MOUSEBUTTONDOWN));
+    ASSERT_EQ(events[2].motion.x, 3);
+    ASSERT_EQ(ranges[1].size, 0u);
+    ASSERT_EQ(history.size(), 2u);
+    ASSERT_EQ(history[ranges[0].begin].x, 0);
+    ASSERT_EQ(history[ranges[2].begin].x, 2);
+
+    // Motion of other windows is not merged
+    events = {SDLMotion(1, 0, 0), SDLMotion(2, 5, 5), SDLMotion(2, 6, 6), SDLMotion(1, 1, 1)};
+    history.clear();
+    SDLCoalesceEvents(events, ranges, history);
+    ASSERT_EQ(events.size(), 3u);
+    ASSERT_EQ(events[0].motion.windowID, 1u);
+    ASSERT_EQ(events[1].motion.windowID, 2u);
+    ASSERT_EQ(events[1].motion.x, 6);
+    ASSERT_EQ(ranges[0].size, 0u);
+    ASSERT_EQ(ranges[1].size, 1u);
+    ASSERT_EQ(ranges[2].size, 0u);
+
+    // Only the latest RESIZED / SIZE_CHANGED of a window is kept
+    events = {
+        SDLWindow(1, SDL_WINDOWEVENT_RESIZED, 10, 10),
+        SDLWindow(1, SDL_WINDOWEVENT_SIZE_CHANGED, 10, 10),
+        SDLWindow(2, SDL_WINDOWEVENT_RESIZED, 30, 30),
+        SDLWindow(1, SDL_WINDOWEVENT_EXPOSED, 0, 0),
+        SDLWindow(1, SDL_WINDOWEVENT_RESIZED, 20, 20),
+        SDLWindow(1, SDL_WINDOWEVENT_SIZE_CHANGED, 20, 20),
+    };
+    history.clear();
+    SDLCoalesceEvents(events, ranges, history);
+    ASSERT_EQ(events.size(), 3u);
+    ASSERT_EQ(events[0].window.windowID, 2u);
+    ASSERT_EQ(events[1].window.event, SDL_WINDOWEVENT_EXPOSED);
+    ASSERT_EQ(events[2].window.event, SDL_WINDOWEVENT_SIZE_CHANGED);
+    ASSERT_EQ(events[2].window.data1, 20);
+}
+#endif
+TEST(EventTest, MotionHistory) {
+    // Coalesced from (10, 10), (12, 11) to (15, 13)
+    Point offsets[] = {{-5, -3}, {-3, -2}};
+    MotionEvent motion(15, 13);
+    motion.set_rel(5, 3);
+    motion.set_history(offsets, 2);
+    ASSERT_EQ(motion.history_size(), 2u);
+    ASSERT_EQ(motion.history(0), Point(10, 10));
+
+    // Mapped to the child coord with the latest position
+    MotionEvent child = motion;
+    child.set_position(5, 3);
+    ASSERT_EQ(child.history(0), Point(0, 0));
+    ASSERT_EQ(child.history(1), Point(2, 1));
+}
+TEST(WidgetTest, ZOrder) {
+    UIContext ctxt;
+    Widget    root;
+    root.resize(100, 100);
+
+    // The newest child is on the top
+    Widget *a = new Widget(&root);
+    Widget *b = new Widget(&root);
+    Widget *c = new Widget(&root);
+    for (auto w : {a, b, c}) {
+        w->set_rect(0, 0, 50, 50);
+    }
+    ASSERT_EQ(root.child_at(10, 10), c);
+
+    a->raise();
+    ASSERT_EQ(root.child_at(10, 10), a);
+    a->lower();
+    c->lower();
+    ASSERT_EQ(root.child_at(10, 10), b);
+
+    // Removing keeps the order of others
+    root.remove_child(b);
+    ASSERT_FALSE(root.has_child(b));
+    ASSERT_TRUE(root.has_child(a));
+    ASSERT_TRUE(root.has_child(c));
+    ASSERT_EQ(root.child_at(10, 10), a);
+    b->set_parent(nullptr);
+    delete b;
+
+    delete a;
+    ASSERT_TRUE(root.has_child(c));
+    ASSERT_EQ(root.child_at(10, 10), c);
+}
+// Fill its rect, count the paint events
+class PaintProbe : public Widget {
+    public:
+        PaintProbe(Widget *parent, Color c) : Widget(parent), color(c) { }
+
+        bool paint_event(PaintEvent &) override {
+            auto &p = painter();
+            p.set_color(color);
+            p.fill_rect(Rect(0, 0, size()));
+            painted += 1;
+            return true;
+        }
+
+        Color color;
+        int   painted = 0;
+};
+
+TEST(WidgetTest, MoveDamage) {
+    UIContext ctxt;
+    Widget    root;
+    root.resize(100, 100);
+
+    // The software device keeps the previous frame, so the second one is partial
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+    Painter   painter(buf);
+
+    auto probe = new PaintProbe(&root, Color::Red);
+    probe->set_rect(10, 10, 20, 20);
+    root.render(painter);
+    auto background = buf.color_at(95, 95);
+    ASSERT_EQ(buf.color_at(15, 15), Color::Red);
+
+    probe->move(50, 50);
+    root.render(painter);
+    ASSERT_EQ(buf.color_at(15, 15), background);
+    ASSERT_EQ(buf.color_at(55, 55), Color::Red);
+
+    // Shrinking leaves the old area too
+    probe->resize(5, 5);
+    root.render(painter);
+    ASSERT_EQ(buf.color_at(52, 52), Color::Red);
+    ASSERT_EQ(buf.color_at(65, 65), background);
+}
+TEST(WidgetTest, OpaqueCulling) {
+    UIContext ctxt;
+    Widget    root;
+    root.resize(100, 100);
+
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+    Painter   painter(buf);
+
+    auto under = new PaintProbe(&root, Color::Red);
+    auto cover = new PaintProbe(&root, Color::Blue);
+    under->set_rect(20, 20, 30, 30);
+    cover->set_rect(10, 10, 60, 60);
+    cover->set_attribute(WidgetAttrs::Opaque, true);
+
+    root.render(painter);
+    ASSERT_EQ(under->painted, 0);
+    ASSERT_EQ(cover->painted, 1);
+    ASSERT_EQ(buf.color_at(30, 30), Color::Blue);
+
+    // Partly out of the cover
+    under->move(50, 50);
+    root.render(painter);
+    ASSERT_EQ(under->painted, 1);
+    ASSERT_EQ(buf.color_at(75, 75), Color::Red);
+
+    // Not opaque any more
+    under->move(20, 20);
+    cover->set_attribute(WidgetAttrs::Opaque, false);
+    root.render(painter);
+    ASSERT_EQ(under->painted, 2);
+}
+TEST(WidgetTest, CacheLayer) {
+    UIContext ctxt;
+    Widget    root;
+    root.resize(100, 100);
+
+    PixBuffer buf(PixFormat::RGBA32, 100, 100);
+    Painter   painter(buf);
+
+    auto layer = new Widget(&root);
+    layer->set_rect(10, 10, 50, 50);
+    layer->set_attribute(WidgetAttrs::CacheLayer, true);
+    auto probe = new PaintProbe(layer, Color::Red);
+    probe->set_rect(0, 0, 20, 20);
+
+    root.render(painter);
+    ASSERT_EQ(probe->painted, 1);
+    ASSERT_EQ(buf.color_at(15, 15), Color::Red);
+
+    // Reused until a child repaints
+    root.repaint();
+    root.render(painter);
+    ASSERT_EQ(probe->painted, 1);
+    ASSERT_EQ(buf.color_at(15, 15), Color::Red);
+
+    probe->color = Color::Blue;
+    probe->repaint();
+    root.render(painter);
+    ASSERT_EQ(probe->painted, 2);
+    ASSERT_EQ(buf.color_at(15, 15), Color::Blue);
+}
+TEST(WidgetTest, ChildIndex) {
+    UIContext ctxt;
+    Widget    root;
+    root.resize(1000, 1000);
+
+    std::vector<Widget *> children;
+    for (int i = 0; i < 400; i++) {
+        auto w = new Widget(&root);
+        w->set_rect((i * 37) % 900, (i * 53) % 900, 60 + i % 40, 40 + i % 70);
+        children.push_back(w);
+    }
+    root.set_attribute(WidgetAttrs::ChildIndex, true);
+
+    // Shuffle the z-order and the rectangles
+    for (int i = 0; i < 400; i += 3) {
+        children[i]->raise();
+        children[(i * 7) % 400]->lower();
+        children[(i * 11) % 400]->move((i * 13) % 900, (i * 17) % 900);
+        children[(i * 19) % 400]->resize(10 + i, 20);
+    }
+    children[5]->hide();
+    delete children[6];
+
+    std::vector<Widget *> indexed;
+    for (int y = 0; y < 1000; y += 7) {
+        for (int x = 0; x < 1000; x += 7) {
+            indexed.push_back(root.child_at(x, y));
+        }
+    }
+
+    // Same as the linear scan
+    root.set_attribute(WidgetAttrs::ChildIndex, false);
+    size_t n = 0;
+    for (int y = 0; y < 1000; y += 7) {
+        for (int x = 0; x < 1000; x += 7) {
+            ASSERT_EQ(root.child_at(x, y), indexed[n++]);
+        }
+    }
+}
+TEST(WidgetTest, FrameClock) {
+    UIContext  ctxt;
+    EventLoop  loop(ctxt.dispatcher());
+    Widget     window;
+    FrameClock clock(&window);
+    clock.set_refresh_rate(100.0f);
+    ASSERT_EQ(clock.refresh_rate(), 100.0f);
+
+    // Requests before the tick are merged into one frame
+    clock.request_frame();
+    clock.request_frame();
+    clock.request_frame();
+
+    int ticks = 0;
+    int id    = clock.add_tick_callback([&](timestamp_t) {
+        return ++ticks < 3;
+    });
+    clock.add_tick_callback([&](timestamp_t) {
+        // Removing an other callback while ticking
+        clock.remove_tick_callback(id);
+        return false;
+    });
+
+    std::vector<uint32_t> requests;
+    clock.signal_frame_done().connect([&]() {
+        requests.push_back(clock.stats().requests);
+        if (clock.stats().frame == 1) {
+            clock.request_frame();
+            return;
+        }
+        loop.stop();
+    });
+
+    loop.run();
+    ASSERT_EQ(ticks, 1);
+    ASSERT_EQ(requests.size(), 2u);
+    ASSERT_EQ(requests[0], 3u);
+    ASSERT_EQ(requests[1], 1u);
+}
+TEST(WidgetTest, AnimationClock) {
+    UIContext ctxt;
+    EventLoop loop(ctxt.dispatcher());
+    Widget    window;
+    auto      clock = new FrameClock(&window);
+
+    float value = 0.0f;
+    LerpAnimation<float> anim;
+    anim.bind(&value);
+    anim.set_start_value(0.0f);
+    anim.set_end_value(1.0f);
+    anim.set_duration(1000);
+    anim.set_frame_clock(clock);
+    anim.start();
+
+    // The clock goes with its window, the animation keeps playing on the timer
+    delete clock;
+
+    Timer timer;
+    timer.set_interval(100);
+    timer.signal_timeout().connect([&]() {
+        loop.stop();
+    });
+    timer.start();
+    loop.run();
+    ASSERT_GT(value, 0.0f);
+    ASSERT_LT(value, 1.0f);
+}
+TEST(EventTest, TimerWheel) {
+    TimerWheel wheel(1000);
+    ASSERT_EQ(wheel.next_timeout(1000), -1);
+
+    auto fast = wheel.add(nullptr, 1000, 10);
+    auto slow = wheel.add(nullptr, 1000, 100000); //< On the upper level
+    ASSERT_NE(fast, slow);
+    ASSERT_EQ(wheel.next_timeout(1000), 10);
+
+    size_t nfast = 0;
+    size_t nslow = 0;
+    auto count = [&](Object *, timerid_t id) {
+        nfast += (id == fast);
+        nslow += (id == slow);
+    };
+    for (uint64_t now = 1001; now <= 101000; now++) {
+        wheel.expire(now, count);
+    }
+    ASSERT_EQ(nfast, 10000u);
+    ASSERT_EQ(nslow, 1u);
+
+    // Missed periods are dropped
+    ASSERT_TRUE(wheel.del(slow));
+    ASSERT_FALSE(wheel.del(slow));
+    ASSERT_EQ(wheel.expire(101055, count), 1u);
+    ASSERT_EQ(wheel.next_timeout(101055), 10);
+
+    // The slack lets timers added at different time expire together
+    ASSERT_TRUE(wheel.del(fast));
+    auto a = wheel.add(nullptr, 200000, 100, 16);
+    auto b = wheel.add(nullptr, 200003, 101, 16);
+    std::vector<timerid_t> fired;
+    auto collect = [&](Object *, timerid_t id) {
+        fired.push_back(id);
+    };
+    ASSERT_EQ(wheel.expire(200111, collect), 0u);
+    wheel.expire(200112, collect); //< Both aligned up from 200100 and 200104
+    ASSERT_EQ(fired.size(), 2u);
+    ASSERT_EQ(fired[0], a);
+    ASSERT_EQ(fired[1], b);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
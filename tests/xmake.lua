@@ -61,6 +61,10 @@ if has_config("tests") then
         -- Add string test
         target("test")
             add_packages("gtest")
+            if is_plat("linux") then
+                -- For the SDL event coalescing test
+                add_packages("libsdl")
+            end
             set_kind("binary")
             add_files("test.cpp")
 